@@ -0,0 +1,550 @@
+#ifndef __Directory_h__
+#define __Directory_h__
+
+/** @file Directory.h
+	Reading directories a buffer full of entries at a time, and walking directory trees on several threads.
+	On Linux entries come straight from getdents64 and metadata from statx relative to the open directory,
+		elsewhere readdir and fstatat are used.
+*/
+
+#include "Stat.h"
+#include "POSIXErrno.h"
+#include "Thread.h"
+#include "Mutex.h"
+#include "Signal.h"
+#include "AtomicInteger.h"
+#include <string>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if __linux__
+	#include <sys/syscall.h>
+	#include <sys/sysmacros.h>
+#endif
+
+#ifndef trace_scope
+	#define trace_scope ///< in case Tracer.h is not included
+#endif
+#ifndef trace_bool
+	#define trace_bool(x) (x) ///< in case Tracer.h is not included
+#endif
+
+namespace io {
+
+	/** Reads the entries of a directory without sorting, filtering or allocating per entry.
+		Entry names point into our buffer and are only valid until the next call to next().
+	*/
+	class Directory {
+		public:
+			/// What an entry is, as far as the directory itself knows.
+			enum Type {
+				Unknown,	///< The file system did not say, use type() to find out
+				File,		///< Regular file
+				Folder,		///< Directory
+				Link,		///< Symbolic link
+				Other		///< Device, pipe, socket, etc.
+			};
+			/// One entry in the directory.
+			struct Entry {
+				const char	*name;		///< The name of the entry, null terminated
+				size_t		length;		///< The number of bytes in name
+				Type		type;		///< The type if the directory knows it
+				ino_t		inode;		///< The inode number
+			};
+			/// Opens the directory.
+			Directory(const std::string &path, size_t bufferSize= 64 * 1024);
+			/// Closes the directory.
+			~Directory();
+			/// The path we were opened with.
+			const std::string &path() const;
+			/// The open directory, for *at() calls.
+			int descriptor() const;
+			/// Get the next entry other than . and ..
+			bool next(Entry &entry);
+			/// The type of an entry, looking it up if the directory did not say.
+			Type type(const Entry &entry) const;
+			/// Get the metadata for an entry.
+			struct stat &stat(const Entry &entry, struct stat &info, Stat::ResolveSymLinks symlink= Stat::LookAtSymlink) const;
+			/// Converts a dirent d_type to our type.
+			static Type type(unsigned char directoryType);
+			/// Converts a stat mode to our type.
+			static Type type(mode_t mode);
+		private:
+#if __linux__
+			/// What getdents64 fills the buffer with.
+			struct _LinuxDirent64 {
+				uint64_t		d_ino;		///< Inode number
+				int64_t			d_off;		///< Offset to the next entry
+				unsigned short	d_reclen;	///< Size of this entry
+				unsigned char	d_type;		///< DT_* type
+				char			d_name[1];	///< Null terminated name (actually variable length)
+			};
+			std::string	_buffer;	///< The entries from the last getdents64
+			size_t		_used;		///< The number of bytes in _buffer from the last getdents64
+			size_t		_next;		///< The offset in _buffer of the next entry
+#else
+			DIR			*_directory;	///< The directory stream
+#endif
+			std::string	_path;			///< The path we were opened with
+			int			_descriptor;	///< The open directory
+			static bool _special(const char *name);
+			Directory(const Directory&); ///< Prevent Usage
+			Directory &operator=(const Directory&); ///< Prevent Usage
+	};
+
+	/** Walks a directory tree on several threads, calling a Visitor for every entry.
+		Each thread works on directories from the back of its own queue and pushes the
+			subdirectories it finds there; a thread with an empty queue takes from the
+			front of another thread's queue, which is where the largest unexplored subtrees are.
+		A thread that finds every queue empty sleeps until a directory is pushed or the walk is over.
+		Symbolic links are reported but never followed.
+	*/
+	class TreeWalker {
+		public:
+			/// How much we need to know about each entry.
+			enum Information {
+				NamesOnly,	///< Name and whatever type the directory reports
+				Types,		///< Name and type, looked up if the directory does not report it
+				Metadata	///< Name, type and stat information
+			};
+			/// Called from the walker threads, so implementations must be thread safe.
+			class Visitor {
+				public:
+					/// Does nothing.
+					virtual ~Visitor() {}
+					/// An entry was found, info is NULL unless walking with Metadata. @return true to descend into a directory.
+					virtual bool visit(const std::string &directory, const Directory::Entry &entry, const struct stat *info)= 0;
+					/// A directory could not be read, or an entry in it looked at (path is then the entry's), the walk continues.
+					virtual void failed(const std::string &/*path*/, const std::exception &/*exception*/) {}
+			};
+			/// Prepare to walk.
+			TreeWalker(Visitor &visitor, int threads= 8, Information information= Types);
+			/// Nothing to clean up.
+			~TreeWalker();
+			/// Walks the tree under root, returning when every directory has been visited.
+			void walk(const std::string &root);
+			/// The number of directories read by the last walk.
+			int directories() const;
+		private:
+			/// A thread's queue of directories to read.
+			struct _Queue {
+				exec::Mutex				lock;	///< Protects paths
+				std::deque<std::string>	paths;	///< The directories waiting to be read
+				_Queue():lock(), paths() {}
+			};
+			/// The thread that reads directories.
+			class _Worker : public exec::Thread {
+				public:
+					/// Waits to be started.
+					_Worker(TreeWalker &walker, size_t index):exec::Thread(KeepAroundAfterFinish), _walker(walker), _index(index) {}
+					/// Nothing to clean up.
+					virtual ~_Worker() {}
+				protected:
+					/// Reads directories until there are none left anywhere.
+					virtual void *run();
+				private:
+					TreeWalker	&_walker;	///< The walk we are part of
+					size_t		_index;		///< Our queue
+					_Worker(const _Worker&); ///< Prevent Usage
+					_Worker &operator=(const _Worker&); ///< Prevent Usage
+			};
+			typedef std::vector<_Queue*>	QueueList;
+			Visitor				&_visitor;		///< Who gets told about entries
+			int					_threads;		///< How many threads to walk with
+			Information			_information;	///< What we need to know about entries
+			QueueList			_queues;		///< One per thread
+			exec::AtomicInteger	_pending;		///< Directories queued or being read
+			exec::AtomicInteger	_directories;	///< Directories read
+			exec::Mutex			_idle;			///< Protects _sleepers, held to wait on _changed
+			exec::Signal		_changed;		///< A directory was pushed or the walk is over
+			int					_sleepers;		///< Threads waiting on _changed
+			bool _take(size_t index, std::string &path);
+			bool _next(size_t index, std::string &path);
+			void _finished();
+			void _push(size_t index, const std::string &path);
+			void _read(size_t index, const std::string &path);
+			static std::string &_child(const std::string &path, const Directory::Entry &entry, std::string &child);
+			TreeWalker(const TreeWalker&); ///< Prevent Usage
+			TreeWalker &operator=(const TreeWalker&); ///< Prevent Usage
+	};
+
+	/**
+		@param path			The directory to read.
+		@param bufferSize	How many bytes of entries to read at once (Linux only).
+	*/
+	inline Directory::Directory(const std::string &path, size_t bufferSize)
+#if __linux__
+		:_buffer(bufferSize, '\0'), _used(0), _next(0),
+#else
+		:_directory(NULL),
+#endif
+		_path(path), _descriptor(-1) {trace_scope
+		ErrnoOnNegative(_descriptor= ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+#if !__linux__
+		if(NULL == (_directory= ::fdopendir(_descriptor))) {
+			const int	error= errno;
+
+			::close(_descriptor);
+			ErrnoCodeThrow(error, "fdopendir");
+		}
+		(void)bufferSize;
+#endif
+	}
+	inline Directory::~Directory() {trace_scope
+#if __linux__
+		::close(_descriptor);
+#else
+		::closedir(_directory); // closes _descriptor
+#endif
+	}
+	inline const std::string &Directory::path() const {trace_scope
+		return _path;
+	}
+	inline int Directory::descriptor() const {trace_scope
+		return _descriptor;
+	}
+	/**
+		@param entry	Receives the next entry.
+		@return			false if there are no more entries.
+	*/
+	inline bool Directory::next(Entry &entry) {trace_scope
+#if __linux__
+		while(true) {
+			if(_next >= _used) {
+				long	amount;
+
+				ErrnoOnNegative(amount= ::syscall(SYS_getdents64, _descriptor, const_cast<char*>(_buffer.data()), _buffer.size()));
+				if(0 == amount) {
+					return false;
+				}
+				_used= static_cast<size_t>(amount);
+				_next= 0;
+			}
+			const _LinuxDirent64	*found= reinterpret_cast<const _LinuxDirent64*>(&_buffer[_next]);
+
+			_next+= found->d_reclen;
+			if(!_special(found->d_name)) {
+				entry.name= found->d_name;
+				entry.length= strlen(found->d_name);
+				entry.type= type(found->d_type);
+				entry.inode= static_cast<ino_t>(found->d_ino);
+				return true;
+			}
+		}
+#else
+		struct dirent	*found;
+
+		do	{
+			errno= 0;
+			if(NULL == (found= ::readdir(_directory))) {
+				ErrnoAssert(0 == errno);
+				return false;
+			}
+		} while(_special(found->d_name));
+		entry.name= found->d_name;
+		entry.length= strlen(found->d_name);
+		entry.type= type(found->d_type);
+		entry.inode= found->d_ino;
+		return true;
+#endif
+	}
+	/**
+		@param entry	An entry from next().
+		@return			The type of the entry itself (links are not followed).
+	*/
+	inline Directory::Type Directory::type(const Entry &entry) const {trace_scope
+		struct stat	info;
+
+		if(Unknown != entry.type) {
+			return entry.type;
+		}
+		return type(stat(entry, info).st_mode);
+	}
+	/** On Linux statx is asked only for the basic fields and allowed to skip syncing with remote file systems.
+		@param entry	An entry from next().
+		@param info		Receives the metadata.
+		@param symlink	LookAtLinkTarget to follow a symbolic link.
+		@return			info
+	*/
+	inline struct stat &Directory::stat(const Entry &entry, struct stat &info, Stat::ResolveSymLinks symlink) const {trace_scope
+		const int	flags= Stat::LookAtSymlink == symlink ? AT_SYMLINK_NOFOLLOW : 0;
+
+#if __linux__ && defined(STATX_BASIC_STATS)
+		struct statx	extended;
+
+		ErrnoOnNegative(::statx(_descriptor, entry.name, flags | AT_STATX_DONT_SYNC, STATX_BASIC_STATS, &extended));
+		memset(&info, 0, sizeof(info));
+		info.st_dev= makedev(extended.stx_dev_major, extended.stx_dev_minor);
+		info.st_ino= extended.stx_ino;
+		info.st_mode= extended.stx_mode;
+		info.st_nlink= extended.stx_nlink;
+		info.st_uid= extended.stx_uid;
+		info.st_gid= extended.stx_gid;
+		info.st_rdev= makedev(extended.stx_rdev_major, extended.stx_rdev_minor);
+		info.st_size= extended.stx_size;
+		info.st_blksize= extended.stx_blksize;
+		info.st_blocks= extended.stx_blocks;
+		info.st_atim.tv_sec= extended.stx_atime.tv_sec;
+		info.st_atim.tv_nsec= extended.stx_atime.tv_nsec;
+		info.st_mtim.tv_sec= extended.stx_mtime.tv_sec;
+		info.st_mtim.tv_nsec= extended.stx_mtime.tv_nsec;
+		info.st_ctim.tv_sec= extended.stx_ctime.tv_sec;
+		info.st_ctim.tv_nsec= extended.stx_ctime.tv_nsec;
+#else
+		ErrnoOnNegative(::fstatat(_descriptor, entry.name, &info, flags));
+#endif
+		return info;
+	}
+	/**
+		@param directoryType	The DT_* value from a directory entry.
+		@return					The matching type.
+	*/
+	inline Directory::Type Directory::type(unsigned char directoryType) {trace_scope
+		switch(directoryType) {
+			case DT_REG:		return File;
+			case DT_DIR:		return Folder;
+			case DT_LNK:		return Link;
+			case DT_UNKNOWN:	return Unknown;
+			default:			return Other;
+		}
+	}
+	/**
+		@param mode	The st_mode from stat.
+		@return		The matching type.
+	*/
+	inline Directory::Type Directory::type(mode_t mode) {trace_scope
+		if(S_ISREG(mode)) {
+			return File;
+		}
+		if(S_ISDIR(mode)) {
+			return Folder;
+		}
+		if(S_ISLNK(mode)) {
+			return Link;
+		}
+		return Other;
+	}
+	/**
+		@param name	The name of an entry.
+		@return		true for . and ..
+	*/
+	inline bool Directory::_special(const char *name) {trace_scope
+		return trace_bool('.' == name[0]) && ( trace_bool('\0' == name[1]) || (trace_bool('.' == name[1]) && trace_bool('\0' == name[2])) );
+	}
+
+	/**
+		@param visitor		Told about every entry, from all threads at once.
+		@param threads		The number of threads to read directories on.
+		@param information	What the visitor needs to know about each entry.
+	*/
+	inline TreeWalker::TreeWalker(Visitor &visitor, int threads, Information information)
+		:_visitor(visitor), _threads(threads < 1 ? 1 : threads), _information(information),
+		_queues(), _pending(0), _directories(0), _idle(), _changed(), _sleepers(0) {trace_scope
+	}
+	inline TreeWalker::~TreeWalker() {trace_scope
+	}
+	/**
+		@param root	The directory to start in, which is not itself passed to the visitor.
+	*/
+	inline void TreeWalker::walk(const std::string &root) {trace_scope
+		std::vector<_Worker*>	workers;
+
+		_directories.valueBeforeDecrement(_directories.value());
+		for(int index= 0; index < _threads; ++index) {
+			_queues.push_back(new _Queue());
+		}
+		_push(0, root);
+		for(int index= 0; index < _threads; ++index) {
+			workers.push_back(new _Worker(*this, index));
+			workers.back()->start();
+		}
+		for(int index= 0; index < _threads; ++index) { // every worker looks in every queue, so none is deleted until all are done
+			workers[index]->join();
+			delete workers[index];
+		}
+		for(int index= 0; index < _threads; ++index) {
+			delete _queues[index];
+		}
+		_queues.clear();
+	}
+	inline int TreeWalker::directories() const {trace_scope
+		return _directories.value();
+	}
+	/**
+		@param index	The queue of the thread looking for work.
+		@param path		Receives the directory to read.
+		@return			false if there was nothing in any queue.
+	*/
+	inline bool TreeWalker::_take(size_t index, std::string &path) {trace_scope
+		{
+			_Queue	&mine= *_queues[index];
+
+			mutex_section(mine.lock);
+			if(!mine.paths.empty()) {
+				path.swap(mine.paths.back());
+				mine.paths.pop_back();
+				return true;
+			}
+		}
+		for(size_t offset= 1; offset < _queues.size(); ++offset) {
+			_Queue	&other= *_queues[(index + offset) % _queues.size()];
+
+			mutex_section(other.lock);
+			if(!other.paths.empty()) {
+				path.swap(other.paths.front());
+				other.paths.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+	/** Sleeps until there is a directory to take or the walk is over.
+		The queues are looked at again with _idle held, and _push() signals with it held,
+			so a directory pushed between the first look and the wait is not missed.
+		@param index	The queue of the thread looking for work.
+		@param path		Receives the directory to read.
+		@return			false when every directory has been read.
+	*/
+	inline bool TreeWalker::_next(size_t index, std::string &path) {trace_scope
+		if(trace_bool(_take(index, path))) {
+			return true;
+		}
+		mutex_section(_idle);
+		while(trace_bool(_pending.value() > 0)) {
+			if(trace_bool(_take(index, path))) {
+				return true;
+			}
+			++_sleepers;
+			_changed.wait(_idle);
+			--_sleepers;
+		}
+		return false;
+	}
+	/**
+		@param index	The queue of the thread that found the directory.
+		@param path		The directory to read.
+	*/
+	inline void TreeWalker::_push(size_t index, const std::string &path) {trace_scope
+		_Queue	&mine= *_queues[index];
+
+		_pending++;
+		{
+			mutex_section(mine.lock);
+			mine.paths.push_back(path);
+		}
+		mutex_section(_idle);
+		if(trace_bool(_sleepers > 0)) {
+			_changed.signal();
+		}
+	}
+	/** A directory has been read, when it was the last one every sleeping thread is woken to finish.
+	*/
+	inline void TreeWalker::_finished() {trace_scope
+		if(trace_bool(0 == _pending.valueAfterDecrement(1))) {
+			mutex_section(_idle);
+			_changed.broadcast();
+		}
+	}
+	/** Metadata is gathered for a whole buffer of entries before the visitor is called,
+			so the statx calls run back to back against the same open directory.
+		An entry that cannot be looked at, usually because it was removed after the directory was read,
+			is reported to the visitor's failed() and skipped, and the rest of the directory is read.
+		@param index	The queue of the thread reading the directory.
+		@param path		The directory to read.
+	*/
+	inline void TreeWalker::_read(size_t index, const std::string &path) {trace_scope
+		typedef std::vector<Directory::Entry>	EntryList;
+		typedef std::vector<size_t>				OffsetList;
+		typedef std::vector<struct stat>		StatList;
+		typedef std::vector<char>				FlagList;
+		const size_t	batchSize= 256;
+		Directory		directory(path);
+		EntryList		entries;
+		OffsetList		offsets;
+		StatList		metadata(Metadata == _information ? batchSize : 0);
+		FlagList		vanished(batchSize);
+		std::string		names, child;
+		bool			more= true;
+
+		_directories++;
+		entries.reserve(batchSize);
+		offsets.reserve(batchSize);
+		while(more) {
+			Directory::Entry	entry;
+
+			entries.clear();
+			offsets.clear();
+			names.clear();
+			while( trace_bool(entries.size() < batchSize) && trace_bool(more= directory.next(entry)) ) {
+				entries.push_back(entry); // entry.name is only good until the next getdents64
+				offsets.push_back(names.size());
+				names.append(entry.name, entry.length + 1);
+			}
+			for(size_t item= 0; item < entries.size(); ++item) {
+				entries[item].name= names.data() + offsets[item];
+				vanished[item]= false;
+				try {
+					if(Metadata == _information) {
+						directory.stat(entries[item], metadata[item]);
+						entries[item].type= Directory::type(metadata[item].st_mode);
+					} else if( (Types == _information) && (Directory::Unknown == entries[item].type) ) {
+						entries[item].type= directory.type(entries[item]);
+					}
+				} catch(const std::exception &exception) {
+					vanished[item]= true;
+					_visitor.failed(_child(path, entries[item], child), exception);
+				}
+			}
+			for(size_t item= 0; item < entries.size(); ++item) {
+				const Directory::Entry	&found= entries[item];
+
+				if(trace_bool(vanished[item])) {
+					continue;
+				}
+				if(_visitor.visit(path, found, Metadata == _information ? &metadata[item] : NULL)
+						&& (Directory::Folder == found.type)) {
+					_push(index, _child(path, found, child));
+				}
+			}
+		}
+	}
+	/**
+		@param path		The directory the entry is in.
+		@param entry	The entry.
+		@param child	Set to the path of the entry.
+		@return			<code>child</code>
+	*/
+	inline std::string &TreeWalker::_child(const std::string &path, const Directory::Entry &entry, std::string &child) {trace_scope
+		child.assign(path);
+		if( child.empty() || ('/' != child[child.size() - 1]) ) {
+			child.append(1, '/');
+		}
+		child.append(entry.name, entry.length);
+		return child;
+	}
+	/**
+		@return	NULL
+	*/
+	inline void *TreeWalker::_Worker::run() {trace_scope
+		std::string	path;
+
+		while(_walker._next(_index, path)) {
+			try {
+				_walker._read(_index, path);
+			} catch(const std::exception &exception) {
+				_walker._visitor.failed(path, exception);
+			}
+			_walker._finished();
+		}
+		return NULL;
+	}
+}
+
+#endif // __Directory_h__
@@ -0,0 +1,229 @@
+#include "Directory.h"
+#include "DateTime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+
+#define dotest(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
+	}
+
+// g++ -o /tmp/test Directory_test.cpp -I.. -O2 -DUSE_DEPRECATED_ERRNO_EXCEPTIONS -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings -lpthread
+// /tmp/test /tmp/ [existing tree to walk]
+
+/// Counts what it sees, from any number of threads.
+class Counter : public io::TreeWalker::Visitor {
+	public:
+		Counter():_files(0), _directories(0), _bytes(0), _lock() {}
+		virtual ~Counter() {}
+		virtual bool visit(const std::string &/*directory*/, const io::Directory::Entry &entry, const struct stat *info) {
+			if(io::Directory::File == entry.type) {
+				_files++;
+				if(NULL != info) {
+					mutex_section(_lock);
+					_bytes+= info->st_size;
+				}
+			} else if(io::Directory::Folder == entry.type) {
+				_directories++;
+			}
+			return true;
+		}
+		int files() {return _files.value();}
+		int directories() {return _directories.value();}
+		off_t bytes() {return _bytes;}
+	private:
+		exec::AtomicInteger	_files, _directories;
+		off_t				_bytes;
+		exec::Mutex			_lock;
+};
+
+/// Removes the files named file0.txt and up the first time it visits anything, and counts the entries it is told vanished.
+class Remover : public Counter {
+	public:
+		Remover(const std::string &directory, int count):Counter(), _directory(directory), _count(count), _removed(false), _failures(0) {}
+		virtual ~Remover() {}
+		virtual bool visit(const std::string &directory, const io::Directory::Entry &entry, const struct stat *info) {
+			if(!_removed) {
+				_removed= true;
+				for(int file= 0; file < _count; ++file) {
+					char	name[64];
+
+					snprintf(name, sizeof(name), "/file%d.txt", file);
+					unlink((_directory + name).c_str());
+				}
+			}
+			return Counter::visit(directory, entry, info);
+		}
+		virtual void failed(const std::string &/*path*/, const std::exception &/*exception*/) {
+			_failures++;
+		}
+		int failures() {return _failures.value();}
+	private:
+		std::string			_directory;
+		int					_count;
+		bool				_removed;
+		exec::AtomicInteger	_failures;
+};
+
+/// The way we walked trees before Directory, for comparison.
+static void scandirWalk(const std::string &path, int &files, int &directories, off_t &bytes, bool metadata) {
+	io::Stat::StringList	fileList, directoryList;
+
+	io::Stat(path.c_str()).list(&fileList, &directoryList, io::Stat::AllFiles);
+	files+= fileList.size();
+	directories+= directoryList.size();
+	if(metadata) {
+		for(io::Stat::StringList::iterator file= fileList.begin(); file != fileList.end(); ++file) {
+			bytes+= io::Stat((path + "/" + *file).c_str(), io::Stat::LookAtSymlink).size();
+		}
+	}
+	for(io::Stat::StringList::iterator directory= directoryList.begin(); directory != directoryList.end(); ++directory) {
+		scandirWalk(path + "/" + *directory, files, directories, bytes, metadata);
+	}
+}
+
+static void makeTree(const std::string &root, int directories, int filesPerDirectory) {
+	mkdir(root.c_str(), 0700);
+	for(int directory= 0; directory < directories; ++directory) {
+		char	name[64];
+		std::string	parent= root + (directory % 4 == 3 ? "/nested" : "");
+
+		mkdir(parent.c_str(), 0700);
+		snprintf(name, sizeof(name), "/d%d", directory);
+		mkdir((parent + name).c_str(), 0700);
+		for(int file= 0; file < filesPerDirectory; ++file) {
+			char	fileName[64];
+			FILE	*created;
+
+			snprintf(fileName, sizeof(fileName), "/file%d.txt", file);
+			if(NULL != (created= fopen((parent + name + fileName).c_str(), "w"))) {
+				fwrite(fileName, 1, file % 7, created);
+				fclose(created);
+			}
+		}
+	}
+}
+
+static void removeTree(const std::string &path) {
+	io::Directory			directory(path);
+	io::Directory::Entry	entry;
+	std::vector<std::string>	folders;
+
+	while(directory.next(entry)) {
+		if(io::Directory::Folder == directory.type(entry)) {
+			folders.push_back(std::string(entry.name, entry.length));
+		} else {
+			unlinkat(directory.descriptor(), entry.name, 0);
+		}
+	}
+	for(std::vector<std::string>::iterator folder= folders.begin(); folder != folders.end(); ++folder) {
+		removeTree(path + "/" + *folder);
+	}
+	rmdir(path.c_str());
+}
+
+static void report(const char *name, int files, double seconds) {
+	printf("%-28s %9d files %0.3fs %12.0f files/sec\n", name, files, seconds, files / (seconds > 0 ? seconds : 1e-9));
+}
+
+int main(int argc, char *argv[]) {
+	const std::string	root= std::string(argc < 2 ? "bin/tests/" : argv[1]) + "Directory_test";
+	const std::string	walk= argc < 3 ? root : argv[2];
+	int					directories= 400, filesPerDirectory= 250;
+#ifdef __Tracer_h__
+	directories= 6;
+	filesPerDirectory= 3;
+#endif
+	try {
+		if(walk == root) {
+			makeTree(root, directories, filesPerDirectory);
+		}
+		{
+			io::Directory				directory(walk);
+			io::Directory::Entry		entry;
+			std::set<std::string>		names;
+			int							count= 0;
+
+			while(directory.next(entry)) {
+				dotest(entry.length == strlen(entry.name));
+				dotest(std::string(".") != entry.name);
+				dotest(std::string("..") != entry.name);
+				names.insert(entry.name);
+				++count;
+			}
+			dotest(!directory.next(entry));
+			if(walk == root) {
+				dotest(names.count("d0") == 1);
+				dotest(names.count("nested") == 1);
+				dotest(count == directories - directories / 4 + 1);
+			}
+		}
+		for(int metadata= 0; metadata < 2; ++metadata) {
+			int				files= 0, folders= 0;
+			off_t			bytes= 0;
+			dt::DateTime	start;
+			double			seconds;
+
+			scandirWalk(walk, files, folders, bytes, metadata != 0);
+			seconds= dt::DateTime() - start;
+			report(metadata ? "scandir + stat" : "scandir", files, seconds);
+			if(walk == root) {
+				dotest(files == directories * filesPerDirectory);
+			}
+			for(int threads= 1; threads <= 16; threads*= 4) {
+				Counter				counter;
+				io::TreeWalker		walker(counter, threads, metadata ? io::TreeWalker::Metadata : io::TreeWalker::Types);
+				char				name[64];
+
+				start= dt::DateTime();
+				walker.walk(walk);
+				seconds= dt::DateTime() - start;
+				snprintf(name, sizeof(name), "getdents64%s %d thread%s", metadata ? " + statx" : "", threads, threads == 1 ? "" : "s");
+				report(name, counter.files(), seconds);
+				dotest(counter.files() == files);
+				dotest(counter.directories() == folders);
+				dotest(walker.directories() == folders + 1);
+				if(metadata) {
+					dotest(counter.bytes() == bytes);
+				}
+			}
+		}
+		{ // entries removed after the directory is read, before they are looked at, are reported and the walk goes on
+			const std::string	vanish= root + "/vanish";
+			const int			count= 300;
+			Remover				remover(vanish, count);
+			io::TreeWalker		walker(remover, 1, io::TreeWalker::Metadata);
+
+			mkdir(vanish.c_str(), 0700);
+			mkdir((vanish + "/kept").c_str(), 0700);
+			fclose(fopen((vanish + "/kept/file.txt").c_str(), "w"));
+			for(int file= 0; file < count; ++file) {
+				char	name[64];
+
+				snprintf(name, sizeof(name), "/file%d.txt", file);
+				fclose(fopen((vanish + name).c_str(), "w"));
+			}
+			walker.walk(vanish);
+			dotest(remover.failures() > 0);
+			dotest(remover.files() + remover.failures() == count + 1);
+			dotest(remover.directories() == 1);
+			dotest(walker.directories() == 2);
+			removeTree(vanish);
+		}
+		{
+			Counter			counter;
+			io::TreeWalker	walker(counter, 2);
+
+			walker.walk(root + "/does not exist");
+			dotest(counter.files() == 0);
+			dotest(walker.directories() == 0);
+		}
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
+	if(walk == root) {
+		removeTree(root);
+	}
+	return 0;
+}
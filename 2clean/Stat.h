@@ -62,14 +62,15 @@ namespace io {
 			std::string	_path;
 			struct stat	_stat;
 			static std::string &_stringify(time_t seconds, std::string &time, TimeZone zone);
-			static int _allFiles(struct dirent *entry);
-			static int _allDirectories(struct dirent *entry);
-			static int _all(struct dirent *entry);
-			static int _visibleFiles(struct dirent *entry);
-			static int _visibleDirectories(struct dirent *entry);
-			static int _visible(struct dirent *entry);
+			static int _allFiles(const struct dirent *entry);
+			static int _allDirectories(const struct dirent *entry);
+			static int _all(const struct dirent *entry);
+			static int _visibleFiles(const struct dirent *entry);
+			static int _visibleDirectories(const struct dirent *entry);
+			static int _visible(const struct dirent *entry);
 			static bool _specialDirectory(const struct dirent *entry);
 			static bool _hidden(const struct dirent *entry);
+			static size_t _nameLength(const struct dirent *entry);
 	};
 
 	inline Stat::Stat(const char *pathParam, ResolveSymLinks symlink)
@@ -187,7 +188,7 @@ namespace io {
 		return S_ISLNK(_stat.st_mode);
 	}
 	inline void Stat::list(StringList *files, StringList *directories, ListingMode modeParam) const {
-		typedef int(*Filter)(struct dirent*);
+		typedef int(*Filter)(const struct dirent*);
 		Filter			toUse;
 		int				count;
 		struct dirent	**entries;
@@ -223,9 +224,9 @@ namespace io {
 		errnoAssertPositiveMessageException( count= scandir(_path.c_str(), &entries, toUse, alphasort) );
 		for(int index= 0; index < count; ++index) {
 			if( (NULL != files) && (entries[index]->d_type == DT_REG) ) {
-				files->push_back(std::string(entries[index]->d_name, entries[index]->d_namlen));
+				files->push_back(std::string(entries[index]->d_name, _nameLength(entries[index])));
 			} else if( (NULL != directories) && (entries[index]->d_type == DT_DIR) ) {
-				directories->push_back(std::string(entries[index]->d_name, entries[index]->d_namlen));
+				directories->push_back(std::string(entries[index]->d_name, _nameLength(entries[index])));
 			} else {
 				exception= "We got something we did not expect";
 			}
@@ -259,53 +260,60 @@ namespace io {
 		time.resize(length);
 		return time;
 	}
-	inline int Stat::_allFiles(struct dirent *entry) {
+	inline int Stat::_allFiles(const struct dirent *entry) {
 		if(_specialDirectory(entry)) {
 			return 0;
 		}
 		return entry->d_type == DT_REG ? 1 : 0;
 	}
-	inline int Stat::_allDirectories(struct dirent *entry) {
+	inline int Stat::_allDirectories(const struct dirent *entry) {
 		if(_specialDirectory(entry)) {
 			return 0;
 		}
 		return entry->d_type == DT_DIR ? 1 : 0;
 	}
-	inline int Stat::_all(struct dirent *entry) {
+	inline int Stat::_all(const struct dirent *entry) {
 		if(_specialDirectory(entry)) {
 			return 0;
 		}
 		return (entry->d_type == DT_DIR) || (entry->d_type == DT_REG);
 	}
-	inline int Stat::_visibleFiles(struct dirent *entry) {
+	inline int Stat::_visibleFiles(const struct dirent *entry) {
 		if(_allFiles(entry) && !_hidden(entry)) {
 			return 1;
 		}
 		return 0;
 	}
-	inline int Stat::_visibleDirectories(struct dirent *entry) {
+	inline int Stat::_visibleDirectories(const struct dirent *entry) {
 		if(_allDirectories(entry) && !_hidden(entry)) {
 			return 1;
 		}
 		return 0;
 	}
-	inline int Stat::_visible(struct dirent *entry) {
+	inline int Stat::_visible(const struct dirent *entry) {
 		if(_all(entry) && !_hidden(entry)) {
 			return 1;
 		}
 		return 0;
 	}
 	inline bool Stat::_specialDirectory(const struct dirent *entry) {
-		if( (entry->d_namlen == 1) && (entry->d_name[0] == '.') ) {
+		if( (_nameLength(entry) == 1) && (entry->d_name[0] == '.') ) {
 			return true;
 		}
-		if( (entry->d_namlen == 2) && (entry->d_name[0] == '.') && (entry->d_name[1] == '.') ) {
+		if( (_nameLength(entry) == 2) && (entry->d_name[0] == '.') && (entry->d_name[1] == '.') ) {
 			return true;
 		}
 		return false;
 	}
 	inline bool Stat::_hidden(const struct dirent *entry) {
-		return (entry->d_namlen >= 1) && (entry->d_name[0] == '.');
+		return (_nameLength(entry) >= 1) && (entry->d_name[0] == '.');
+	}
+	inline size_t Stat::_nameLength(const struct dirent *entry) {
+#if __linux__
+		return strlen(entry->d_name);
+#else
+		return entry->d_namlen;
+#endif
 	}
 }
 
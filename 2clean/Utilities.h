@@ -2,6 +2,7 @@
 #define __Utilities_h__
 
 #include "Exception.h"
+#include "ByteOrder.h"
 #include <ctype.h>
 #include <string>
 
@@ -20,52 +21,46 @@ namespace utils {
 		}
 		return endian;
 	}
+	/** Stores an integer in a buffer in the given byte order.
+		If <code>bufferSize</code> is smaller than the integer, only the first <code>bufferSize</code> bytes are stored.
+	*/
 	template<typename Int>
-	inline void storeInteger(Int number, void *buffer, size_t bufferSize, Endian endian= NativeEndian) {
-		endian= actualEndian(endian);
-		for(unsigned int byte= 0; byte < bufferSize; ++byte) {
-			int	shiftAmount;
-
-			if(BigEndian == endian) {
-				shiftAmount= 8 * (sizeof(Int) - byte - 1);
-			} else {
-				shiftAmount= 8 * byte;
-			}
-			if(byte < bufferSize) {
-				if(shiftAmount != 0) {
-					buffer[byte]= 0xFF & ( number >> shiftAmount );
-				} else {
-					buffer[byte]= 0xFF & number;
-				}
-			}
-		}
+	inline size_t storeInteger(Int number, void *buffer, size_t bufferSize, Endian endian= NativeEndian) {
+		const size_t	bytes= bufferSize < sizeof(Int) ? bufferSize : sizeof(Int);
+
+		endian::convert(&number, &number, 1, BigEndian == actualEndian(endian));
+		memcpy(buffer, &number, bytes);
 		return sizeof(Int);
 	}
+	/** Retrieves an integer from a buffer in the given byte order.
+		If <code>bufferSize</code> is smaller than the integer, the missing bytes are treated as zero.
+	*/
 	template<typename Int>
-	inline Int retrieveInteger(void *buffer, size_t bufferSize, Endian endian= NativeEndian) {
-		Int		value= 0;
+	inline Int retrieveInteger(const void *buffer, size_t bufferSize, Endian endian= NativeEndian) {
+		const size_t	bytes= bufferSize < sizeof(Int) ? bufferSize : sizeof(Int);
+		Int				value= 0;
 
-		endian= _actualEndian(endian);
-		for(unsigned int byte= 0; byte < sizeof(Int); ++byte) {
-			Int	byteAsInt= 0;
-			int	shiftAmount;
-
-			if(byte < bufferSize) {
-				byteAsInt= buffer[byte];
-			}
-			if(BigEndian == endian) {
-				shiftAmount= 8 * (sizeof(Int) - byte - 1);
-			} else {
-				shiftAmount= 8 * byte;
-			}
-			if(shiftAmount != 0) {
-				value |= ( byteAsInt << shiftAmount );
-			} else {
-				value |= byteAsInt;
-			}
-		}
+		memcpy(&value, buffer, bytes);
+		endian::convert(&value, &value, 1, BigEndian == actualEndian(endian));
 		return value;
 	}
+	/** Stores <code>count</code> integers in a buffer (which does not need to be aligned) in the given byte order.
+		@return	The number of bytes stored in <code>buffer</code>.
+	*/
+	template<typename Int>
+	inline size_t storeIntegers(const Int *numbers, size_t count, void *buffer, Endian endian= NativeEndian) {
+		endian::convert(numbers, reinterpret_cast<Int*>(buffer), count, BigEndian == actualEndian(endian));
+		return count * sizeof(Int);
+	}
+	/** Retrieves <code>count</code> integers from a buffer (which does not need to be aligned) in the given byte order.
+		@return	<code>numbers</code>
+	*/
+	template<typename Int>
+	inline Int *retrieveIntegers(const void *buffer, Int *numbers, size_t count, Endian endian= NativeEndian) {
+		memcpy(numbers, buffer, count * sizeof(Int));
+		endian::convert(numbers, numbers, count, BigEndian == actualEndian(endian));
+		return numbers;
+	}
 	inline void secondsToSecondsAndNanoseconds(double seconds, time_t &wholeSeconds, uint32_t &nanoseconds) {
 		const uint32_t	nanosecondsInASecond= 1000000000;
 
@@ -1,43 +1,366 @@
 #ifndef __WordList_h__
 #define __WordList_h__
 
+/** @file WordList.h
+	A persistent dictionary of words (any bytes), each given a number that never changes.
+	The file is an append-only heap of words, each a four byte big endian length then the bytes,
+		and the number of a word (its ID) is where it is in the file.
+	The words are found through an open addressing (linear probing) hash table in the same file,
+		slots of the 64 bit hash of a word and its ID, empty if the ID is 0.
+		When the table is three quarters full, a table twice the size is appended and the header
+		is pointed at it, the old table is left where it is.
+	The header is "WordList\n" then the location of the table, the number of slots and the number of words,
+		each eight bytes big endian.
+	Recently used words are kept in memory, in direct mapped caches from word to ID and from ID to word,
+		so words that are looked up often are not read from the file.
+	A word is flushed before the slot that points at it is written, and a new table before the header points at it,
+		so a crash of the program can at worst leave a word in the file that no slot points at.
+		Surviving a crash of the system too takes io::File::SyncData (or SyncAll) as the durability,
+		which syncs the file at each of those points and so costs a disk write per new word.
+	An ID is only taken if a slot of the table points at it, so an offset that is not the start of a word is refused.
+*/
+
 #include <string>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
 #include "File.h"
 #include "Exception.h"
+#include "POSIXErrno.h"
+
+#ifndef trace_scope
+	#define trace_scope ///< in case Tracer.h is not included
+#endif
+#ifndef trace_bool
+	#define trace_bool(x) (x) ///< in case Tracer.h is not included
+#endif
 
 class WordList {
 	public:
 		typedef off_t	ID;
-		WordList(const char * const path);
+		WordList(const char * const path, size_t cacheSize= 64 * 1024, io::File::Durability durability= io::File::FlushToKernel);
 		~WordList();
 		ID lookup(const void * const word, size_t bytes);
 		ID lookup(const std::string &word);
 		size_t lookup(ID wordID, void *buffer, size_t bufferSize);
 		std::string &lookup(ID wordID, std::string &word);
+		int64_t size() const;
 	private:
+		/// A word and its ID, in one of the caches
+		struct Cached {
+			std::string	word;	///< The word
+			ID			id;		///< The ID of the word, 0 if the entry is empty
+			Cached():word(), id(0) {}
+		};
+		typedef std::vector<Cached>		Cache;
+		typedef std::vector<uint64_t>	Slots;
 		io::File	_file;
+		off_t		_end;		///< The size of the file, where the next word goes
+		off_t		_table;		///< Where the hash table is
+		int64_t		_slots;		///< The number of slots in the hash table, a power of two
+		int64_t		_words;		///< The number of words
+		Cache		_byWord;	///< Recent words, by hash of the word
+		Cache		_byID;		///< Recent words, by ID
+		void _create();
+		bool _find(uint64_t hash, const void *word, size_t bytes, int64_t &slot, ID &id);
+		bool _matches(ID id, const void *word, size_t bytes);
+		bool _listed(uint64_t hash, ID id);
+		void _grow();
+		void _writeHeader();
+		Cached &_cachedID(ID id);
+		static void _insert(Slots &slots, uint64_t hash, ID id);
+		static uint64_t _hash(const void *word, size_t bytes);
+		WordList(const WordList&); ///< Prevent Usage
+		WordList &operator=(const WordList&); ///< Prevent Usage
 };
 
-inline WordList::WordList(const char * const path)
-	:_file(path, io::File::Binary, io::File::WriteIfPossible) {
+/**
+	@param path			The file to open, created if it does not exist
+	@param cacheSize	The number of words to keep in memory (each way), rounded up to a power of two
+	@param durability	How far to push a word before the slot that points at it, and a table before the header
+	@throw posix::err::EILSEQ_ErrNo if the file is not a word list
+*/
+inline WordList::WordList(const char * const path, size_t cacheSize, io::File::Durability durability)
+	:_file(path, io::File::Binary, io::File::WriteIfPossible), _end(0), _table(0), _slots(0), _words(0), _byWord(), _byID() {trace_scope
 	const std::string	header("WordList\n");
-	std::string	buffer;
+	const off_t			kHeaderSize= header.size() + 3 * sizeof(int64_t);
+	size_t				cache= 1;
+	std::string			buffer;
 
-	if(_file.size() == 0) {
+	while(trace_bool(cache < cacheSize)) {
+		cache<<= 1;
+	}
+	_file.durability(durability);
+	_byWord.resize(cache);
+	_byID.resize(cache);
+	_end= _file.size();
+	if(_end == 0) {
 		_file.write(header);
-	} else {
-		AssertMessageException(_file.read(buffer, header.size()) == header)
+		_end= header.size();
+	} else if( (_end < static_cast<off_t>(header.size())) || (_file.read(buffer, header.size(), 0, io::File::FromStart) != header) ) {
+		ErrnoCodeThrow(EILSEQ, "Not a WordList");
+	}
+	if(_end == static_cast<off_t>(header.size())) { // new, or written before there was a table
+		if(_file.writable()) {
+			_create();
+		}
+		return;
+	}
+	if(_end < kHeaderSize) {
+		ErrnoCodeThrow(EILSEQ, "WordList header is truncated");
+	}
+	_table= _file.read<int64_t>(io::File::BigEndian, header.size(), io::File::FromStart);
+	_slots= _file.read<int64_t>(io::File::BigEndian);
+	_words= _file.read<int64_t>(io::File::BigEndian);
+	if( (_slots <= 0) || ((_slots & (_slots - 1)) != 0) || (_table < kHeaderSize)
+			|| (_table + _slots * static_cast<off_t>(sizeof(uint64_t) * 2) > _end) || (_words >= _slots) ) {
+		ErrnoCodeThrow(EILSEQ, "WordList header is corrupt");
+	}
+}
+/** Anything written is flushed when the file is closed.
+*/
+inline WordList::~WordList() {trace_scope
+}
+/** The word is added if it is not already in the list.
+	@param word		The bytes of the word
+	@param bytes	The number of bytes in word
+	@return			The ID of the word, or 0 if it is not in the list and the file is read only
+*/
+inline WordList::ID WordList::lookup(const void * const word, size_t bytes) {trace_scope
+	const uint64_t	hash= _hash(word, bytes);
+	Cached			&cached= _byWord[hash & (_byWord.size() - 1)];
+	int64_t			slot;
+	ID				id;
+
+	if( (0 != cached.id) && (cached.word.size() == bytes) && (memcmp(cached.word.data(), word, bytes) == 0) ) {
+		return cached.id;
+	}
+	if(trace_bool(0 == _slots)) { // read only and empty
+		return 0;
+	}
+	if(!_find(hash, word, bytes, slot, id)) {
+		if(!_file.writable()) {
+			return 0;
+		}
+		id= _end;
+		_file.write<uint32_t>(static_cast<uint32_t>(bytes), io::File::BigEndian, _end, io::File::FromStart);
+		_file.write(word, bytes);
+		_end+= sizeof(uint32_t) + bytes;
+		_file.flush();
+		const uint64_t	entry[]= {hash, static_cast<uint64_t>(id)};
+
+		_file.write(entry, 2, io::File::BigEndian, _table + slot * sizeof(entry), io::File::FromStart);
+		++_words;
+		_writeHeader();
+		if(trace_bool(_words * 4 > _slots * 3)) {
+			_grow();
+		}
+	}
+	cached.word.assign(reinterpret_cast<const char*>(word), bytes);
+	cached.id= id;
+	return id;
+}
+inline WordList::ID WordList::lookup(const std::string &word) {trace_scope
+	return lookup(word.data(), word.size());
+}
+/**
+	@param wordID		The ID of a word
+	@param buffer		Where to copy the word
+	@param bufferSize	The most to copy to buffer
+	@return				The size of the word, which may be more than bufferSize
+	@throw posix::err::EINVAL_ErrNo if wordID is not the ID of a word
+*/
+inline size_t WordList::lookup(WordList::ID wordID, void *buffer, size_t bufferSize) {trace_scope
+	const Cached	&cached= _cachedID(wordID);
+
+	memcpy(buffer, cached.word.data(), cached.word.size() < bufferSize ? cached.word.size() : bufferSize);
+	return cached.word.size();
+}
+/**
+	@param wordID	The ID of a word
+	@param word		Set to the word
+	@return			word
+	@throw posix::err::EINVAL_ErrNo if wordID is not the ID of a word
+*/
+inline std::string &WordList::lookup(WordList::ID wordID, std::string &word) {trace_scope
+	word= _cachedID(wordID).word;
+	return word;
+}
+/**
+	@return	The number of words in the list
+*/
+inline int64_t WordList::size() const {trace_scope
+	return _words;
+}
+/** Writes an empty table and the header.
+*/
+inline void WordList::_create() {trace_scope
+	const int64_t	kInitialSlots= 1024;
+	const Slots		empty(kInitialSlots * 2, 0);
+
+	_table= _end + 3 * sizeof(int64_t);
+	_slots= kInitialSlots;
+	_words= 0;
+	_file.write(&empty[0], empty.size(), io::File::BigEndian, _table, io::File::FromStart);
+	_end= _table + empty.size() * sizeof(uint64_t);
+	_file.flush();
+	_writeHeader();
+}
+/** Probes the slots from the one the hash picks, a run of them at a time.
+	@param hash		The hash of the word
+	@param word		The bytes of the word
+	@param bytes	The number of bytes in word
+	@param slot		Set to the slot the word is in, or the empty slot where it would go
+	@param id		Set to the ID of the word, if it was found
+	@return			true if the word was found
+*/
+inline bool WordList::_find(uint64_t hash, const void *word, size_t bytes, int64_t &slot, ID &id) {trace_scope
+	const int64_t	kSlotsPerRead= 16;
+	uint64_t		run[kSlotsPerRead * 2];
+
+	slot= static_cast<int64_t>(hash & (_slots - 1));
+	while(true) {
+		const int64_t	count= (_slots - slot < kSlotsPerRead) ? _slots - slot : kSlotsPerRead;
+
+		_file.read(run, count * 2, io::File::BigEndian, _table + slot * 2 * sizeof(uint64_t), io::File::FromStart);
+		for(int64_t index= 0; trace_bool(index < count); ++index, ++slot) {
+			if(trace_bool(0 == run[index * 2 + 1])) {
+				return false;
+			}
+			if( (run[index * 2] == hash) && _matches(static_cast<ID>(run[index * 2 + 1]), word, bytes) ) {
+				id= static_cast<ID>(run[index * 2 + 1]);
+				return true;
+			}
+		}
+		if(trace_bool(slot == _slots)) {
+			slot= 0;
+		}
 	}
 }
-inline WordList::~WordList() {
+/**
+	@param id		The ID of a word with the same hash
+	@param word		The bytes of the word
+	@param bytes	The number of bytes in word
+	@return			true if the word at id is word
+*/
+inline bool WordList::_matches(ID id, const void *word, size_t bytes) {trace_scope
+	std::string	found;
+
+	if(_file.read<uint32_t>(io::File::BigEndian, id, io::File::FromStart) != bytes) {
+		return false;
+	}
+	_file.read(found, bytes);
+	return memcmp(found.data(), word, bytes) == 0;
 }
-inline WordList::ID WordList::lookup(const void * const word, size_t bytes) {
+/** Probes the slots from the one the hash picks for one that points at id, without reading any words.
+	@param hash		The hash of the word at id
+	@param id		The ID to look for
+	@return			true if a slot points at id
+*/
+inline bool WordList::_listed(uint64_t hash, ID id) {trace_scope
+	const int64_t	kSlotsPerRead= 16;
+	uint64_t		run[kSlotsPerRead * 2];
+	int64_t			slot= static_cast<int64_t>(hash & (_slots - 1));
+
+	while(true) {
+		const int64_t	count= (_slots - slot < kSlotsPerRead) ? _slots - slot : kSlotsPerRead;
+
+		_file.read(run, count * 2, io::File::BigEndian, _table + slot * 2 * sizeof(uint64_t), io::File::FromStart);
+		for(int64_t index= 0; trace_bool(index < count); ++index, ++slot) {
+			if(trace_bool(0 == run[index * 2 + 1])) {
+				return false;
+			}
+			if( (run[index * 2] == hash) && (static_cast<ID>(run[index * 2 + 1]) == id) ) {
+				return true;
+			}
+		}
+		if(trace_bool(slot == _slots)) {
+			slot= 0;
+		}
+	}
 }
-inline WordList::ID WordList::lookup(const std::string &word) {
+/** The whole table is read and rehashed into one twice the size in memory, which is appended to the file.
+*/
+inline void WordList::_grow() {trace_scope
+	Slots	slots(_slots * 2), grown(_slots * 4, 0);
+
+	_file.read(&slots[0], slots.size(), io::File::BigEndian, _table, io::File::FromStart);
+	for(size_t slot= 0; trace_bool(slot < slots.size()); slot+= 2) {
+		if(trace_bool(0 != slots[slot + 1])) {
+			_insert(grown, slots[slot], static_cast<ID>(slots[slot + 1]));
+		}
+	}
+	_file.write(&grown[0], grown.size(), io::File::BigEndian, _end, io::File::FromStart);
+	_file.flush();
+	_table= _end;
+	_slots*= 2;
+	_end+= grown.size() * sizeof(uint64_t);
+	_writeHeader();
 }
-inline size_t WordList::lookup(WordList::ID wordID, void *buffer, size_t bufferSize) {
+inline void WordList::_writeHeader() {trace_scope
+	const int64_t	header[]= {_table, _slots, _words};
+	const off_t		kSignatureSize= 9;
+
+	_file.write(header, sizeof(header) / sizeof(header[0]), io::File::BigEndian, kSignatureSize, io::File::FromStart);
 }
-inline std::string &WordList::lookup(WordList::ID wordID, std::string &word) {
+/**
+	@param id	The ID of a word
+	@return		The cache entry for the ID, with the word read into it if it was not there
+	@throw posix::err::EINVAL_ErrNo if id is not the start of a word that a slot points at
+*/
+inline WordList::Cached &WordList::_cachedID(ID id) {trace_scope
+	const off_t	kHeaderSize= 9 + 3 * sizeof(int64_t);
+	Cached		&cached= _byID[(static_cast<uint64_t>(id) * 0x9E3779B97F4A7C15ULL) >> 40 & (_byID.size() - 1)];
+
+	if(trace_bool(cached.id != id)) {
+		if( (id < kHeaderSize) || (id + static_cast<off_t>(sizeof(uint32_t)) > _end) ) {
+			ErrnoCodeThrow(EINVAL, "Not a WordList ID");
+		}
+		const uint32_t	bytes= _file.read<uint32_t>(io::File::BigEndian, id, io::File::FromStart);
+
+		std::string		word;
+
+		if(id + static_cast<off_t>(sizeof(uint32_t) + bytes) > _end) {
+			ErrnoCodeThrow(EINVAL, "Not a WordList ID");
+		}
+		_file.read(word, bytes);
+		if(!_listed(_hash(word.data(), word.size()), id)) {
+			ErrnoCodeThrow(EINVAL, "Not a WordList ID");
+		}
+		cached.word.swap(word);
+		cached.id= id;
+	}
+	return cached;
+}
+/**
+	@param slots	A hash table, hash then ID for each slot
+	@param hash		The hash of the word
+	@param id		The ID of the word
+*/
+inline void WordList::_insert(Slots &slots, uint64_t hash, ID id) {trace_scope
+	const size_t	count= slots.size() / 2;
+	size_t			slot= static_cast<size_t>(hash & (count - 1));
+
+	while(trace_bool(0 != slots[slot * 2 + 1])) {
+		slot= (slot + 1) & (count - 1);
+	}
+	slots[slot * 2]= hash;
+	slots[slot * 2 + 1]= static_cast<uint64_t>(id);
+}
+/** FNV-1a, which is never 0 for the short words this is for, but 0 works too.
+	@param word		The bytes of the word
+	@param bytes	The number of bytes in word
+	@return			The hash of the word
+*/
+inline uint64_t WordList::_hash(const void *word, size_t bytes) {trace_scope
+	const uint8_t	*byte= reinterpret_cast<const uint8_t*>(word);
+	uint64_t		hash= 14695981039346656037ULL;
+
+	for(size_t index= 0; trace_bool(index < bytes); ++index) {
+		hash^= byte[index];
+		hash*= 1099511628211ULL;
+	}
+	return hash;
 }
 
 #endif // __WordList_h__
@@ -0,0 +1,203 @@
+#include "WordList.h"
+#include "DateTime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#define dotest(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
+	}
+
+// g++ -o /tmp/test WordList_test.cpp -I.. -O2 -DUSE_DEPRECATED_ERRNO_EXCEPTIONS -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings -lpthread
+// /tmp/test /tmp/
+
+static std::string word(int index) {
+	char	buffer[32];
+
+	snprintf(buffer, sizeof(buffer), "w%x", index * 7919);
+	return buffer;
+}
+
+/** Adds words through a few table growths, checks the IDs survive a reopen, and the odd words and buffers.
+*/
+static void wordTest(const std::string &path, int count) {
+	std::vector<WordList::ID>	ids;
+	std::string					found;
+	char						buffer[4];
+
+	unlink(path.c_str());
+	{
+		WordList	words(path.c_str(), 16);
+
+		for(int i= 0; i < count; ++i) {
+			ids.push_back(words.lookup(word(i)));
+			dotest(ids.back() != 0);
+		}
+		dotest(words.size() == count);
+		for(int i= 0; i < count; ++i) {
+			dotest(words.lookup(word(i)) == ids[i]);
+			dotest(words.lookup(ids[i], found) == word(i));
+		}
+		dotest(words.size() == count);
+		ids.push_back(words.lookup(std::string()));
+		ids.push_back(words.lookup(std::string("\0\xFF\0", 3)));
+		ids.push_back(words.lookup(std::string(100000, 'x')));
+		dotest(words.lookup(std::string("\0\xFF\0", 3)) == ids[count + 1]);
+		dotest(words.lookup("w0\0", 3) != ids[0]);
+		dotest(words.lookup(ids[count], buffer, sizeof(buffer)) == 0);
+		dotest(words.lookup(ids[count + 2], buffer, sizeof(buffer)) == 100000);
+		dotest(std::string(buffer, sizeof(buffer)) == "xxxx");
+		dotest(words.lookup(ids[count + 1], found) == std::string("\0\xFF\0", 3));
+		try {
+			words.lookup(1, found);
+			fprintf(stderr, "FAIL: bad ID found %s\n", found.c_str());
+		} catch(const posix::err::EINVAL_Errno &) {
+			// expected
+		}
+		const WordList::ID	nested= words.lookup(std::string("\0\0\0\2ab", 6)); // a word that looks like a word inside
+
+		try {
+			words.lookup(ids[count + 2] + 1, found);
+			fprintf(stderr, "FAIL: ID inside a word found %s\n", found.c_str());
+		} catch(const posix::err::EINVAL_Errno &) {
+			// expected
+		}
+		try {
+			words.lookup(nested + 4, found);
+			fprintf(stderr, "FAIL: ID inside a word found %s\n", found.c_str());
+		} catch(const posix::err::EINVAL_Errno &) {
+			// expected
+		}
+		try {
+			words.lookup(static_cast<WordList::ID>(1) << 40, found);
+			fprintf(stderr, "FAIL: ID past the end found %s\n", found.c_str());
+		} catch(const posix::err::EINVAL_Errno &) {
+			// expected
+		}
+	}
+	{
+		WordList	words(path.c_str());
+
+		dotest(words.size() == count + 5);
+		for(int i= 0; i < count; ++i) {
+			dotest(words.lookup(ids[i], found) == word(i));
+			dotest(words.lookup(word(i)) == ids[i]);
+		}
+		dotest(words.lookup(std::string(100000, 'x')) == ids[count + 2]);
+		dotest(words.lookup(std::string()) == ids[count]);
+	}
+	{
+		WordList	words(path.c_str(), 16, io::File::SyncData);
+
+		dotest(words.lookup(word(count + 1)) != 0);
+		dotest(words.size() == count + 6);
+	}
+	chmod(path.c_str(), 0444);
+	if(access(path.c_str(), W_OK) != 0) {
+		WordList	words(path.c_str());
+
+		dotest(words.lookup(word(count)) == 0);
+		dotest(words.lookup(word(1)) == ids[1]);
+	}
+	unlink(path.c_str());
+	{
+		io::File	file(path, io::File::Binary, io::File::ReadWrite);
+
+		file.write(std::string("NotWords\n"));
+	}
+	try {
+		WordList	words(path.c_str());
+
+		fprintf(stderr, "FAIL: opened a file that is not a WordList\n");
+	} catch(const posix::err::EILSEQ_Errno &) {
+		// expected
+	}
+	unlink(path.c_str());
+}
+
+/** Interns draws from a Zipf distribution (s=1) over vocabulary words, like the words of a text,
+		then again after reopening, then looks up the word of every ID.
+*/
+static void wordBenchmark(const std::string &path, int vocabulary, int draws) {
+	std::vector<double>			cdf(vocabulary);
+	std::vector<int>			drawn(draws);
+	std::vector<WordList::ID>	ids(draws);
+	std::string					found;
+	double						total= 0.0, internTime, openTime, reinternTime, wordTime;
+	int							bad= 0;
+	int64_t						unique;
+
+	for(int i= 0; i < vocabulary; ++i) {
+		total+= 1.0 / (i + 1);
+		cdf[i]= total;
+	}
+	srandom(vocabulary);
+	for(int i= 0; i < draws; ++i) {
+		const double	where= total * (static_cast<double>(random()) / RAND_MAX);
+
+		drawn[i]= std::lower_bound(cdf.begin(), cdf.end(), where) - cdf.begin();
+		if(drawn[i] >= vocabulary) {
+			drawn[i]= vocabulary - 1;
+		}
+	}
+	unlink(path.c_str());
+	{
+		WordList		words(path.c_str());
+		dt::DateTime	start;
+
+		for(int i= 0; i < draws; ++i) {
+			ids[i]= words.lookup(word(drawn[i]));
+		}
+		internTime= dt::DateTime() - start;
+		unique= words.size();
+	}
+	{
+		dt::DateTime	start;
+		WordList		words(path.c_str());
+
+		openTime= dt::DateTime() - start;
+		start= dt::DateTime();
+		for(int i= 0; i < draws; ++i) {
+			if(words.lookup(word(drawn[i])) != ids[i]) {
+				++bad;
+			}
+		}
+		reinternTime= dt::DateTime() - start;
+		start= dt::DateTime();
+		for(int i= 0; i < draws; ++i) {
+			if(words.lookup(ids[i], found).size() < 2) {
+				++bad;
+			}
+		}
+		wordTime= dt::DateTime() - start;
+	}
+	dotest(0 == bad);
+	unlink(path.c_str());
+	printf("%9d draws of %8d words (%8d unique): intern %9.0f/sec open %6.3fs reopened intern %9.0f/sec ID to word %9.0f/sec\n",
+			draws, vocabulary, static_cast<int>(unique),
+			draws / (internTime > 0 ? internTime : 1e-9), openTime,
+			draws / (reinternTime > 0 ? reinternTime : 1e-9), draws / (wordTime > 0 ? wordTime : 1e-9));
+}
+
+int main(int argc, const char * const argv[]) {
+	try {
+		std::string	path("/tmp/");
+
+		if(argc >= 2) {
+			path= argv[1];
+		}
+#ifdef __Tracer_h__
+		wordTest(path + "test.words", 300);
+		wordBenchmark(path + "test.words", 1000, 5000);
+#else
+		wordTest(path + "test.words", 30000);
+		wordBenchmark(path + "test.words", 1000000, 10000000);
+#endif
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
+	return 0;
+}
@@ -2,7 +2,7 @@
 #define __ZCompression_h__
 
 #include <zlib.h>
-#include "Exception.h"
+#include "../Exception.h"
 
 #define zlib_handle_error(code) if(0 != code) throw z::Exception(code, __FILE__, __LINE__); else z::noop()
 
@@ -3,6 +3,24 @@
 
 #include <os/File.h>
 #include <os/POSIXErrno.h>
+#include <os/DateTime.h>
+#include <os/LZCompression.h>
+#include <os/2clean/ZCompression.h>
+#include <os/Hash.h>
+#include <os/ReferenceCounted.h>
+#include <os/ReferencedString.h>
+#include <os/RWLock.h>
+#include <os/Mutex.h>
+#include <os/Thread.h>
+#include <os/Queue.h>
+#include <os/AtomicInteger.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <set>
+#include <map>
+#include <vector>
+#include <utility>
 
 #ifndef trace_scope
 	#define trace_scope ///< in case Tracer.h is not included
@@ -13,6 +31,12 @@
 
 /// Default signature detects text conversions and has high-bit value to prevent text detection
 #define io_ArchiveFile_DefaultSignature "\x89""00\x0D\x0A\x1A\x0A"
+/// Starts the block directory written in the free space at the end of the file
+#define io_ArchiveFile_DirectorySignature "\x89""DR\x0D\x0A\x1A\x0A"
+/// Ends the file when a valid block directory precedes it
+#define io_ArchiveFile_DirectoryTrailer "\x89""DE\x0D\x0A\x1A\x0A"
+/// Starts a committed transaction in the journal
+#define io_ArchiveFile_JournalSignature "\x89""JL\x0D\x0A\x1A\x0A"
 
 #ifndef INT64_MAX
 	#define INT64_MAX (0x7FFFFFFFFFFFFFFFLL)
@@ -20,9 +44,116 @@
 
 namespace io {
 	/** A container file that can return allocated sections.
+		Every block operation calls flush(), use durability() to choose what that costs,
+			for instance NoSync plus a flush(SyncData) after a group of operations.
+		The free blocks are indexed in memory when the file is opened, so only one ArchiveFile
+			should modify a given file at a time.
+		At close, or checkpoint(), the free block index is written as a directory in the free space
+			at the end of the file so the next open does not have to read every block header.
+			The directory is invalidated before the first change after it is written, so after
+			a crash the file is scanned instead.
+		Between startTransaction() and commit() block headers are only changed in memory
+			and block operations do not flush. commit() syncs the file (so block contents written
+			during the transaction are on disk), writes every changed header to the journal
+			(the file path plus "-journal") and syncs it, then writes the headers in place.
+			An interrupted commit is either replayed from the journal on open or never happened.
+			Blocks disposed during a transaction are not reused until it is committed,
+			but writes to blocks that were allocated before the transaction are not journaled.
+		compact() moves blocks toward the start of the file a time slice at a time and truncates the
+			free space at the end. A moved block keeps its identifier through a relocation map kept
+			in reserved blocks, so hold on to identifiers rather than Blocks across compact().
+			Disposing a moved block outside a transaction is done in a transaction of its own,
+			since the relocation map has to change with it.
+		allocate(data, flags, codec) writes an encoded block: the data is compressed and a CRC32C
+			is kept with it, which read() checks before uncompressing. The Deflate codec is zlib,
+			through 2clean/ZCompression.h, so programs using ArchiveFile link with -lz.
+		replace() writes new contents for a block to a new block, which takes over its identifier
+			through the relocation map, in a transaction, so structures kept in several blocks
+			(like the index of KeyedArchive.h) can be changed without being left half written.
+		Block::view() gives the contents of a block in place, in a read-only memory map of the file,
+			instead of copying them. The file is mapped again (a new epoch) when a block is past the end
+			of the map, and each View keeps the map it points into, so Views stay valid after that
+			(what they see changes if the block is written, disposed or moved by compact()).
+			While there are Views, compact() does not truncate the file.
+		Storage is reserved (File::reserve()) ahead of the end of the file as blocks are appended,
+			and disposing a block of a megabyte or more gives its storage back (File::punchHole())
+			once its free header is on disk, at the next flush(SyncData) or commit() (at once with durability(SyncData)),
+			so the file does not hold on to space it is not using.
+		Scanner goes through every block like Block::next() but reads the file a chunk at a time,
+			optionally with the contents and with another thread reading ahead, for whole file passes
+			like finding the free blocks when there is no directory.
+		Any number of threads can read blocks while one changes the file. lookup(), begin() and view(),
+			and Block::next(), read(), view(), identifier() and flags() share a lock on the block metadata
+			and read with pread() (or the map), so they do not use the file position. Every other
+			block operation holds the lock to itself, and can call the others while it does.
+			Block contents written with File::write() are handed to the kernel before the next read,
+			but they must not be written while another thread reads or allocates.
 	*/
 	class ArchiveFile : public File {
 		public:
+			/// How fragmented the free space is, not counting the last (near infinite) free block
+			struct Fragmentation {
+				int64_t	size;			///< Where the last block ends, the size of the file when truncated
+				int64_t	freeBlocks;		///< The number of free blocks
+				int64_t	freeBytes;		///< The total size of the free blocks
+				int64_t	largestFree;	///< The size of the largest free block
+				int64_t	miniBlocks;		///< Free blocks too small for a full header, which can only be merged
+				int64_t	relocated;		///< Blocks that compact() has moved away from their identifier
+			};
+			/// How an encoded block's data is compressed
+			enum Codec {
+				Stored,		///< Not compressed, just checksummed
+				Fast,		///< LZCompression.h, quick to compress and uncompress
+				Deflate		///< zlib (ZCompression.h), smaller but slower
+			};
+			/// A read-only memory map of the file, unmapped when the last reference is released
+			class Map : public exec::ReferenceCounted {
+				public:
+					/// Reference counted pointer to a Map
+					typedef exec::ReferenceCounted::Ptr<Map>	Ptr;
+					/// Map the first size bytes of the file
+					Map(int descriptor, int64_t size, int64_t epoch);
+					/// The start of the file in memory
+					const char *data() const;
+					/// The number of bytes mapped
+					int64_t size() const;
+					/// Maps of a file are numbered from 1 as the file is mapped again
+					int64_t epoch() const;
+				protected:
+					/// Unmap, called when the last reference is released
+					virtual ~Map();
+				private:
+					void	*_address;	///< Where the file is mapped
+					int64_t	_size;		///< The number of bytes mapped
+					int64_t	_epoch;		///< Which map of the file this is
+					Map(const Map&); ///< Prevent Usage
+					Map &operator=(const Map&); ///< Prevent Usage
+			};
+			/// The contents of a block in a Map (or uncompressed, for a compressed encoded block)
+			class View {
+				public:
+					/// An empty view
+					View();
+					/// Another reference to the same contents
+					View(const View &other);
+					~View();
+					/// Another reference to the same contents
+					View &operator=(const View &other);
+					/// The contents of the block
+					const ReferencedString &contents() const;
+					/// The epoch of the map the contents are in, or 0 if they are not in a map
+					int64_t epoch() const;
+					/// Let go of the map
+					void clear();
+				private:
+					friend class ArchiveFile;
+					Map::Ptr			_map;		///< The map the contents are in
+					ReferencedString	_contents;	///< The contents of the block
+					std::string			_buffer;	///< The uncompressed contents of a compressed block
+					/// Point at the same contents as other
+					void _assign(const View &other);
+			};
+			class Scanner;
 			/** A block in the file.
 				NOTE: Last block is a near-infinite free block
 			*/
@@ -69,6 +200,10 @@ namespace io {
 					int64_t offset(bool ofData= true);
 					/// Is this a free block?
 					bool free();
+					/// Is this block used by the ArchiveFile itself (it holds part of the relocation map)
+					bool reserved();
+					/// Was this block written by ArchiveFile::allocate(data, flags, codec)
+					bool encoded();
 					/// Attempt to allocate a block of the given data size, false returned if not possible
 					bool allocate(int64_t payloadSize, uint8_t userFlags);
 					/// Mark this block as free
@@ -85,11 +220,15 @@ namespace io {
 					uint8_t flags(uint8_t newFlags);
 					/// Attempts to resize the block, returns false if not possible
 					bool resize(int64_t newPayloadSize);
-					/// Read the contents of the block
+					/// Read the contents of the block (uncompressed and checked if it is encoded)
 					std::string read();
-					/// Read the contents of the block into a buffer
+					/// Read the contents of the block into a buffer (uncompressed and checked if it is encoded)
 					std::string &read(std::string &buffer);
+					/// Get the contents of the block in a memory map of the file (checked and uncompressed if it is encoded)
+					View &view(View &contents);
 				protected:
+					friend class ArchiveFile;
+					friend class Scanner;
 					int64_t		_location;	///< The offset in _storage of the block
 					uint8_t		_flags;		///< User flags (lower 7 bits) for allocated block
 					int64_t		_size;		///< The size of the entire block, including header
@@ -102,8 +241,88 @@ namespace io {
 					void _writeHeaderFlags();
 					/// Writes _flags and _size - (header size) to _location in _storage
 					void _writeHeader();
+					/// allocate() with the whole flags byte of the header
+					bool _allocateAs(int64_t payloadSize, uint8_t headerFlags);
 					/// Writes allocated header and adds free block after if it is bigger than needed
-					void _allocate(int64_t payloadSize, uint8_t userFlags);
+					void _allocate(int64_t payloadSize, uint8_t headerFlags);
+			};
+			/** Goes through the blocks in order like Block::next(), but reads the file a chunk at a time
+					and finds the headers in the chunk, instead of reading each header from the file.
+				WithContents keeps the contents of allocated blocks in the chunks too, so contents() does not read.
+				PrefetchThread reads the next chunk in another thread while the blocks in the last one are looked at.
+					It reads every chunk, where without it chunks inside a block whose contents are not wanted
+					are skipped, so it is for scans of small blocks or of their contents.
+				Headers changed in a transaction are seen, but a block changed during the scan
+					may be seen as it was before the change.
+			*/
+			class Scanner {
+				public:
+					/// What is read for each block
+					enum Reading {
+						HeadersOnly,	///< Just the header, contents() reads the block from the file
+						WithContents	///< The contents of allocated blocks are read with the headers
+					};
+					/// Whether chunks are read ahead
+					enum Prefetch {
+						NoPrefetch,		///< Read a chunk when the blocks in the last one are done
+						PrefetchThread	///< Read chunks ahead in another thread
+					};
+					/// Start at the first block
+					Scanner(ArchiveFile &file, Reading reading= HeadersOnly, Prefetch prefetch= NoPrefetch, size_t chunkSize= 1024 * 1024);
+					/// Stop the prefetch thread
+					~Scanner();
+					/// Is there a current block
+					operator bool() const;
+					/// Go to the next block
+					Scanner &operator++();
+					/// The current block
+					Block &block();
+					/// The contents of the current block (checked and uncompressed if it is encoded), until the next block
+					const ReferencedString &contents();
+				private:
+					typedef exec::Queue<std::string*>	Chunks;	///< Chunks read ahead, NULL if reading failed
+					/// Reads the chunks in order into _chunks, until one is short
+					class _Prefetcher : public exec::Thread {
+						public:
+							/// Start reading at start
+							_Prefetcher(Scanner &scanner, int64_t start);
+							virtual ~_Prefetcher();
+						protected:
+							/// Read chunks until the end of the file or _stop
+							virtual void *run();
+						private:
+							Scanner	&_scanner;	///< Where the chunks go
+							int64_t	_offset;	///< Where the next chunk starts
+							_Prefetcher(const _Prefetcher&); ///< Prevent Usage
+							_Prefetcher &operator=(const _Prefetcher&); ///< Prevent Usage
+					};
+					ArchiveFile			&_file;			///< The file being scanned
+					Reading				_reading;		///< Whether contents are read with the headers
+					size_t				_chunkSize;		///< How much is read at a time
+					Block				_block;			///< The current block, invalid at the end
+					int64_t				_next;			///< Where the block after _block is, 0 if _block is the last
+					std::string			_window;		///< The part of the file being looked at
+					int64_t				_windowStart;	///< Where in the file _window starts
+					int64_t				_readFrom;		///< Where the next chunk starts, _window ends here unless it is empty
+					bool				_endOfFile;		///< A chunk was short, there are no more
+					bool				_inWindow;		///< The contents of _block are in _window
+					bool				_haveContents;	///< _contents is for _block
+					std::string			_buffer;		///< Contents read or uncompressed for contents()
+					ReferencedString	_contents;		///< What contents() returns
+					Chunks				_chunks;		///< Chunks from _prefetcher
+					_Prefetcher			*_prefetcher;	///< Reading ahead, or NULL
+					exec::AtomicInteger	_stop;			///< Not 0 when _prefetcher should stop reading
+					int					_error;			///< The errno that stopped _prefetcher
+					/// Find the header of the block at _next
+					void _advance();
+					/// Drop what is before from in _window
+					void _discard(int64_t from);
+					/// Read until _window reaches end, keeping what is after from, false if the file ends first
+					bool _fill(int64_t from, int64_t end, size_t readSize);
+					/// Stop _prefetcher and let go of what it read
+					void _stopPrefetching();
+					Scanner(const Scanner&); ///< Prevent Usage
+					Scanner &operator=(const Scanner&); ///< Prevent Usage
 			};
 			/// Open or Create ArchiveFile at given path
 			ArchiveFile(const char *path, Protection protection= WriteIfPossible, uint16_t version= 1, const std::string &signature= io_ArchiveFile_DefaultSignature);
@@ -115,18 +334,279 @@ namespace io {
 			Block allocate(int64_t dataSize, uint8_t flags= 0);
 			/// Allocate a block from the file and write data to it
 			Block allocate(const std::string &data, uint8_t flags= 0);
+			/// Allocate a block from the file and write data to it compressed and checksummed
+			Block allocate(const std::string &data, uint8_t flags, Codec codec);
+			/// Write new contents for a block in a new block, which takes over its identifier
+			Block replace(int64_t identifier, const std::string &data, uint8_t flags= 0);
+			/// Write new contents for a block in a new block compressed and checksummed, which takes over its identifier
+			Block replace(int64_t identifier, const std::string &data, uint8_t flags, Codec codec);
 			/// Load the block from the file for the given identifier
 			Block lookup(int64_t identifier);
 			/// The first block in the file
 			Block begin();
 			/// Invalid block representing the block after the last block
 			Block end();
+			/// Write the block directory now
+			void checkpoint();
+			/// Is the block directory written at close
+			bool directory() const;
+			/// Set whether the block directory is written at close, returns the previous setting
+			bool directory(bool keep);
+			/// Start batching block header changes
+			void startTransaction();
+			/// Make all block header changes since startTransaction() durable
+			void commit();
+			/// Forget all block header changes since startTransaction()
+			void rollback();
+			/// Is there a transaction that has not been committed or rolled back
+			bool transaction() const;
+			/// Move blocks toward the start of the file for about the given time, true when a pass over the file is finished
+			bool compact(double seconds= 0.010);
+			/// Measure the free space
+			Fragmentation fragmentation();
+			/// Get the contents of the block with the given identifier in a memory map of the file
+			View &view(int64_t identifier, View &contents);
+			/// The epoch of the latest map of the file, 0 if it has not been mapped
+			int64_t epoch() const;
+			/// Flush to the level set with durability()
+			void flush();
+			/// Flush to the given level, and at SyncData or more give back the storage of big disposed blocks
+			void flush(Durability durability);
 		private:
-			int64_t	_headerSize;	///< The size of the header (signature and version)
+			typedef std::pair<int64_t,int64_t>	SizeLocation;	///< Block size then location, to order free blocks by size
+			typedef std::set<SizeLocation>		FreeBySize;		///< Free blocks smallest first
+			typedef std::map<int64_t,int64_t>	FreeByLocation;	///< Free block location to size
+			typedef std::set<int64_t>			LocationSet;	///< Block locations
+			typedef std::map<int64_t,std::string>	HeaderMap;	///< Block location to header bytes
+			typedef std::map<int64_t,int64_t>	IdentifierMap;	///< Identifier to location, or location to identifier
+			int64_t			_headerSize;		///< The size of the header (signature and version)
+			FreeBySize		_freeBySize;		///< Every free block, by size
+			FreeByLocation	_freeByLocation;	///< Every free block, by location
+			LocationSet		_unmerged;			///< Free blocks that are directly followed by another free block
+			bool			_keepDirectory;		///< Write the block directory at close
+			int64_t			_directoryTrailer;	///< Location of the trailer of the valid directory on disk, or 0
+			bool			_transaction;		///< Are header changes being held in _pending
+			bool			_committing;		///< Is commit() disposing the blocks in _disposed
+			HeaderMap		_pending;			///< Headers changed in the transaction (or replayed into a read-only file)
+			LocationSet		_disposed;			///< Blocks to dispose when the transaction is committed
+			std::string		_journalPath;		///< Where the journal is kept
+			File			*_journal;			///< The journal, once there has been a transaction
+			bool			_journalValid;		///< The journal holds the last commit, which may not be on disk in place
+			IdentifierMap	_relocations;		///< Where each moved block is now, by identifier
+			IdentifierMap	_identifiers;		///< The identifier of each moved block, by location
+			IdentifierMap	_relocationChanges;	///< Changes to _relocations to write at commit, location 0 if no longer moved
+			LocationSet		_relocationBlocks;	///< The reserved blocks _relocations is written in
+			int64_t			_relocationEntries;	///< The number of entries in _relocationBlocks
+			int64_t			_relocationSequence;	///< The sequence number of the last relocation block written
+			int64_t			_compactFrom;		///< compact() has looked at the blocks after this, or 0 to start at the end
+			Map::Ptr		_map;				///< The current map of the file
+			std::vector<Map::Ptr>	_oldMaps;	///< Maps that were replaced while Views still had them
+			int64_t			_epoch;				///< The number of times the file has been mapped
+			int64_t			_reserved;			///< Storage is reserved up to here, INT64_MAX if the file system cannot reserve
+			FreeByLocation	_holes;				///< Big disposed blocks to punch out once their free headers are on disk, location to end
+			exec::RWLock	_metadata;			///< Shared by readers, held alone by the thread changing the file
+			exec::ThreadId	_writer;			///< The thread holding _metadata to itself
+			int				_writing;			///< How many times _writer has locked _metadata, 0 if no one has
+			exec::Mutex		_owner;				///< Held to look at or change _writer and _writing
+			mutable exec::RWLock	_mapLock;	///< Shared to use _map, held alone to change _map, _oldMaps or _epoch
+			/// Holds _metadata for a scope, the thread that holds it to itself can lock it again
+			class Locker {
+				public:
+					/// Lock the file's metadata for reading or writing
+					Locker(ArchiveFile &file, exec::RWLock::ReadWrite access);
+					/// Unlock, unless this thread still holds it from an outer Locker
+					~Locker();
+				private:
+					ArchiveFile	&_file;		///< The file whose metadata is locked
+					bool		_reading;	///< Holds a shared lock, rather than being counted in _writing
+					Locker(const Locker&); ///< Prevent Usage
+					Locker &operator=(const Locker&); ///< Prevent Usage
+			};
+			/// Find a free block and allocate it with the given header flags
+			Block _allocate(int64_t dataSize, uint8_t headerFlags);
+			/// replace() with the whole flags byte of the header
+			Block _replace(int64_t identifier, const std::string &data, uint8_t headerFlags);
 			/// Create file if necessary or validate the header
 			void _init(uint16_t version, const std::string &signature);
+			/// Scan the blocks to find the free ones
+			void _index();
+			/// A free block header was written
+			void _addFree(int64_t location, int64_t size);
+			/// Any free blocks starting in the range are no longer free blocks
+			void _removeFree(int64_t from, int64_t to);
+			/// Merge free blocks that are next to each other
+			void _coalesce();
+			/// A block header is about to be written
+			void _modifying();
+			/// Read the free block index from the block directory
+			bool _loadDirectory();
+			/// Add a big endian integer to a buffer
+			static void _append(std::string &buffer, int64_t value);
+			/// Get a big endian integer from a buffer
+			static int64_t _extract(const std::string &buffer, size_t offset);
+			/// Get a big endian integer from memory
+			static int64_t _extract(const char *data);
+			/// The size of a block header starting with the flags byte
+			static int64_t _blockHeaderSize(uint8_t flags);
+			/// FNV-1a of the buffer
+			static int64_t _checksum(const std::string &buffer, size_t length);
+			/// Compress and checksum the contents of an encoded block
+			static void _encode(const std::string &data, uint8_t flags, Codec codec, std::string &encoded);
+			/// Check the contents of an encoded block, returns how its data is compressed
+			static Codec _check(const char *data, size_t size);
+			/// Uncompress the data of an encoded block that has been checked
+			static void _uncompress(const char *data, size_t size, Codec codec, std::string &buffer);
+			/// Flush after a block operation, unless in a transaction
+			void _flushBlocks();
+			/// Write a block header, or hold it if in a transaction
+			void _writeHeader(int64_t location, uint8_t flags, int64_t payloadSize, bool full);
+			/// Apply a journal left by a commit that may not have finished
+			void _replay();
+			/// Read the relocation map from _relocationBlocks
+			void _loadRelocations();
+			/// Write the relocation map changes to new blocks, in the transaction being committed
+			void _writeRelocations();
+			/// The block at from has been copied to to
+			void _relocate(int64_t from, int64_t to);
+			/// The block at location is being disposed
+			void _forget(int64_t location);
+			/// Copy a block into a free block before it, if there is one it fits well
+			bool _move(int64_t location, std::string &buffer);
+			/// Cut the file off after the header of the last block
+			void _truncate();
+			/// The file is about to grow to end, reserve storage past it if it has not been
+			void _grow(int64_t end);
+			/// The block at location of the given size was disposed, give its storage back if it is big
+			void _release(int64_t location, int64_t size);
+			/// Punch out the parts of _holes that are still free, their headers have to be on disk
+			void _punchHoles();
+			/// Hand buffered writes to the kernel, so pread() and maps see them
+			void _visible();
+			/// The size of the file, without moving the file position
+			int64_t _length();
+			/// Read from the file without moving the file position, returns how much was read before the end of the file
+			size_t _readAt(void *buffer, size_t size, int64_t offset);
+			/// The current map of the file, mapped again if it does not reach end
+			Map::Ptr _mapTo(int64_t end);
+			/// Are there Views of any map of the file
+			bool _viewed();
+			/// Point contents at the contents of the block at location with the given header
+			View &_view(int64_t location, uint8_t flags, int64_t payloadSize, View &contents);
+			ArchiveFile(const ArchiveFile&); ///< Prevent Usage
+			ArchiveFile &operator=(const ArchiveFile&); ///< Prevent Usage
 	};
 
+	/**
+		@param descriptor	The open file to map
+		@param size			The number of bytes to map, more than 0
+		@param epoch		The number of this map of the file
+		@throw posix::err::ErrNo if the file cannot be mapped
+	*/
+	inline ArchiveFile::Map::Map(int descriptor, int64_t size, int64_t epoch)
+			:exec::ReferenceCounted(), _address(MAP_FAILED), _size(size), _epoch(epoch) {trace_scope
+		_address= ::mmap(NULL, static_cast<size_t>(size), PROT_READ, MAP_SHARED, descriptor, 0);
+		const bool	mapped= (MAP_FAILED != _address); // so the traced condition does not read as a test failure
+
+		if(!mapped) {
+			ErrnoCodeThrow(errno, "mmap");
+		}
+	}
+	inline ArchiveFile::Map::~Map() {trace_scope
+		::munmap(_address, static_cast<size_t>(_size));
+	}
+	inline const char *ArchiveFile::Map::data() const {trace_scope
+		return reinterpret_cast<const char*>(_address);
+	}
+	inline int64_t ArchiveFile::Map::size() const {trace_scope
+		return _size;
+	}
+	inline int64_t ArchiveFile::Map::epoch() const {trace_scope
+		return _epoch;
+	}
+	inline ArchiveFile::View::View()
+		:_map(), _contents(), _buffer() {trace_scope}
+	inline ArchiveFile::View::View(const View &other)
+			:_map(), _contents(), _buffer() {trace_scope
+		_assign(other);
+	}
+	inline ArchiveFile::View::~View() {trace_scope}
+	inline ArchiveFile::View &ArchiveFile::View::operator=(const View &other) {trace_scope
+		if(this != &other) {
+			_assign(other);
+		}
+		return *this;
+	}
+	/**
+		@return	The contents of the block, valid while this View has them
+	*/
+	inline const ReferencedString &ArchiveFile::View::contents() const {trace_scope
+		return _contents;
+	}
+	inline int64_t ArchiveFile::View::epoch() const {trace_scope
+		return _map ? _map->epoch() : 0;
+	}
+	inline void ArchiveFile::View::clear() {trace_scope
+		_map= Map::Ptr();
+		_contents= ReferencedString();
+		_buffer.clear();
+	}
+	/** Uncompressed contents are in our own _buffer, so they are copied.
+	*/
+	inline void ArchiveFile::View::_assign(const View &other) {trace_scope
+		_map= other._map;
+		if(_map) {
+			_buffer.clear();
+			_contents= other._contents;
+		} else {
+			_buffer= other._buffer;
+			_contents= ReferencedString(_buffer.data(), _buffer.size());
+		}
+	}
+	/** If this thread already holds the lock to itself, it is just counted again.
+		Every thread looks at _writer and _writing to know if it already holds the lock, while the writer changes them,
+			so they are only used with _owner held. Only the thread holding _metadata to itself can find itself in them.
+		@param file		The file to lock
+		@param access	Read to share the lock with other readers, Write to hold it alone
+	*/
+	inline ArchiveFile::Locker::Locker(ArchiveFile &file, exec::RWLock::ReadWrite access)
+			:_file(file), _reading(false) {trace_scope
+		bool	reentered;
+
+		{
+			mutex_section(_file._owner);
+
+			reentered= (_file._writing > 0) && (_file._writer == exec::ThreadId::current());
+			if(reentered) {
+				++_file._writing;
+			}
+		}
+		if(!reentered) {
+			_file._metadata.lock(access);
+			if(exec::RWLock::Read == access) {
+				_reading= true;
+			} else {
+				mutex_section(_file._owner);
+
+				_file._writer= exec::ThreadId::current();
+				_file._writing= 1;
+			}
+		}
+	}
+	inline ArchiveFile::Locker::~Locker() {trace_scope
+		bool	released= _reading;
+
+		if(!_reading) {
+			mutex_section(_file._owner);
+
+			released= (--_file._writing == 0);
+			if(released) {
+				_file._writer= exec::ThreadId();
+			}
+		}
+		if(released) {
+			_file._metadata.unlock();
+		}
+	}
 	inline ArchiveFile::Block::Block()
 			:_location(0), _flags(0), _size(0), _storage(NULL) {trace_scope}
 	inline ArchiveFile::Block::Block(const Block &other)
@@ -144,6 +624,8 @@ namespace io {
 		Block			n;
 
 		if( (_location + _size) < kFileSizeMax) {
+			Locker	locker(*_storage, exec::RWLock::Read);
+
 			n._storage= _storage;
 			n._location= _location + _size;
 			n._readHeader();
@@ -198,7 +680,18 @@ namespace io {
 		*this= next();
 		return old;
 	}
+	/**
+		@return	The location the block was created at, if compact() has moved it, otherwise its location
+	*/
 	inline int64_t ArchiveFile::Block::identifier() {trace_scope
+		if(NULL != _storage) {
+			Locker					locker(*_storage, exec::RWLock::Read);
+			IdentifierMap::iterator	found= _storage->_identifiers.find(_location);
+
+			if(trace_bool(found != _storage->_identifiers.end())) {
+				return found->second;
+			}
+		}
 		return _location;
 	}
 	/** Gets the size.
@@ -233,28 +726,62 @@ namespace io {
 	*/
 	inline bool ArchiveFile::Block::free() {trace_scope
 		const uint8_t	kAllocatedBit= 0x80;
+		const uint8_t	kFlagsRelocationMap= 0x7E;
+		const uint8_t	kFlagsEncoded= 0x7D;
+
+		return trace_bool(((_flags & kAllocatedBit) != kAllocatedBit) && (_flags != kFlagsRelocationMap) && (_flags != kFlagsEncoded));
+	}
+	/**
+		@return true if this block holds part of the relocation map, so it is neither free nor allocated by the user
+	*/
+	inline bool ArchiveFile::Block::reserved() {trace_scope
+		const uint8_t	kFlagsRelocationMap= 0x7E;
+
+		return trace_bool(_flags == kFlagsRelocationMap);
+	}
+	/**
+		@return true if this block holds data that is compressed and checksummed, so it is read with read()
+	*/
+	inline bool ArchiveFile::Block::encoded() {trace_scope
+		const uint8_t	kFlagsEncoded= 0x7D;
 
-		return trace_bool((_flags & kAllocatedBit) != kAllocatedBit);
+		return trace_bool(_flags == kFlagsEncoded);
 	}
 	/** Creates a block in the file with the given data size and user flags.
+		If a moved block still has this location as its identifier, the block is allocated
+			one byte later, after a one byte free block.
 		@param payloadSize	The size of data that can be written to the block
 		@param userFlags	The flags the user can associate with the block (lower 7 bits only)
 		@return				true if a block can be allocated
 	*/
 	inline bool ArchiveFile::Block::allocate(int64_t payloadSize, uint8_t userFlags) {trace_scope
-		if( !free() || (NULL == _storage) || (payloadSize > size()) ) { // @todo Test
-			return false;
-		}
-		_allocate(payloadSize, userFlags);
-		return true;
+		const uint8_t	kAllocatedBit= 0x80;
+		Locker			locker(*_storage, exec::RWLock::Write);
+
+		return _allocateAs(payloadSize, kAllocatedBit | userFlags);
 	}
 	/** Marks the block as available for user by others
 	*/
 	inline ArchiveFile::Block &ArchiveFile::Block::dispose() {trace_scope
 		if(!free() && (NULL != _storage) ) {
+			Locker	locker(*_storage, exec::RWLock::Write);
+
+			if(!_storage->_transaction && (_storage->_identifiers.count(_location) > 0)) {
+				_storage->startTransaction();
+				dispose();
+				_storage->commit();
+				_readHeader();
+				return *this;
+			}
+			_storage->_forget(_location);
+			if(_storage->_transaction && !_storage->_committing) {
+				_storage->_disposed.insert(_location);
+				return *this;
+			}
 			_writeFreeHeader();
-			_storage->flush();
+			_storage->_flushBlocks();
 			merge();
+			_storage->_release(_location, _size);
 		}
 		return *this;
 	}
@@ -262,16 +789,28 @@ namespace io {
 		@return	true if we have a valid ArchiveFile (not NULL), the identifier is not 0 and the offset is within the file
 	*/
 	inline bool ArchiveFile::Block::valid() const {trace_scope
-		return trace_bool((NULL != _storage) && (_location > 0) && (_location < _storage->size()));
+		if( (NULL == _storage) || (_location <= 0) ) {
+			return false;
+		}
+		Locker	locker(*_storage, exec::RWLock::Read);
+
+		_storage->_visible();
+		return trace_bool( (_location < _storage->_length()) || (_storage->_pending.count(_location) > 0) );
 	}
 	/** If this is a free block, looks for a series of free blocks after this block
 			and merges them with this block.
+		Not in a transaction until it is being committed: the headers of the blocks merged away are still
+			on disk, and a rollback or a crash needs them, so they must not be written over until then.
 	*/
 	inline ArchiveFile::Block &ArchiveFile::Block::merge() {trace_scope
 		if( (NULL == _storage) || (_location == 0) ) { // @todo Test
 			return *this;
 		}
+		if(_storage->_transaction && !_storage->_committing) {
+			return *this;
+		}
 		if(free()) { // @todo Test
+			Locker	locker(*_storage, exec::RWLock::Write);
 			Block	current= *this;
 			Block	after= next();
 
@@ -281,8 +820,9 @@ namespace io {
 			}
 			if(current != *this) { // We found some free blocks after this
 				_size= current._location + current._size - _location;
+				_storage->_removeFree(_location + 1, _location + _size);
 				_writeFreeHeader();
-				_storage->flush();
+				_storage->_flushBlocks();
 			}
 		}
 		return *this;
@@ -290,36 +830,51 @@ namespace io {
 	inline ArchiveFile &ArchiveFile::Block::file() {trace_scope
 		return *_storage;
 	}
-	/**
+	/** An encoded block keeps the user flags in the first byte of its contents.
 		@return The lower 7 bits of the flags (highest 8th bit is reserved and not modifiable)
 	*/
 	inline uint8_t ArchiveFile::Block::flags() {trace_scope
 		const uint8_t	kUserFlagsMask= 0x7F;
 
+		if(encoded()) {
+			uint8_t	envelope= 0;
+
+			_storage->_visible();
+			AssertMessageException(_storage->_readAt(&envelope, sizeof(envelope), offset()) == sizeof(envelope));
+			return envelope & kUserFlagsMask;
+		}
 		return (_flags & kUserFlagsMask);
 	}
-	/**
+	/** The flags of an encoded block are written to its contents, they are not covered by its checksum.
 		@param newFlags If the highest bit is set, it will be cleared and ignored
 		@todo Test
 	*/
 	inline uint8_t ArchiveFile::Block::flags(uint8_t newFlags) {trace_scope
 		const uint8_t	kUserFlagsMask= 0x7F;
-		const uint8_t	oldFlags= _flags & kUserFlagsMask;
+		Locker			locker(*_storage, exec::RWLock::Write);
+		const uint8_t	oldFlags= flags();
 
+		if(encoded()) {
+			_storage->write<uint8_t>(newFlags & kUserFlagsMask, BigEndian, offset(), FromStart);
+			return oldFlags;
+		}
 		_flags= (newFlags & kUserFlagsMask);
 		return oldFlags;
 	}
 	/** Shrinking this block should always work. Growing this block depends on
-			free blocks after this one.
+			free blocks after this one. Encoded blocks are written whole, so they cannot be resized.
 		@param newPayloadSize	The requested new size of the block
 		@return					true if the block could be resized.
 	*/
 	inline bool ArchiveFile::Block::resize(int64_t newPayloadSize) {trace_scope
-		Block	block, nextBlock;
+		const uint8_t	kAllocatedBit= 0x80;
+		Block			block, nextBlock;
 
-		if( free() || (NULL == _storage) || (0 == _location) ) {
+		if( free() || encoded() || (NULL == _storage) || (0 == _location) ) {
 			return false;
 		}
+		Locker	locker(*_storage, exec::RWLock::Write);
+
 		if(newPayloadSize > size()) {
 			block= *this;
 			nextBlock= block.next();
@@ -334,12 +889,13 @@ namespace io {
 			if(newPayloadSize > size() + extraFree) {
 				return false;
 			}
+			_storage->_removeFree(_location + _size, _location + _size + extraFree);
 			_size+= extraFree;
 		}
 		if(newPayloadSize == size()) {
 			_writeHeader();
 		} else {
-			_allocate(newPayloadSize, _flags);
+			_allocate(newPayloadSize, kAllocatedBit | _flags);
 		}
 		return true;
 	}
@@ -348,30 +904,68 @@ namespace io {
 
 		return read(buffer);
 	}
+	/**
+		@param buffer	Replaced with the contents of the block
+		@return			buffer
+		@throw posix::err::EILSEQ_ErrNo if the block is encoded and its checksum does not match
+	*/
 	inline std::string &ArchiveFile::Block::read(std::string &buffer) {trace_scope
-		_storage->read(buffer, size(), *this, *this);
+		const size_t	kEncodedHeaderSize= sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(int64_t);
+
+		_storage->_visible();
+		buffer.assign(size(), '\0');
+		AssertMessageException(_storage->_readAt(const_cast<char*>(buffer.data()), buffer.size(), offset()) == buffer.size());
+		if(encoded()) {
+			const Codec	codec= _check(buffer.data(), buffer.size());
+
+			if(Stored == codec) {
+				buffer.erase(0, kEncodedHeaderSize);
+			} else {
+				std::string	data;
+
+				_uncompress(buffer.data(), buffer.size(), codec, data);
+				buffer.swap(data);
+			}
+		}
 		return buffer;
 	}
+	/**
+		@param contents	Set to the contents of the block
+		@return			contents
+		@throw posix::err::EINVAL_ErrNo if the block is not allocated
+		@throw posix::err::EILSEQ_ErrNo if the block is encoded and its checksum does not match
+	*/
+	inline ArchiveFile::View &ArchiveFile::Block::view(View &contents) {trace_scope
+		return _storage->_view(_location, _flags, size(), contents);
+	}
 	/** Assuming the _storage and _location are set, the _flags and _size are read from the header.
-		@throw posix::err::EILSEQ_ErrNo if _flags on disk are no in the ranges of 00-07 and 7F-FF
+		@throw posix::err::EILSEQ_ErrNo if _flags on disk are no in the ranges of 00-07 and 7D-FF
 		@return	true if we were able to read the header
 	*/
 	inline bool ArchiveFile::Block::_readHeader() {trace_scope
-		const uint8_t	kFlagsFreeBlockFullHeader= 0x7F;
-		const uint8_t	kAllocatedBit= 0x80;
 		const int64_t	kFlagsSize= sizeof(uint8_t);
-		const int64_t	kMaxMiniFreeSize= sizeof(int64_t) - 1;
 		const int64_t	kHeaderSize= kFlagsSize + sizeof(int64_t);
 
+		HeaderMap::iterator	pending;
+		char				header[kHeaderSize];
+		size_t				headerSize;
+
 		if( (NULL == _storage) || (0 == _location) ) { // @todo Test
 			return false;
 		}
-		_flags= _storage->read<uint8_t>(BigEndian, _location, FromStart);
-		if( ( (_flags & kAllocatedBit) == kAllocatedBit )
-				|| (_flags == kFlagsFreeBlockFullHeader) ) { // @todo Test
-			_size= kHeaderSize + _storage->read<int64_t>(BigEndian);
-		} else if(_flags > kMaxMiniFreeSize) {
-			ErrnoCodeThrow(EILSEQ, "File Block is corrupt");
+		pending= _storage->_pending.find(_location);
+		if(trace_bool(pending != _storage->_pending.end())) {
+			headerSize= pending->second.size() < sizeof(header) ? pending->second.size() : sizeof(header);
+			memcpy(header, pending->second.data(), headerSize);
+		} else {
+			_storage->_visible();
+			headerSize= _storage->_readAt(header, sizeof(header), _location);
+		}
+		AssertMessageException(headerSize >= static_cast<size_t>(kFlagsSize));
+		_flags= static_cast<uint8_t>(header[0]);
+		if(_blockHeaderSize(_flags) == kHeaderSize) { // @todo Test
+			AssertMessageException(headerSize == sizeof(header));
+			_size= kHeaderSize + _extract(header + kFlagsSize);
 		} else {
 			_size= kFlagsSize + _flags;
 		}
@@ -392,23 +986,53 @@ namespace io {
 			_flags= kFlagsFreeBlockFullHeader;
 			_writeHeader();
 		}
+		_storage->_addFree(_location, _size);
 	}
 	inline void ArchiveFile::Block::_writeHeaderFlags() {trace_scope
-		_storage->write<uint8_t>(_flags, BigEndian, _location, FromStart);
+		_storage->_writeHeader(_location, _flags, 0, false);
 	}
 	inline void ArchiveFile::Block::_writeHeader() {trace_scope
 		const int64_t	kHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
 
-		_writeHeaderFlags();
-		_storage->write<int64_t>(_size - kHeaderSize, BigEndian);
+		_storage->_writeHeader(_location, _flags, _size - kHeaderSize, true);
+	}
+	/** If a moved block still has this location as its identifier, the block is allocated
+			one byte later, after a one byte free block.
+		@param payloadSize	The size of data that can be written to the block
+		@param headerFlags	The flags byte of the header, the allocated bit and user flags or an ArchiveFile block type
+		@return				true if a block can be allocated
+	*/
+	inline bool ArchiveFile::Block::_allocateAs(int64_t payloadSize, uint8_t headerFlags) {trace_scope
+		const int64_t	kFlagsSize= sizeof(uint8_t);
+
+		if( !free() || (NULL == _storage) || (payloadSize > size()) ) { // @todo Test
+			return false;
+		}
+		if(trace_bool(_storage->_relocations.count(_location) > 0)) {
+			Block	after;
+
+			after._storage= _storage;
+			after._location= _location + kFlagsSize;
+			after._size= _size - kFlagsSize;
+			if(!after._allocateAs(payloadSize, headerFlags)) {
+				return false;
+			}
+			_size= kFlagsSize;
+			_writeFreeHeader();
+			_storage->_flushBlocks();
+			*this= after;
+			return true;
+		}
+		_allocate(payloadSize, headerFlags);
+		return true;
 	}
 	/** Assumes the block is free, and writes to disk the header for the given size and flags.
 			Also marks any trailing data free.
 		@param payloadSize	The size of data to carve out of this block
-		@param userFlags	The 7-bit value the user wants associated with this block
+		@param headerFlags	The flags byte of the header
 	*/
-	inline void ArchiveFile::Block::_allocate(int64_t payloadSize, uint8_t userFlags) {trace_scope
-		const uint8_t	kAllocatedBit= 0x80;
+	inline void ArchiveFile::Block::_allocate(int64_t payloadSize, uint8_t headerFlags) {trace_scope
+		const int64_t	kFileSizeMax= INT64_MAX;
 		const int64_t	kFlagsSize= sizeof(uint8_t);
 		const int64_t	kHeaderSize= kFlagsSize + sizeof(int64_t);
 		const int64_t	oldSize= _size;
@@ -420,64 +1044,728 @@ namespace io {
 			freeTailBlock._storage= _storage;
 			freeTailBlock._location= _location + _size;
 			freeTailBlock._size= oldSize - _size;
+			if(trace_bool(_location + oldSize == kFileSizeMax)) {
+				_storage->_grow(freeTailBlock._location + kHeaderSize);
+			}
 			freeTailBlock._writeFreeHeader();
 		}
-		_flags= kAllocatedBit | userFlags;
+		_storage->_removeFree(_location, _location + 1);
+		_flags= headerFlags;
 		_writeHeader();
-		_storage->flush();
+		_storage->_flushBlocks();
+	}
+	/**
+		@param file			The file to scan
+		@param reading		Whether the contents of allocated blocks are read with the headers
+		@param prefetch		Whether another thread reads the chunks ahead
+		@param chunkSize	How much of the file to read at a time
+	*/
+	inline ArchiveFile::Scanner::Scanner(ArchiveFile &file, Reading reading, Prefetch prefetch, size_t chunkSize)
+			:_file(file), _reading(reading), _chunkSize(chunkSize > 0 ? chunkSize : 1), _block(), _next(0), _window(), _windowStart(0), _readFrom(0),
+				_endOfFile(false), _inWindow(false), _haveContents(false), _buffer(), _contents(), _chunks(2), _prefetcher(NULL), _stop(0), _error(0) {trace_scope
+		{
+			Locker	locker(_file, exec::RWLock::Read);
+
+			_next= _file._headerSize;
+			_file._visible();
+		}
+		_windowStart= _next;
+		_readFrom= _next;
+		if(PrefetchThread == prefetch) {
+			_prefetcher= new _Prefetcher(*this, _next);
+			_prefetcher->start();
+		}
+		try {
+			_advance();
+		} catch(const std::exception &) {
+			_stopPrefetching();
+			throw;
+		}
+	}
+	inline ArchiveFile::Scanner::~Scanner() {trace_scope
+		_stopPrefetching();
+	}
+	/**
+		@return	false once the scan has gone past the last block
+	*/
+	inline ArchiveFile::Scanner::operator bool() const {trace_scope
+		return trace_bool(NULL != _block._storage);
+	}
+	/**
+		@throw posix::err::EILSEQ_ErrNo if the next block is corrupt or goes past the end of the file
+	*/
+	inline ArchiveFile::Scanner &ArchiveFile::Scanner::operator++() {trace_scope
+		_advance();
+		return *this;
+	}
+	inline ArchiveFile::Block &ArchiveFile::Scanner::block() {trace_scope
+		return _block;
+	}
+	/**
+		@return	The contents, in the chunk read if the scan is WithContents, otherwise read from the file
+		@throw posix::err::EINVAL_ErrNo if the block is not allocated
+		@throw posix::err::EILSEQ_ErrNo if the block is encoded and its checksum does not match
+	*/
+	inline const ReferencedString &ArchiveFile::Scanner::contents() {trace_scope
+		const uint8_t	kAllocatedBit= 0x80;
+		const uint8_t	kFlagsEncoded= 0x7D;
+		const int64_t	kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		const size_t	kEncodedHeaderSize= sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(int64_t);
+
+		if(trace_bool(!_haveContents)) {
+			if( ((_block._flags & kAllocatedBit) != kAllocatedBit) && (kFlagsEncoded != _block._flags) ) {
+				ErrnoCodeThrow(EINVAL, "File Block is not allocated");
+			}
+			if(_inWindow) {
+				const char	*data= _window.data() + (_block._location + kBlockHeaderSize - _windowStart);
+				size_t		size= static_cast<size_t>(_block._size - kBlockHeaderSize);
+
+				if(kFlagsEncoded == _block._flags) {
+					const Codec	codec= _check(data, size);
+
+					if(Stored == codec) {
+						data+= kEncodedHeaderSize;
+						size-= kEncodedHeaderSize;
+					} else {
+						_uncompress(data, size, codec, _buffer);
+						data= _buffer.data();
+						size= _buffer.size();
+					}
+				}
+				_contents= ReferencedString(data, size);
+			} else {
+				_block.read(_buffer);
+				_contents= ReferencedString(_buffer.data(), _buffer.size());
+			}
+			_haveContents= true;
+		}
+		return _contents;
+	}
+	/** A block whose header was changed in a transaction is read like Block::next() does.
+		After a big block whose contents are not wanted, just a little is read to get the next header,
+			since copying a chunk of contents costs more than a read for each block that big.
+		@throw posix::err::EILSEQ_ErrNo if the block is corrupt or goes past the end of the file
+	*/
+	inline void ArchiveFile::Scanner::_advance() {trace_scope
+		const int64_t	kFileSizeMax= INT64_MAX;
+		const int64_t	kFlagsSize= sizeof(uint8_t);
+		const int64_t	kBlockHeaderSize= kFlagsSize + sizeof(int64_t);
+		const int64_t	kBigBlock= 16 * 1024;
+		const size_t	kHeaderReadSize= 512;
+		const int64_t	location= _next;
+		const size_t	readSize= (HeadersOnly == _reading) && (_block._size > kBigBlock) && (kHeaderReadSize < _chunkSize) ? kHeaderReadSize : _chunkSize;
+		bool			pending= false;
+
+		_haveContents= false;
+		_inWindow= false;
+		if(trace_bool(0 == location)) {
+			_block= Block();
+			return;
+		}
+		{
+			Locker	locker(_file, exec::RWLock::Read);
+
+			if(!_file._pending.empty() && trace_bool(_file._pending.count(location) > 0)) {
+				_block= Block(location, _file);
+				pending= true;
+			}
+		}
+		if(!pending) {
+			if(!_fill(location, location + kFlagsSize, readSize)) {
+				ErrnoCodeThrow(EILSEQ, "File Block is past the end of the file");
+			}
+			const uint8_t	flags= static_cast<uint8_t>(_window[location - _windowStart]);
+			const int64_t	headerSize= _blockHeaderSize(flags);
+
+			if(!_fill(location, location + headerSize, readSize)) {
+				ErrnoCodeThrow(EILSEQ, "File Block is past the end of the file");
+			}
+			_block._storage= &_file;
+			_block._location= location;
+			_block._flags= flags;
+			if(kBlockHeaderSize == headerSize) {
+				_block._size= kBlockHeaderSize + _extract(_window.data() + (location - _windowStart + kFlagsSize));
+			} else {
+				_block._size= kFlagsSize + flags;
+			}
+		}
+		if(_block._size < kFlagsSize) {
+			ErrnoCodeThrow(EILSEQ, "File Block is corrupt");
+		}
+		_next= (location + _block._size < kFileSizeMax) ? location + _block._size : 0;
+		if( (WithContents == _reading) && !pending && (0 != _next) && !_block.free() ) {
+			if(!_fill(location, _next, _chunkSize)) {
+				ErrnoCodeThrow(EILSEQ, "File Block is past the end of the file");
+			}
+			_inWindow= true;
+		}
+	}
+	/** Only called before reading a chunk, so what is kept is moved once a chunk, not once a block.
+		@param from	Where in the file the part of _window still needed starts
+	*/
+	inline void ArchiveFile::Scanner::_discard(int64_t from) {trace_scope
+		const int64_t	windowEnd= _windowStart + static_cast<int64_t>(_window.size());
+
+		if(from >= windowEnd) {
+			_window.clear();
+		} else if(from > _windowStart) {
+			_window.erase(0, static_cast<size_t>(from - _windowStart));
+		} else {
+			return;
+		}
+		_windowStart= from;
+	}
+	/** Without a prefetch thread, the chunks that are all before from are not read.
+		@param from		Where in the file the part of _window still needed starts
+		@param end		Where in the file the part of _window needed ends
+		@param readSize	How much to read at a time without a prefetch thread
+		@return			true if _window reaches end, false if the file ends before it
+		@throw posix::err::ErrNo if the file cannot be read
+	*/
+	inline bool ArchiveFile::Scanner::_fill(int64_t from, int64_t end, size_t readSize) {trace_scope
+		while(trace_bool(_windowStart + static_cast<int64_t>(_window.size()) < end)) {
+			if(_endOfFile) {
+				return false;
+			}
+			_discard(from);
+
+			const int64_t	chunkStart= _window.empty() && (NULL == _prefetcher) ? _windowStart : _readFrom;
+			const size_t	kept= _window.size();
+			const size_t	wanted= (NULL == _prefetcher) ? readSize : _chunkSize;
+			size_t			amount;
+
+			if(NULL == _prefetcher) {
+				_window.resize(kept + wanted);
+				amount= _file._readAt(&_window[kept], wanted, chunkStart);
+				_window.resize(kept + amount);
+			} else {
+				std::string	*chunk= _chunks.dequeue();
+
+				if(NULL == chunk) {
+					_endOfFile= true;
+					ErrnoCodeThrow(0 == _error ? EIO : _error, "pread");
+				}
+				amount= chunk->size();
+				if(0 == kept) {
+					_window.swap(*chunk);
+				} else {
+					_window.append(*chunk);
+				}
+				delete chunk;
+				if(_windowStart > chunkStart) { // a chunk before the block, or the start of it
+					_window.erase(0, static_cast<size_t>(_windowStart - chunkStart < static_cast<int64_t>(amount) ? _windowStart - chunkStart : amount));
+				}
+			}
+			_readFrom= chunkStart + amount;
+			_endOfFile= (amount < wanted);
+		}
+		return true;
+	}
+	/** The prefetch thread stops at the next chunk, so what it has read is taken off _chunks until it does.
+	*/
+	inline void ArchiveFile::Scanner::_stopPrefetching() {trace_scope
+		if(NULL != _prefetcher) {
+			_stop.valueAfterIncrement();
+			while(trace_bool(!_endOfFile)) {
+				std::string	*chunk= _chunks.dequeue();
+
+				_endOfFile= (NULL == chunk) || (chunk->size() < _chunkSize);
+				delete chunk;
+			}
+			_prefetcher->join();
+			delete _prefetcher;
+			_prefetcher= NULL;
+		}
+	}
+	/**
+		@param scanner	The Scanner to read the chunks for
+		@param start	Where the first chunk starts
+	*/
+	inline ArchiveFile::Scanner::_Prefetcher::_Prefetcher(Scanner &scanner, int64_t start)
+			:exec::Thread(KeepAroundAfterFinish), _scanner(scanner), _offset(start) {trace_scope
+	}
+	inline ArchiveFile::Scanner::_Prefetcher::~_Prefetcher() {trace_scope
+	}
+	/** Once the Scanner asks it to stop, the chunks are empty, which ends the scan.
+		A read that fails puts NULL on the queue instead, and the error in the Scanner.
+	*/
+	inline void *ArchiveFile::Scanner::_Prefetcher::run() {trace_scope
+		size_t	amount;
+
+		do {
+			std::string	*chunk= new std::string();
+
+			if(_scanner._stop.value() == 0) {
+				try {
+					chunk->resize(_scanner._chunkSize);
+					amount= _scanner._file._readAt(&(*chunk)[0], chunk->size(), _offset);
+				} catch(const posix::err::Errno &exception) {
+					delete chunk;
+					_scanner._error= exception.code();
+					_scanner._chunks.enqueue(NULL);
+					return NULL;
+				}
+				chunk->resize(amount);
+				_offset+= amount;
+			}
+			amount= chunk->size();
+			_scanner._chunks.enqueue(chunk);
+		} while(trace_bool(amount == _scanner._chunkSize));
+		return NULL;
 	}
 	inline ArchiveFile::ArchiveFile(const char *path, Protection protection, uint16_t version, const std::string &signature)
-			:File(path, File::Binary, protection), _headerSize(0) {trace_scope
+			:File(path, File::Binary, protection), _headerSize(0), _freeBySize(), _freeByLocation(), _unmerged(),
+			_keepDirectory(true), _directoryTrailer(0),
+			_transaction(false), _committing(false), _pending(), _disposed(),
+			_journalPath(std::string(path) + "-journal"), _journal(NULL), _journalValid(false),
+			_relocations(), _identifiers(), _relocationChanges(), _relocationBlocks(), _relocationEntries(0), _relocationSequence(0),
+			_compactFrom(0), _map(), _oldMaps(), _epoch(0), _reserved(0), _holes(), _metadata(), _writer(), _writing(0), _owner(), _mapLock() {trace_scope
 		_init(version, signature);
 	}
-	inline ArchiveFile::~ArchiveFile() {trace_scope}
+	/** An uncommitted transaction is rolled back. The journal is removed once the last commit
+			is on disk in place, then the block directory is written if the file was changed since it was opened.
+	*/
+	inline ArchiveFile::~ArchiveFile() {trace_scope
+		const bool	rolledBack= _transaction;
+
+		try {
+			if(_journalValid) {
+				flush(SyncData);
+				::unlink(_journalPath.c_str());
+			}
+		} catch(const std::exception &) {
+			// the next open will replay the journal
+		}
+		delete _journal;
+		if(_keepDirectory && writable() && (0 == _directoryTrailer) && !rolledBack) {
+			try {
+				checkpoint();
+			} catch(const std::exception &) {
+				// the next open will scan the blocks
+			}
+		}
+	}
 	/// @todo Test
 	inline ArchiveFile::ArchiveFile(const std::string &path, Protection protection, uint16_t version, const std::string &signature)
-			:File(path, File::Binary, protection), _headerSize(0) {trace_scope
+			:File(path, File::Binary, protection), _headerSize(0), _freeBySize(), _freeByLocation(), _unmerged(),
+			_keepDirectory(true), _directoryTrailer(0),
+			_transaction(false), _committing(false), _pending(), _disposed(),
+			_journalPath(std::string(path) + "-journal"), _journal(NULL), _journalValid(false),
+			_relocations(), _identifiers(), _relocationChanges(), _relocationBlocks(), _relocationEntries(0), _relocationSequence(0),
+			_compactFrom(0), _map(), _oldMaps(), _epoch(0), _reserved(0), _holes(), _metadata(), _writer(), _writing(0), _owner(), _mapLock() {trace_scope
 		_init(version, signature);
 	}
-	/** Walks the blocks, starting the the first block, looking for a free block big enough to hold
-			the requested data size.
-		NOTE: All free blocks are Block::merge()d
+	/** Takes the smallest free block big enough to hold the requested data size
+			(the earliest one if there are several), using the free block index rather than the file.
+		NOTE: Free blocks next to each other are Block::merge()d first
 	*/
 	inline ArchiveFile::Block ArchiveFile::allocate(int64_t dataSize, uint8_t flags) {trace_scope
-		for(Block b= begin(); trace_bool(b != end()); ++b) {
-			if(b.free()) {
-				b.merge();
-				if( (dataSize <= b.size()) && b.allocate(dataSize, flags) ) { // @todo Test
-					return b;
-				}
-			}
-		}
-		return Block();
+		const uint8_t	kAllocatedBit= 0x80;
+		Locker			locker(*this, exec::RWLock::Write);
+
+		return _allocate(dataSize, kAllocatedBit | flags);
 	}
 	inline ArchiveFile::Block ArchiveFile::allocate(const std::string &data, uint8_t flags) {trace_scope
+		Locker	locker(*this, exec::RWLock::Write);
 		Block	block= allocate(data.size(), flags);
 
 		write(data, block, block);
 		return block;
 	}
-	/// @todo Test
+	/** If the codec does not make the data smaller, it is stored uncompressed.
+		The block's size() is the size of the encoded data, read() gives back the original data.
+		@param data		The data to write
+		@param flags	The user flags for the block (lower 7 bits only)
+		@param codec	How to compress the data
+	*/
+	inline ArchiveFile::Block ArchiveFile::allocate(const std::string &data, uint8_t flags, Codec codec) {trace_scope
+		const uint8_t	kFlagsEncoded= 0x7D;
+		std::string		encoded;
+
+		_encode(data, flags, codec, encoded); // before locking, so other threads can read while we compress
+		Locker	locker(*this, exec::RWLock::Write);
+		Block	block= _allocate(encoded.size(), kFlagsEncoded);
+
+		write(encoded, block, block);
+		return block;
+	}
+	/** The old block is disposed and the new block takes over its identifier in a transaction,
+			so after a crash the block has either the old or the new contents, never part of each.
+			If a transaction has not been started, the replace is committed on its own.
+		Block objects for the old block are out of date.
+		@param identifier	The identifier of an allocated block
+		@param data			The new contents of the block
+		@param flags		The user flags for the block (lower 7 bits only)
+		@return				The new block
+		@throw posix::err::EINVAL_ErrNo if the block is not allocated
+	*/
+	inline ArchiveFile::Block ArchiveFile::replace(int64_t identifier, const std::string &data, uint8_t flags) {trace_scope
+		const uint8_t	kAllocatedBit= 0x80;
+
+		return _replace(identifier, data, kAllocatedBit | flags);
+	}
+	/** Like allocate(data, flags, codec), if the codec does not make the data smaller, it is stored uncompressed.
+		@param identifier	The identifier of an allocated block
+		@param data			The new contents of the block
+		@param flags		The user flags for the block (lower 7 bits only)
+		@param codec		How to compress the data
+		@return				The new block
+		@throw posix::err::EINVAL_ErrNo if the block is not allocated
+	*/
+	inline ArchiveFile::Block ArchiveFile::replace(int64_t identifier, const std::string &data, uint8_t flags, Codec codec) {trace_scope
+		const uint8_t	kFlagsEncoded= 0x7D;
+		std::string		encoded;
+
+		_encode(data, flags, codec, encoded);
+		return _replace(identifier, encoded, kFlagsEncoded);
+	}
+	/** Blocks moved by compact() are found through the relocation map.
+	*/
 	inline ArchiveFile::Block ArchiveFile::lookup(int64_t identifier) {trace_scope
+		Locker					locker(*this, exec::RWLock::Read);
+		IdentifierMap::iterator	found= _relocations.find(identifier);
+
+		if(trace_bool(found != _relocations.end())) {
+			return Block(found->second, *this);
+		}
 		return Block(identifier, *this);
 	}
+	/** Like lookup(identifier).view(contents), but the header is read from the map too,
+			so nothing is copied out of the file for a block that is not encoded.
+		@param identifier	The identifier of an allocated block
+		@param contents		Set to the contents of the block
+		@return				contents
+		@throw posix::err::EINVAL_ErrNo if the block is not allocated
+		@throw posix::err::EILSEQ_ErrNo if the block is encoded and its checksum does not match
+	*/
+	inline ArchiveFile::View &ArchiveFile::view(int64_t identifier, View &contents) {trace_scope
+		const int64_t		kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		Locker				locker(*this, exec::RWLock::Read);
+		IdentifierMap::iterator	found= _relocations.find(identifier);
+		const int64_t		location= trace_bool(found != _relocations.end()) ? found->second : identifier;
+		HeaderMap::iterator	pending= _pending.find(location);
+
+		if(trace_bool(pending != _pending.end())) {
+			return Block(location, *this).view(contents);
+		}
+		Map::Ptr	map= _mapTo(location + kBlockHeaderSize);
+		const char	*header= map->data() + location;
+
+		return _view(location, static_cast<uint8_t>(header[0]), _extract(header + sizeof(uint8_t)), contents);
+	}
+	/**
+		@return	The number of times the file has been mapped
+	*/
+	inline int64_t ArchiveFile::epoch() const {trace_scope
+		exec::RWLock::Locker	locker(_mapLock, exec::RWLock::Read);
+
+		return _epoch;
+	}
+	/** Hides File::flush() so the flushes of every block operation go through flush(Durability).
+	*/
+	inline void ArchiveFile::flush() {trace_scope
+		flush(durability());
+	}
+	/** Once the file is synced, the free headers of the big blocks disposed since the last sync are on disk,
+			so their storage is given back. In a transaction that waits for commit().
+		@param durability	How far to push the data written so far
+	*/
+	inline void ArchiveFile::flush(Durability durability) {trace_scope
+		File::flush(durability);
+		if(trace_bool(SyncData <= durability)) {
+			Locker	locker(*this, exec::RWLock::Write);
+
+			if(trace_bool(!_transaction)) {
+				_punchHoles();
+			}
+		}
+	}
 	inline ArchiveFile::Block ArchiveFile::begin() {trace_scope
+		Locker	locker(*this, exec::RWLock::Read);
+
 		return Block(_headerSize, *this);
 	}
 	inline ArchiveFile::Block ArchiveFile::end() {trace_scope
 		return Block();
 	}
-	/** If the file doesn't exist or it is zero length, it is created and the header is written.
-			If the file exists, the header is read and verified.
-		@throw posix::err::ERANGE_ErrNo if file is not empty but too small for the header
-		@throw posix::err::EILSEQ_ErrNo Signature or version do not match
+	/** The directory goes right after the header of the last (near infinite) free block
+			and the file is truncated after it.
+		The directory is: signature, location of the last block, relocation block count,
+			location of each relocation block, free block count, location and size of each free block, checksum.
+		Followed by the trailer: directory location, directory size, trailer signature.
 	*/
-	inline void ArchiveFile::_init(uint16_t version, const std::string &signature) {trace_scope
-		const uint8_t	kFlagsFreeBlockFullHeader= 0x7F;
-		const int64_t	kSignatureSize= signature.size();
-		const int64_t	kFileSizeMax= INT64_MAX;
+	inline void ArchiveFile::checkpoint() {trace_scope
 		const int64_t	kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
-		const int64_t	kHeaderSize= kSignatureSize + sizeof(uint16_t);
+		Locker			locker(*this, exec::RWLock::Write);
+		const int64_t	tail= _freeByLocation.rbegin()->first;
+		const int64_t	location= tail + kBlockHeaderSize;
+		std::string		buffer(io_ArchiveFile_DirectorySignature);
+
+		AssertMessageException(writable());
+		_append(buffer, tail);
+		_append(buffer, _relocationBlocks.size());
+		for(LocationSet::iterator block= _relocationBlocks.begin(); trace_bool(block != _relocationBlocks.end()); ++block) {
+			_append(buffer, *block);
+		}
+		_append(buffer, _freeByLocation.size());
+		for(FreeByLocation::iterator block= _freeByLocation.begin(); trace_bool(block != _freeByLocation.end()); ++block) {
+			_append(buffer, block->first);
+			_append(buffer, block->second);
+		}
+		_append(buffer, _checksum(buffer, buffer.size()));
+		const int64_t	directorySize= buffer.size();
+		_append(buffer, location);
+		_append(buffer, directorySize);
+		buffer.append(io_ArchiveFile_DirectoryTrailer);
+		write(buffer, location, FromStart);
+		flush();
+		ErrnoOnNegative(::ftruncate(descriptor(), location + buffer.size()));
+		moveto(0, FromStart);
+		_directoryTrailer= location + directorySize;
+	}
+	inline bool ArchiveFile::directory() const {trace_scope
+		return _keepDirectory;
+	}
+	/** Transactions cannot be nested.
+	*/
+	inline void ArchiveFile::startTransaction() {trace_scope
+		Locker	locker(*this, exec::RWLock::Write);
+
+		AssertMessageException(writable());
+		AssertMessageException(!_transaction);
+		_transaction= true;
+	}
+	/** If blocks have been moved, or moved blocks disposed, the changes to the relocation map are written first.
+		The journal is written at the start of the file as:
+			signature, number of headers, (location, header size, header) for each header, checksum.
+		Only the last commit is ever needed, since each commit syncs the headers the previous one wrote in place.
+	*/
+	inline void ArchiveFile::commit() {trace_scope
+		Locker		locker(*this, exec::RWLock::Write);
+		std::string	record(io_ArchiveFile_JournalSignature);
+
+		AssertMessageException(_transaction);
+		if(trace_bool(!_relocationChanges.empty())) { // before the disposed blocks are free, so it cannot be written over them
+			_writeRelocations();
+		}
+		_committing= true;
+		for(LocationSet::iterator location= _disposed.begin(); trace_bool(location != _disposed.end()); ++location) {
+			Block(*location, *this).dispose();
+		}
+		_committing= false;
+		_disposed.clear();
+		if(trace_bool(_pending.empty())) {
+			_transaction= false;
+			return;
+		}
+		_append(record, _pending.size());
+		for(HeaderMap::iterator header= _pending.begin(); trace_bool(header != _pending.end()); ++header) {
+			_append(record, header->first);
+			record.append(1, static_cast<char>(header->second.size()));
+			record.append(header->second);
+		}
+		_append(record, _checksum(record, record.size()));
+		flush(SyncData);
+		if(NULL == _journal) {
+			_journal= new File(_journalPath, Binary, ReadWrite);
+		}
+		_journal->write(record, 0, FromStart);
+		_journal->flush(SyncData);
+		_journalValid= true;
+		for(HeaderMap::iterator header= _pending.begin(); trace_bool(header != _pending.end()); ++header) {
+			write(header->second, header->first, FromStart);
+		}
+		_pending.clear();
+		_transaction= false;
+		flush(FlushToKernel);
+		_punchHoles();
+	}
+	/** Blocks allocated in the transaction go back to being free, whatever was written to them.
+	*/
+	inline void ArchiveFile::rollback() {trace_scope
+		Locker	locker(*this, exec::RWLock::Write);
+
+		AssertMessageException(_transaction);
+		_pending.clear();
+		_disposed.clear();
+		_transaction= false;
+		_index();
+	}
+	inline bool ArchiveFile::transaction() const {trace_scope
+		return _transaction;
+	}
+	/** Looks at the runs of allocated blocks between free blocks from the end of the file back,
+			moving each block, last first, into the best fitting free block before it.
+			Then the free space at the end is truncated.
+		Each call is one transaction, which cannot be called during another transaction,
+			and the next call carries on where this one stopped.
+		Blocks keep their identifiers, but Block objects for moved blocks are out of date.
+		@param seconds	How long to spend moving blocks, at least one block is looked at
+		@return			true if the blocks have all been looked at, the next call starts again at the end
+	*/
+	inline bool ArchiveFile::compact(double seconds) {trace_scope
+		const dt::DateTime	start;
+		std::string			buffer;
+		bool				finished= false, stopped= false;
+		Locker				locker(*this, exec::RWLock::Write);
+
+		AssertMessageException(!_transaction);
+		_coalesce();
+		startTransaction();
+		try {
+			while(!finished && !stopped) {
+				const int64_t				tail= _freeByLocation.rbegin()->first;
+				const int64_t				limit= ( (0 != _compactFrom) && (_compactFrom < tail) ) ? _compactFrom : tail;
+				FreeByLocation::iterator	before= _freeByLocation.lower_bound(limit);
+				int64_t						runStart= _headerSize, freeBefore= 0;
+				std::vector<int64_t>		run;
+
+				if(trace_bool(before != _freeByLocation.begin())) {
+					--before;
+					freeBefore= before->first; // blocks may be moved into it
+					runStart= before->first + before->second;
+				}
+				for(Block block(runStart, *this); trace_bool(block.offset(false) < limit); ++block) {
+					run.push_back(block.offset(false));
+				}
+				for(std::vector<int64_t>::reverse_iterator location= run.rbegin(); trace_bool(location != run.rend()); ++location) {
+					_move(*location, buffer);
+					if(trace_bool(dt::DateTime() - start >= seconds)) {
+						_compactFrom= *location;
+						stopped= true;
+						break;
+					}
+				}
+				if(!stopped) {
+					finished= (0 == freeBefore);
+					_compactFrom= freeBefore;
+				}
+			}
+			commit();
+		} catch(const std::exception &) {
+			rollback();
+			throw;
+		}
+		_coalesce();
+		_truncate();
+		return finished;
+	}
+	/**
+		@return	Counts of the free blocks before the last block.
+	*/
+	inline ArchiveFile::Fragmentation ArchiveFile::fragmentation() {trace_scope
+		const int64_t				kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		Locker						locker(*this, exec::RWLock::Read);
+		FreeByLocation::iterator	last= _freeByLocation.end();
+		Fragmentation				result;
+
+		--last;
+		result.size= last->first + kBlockHeaderSize;
+		result.freeBlocks= 0;
+		result.freeBytes= 0;
+		result.largestFree= 0;
+		result.miniBlocks= 0;
+		result.relocated= _relocations.size();
+		for(FreeByLocation::iterator block= _freeByLocation.begin(); trace_bool(block != last); ++block) {
+			++result.freeBlocks;
+			result.freeBytes+= block->second;
+			if(block->second > result.largestFree) {
+				result.largestFree= block->second;
+			}
+			if(block->second < kBlockHeaderSize) {
+				++result.miniBlocks;
+			}
+		}
+		return result;
+	}
+	/**
+		@param keep	false to scan the blocks on the next open, unless checkpoint() is called.
+		@return		The previous setting.
+	*/
+	inline bool ArchiveFile::directory(bool keep) {trace_scope
+		Locker		locker(*this, exec::RWLock::Write);
+		const bool	previous= _keepDirectory;
+
+		_keepDirectory= keep;
+		return previous;
+	}
+	/** See allocate(), the header flags say what kind of block it is.
+		A free block that is exactly the right size cannot be used if it is at the identifier of a moved block,
+			there is no room to allocate one byte later. replace() leaves many of those, so after a few
+			the next bigger size is tried, without reading their headers.
+		@param dataSize		The size of data that can be written to the block
+		@param headerFlags	The flags byte of the header
+		@return				The block, or an invalid block if none could be allocated
+	*/
+	inline ArchiveFile::Block ArchiveFile::_allocate(int64_t dataSize, uint8_t headerFlags) {trace_scope
+		const int64_t			kHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		const int				kMaxExactMoved= 8;
+		FreeBySize::iterator	found;
+		int						exactMoved= 0;
+
+		_coalesce();
+		for(found= _freeBySize.lower_bound(SizeLocation(kHeaderSize + dataSize, 0)); trace_bool(found != _freeBySize.end()); ++found) {
+			if( (found->first == kHeaderSize + dataSize) && (_relocations.count(found->second) > 0) ) {
+				if(trace_bool(++exactMoved == kMaxExactMoved)) {
+					found= _freeBySize.lower_bound(SizeLocation(kHeaderSize + dataSize + 1, 0));
+					--found; // the loop moves to it
+				}
+				continue;
+			}
+			Block	b(found->second, *this);
+
+			if(b._allocateAs(dataSize, headerFlags)) { // @todo Test
+				return b;
+			}
+		}
+		return Block();
+	}
+	/** The new block is allocated before the old one is disposed, so the data is never written over the old contents,
+			and the identifier is moved to it the way compact() moves a block.
+		@param identifier	The identifier of an allocated block
+		@param data			The new contents of the block, encoded if headerFlags says it is an encoded block
+		@param headerFlags	The flags byte of the header
+		@return				The new block
+		@throw posix::err::EINVAL_ErrNo if the block is not allocated
+	*/
+	inline ArchiveFile::Block ArchiveFile::_replace(int64_t identifier, const std::string &data, uint8_t headerFlags) {trace_scope
+		Locker	locker(*this, exec::RWLock::Write);
+		Block	previous= lookup(identifier);
+
+		if(!previous.valid() || previous.free() || previous.reserved() || (_disposed.count(previous.offset(false)) > 0)) {
+			ErrnoCodeThrow(EINVAL, "Block is not allocated");
+		}
+		if(trace_bool(!_transaction)) {
+			Block	block;
+
+			startTransaction();
+			try {
+				block= _replace(identifier, data, headerFlags);
+				commit();
+			} catch(const std::exception &) {
+				rollback();
+				throw;
+			}
+			return block;
+		}
+		Block	block= _allocate(data.size(), headerFlags);
+
+		write(data, block, block);
+		_relocate(previous.offset(false), block.offset(false));
+		previous.dispose();
+		return block;
+	}
+	/** If the file doesn't exist or it is zero length, it is created and the header is written.
+			If the file exists, the header is read and verified.
+		@throw posix::err::ERANGE_ErrNo if file is not empty but too small for the header
+		@throw posix::err::EILSEQ_ErrNo Signature or version do not match
+	*/
+	inline void ArchiveFile::_init(uint16_t version, const std::string &signature) {trace_scope
+		const uint8_t	kFlagsFreeBlockFullHeader= 0x7F;
+		const int64_t	kSignatureSize= signature.size();
+		const int64_t	kFileSizeMax= INT64_MAX;
+		const int64_t	kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		const int64_t	kHeaderSize= kSignatureSize + sizeof(uint16_t);
 		Block	block;
 
 		if(size() == 0) {
@@ -503,6 +1791,806 @@ namespace io {
 			block= Block(location(), *this); // verify we can read the first block
 		}
 		_headerSize= kHeaderSize;
+		_replay();
+		if(!_loadDirectory()) {
+			_index();
+		}
+	}
+	/** Reads every block header once, a chunk of the file at a time.
+	*/
+	inline void ArchiveFile::_index() {trace_scope
+		_freeBySize.clear();
+		_freeByLocation.clear();
+		_unmerged.clear();
+		_relocationBlocks.clear();
+		for(Scanner scan(*this); trace_bool(scan); ++scan) {
+			Block	&b= scan.block();
+
+			if(b.free()) {
+				_addFree(b.offset(false), b.size(false));
+			} else if(b.reserved()) {
+				_relocationBlocks.insert(b.offset(false));
+			}
+		}
+		_loadRelocations();
+	}
+	/** Replaces any previous entry for the location.
+		@param location	The location of the free block
+		@param size		The size of the entire block, including header
+	*/
+	inline void ArchiveFile::_addFree(int64_t location, int64_t size) {trace_scope
+		FreeByLocation::iterator	found= _freeByLocation.lower_bound(location);
+
+		if(trace_bool(found != _freeByLocation.end()) && trace_bool(found->first == location)) {
+			_freeBySize.erase(SizeLocation(found->second, location));
+			found->second= size;
+		} else {
+			found= _freeByLocation.insert(found, FreeByLocation::value_type(location, size));
+		}
+		_freeBySize.insert(SizeLocation(size, location));
+		if(trace_bool(found != _freeByLocation.begin())) {
+			FreeByLocation::iterator	before= found;
+
+			--before;
+			if(before->first + before->second == location) {
+				_unmerged.insert(before->first);
+			}
+		}
+		if(_freeByLocation.count(location + size) > 0) {
+			_unmerged.insert(location);
+		}
+	}
+	/**
+		@param from	The first location that is no longer free
+		@param to	The location after the last location that is no longer free
+	*/
+	inline void ArchiveFile::_removeFree(int64_t from, int64_t to) {trace_scope
+		FreeByLocation::iterator	found= _freeByLocation.lower_bound(from);
+
+		if(trace_bool(found != _freeByLocation.begin()) && trace_bool(found != _freeByLocation.end()) && trace_bool(found->first < to)) {
+			FreeByLocation::iterator	before= found;
+
+			--before;
+			if(before->first + before->second == found->first) {
+				_unmerged.erase(before->first); // it is no longer followed by a free block
+			}
+		}
+		while(trace_bool(found != _freeByLocation.end()) && trace_bool(found->first < to)) {
+			_freeBySize.erase(SizeLocation(found->second, found->first));
+			_unmerged.erase(found->first);
+			_freeByLocation.erase(found++);
+		}
+	}
+	/** The trailer signature is overwritten and synced before the change is made,
+			so a crash leaves a file that is scanned on open rather than trusted.
+		It is synced whatever durability() is. Without the sync, writeback could put the change on disk first,
+			and an old directory with a stale free list could be trusted and give out a block in use.
+			It only happens once for each directory written.
+	*/
+	inline void ArchiveFile::_modifying() {trace_scope
+		if(0 != _directoryTrailer) {
+			const std::string	invalid(sizeof(io_ArchiveFile_DirectoryTrailer) - 1, '\0');
+
+			write(invalid, _directoryTrailer + 2 * sizeof(int64_t), FromStart);
+			_directoryTrailer= 0;
+			flush(SyncData);
+		}
+		if(!_transaction && _journalValid) { // so an old commit is not replayed over this change
+			const std::string	invalid(sizeof(io_ArchiveFile_JournalSignature) - 1, '\0');
+
+			flush(SyncData);
+			_journal->write(invalid, 0, FromStart);
+			_journal->flush(SyncData);
+			_journalValid= false;
+		}
+	}
+	inline void ArchiveFile::_flushBlocks() {trace_scope
+		if(!_transaction) {
+			flush();
+		}
+	}
+	/**
+		@param location		The location of the block
+		@param flags		The flags byte of the header
+		@param payloadSize	The size written after the flags
+		@param full			false to write just the flags
+	*/
+	inline void ArchiveFile::_writeHeader(int64_t location, uint8_t flags, int64_t payloadSize, bool full) {trace_scope
+		std::string	header(1, static_cast<char>(flags));
+
+		if(full) {
+			_append(header, payloadSize);
+		}
+		_modifying();
+		if(_transaction) {
+			_pending[location]= header;
+		} else {
+			write(header, location, FromStart);
+		}
+	}
+	/** A journal that is incomplete or fails its checksum is from a commit that never finished.
+		If the file is read-only the headers are kept in memory instead of written.
+	*/
+	inline void ArchiveFile::_replay() {trace_scope
+		const size_t	kSignatureSize= sizeof(io_ArchiveFile_JournalSignature) - 1;
+		HeaderMap		headers;
+		std::string		record;
+		int64_t			count;
+		size_t			offset= kSignatureSize + sizeof(int64_t);
+
+		if(::access(_journalPath.c_str(), F_OK) != 0) {
+			return;
+		}
+		{
+			File	journal(_journalPath, Binary, ReadOnly);
+
+			journal.read(record, journal.size(), 0, FromStart);
+		}
+		if( (record.size() < offset + sizeof(int64_t)) || (record.compare(0, kSignatureSize, io_ArchiveFile_JournalSignature) != 0) ) {
+			count= -1;
+		} else {
+			count= _extract(record, kSignatureSize);
+		}
+		for(int64_t index= 0; trace_bool(index < count); ++index) {
+			size_t	headerSize;
+
+			if(offset + sizeof(int64_t) + 1 > record.size()) {
+				count= -1;
+				break;
+			}
+			headerSize= static_cast<uint8_t>(record[offset + sizeof(int64_t)]);
+			if(offset + sizeof(int64_t) + 1 + headerSize > record.size()) {
+				count= -1;
+				break;
+			}
+			headers[_extract(record, offset)]= record.substr(offset + sizeof(int64_t) + 1, headerSize);
+			offset+= sizeof(int64_t) + 1 + headerSize;
+		}
+		if( (count < 0) || (offset + sizeof(int64_t) > record.size()) || (_checksum(record, offset) != _extract(record, offset)) ) {
+			headers.clear();
+		}
+		if(!writable()) {
+			_pending.swap(headers);
+			return;
+		}
+		for(HeaderMap::iterator header= headers.begin(); trace_bool(header != headers.end()); ++header) {
+			write(header->second, header->first, FromStart);
+		}
+		flush(SyncData);
+		::unlink(_journalPath.c_str());
+	}
+	/** Everything is checked, including that the last block starts right before the directory,
+			so a directory left behind by an older version of the file is not used.
+		@return	false if there is no valid directory and the blocks must be scanned.
+	*/
+	inline bool ArchiveFile::_loadDirectory() {trace_scope
+		const int64_t	kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		const int64_t	kTrailerSize= 2 * sizeof(int64_t) + sizeof(io_ArchiveFile_DirectoryTrailer) - 1;
+		const int64_t	kFileSizeMax= INT64_MAX;
+		const int64_t	fileSize= size();
+		const int64_t	kSignatureSize= sizeof(io_ArchiveFile_DirectorySignature) - 1;
+		std::string		buffer;
+		LocationSet		relocationBlocks;
+		int64_t			location, directorySize, tail, reservedCount, count;
+
+		if(fileSize < _headerSize + kBlockHeaderSize + kTrailerSize) {
+			return false;
+		}
+		read(buffer, kTrailerSize, fileSize - kTrailerSize, FromStart);
+		if(buffer.compare(2 * sizeof(int64_t), std::string::npos, io_ArchiveFile_DirectoryTrailer) != 0) {
+			return false;
+		}
+		location= _extract(buffer, 0);
+		directorySize= _extract(buffer, sizeof(int64_t));
+		if( (location <= _headerSize) || (location + directorySize + kTrailerSize != fileSize)
+				|| (directorySize < kSignatureSize + 4 * static_cast<int64_t>(sizeof(int64_t))) ) {
+			return false;
+		}
+		read(buffer, directorySize, location, FromStart);
+		if( (buffer.compare(0, sizeof(io_ArchiveFile_DirectorySignature) - 1, io_ArchiveFile_DirectorySignature) != 0)
+				|| (_checksum(buffer, directorySize - sizeof(int64_t)) != _extract(buffer, directorySize - sizeof(int64_t))) ) {
+			return false;
+		}
+		tail= _extract(buffer, kSignatureSize);
+		reservedCount= _extract(buffer, kSignatureSize + sizeof(int64_t));
+		if( (reservedCount < 0) || (directorySize < kSignatureSize + (4 + reservedCount) * static_cast<int64_t>(sizeof(int64_t))) ) {
+			return false;
+		}
+		count= _extract(buffer, kSignatureSize + (2 + reservedCount) * sizeof(int64_t));
+		if( (tail + kBlockHeaderSize != location) || (count < 1)
+				|| (directorySize != kSignatureSize + (4 + reservedCount + 2 * count) * static_cast<int64_t>(sizeof(int64_t))) ) {
+			return false;
+		}
+		Block	last(tail, *this);
+
+		if(!last.free() || (last.size(false) != kFileSizeMax - tail)) {
+			return false;
+		}
+		for(int64_t index= 0; trace_bool(index < reservedCount); ++index) {
+			const int64_t	reserved= _extract(buffer, kSignatureSize + (2 + index) * sizeof(int64_t));
+
+			if( (reserved < _headerSize) || (reserved >= tail) || !Block(reserved, *this).reserved() ) {
+				return false;
+			}
+			relocationBlocks.insert(reserved);
+		}
+		_freeBySize.clear();
+		_freeByLocation.clear();
+		_unmerged.clear();
+		for(int64_t index= 0; index < count; ++index) {
+			const size_t	entry= kSignatureSize + (3 + reservedCount + 2 * index) * sizeof(int64_t);
+
+			_addFree(_extract(buffer, entry), _extract(buffer, entry + sizeof(int64_t)));
+		}
+		if(_freeByLocation.rbegin()->first != tail) {
+			return false;
+		}
+		_relocationBlocks.swap(relocationBlocks);
+		_loadRelocations();
+		_directoryTrailer= location + directorySize;
+		return true;
+	}
+	/**
+		@param buffer	The buffer to append to.
+		@param value	The value to append in BigEndian order.
+	*/
+	inline void ArchiveFile::_append(std::string &buffer, int64_t value) {trace_scope
+		endian::convert(&value, &value, 1, true);
+		buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+	/**
+		@param buffer	The buffer to read from.
+		@param offset	The offset in buffer of the BigEndian value.
+		@return			The value.
+	*/
+	inline int64_t ArchiveFile::_extract(const std::string &buffer, size_t offset) {trace_scope
+		return _extract(buffer.data() + offset);
+	}
+	/**
+		@param data	The BigEndian value.
+		@return		The value.
+	*/
+	inline int64_t ArchiveFile::_extract(const char *data) {trace_scope
+		int64_t	value;
+
+		memcpy(&value, data, sizeof(value));
+		endian::convert(&value, &value, 1, true);
+		return value;
+	}
+	/**
+		@param flags	The first byte of a block header
+		@return			The size of the header, which is the whole block for a free block too small for a full header
+		@throw posix::err::EILSEQ_ErrNo if flags are not in the ranges of 00-07 and 7D-FF
+	*/
+	inline int64_t ArchiveFile::_blockHeaderSize(uint8_t flags) {trace_scope
+		const uint8_t	kFlagsFreeBlockFullHeader= 0x7F;
+		const uint8_t	kFlagsRelocationMap= 0x7E;
+		const uint8_t	kFlagsEncoded= 0x7D;
+		const uint8_t	kAllocatedBit= 0x80;
+		const int64_t	kFlagsSize= sizeof(uint8_t);
+		const int64_t	kMaxMiniFreeSize= sizeof(int64_t) - 1;
+
+		if( ( (flags & kAllocatedBit) == kAllocatedBit )
+				|| (flags == kFlagsFreeBlockFullHeader) || (flags == kFlagsRelocationMap) || (flags == kFlagsEncoded) ) {
+			return kFlagsSize + sizeof(int64_t);
+		}
+		if(flags > kMaxMiniFreeSize) {
+			ErrnoCodeThrow(EILSEQ, "File Block is corrupt");
+		}
+		return kFlagsSize;
+	}
+	/**
+		@param buffer	The data to checksum.
+		@param length	The number of bytes at the start of buffer to checksum.
+		@return			The 64-bit FNV-1a hash of the bytes.
+	*/
+	inline int64_t ArchiveFile::_checksum(const std::string &buffer, size_t length) {trace_scope
+		uint64_t	hash= 0xCBF29CE484222325ULL;
+
+		for(size_t index= 0; trace_bool(index < length); ++index) {
+			hash= (hash ^ static_cast<uint8_t>(buffer[index])) * 0x100000001B3ULL;
+		}
+		return static_cast<int64_t>(hash);
+	}
+	/** The encoded contents are: the user flags, the CRC32C of the rest of the contents (big endian),
+			the codec, the size of the original data, then the (compressed) data.
+		@param data		The data to encode.
+		@param flags	The user flags.
+		@param codec	The compression to try.
+		@param encoded	Replaced with the contents of the block.
+	*/
+	inline void ArchiveFile::_encode(const std::string &data, uint8_t flags, Codec codec, std::string &encoded) {trace_scope
+		const uint8_t	kUserFlagsMask= 0x7F;
+		const size_t	kChecksumOffset= sizeof(uint8_t);
+		const size_t	kCodecOffset= kChecksumOffset + sizeof(uint32_t);
+		std::string		compressed;
+
+		switch(codec) {
+			case Fast:
+				lz::compress(data, compressed);
+				break;
+			case Deflate:
+				z::compress(data, compressed);
+				break;
+			case Stored:
+			default:
+				break;
+		}
+		if( (Stored == codec) || (compressed.size() >= data.size()) ) {
+			codec= Stored;
+		}
+		encoded.assign(1, static_cast<char>(flags & kUserFlagsMask));
+		encoded.append(sizeof(uint32_t), '\0');
+		encoded.append(1, static_cast<char>(codec));
+		_append(encoded, data.size());
+		encoded.append(Stored == codec ? data : compressed);
+
+		const uint32_t	crc= hash::CRC32CHasher::value(encoded.data() + kCodecOffset, encoded.size() - kCodecOffset);
+
+		for(size_t index= 0; trace_bool(index < sizeof(crc)); ++index) {
+			encoded[kChecksumOffset + index]= static_cast<char>(crc >> (8 * (sizeof(crc) - 1 - index)));
+		}
+	}
+	/** The contents of an encoded block are checked in place so a stored block can be used where it is.
+		@param data	The contents of an encoded block.
+		@param size	The number of bytes in data.
+		@return		How the data after the encoded block header is compressed.
+		@throw posix::err::EILSEQ_ErrNo if the checksum does not match or the codec is not known
+	*/
+	inline ArchiveFile::Codec ArchiveFile::_check(const char *data, size_t size) {trace_scope
+		const size_t	kChecksumOffset= sizeof(uint8_t);
+		const size_t	kCodecOffset= kChecksumOffset + sizeof(uint32_t);
+		const size_t	kSizeOffset= kCodecOffset + sizeof(uint8_t);
+		const size_t	kDataOffset= kSizeOffset + sizeof(int64_t);
+		uint32_t		crc= 0;
+
+		if(size < kDataOffset) {
+			ErrnoCodeThrow(EILSEQ, "Encoded block is corrupt");
+		}
+		for(size_t index= 0; trace_bool(index < sizeof(crc)); ++index) {
+			crc= (crc << 8) | static_cast<uint8_t>(data[kChecksumOffset + index]);
+		}
+		if(hash::CRC32CHasher::value(data + kCodecOffset, size - kCodecOffset) != crc) {
+			ErrnoCodeThrow(EILSEQ, "Encoded block checksum does not match");
+		}
+		const Codec	codec= static_cast<Codec>(data[kCodecOffset]);
+
+		if( (codec != Stored) && (codec != Fast) && (codec != Deflate) ) {
+			ErrnoCodeThrow(EILSEQ, "Encoded block codec is unknown");
+		}
+		if( (Stored == codec) && (_extract(data + kSizeOffset) != static_cast<int64_t>(size - kDataOffset)) ) {
+			ErrnoCodeThrow(EILSEQ, "Encoded block is corrupt");
+		}
+		return codec;
+	}
+	/**
+		@param data		The contents of an encoded block that has been _check()ed.
+		@param size		The number of bytes in data.
+		@param codec	How it is compressed (not Stored).
+		@param buffer	Replaced with the original data.
+		@throw posix::err::EILSEQ_ErrNo if the data does not uncompress to the size it was
+	*/
+	inline void ArchiveFile::_uncompress(const char *data, size_t size, Codec codec, std::string &buffer) {trace_scope
+		const size_t	kSizeOffset= sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint8_t);
+		const size_t	kDataOffset= kSizeOffset + sizeof(int64_t);
+		const int64_t	originalSize= _extract(data + kSizeOffset);
+
+		if(originalSize < 0) {
+			ErrnoCodeThrow(EILSEQ, "Encoded block is corrupt");
+		}
+		buffer.assign(originalSize, '\0');
+		if(Fast == codec) {
+			if(lz::uncompress(data + kDataOffset, size - kDataOffset, const_cast<char*>(buffer.data()), originalSize) != static_cast<size_t>(originalSize)) {
+				ErrnoCodeThrow(EILSEQ, "Encoded block is corrupt");
+			}
+		} else if(z::uncompress(data + kDataOffset, size - kDataOffset, const_cast<char*>(buffer.data()), originalSize) != static_cast<size_t>(originalSize)) {
+			ErrnoCodeThrow(EILSEQ, "Encoded block is corrupt");
+		}
+	}
+	/** Each relocation block is a sequence number, the number of entries, then the identifier and location
+			of each entry, location 0 if the block is no longer moved. Applying them in sequence order gives the map.
+		@throw posix::err::EILSEQ_ErrNo if a relocation block is not the size it says it is
+	*/
+	inline void ArchiveFile::_loadRelocations() {trace_scope
+		HeaderMap	blocks;
+
+		_relocations.clear();
+		_identifiers.clear();
+		_relocationChanges.clear();
+		_relocationEntries= 0;
+		_relocationSequence= 0;
+		for(LocationSet::iterator location= _relocationBlocks.begin(); trace_bool(location != _relocationBlocks.end()); ++location) {
+			std::string	contents;
+			int64_t		count= -1;
+
+			Block(*location, *this).read(contents);
+			if(contents.size() >= 2 * sizeof(int64_t)) {
+				count= _extract(contents, sizeof(int64_t));
+			}
+			if( (count < 0) || (static_cast<int64_t>(contents.size()) != (2 + 2 * count) * static_cast<int64_t>(sizeof(int64_t))) ) {
+				ErrnoCodeThrow(EILSEQ, "Relocation block is corrupt");
+			}
+			_relocationEntries+= count;
+			blocks[_extract(contents, 0)].swap(contents);
+		}
+		for(HeaderMap::iterator block= blocks.begin(); trace_bool(block != blocks.end()); ++block) {
+			const int64_t	count= _extract(block->second, sizeof(int64_t));
+
+			_relocationSequence= block->first;
+			for(int64_t index= 0; trace_bool(index < count); ++index) {
+				const int64_t			identifier= _extract(block->second, (2 + 2 * index) * sizeof(int64_t));
+				const int64_t			location= _extract(block->second, (3 + 2 * index) * sizeof(int64_t));
+				IdentifierMap::iterator	found= _relocations.find(identifier);
+
+				if(trace_bool(found != _relocations.end())) {
+					_identifiers.erase(found->second);
+					_relocations.erase(found);
+				}
+				if(0 != location) {
+					_relocations[identifier]= location;
+					_identifiers[location]= identifier;
+				}
+			}
+		}
+	}
+	/** Usually just the changes are written, to new blocks. Once the relocation blocks take more than
+			twice the space the map needs, the whole map is written to new blocks and they are disposed.
+		Each block holds at most 4 KiB of entries, so they can be moved into free blocks by compact().
+		The new block is allocated before any disposed blocks are free, so it cannot be written over them,
+			and blocks it replaces are disposed with them, so after a crash the map is as it was or as it is.
+	*/
+	inline void ArchiveFile::_writeRelocations() {trace_scope
+		const uint8_t	kFlagsRelocationMap= 0x7E;
+		const int64_t	kMinimumEntries= 16;
+		const int64_t	kMaxEntriesPerBlock= 256;
+		const int64_t	kBlockOverhead= 2; // the header, sequence number and count of a block take about as much as two entries
+		const bool		whole= (_relocationEntries + kBlockOverhead * static_cast<int64_t>(_relocationBlocks.size() + 1)
+										+ static_cast<int64_t>(_relocationChanges.size())
+										> 2 * static_cast<int64_t>(_relocations.size()) + kMinimumEntries);
+		IdentifierMap	&entries= whole ? _relocations : _relocationChanges;
+		std::string		header;
+
+		if(whole) {
+			for(LocationSet::iterator location= _relocationBlocks.begin(); trace_bool(location != _relocationBlocks.end()); ++location) {
+				Block(*location, *this).dispose();
+			}
+			_relocationBlocks.clear();
+			_relocationEntries= 0;
+		}
+		for(IdentifierMap::iterator entry= entries.begin(); trace_bool(entry != entries.end()); ) {
+			std::string	contents;
+			int64_t		count= 0;
+
+			for( ; trace_bool(entry != entries.end()) && trace_bool(count < kMaxEntriesPerBlock); ++entry, ++count) {
+				_append(contents, entry->first);
+				_append(contents, entry->second);
+			}
+			_append(header, ++_relocationSequence);
+			_append(header, count);
+			contents.insert(0, header);
+			header.clear();
+			Block	block= allocate(contents);
+
+			_writeHeader(block.offset(false), kFlagsRelocationMap, block.size(), true);
+			_relocationBlocks.insert(block.offset(false));
+			_relocationEntries+= count;
+		}
+		_relocationChanges.clear();
+	}
+	/**
+		@param from	Where the block was
+		@param to	Where the block is now
+	*/
+	inline void ArchiveFile::_relocate(int64_t from, int64_t to) {trace_scope
+		IdentifierMap::iterator	found= _identifiers.find(from);
+		int64_t					identifier= from;
+
+		if(trace_bool(found != _identifiers.end())) {
+			identifier= found->second;
+			_identifiers.erase(found);
+		}
+		if(identifier == to) {
+			_relocations.erase(identifier);
+			_relocationChanges[identifier]= 0;
+		} else {
+			_relocations[identifier]= to;
+			_identifiers[to]= identifier;
+			_relocationChanges[identifier]= to;
+		}
+	}
+	/**
+		@param location	The location of a block that is no longer allocated, so its identifier can be reused
+	*/
+	inline void ArchiveFile::_forget(int64_t location) {trace_scope
+		IdentifierMap::iterator	found= _identifiers.find(location);
+
+		if(trace_bool(found != _identifiers.end())) {
+			_relocations.erase(found->second);
+			_relocationChanges[found->second]= 0;
+			_identifiers.erase(found);
+		}
+	}
+	/** The best fit is the smallest free block before the block that it fits exactly, or with room
+			for a free block header after it so no mini free block is left. Only a few sizes are tried,
+			since the free blocks that are big enough may all be after the block.
+		Relocation blocks are found by scanning or the directory, not by identifier, so they just move.
+		Encoded blocks are copied as they are, with their header.
+		The block is disposed when the transaction is committed, so its contents are there until then.
+		@param location	The location of the block to move
+		@param buffer	Used to copy the contents
+		@return			true if the block was moved
+	*/
+	inline bool ArchiveFile::_move(int64_t location, std::string &buffer) {trace_scope
+		const uint8_t	kFlagsRelocationMap= 0x7E;
+		const uint8_t	kFlagsEncoded= 0x7D;
+		const int64_t	kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		const int		kMaxSizes= 32;
+		Block			block(location, *this);
+
+		if(block.free() || (_disposed.count(location) > 0)) {
+			return false;
+		}
+		const int64_t			blockSize= block.size(false);
+		FreeBySize::iterator	candidate= _freeBySize.lower_bound(SizeLocation(blockSize, 0));
+
+		if(trace_bool(candidate != _freeBySize.end()) && trace_bool(candidate->first != blockSize)) {
+			candidate= _freeBySize.lower_bound(SizeLocation(blockSize + kBlockHeaderSize, 0));
+		}
+		for(int sizes= 0; trace_bool(candidate != _freeBySize.end()) && trace_bool(sizes < kMaxSizes); ++sizes) {
+			if(candidate->second < location) { // the earliest free block of this size
+				Block	target(candidate->second, *this);
+
+				if(block.encoded() ? target._allocateAs(block.size(), kFlagsEncoded) : target.allocate(block.size(), block.flags())) {
+					read(buffer, block.size(), block, block);
+					write(buffer, target, target);
+					if(block.reserved()) {
+						_writeHeader(target.offset(false), kFlagsRelocationMap, target.size(), true);
+						_relocationBlocks.erase(location);
+						_relocationBlocks.insert(target.offset(false));
+					} else {
+						_relocate(location, target.offset(false));
+					}
+					block.dispose();
+					return true;
+				}
+			}
+			candidate= _freeBySize.lower_bound(SizeLocation(candidate->first == blockSize ? blockSize + kBlockHeaderSize : candidate->first + 1, 0));
+		}
+		return false;
+	}
+	/** The file is synced first, so the header of the last block is on disk before what is after it is gone.
+		Not while there are Views, the memory they point to could be cut off, so the storage is given back
+			with a hole instead. Truncating also lets go of the storage reserved past the end.
+	*/
+	inline void ArchiveFile::_truncate() {trace_scope
+		const int64_t	kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		const int64_t	end= _freeByLocation.rbegin()->first + kBlockHeaderSize;
+		exec::RWLock::Locker	locker(_mapLock, exec::RWLock::Write);
+
+		if( (0 == _directoryTrailer) && (size() > end) ) {
+			flush(SyncData);
+			if(trace_bool(_viewed())) {
+				punchHole(end, size() - end);
+			} else {
+				ErrnoOnNegative(::ftruncate(descriptor(), end));
+				moveto(0, FromStart);
+				_map= Map::Ptr();
+				_reserved= (_reserved < end) ? _reserved : end;
+			}
+		}
+	}
+	/** Storage is reserved an eighth of the file (at least a megabyte) at a time,
+			so blocks appended one after another are not scattered over the disk.
+		@param end	Where the file will end
+	*/
+	inline void ArchiveFile::_grow(int64_t end) {trace_scope
+		const int64_t	kFileSizeMax= INT64_MAX;
+		const int64_t	kReserveMinimum= 1024 * 1024;
+
+		if(trace_bool(end > _reserved)) {
+			const int64_t	reserveTo= end + ( (end / 8 > kReserveMinimum) ? end / 8 : kReserveMinimum );
+
+			_reserved= reserve(reserveTo) ? reserveTo : kFileSizeMax;
+		}
+	}
+	/** The contents of a free block of a megabyte or more are punched out of the file.
+		The free header has to be on disk first, or a crash could leave an allocated block with its contents gone,
+			so the block is held in _holes until the file is synced, or in a transaction until the journal is.
+			Syncing here would cost a sync per dispose even when durability() is NoSync or FlushToKernel.
+		@param location	The location of the free block header
+		@param size		The size of the free block, including the header
+	*/
+	inline void ArchiveFile::_release(int64_t location, int64_t size) {trace_scope
+		const int64_t	kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		const int64_t	kReleaseMinimum= 1024 * 1024;
+		int64_t			length, end;
+
+		_visible();
+		length= _length();
+		end= (location + size < length) ? location + size : length;
+		if(trace_bool(end - location - kBlockHeaderSize < kReleaseMinimum)) {
+			return;
+		}
+		_holes[location]= end;
+		if(trace_bool(!_transaction && (SyncData <= durability()))) { // the dispose already synced its header
+			_punchHoles();
+		}
+	}
+	/** Blocks in _holes may have been allocated, merged or cut off by a truncate since they were disposed,
+			so only what is still inside a free block, past that block's header, is punched out.
+	*/
+	inline void ArchiveFile::_punchHoles() {trace_scope
+		const int64_t	kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		int64_t			length;
+
+		if(trace_bool(_holes.empty())) {
+			return;
+		}
+		_visible();
+		length= _length();
+		for(FreeByLocation::iterator hole= _holes.begin(); trace_bool(hole != _holes.end()); ++hole) {
+			FreeByLocation::iterator	block= _freeByLocation.upper_bound(hole->first);
+
+			if(trace_bool(block != _freeByLocation.begin())) {
+				--block;
+			}
+			for(; trace_bool( (block != _freeByLocation.end()) && (block->first < hole->second) ); ++block) {
+				const int64_t	blockStart= block->first + kBlockHeaderSize;
+				const int64_t	blockEnd= (block->second > length - block->first) ? length : block->first + block->second;
+				const int64_t	start= (blockStart > hole->first + kBlockHeaderSize) ? blockStart : hole->first + kBlockHeaderSize;
+				const int64_t	end= (blockEnd < hole->second) ? blockEnd : hole->second;
+
+				if(trace_bool(end > start)) {
+					punchHole(start, end - start);
+				}
+			}
+		}
+		_holes.clear();
+	}
+	/** The file is mapped to its current size, so the map does not have to be replaced for every block appended.
+		Maps are only replaced, never changed, so Views of the old map are still valid.
+		Threads share _mapLock until one has to replace the map.
+		@param end	The offset in the file the map has to reach
+		@return		The map
+		@throw posix::err::EILSEQ_ErrNo if end is past the end of the file
+	*/
+	inline ArchiveFile::Map::Ptr ArchiveFile::_mapTo(int64_t end) {trace_scope
+		_visible();
+		{
+			exec::RWLock::Locker	locker(_mapLock, exec::RWLock::Read);
+
+			if(_map && trace_bool(_map->size() >= end)) {
+				return _map;
+			}
+		}
+		exec::RWLock::Locker	locker(_mapLock, exec::RWLock::Write);
+
+		if( !_map || trace_bool(_map->size() < end) ) {
+			const int64_t	length= _length();
+
+			if(end > length) {
+				ErrnoCodeThrow(EILSEQ, "File Block is past the end of the file");
+			}
+			if(_map) {
+				if(_map->references() > 1) {
+					_oldMaps.push_back(_map);
+				}
+				_map= Map::Ptr();
+			}
+			_map= Map::Ptr(new Map(descriptor(), length, ++_epoch), exec::ReferenceCounted::DoNotRetain);
+		}
+		return _map;
+	}
+	/** Maps no View has any more are let go. _mapLock must be held.
+		@return	true if any map is still in a View
+	*/
+	inline bool ArchiveFile::_viewed() {trace_scope
+		for(size_t index= _oldMaps.size(); trace_bool(index > 0); --index) {
+			if(_oldMaps[index - 1]->references() == 1) {
+				_oldMaps.erase(_oldMaps.begin() + (index - 1));
+			}
+		}
+		return !_oldMaps.empty() || ( _map && trace_bool(_map->references() > 1) );
+	}
+	/** Stored encoded blocks are checked and viewed in place, compressed ones are uncompressed into contents.
+		@param location		The location of the block header
+		@param flags		The flags byte of the header
+		@param payloadSize	The size of the block after the header
+		@param contents		Set to the contents of the block
+		@return				contents
+		@throw posix::err::EINVAL_ErrNo if the block is not allocated
+		@throw posix::err::EILSEQ_ErrNo if the block is encoded and its checksum does not match
+	*/
+	inline ArchiveFile::View &ArchiveFile::_view(int64_t location, uint8_t flags, int64_t payloadSize, View &contents) {trace_scope
+		const uint8_t	kAllocatedBit= 0x80;
+		const uint8_t	kFlagsEncoded= 0x7D;
+		const int64_t	kBlockHeaderSize= sizeof(uint8_t) + sizeof(int64_t);
+		const size_t	kEncodedHeaderSize= sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(int64_t);
+
+		if( ((flags & kAllocatedBit) != kAllocatedBit) && (kFlagsEncoded != flags) ) {
+			ErrnoCodeThrow(EINVAL, "File Block is not allocated");
+		}
+		const int64_t	start= location + kBlockHeaderSize;
+		Map::Ptr		map= _mapTo(start + payloadSize);
+		const char		*data= map->data() + start;
+
+		if(kFlagsEncoded == flags) {
+			const Codec	codec= _check(data, static_cast<size_t>(payloadSize));
+
+			if(Stored != codec) {
+				contents._map= Map::Ptr();
+				_uncompress(data, static_cast<size_t>(payloadSize), codec, contents._buffer);
+				contents._contents= ReferencedString(contents._buffer.data(), contents._buffer.size());
+				return contents;
+			}
+			data+= kEncodedHeaderSize;
+			payloadSize-= kEncodedHeaderSize;
+		}
+		contents._map= map;
+		contents._buffer.clear();
+		contents._contents= ReferencedString(data, static_cast<size_t>(payloadSize));
+		return contents;
+	}
+	/** Readers call this before reading with pread() or a map, since data written through
+			the FILE may still be in its buffer. A read-only file has nothing buffered.
+	*/
+	inline void ArchiveFile::_visible() {trace_scope
+		if(writable()) {
+			flush(FlushToKernel);
+		}
+	}
+	/** Unlike size(), this does not seek, so it can be called by several threads at once.
+		Call _visible() first if buffered writes may have made the file longer.
+		@return	The size of the file
+	*/
+	inline int64_t ArchiveFile::_length() {trace_scope
+		struct stat	info;
+
+		ErrnoOnNegative(::fstat(descriptor(), &info));
+		return info.st_size;
+	}
+	/**
+		@param buffer	Where to put the data
+		@param size		The number of bytes to read
+		@param offset	Where in the file to read from
+		@return			The number of bytes read, less than size only at the end of the file
+	*/
+	inline size_t ArchiveFile::_readAt(void *buffer, size_t size, int64_t offset) {trace_scope
+		char	*position= reinterpret_cast<char*>(buffer);
+		size_t	amount= 0;
+
+		while(trace_bool(amount < size)) {
+			const ssize_t	result= ::pread(descriptor(), position + amount, size - amount, static_cast<off_t>(offset + amount));
+
+			if(result < 0) {
+				if(EINTR == errno) {
+					continue;
+				}
+				ErrnoCodeThrow(errno, "pread");
+			}
+			if(0 == result) {
+				break;
+			}
+			amount+= static_cast<size_t>(result);
+		}
+		return amount;
+	}
+	/** Merging only looks forward, so disposing a block after a free block leaves two free blocks
+			next to each other until we get here.
+		In a transaction they are left until after it, see Block::merge().
+	*/
+	inline void ArchiveFile::_coalesce() {trace_scope
+		if(_transaction && !_committing) {
+			return;
+		}
+		while(trace_bool(!_unmerged.empty())) {
+			const int64_t	location= *_unmerged.begin();
+
+			_unmerged.erase(_unmerged.begin());
+			if(_freeByLocation.count(location) > 0) {
+				Block(location, *this).merge();
+			}
+		}
 	}
 }
 
@@ -0,0 +1,468 @@
+#ifndef _BlobStore_h_
+#define _BlobStore_h_
+
+#include <os/KeyedArchive.h>
+#include <os/Hash.h>
+#include <os/RWLock.h>
+#include <string>
+#include <string.h>
+
+#ifndef trace_scope
+	#define trace_scope ///< in case Tracer.h is not included
+#endif
+#ifndef trace_bool
+	#define trace_bool(x) (x) ///< in case Tracer.h is not included
+#endif
+
+namespace io {
+	/** A content addressed store of blobs in a KeyedArchive, where each distinct chunk of data is kept once.
+		A blob is named by the SHA-256 of its contents. Storing a blob that is already there just
+			adds a reference to it. A new blob is cut into content defined chunks (see boundary()),
+			so blobs that differ by a few inserted or deleted bytes still share most of their chunks.
+			Each chunk is named by its SHA-256, and a chunk that is already there gets another
+			reference instead of being written again.
+		The index keys are 'b' then the digest for a blob, and 'c' then the digest for a chunk.
+			Each key's value is a record of three big endian 64 bit integers: the number of references,
+			the identifier of the block with the contents, and the size of the contents.
+			A blob's contents are the digests of its chunks, in order.
+		When the last reference to a blob is released, the blob is removed and each of its chunks loses a reference.
+			Chunks left without references are listed for collect(), which disposes those that still have none,
+			so a blob stored again before then gets its old chunks back. The list is a chain of blocks,
+			each holding the identifier of the previous one then the digests. The record of the key "g"
+			has the number of blocks, the newest one and the number of digests. A chunk stays in the index until it is collected.
+		Each store(), release() and collect() is a transaction, or part of the one started with startTransaction().
+			Storing many blobs in one transaction is much quicker, since each commit syncs the file twice.
+		fetch() and references() can be called from any number of threads at once, store(), release()
+			and collect() wait for them.
+	*/
+	class BlobStore : public KeyedArchive {
+		public:
+			/// The name of a blob or chunk, the SHA-256 of its contents
+			typedef hash::SpecificHash<hash::SHA256Hasher>	Digest;
+			/// Open or Create BlobStore at given path
+			BlobStore(const char *path, Protection protection= WriteIfPossible, size_t chunkSize= 8192);
+			/// Open or Create BlobStore at given path
+			BlobStore(const std::string &path, Protection protection= WriteIfPossible, size_t chunkSize= 8192);
+			/// Destructor
+			virtual ~BlobStore();
+			/// Store a blob, or add a reference to it if it is already there
+			Digest store(const void *data, size_t size);
+			/// Store a blob, or add a reference to it if it is already there
+			Digest store(const std::string &data);
+			/// Get the contents of a blob, false if it is not there
+			bool fetch(const Digest &digest, std::string &data);
+			/// The number of references to a blob, 0 if it is not there
+			int64_t references(const Digest &digest);
+			/// Drop a reference to a blob, false if it is not there
+			bool release(const Digest &digest);
+			/// Dispose the chunks no blob uses any more, returns how many were disposed
+			int64_t collect();
+			/// The average size new blobs are cut into, 0 if they are not cut
+			size_t chunkSize() const;
+			/// The size of the first content defined chunk of data
+			static size_t boundary(const void *data, size_t size, size_t chunkSize);
+		private:
+			/// The value of an index key
+			struct _Record {
+				int64_t	references;	///< The number of references to the blob or chunk
+				int64_t	contents;	///< The identifier of the block with the contents
+				int64_t	size;		///< The number of bytes of the blob or chunk
+			};
+			/// The random number each byte adds to the Gear hash in boundary()
+			struct _Gear {
+				uint64_t	entries[256];	///< The number for each byte
+				/// Fills the entries from SplitMix64, so the chunks of a blob are always the same
+				_Gear();
+			};
+			size_t			_chunkSize;	///< The average chunk size
+			exec::RWLock	_lock;		///< Shared to read blobs, held alone to change them
+			/// store() in a transaction
+			void _store(const uint8_t *data, size_t size, const Digest &digest);
+			/// release() in a transaction
+			bool _release(const Digest &digest);
+			/// collect() in a transaction
+			int64_t _collect();
+			/// Add a reference to a chunk, writing it if it is new, and append its digest to a blob's contents
+			void _reference(const uint8_t *chunk, size_t size, std::string &recipe);
+			/// Read the value of an index key, false if the key is not there
+			bool _read(const std::string &key, _Record &record);
+			/// Write the value of an index key
+			void _write(const std::string &key, const _Record &record);
+			/// The index key for a digest
+			static std::string _key(char kind, const void *digest);
+			BlobStore(const BlobStore&); ///< Prevent Usage
+			BlobStore &operator=(const BlobStore&); ///< Prevent Usage
+	};
+
+	/**
+		@param path			The path to the file
+		@param protection	How to open the file
+		@param chunkSize	The average size new blobs are cut into, a power of 2 of at least 64, or 0 to keep each blob whole
+		@throw AssertMessageException if chunkSize is not a power of 2 of at least 64, or 0
+		@throw posix::err::EILSEQ_ErrNo if the file is an ArchiveFile but its first block is not an index root
+	*/
+	inline BlobStore::BlobStore(const char *path, Protection protection, size_t chunkSize)
+		:KeyedArchive(path, protection), _chunkSize(chunkSize), _lock() {trace_scope
+		AssertMessageException( (0 == chunkSize) || ( (chunkSize >= 64) && ((chunkSize & (chunkSize - 1)) == 0) ) );
+	}
+	/**
+		@param path			The path to the file
+		@param protection	How to open the file
+		@param chunkSize	The average size new blobs are cut into, a power of 2 of at least 64, or 0 to keep each blob whole
+		@throw AssertMessageException if chunkSize is not a power of 2 of at least 64, or 0
+		@throw posix::err::EILSEQ_ErrNo if the file is an ArchiveFile but its first block is not an index root
+	*/
+	inline BlobStore::BlobStore(const std::string &path, Protection protection, size_t chunkSize)
+		:KeyedArchive(path, protection), _chunkSize(chunkSize), _lock() {trace_scope
+		AssertMessageException( (0 == chunkSize) || ( (chunkSize >= 64) && ((chunkSize & (chunkSize - 1)) == 0) ) );
+	}
+	inline BlobStore::~BlobStore() {trace_scope
+	}
+	/** The blob is hashed before the store is locked, so fetch() can go on meanwhile.
+		@param data	The contents of the blob
+		@param size	The number of bytes in data
+		@return		The digest to fetch() or release() the blob with
+	*/
+	inline BlobStore::Digest BlobStore::store(const void *data, size_t size) {trace_scope
+		const Digest			digest(data, size);
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Write);
+
+		if(trace_bool(transaction())) {
+			_store(reinterpret_cast<const uint8_t*>(data), size, digest);
+			return digest;
+		}
+		startTransaction();
+		try {
+			_store(reinterpret_cast<const uint8_t*>(data), size, digest);
+			commit();
+		} catch(const std::exception &) {
+			KeyedArchive::rollback();
+			throw;
+		}
+		return digest;
+	}
+	/**
+		@param data	The contents of the blob
+		@return		The digest to fetch() or release() the blob with
+	*/
+	inline BlobStore::Digest BlobStore::store(const std::string &data) {trace_scope
+		return store(data.data(), data.size());
+	}
+	/** The chunks are read in place from the map of the file and appended to data.
+		@param digest	The digest store() returned
+		@param data		Set to the contents of the blob, if it is there
+		@return			true if the blob was found
+		@throw posix::err::EILSEQ_ErrNo if a chunk of the blob is missing or the wrong size
+	*/
+	inline bool BlobStore::fetch(const Digest &digest, std::string &data) {trace_scope
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Read);
+		_Record					blob, chunk;
+		View					recipe, contents;
+
+		if(trace_bool(!_read(_key('b', digest.buffer()), blob))) {
+			return false;
+		}
+		view(blob.contents, recipe);
+		data.clear();
+		data.reserve(static_cast<size_t>(blob.size));
+		for(size_t offset= 0; trace_bool(offset < recipe.contents().size()); offset+= Digest::Size) {
+			if(!_read(_key('c', recipe.contents().data() + offset), chunk)) {
+				ErrnoCodeThrow(EILSEQ, "BlobStore chunk is missing");
+			}
+			view(chunk.contents, contents);
+			data.append(contents.contents().data(), contents.contents().size());
+		}
+		if(static_cast<int64_t>(data.size()) != blob.size) {
+			ErrnoCodeThrow(EILSEQ, "BlobStore blob is the wrong size");
+		}
+		return true;
+	}
+	/**
+		@param digest	The digest store() returned
+		@return			The number of times the blob has been stored and not released
+	*/
+	inline int64_t BlobStore::references(const Digest &digest) {trace_scope
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Read);
+		_Record					blob;
+
+		return _read(_key('b', digest.buffer()), blob) ? blob.references : 0;
+	}
+	/** The chunks of a blob that has no references left are not disposed until collect().
+		@param digest	The digest store() returned
+		@return			true if the blob was there
+	*/
+	inline bool BlobStore::release(const Digest &digest) {trace_scope
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Write);
+		bool					found;
+
+		if(trace_bool(transaction())) {
+			return _release(digest);
+		}
+		startTransaction();
+		try {
+			found= _release(digest);
+			commit();
+		} catch(const std::exception &) {
+			KeyedArchive::rollback();
+			throw;
+		}
+		return found;
+	}
+	/** The space is free for new blocks, ArchiveFile::compact() gives it back to the file system.
+		@return	The number of chunks disposed
+	*/
+	inline int64_t BlobStore::collect() {trace_scope
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Write);
+		int64_t					collected;
+
+		if(trace_bool(transaction())) {
+			return _collect();
+		}
+		startTransaction();
+		try {
+			collected= _collect();
+			commit();
+		} catch(const std::exception &) {
+			KeyedArchive::rollback();
+			throw;
+		}
+		return collected;
+	}
+	inline size_t BlobStore::chunkSize() const {trace_scope
+		return _chunkSize;
+	}
+	/** Gear hashing, as in FastCDC: each byte shifts the hash left one bit and adds a random number for the byte,
+			so the top bits depend on the last 64 bytes. The chunk ends where enough of the top bits are zero:
+			two bits more than chunkSize would need before chunkSize bytes, and two fewer after, so the sizes
+			gather around chunkSize. A chunk is at least a quarter of chunkSize, unless the data ends,
+			and at most 8 times it. Because the cut only depends on the bytes just before it, an edit moves
+			the boundaries near it and the chunks after line up again.
+		@param data			The data to cut
+		@param size			The number of bytes in data
+		@param chunkSize	The average chunk size, a power of 2 of at least 64, or 0 for the whole of data
+		@return				The number of bytes in the first chunk
+	*/
+	inline size_t BlobStore::boundary(const void *data, size_t size, size_t chunkSize) {trace_scope
+		static const _Gear	gear;
+		const uint8_t		*bytes= reinterpret_cast<const uint8_t*>(data);
+		const size_t		minimum= chunkSize / 4;
+		const size_t		middle= size < chunkSize ? size : chunkSize;
+		const size_t		end= size < 8 * chunkSize ? size : 8 * chunkSize;
+		uint64_t			hash= 0, strict, loose;
+		int					bits= 0;
+		size_t				position= minimum;
+
+		if(trace_bool( (0 == chunkSize) || (size <= minimum) )) {
+			return size;
+		}
+		while(trace_bool((static_cast<size_t>(1) << bits) < chunkSize)) {
+			++bits;
+		}
+		strict= ~static_cast<uint64_t>(0) << (64 - (bits + 2));
+		loose= ~static_cast<uint64_t>(0) << (64 - (bits - 2));
+		for(; trace_bool(position < middle); ++position) {
+			hash= (hash << 1) + gear.entries[bytes[position]];
+			if(trace_bool((hash & strict) == 0)) {
+				return position + 1;
+			}
+		}
+		for(; trace_bool(position < end); ++position) {
+			hash= (hash << 1) + gear.entries[bytes[position]];
+			if(trace_bool((hash & loose) == 0)) {
+				return position + 1;
+			}
+		}
+		return end;
+	}
+	inline BlobStore::_Gear::_Gear()
+		:entries() {trace_scope
+		uint64_t	state= 0;
+
+		for(int byte= 0; trace_bool(byte < 256); ++byte) {
+			uint64_t	value= (state+= 0x9E3779B97F4A7C15ULL);
+
+			value= (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			value= (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+			entries[byte]= value ^ (value >> 31);
+		}
+	}
+	/** A blob that is already there gets another reference, without cutting or hashing its chunks.
+		@param data		The contents of the blob
+		@param size		The number of bytes in data
+		@param digest	The digest of data
+	*/
+	inline void BlobStore::_store(const uint8_t *data, size_t size, const Digest &digest) {trace_scope
+		const uint8_t		kFlagsRecipe= 6;
+		const std::string	key= _key('b', digest.buffer());
+		_Record				blob;
+		std::string			recipe;
+
+		if(trace_bool(_read(key, blob))) {
+			++blob.references;
+			_write(key, blob);
+			return;
+		}
+		for(size_t offset= 0; trace_bool(offset < size); ) {
+			const size_t	length= boundary(data + offset, size - offset, _chunkSize);
+
+			_reference(data + offset, length, recipe);
+			offset+= length;
+		}
+		blob.references= 1;
+		blob.contents= allocate(recipe, kFlagsRecipe).identifier();
+		blob.size= static_cast<int64_t>(size);
+		_write(key, blob);
+	}
+	/** Chunks are dereferenced once for each time they are in the blob, as they were referenced.
+		@param digest	The blob to release
+		@return			true if the blob was there
+		@throw posix::err::EILSEQ_ErrNo if a chunk of the blob is missing
+	*/
+	inline bool BlobStore::_release(const Digest &digest) {trace_scope
+		const uint8_t		kFlagsGarbage= 7;
+		const std::string	key= _key('b', digest.buffer());
+		const std::string	garbageKey(1, 'g');
+		_Record				blob, chunk, garbage;
+		std::string			recipe, unreferenced;
+
+		if(trace_bool(!_read(key, blob))) {
+			return false;
+		}
+		if(trace_bool(--blob.references > 0)) {
+			_write(key, blob);
+			return true;
+		}
+		Block	recipeBlock= lookup(blob.contents);
+
+		recipeBlock.read(recipe);
+		recipeBlock.dispose();
+		remove(key);
+		for(size_t offset= 0; trace_bool(offset < recipe.size()); offset+= Digest::Size) {
+			const std::string	chunkKey= _key('c', recipe.data() + offset);
+
+			if(!_read(chunkKey, chunk)) {
+				ErrnoCodeThrow(EILSEQ, "BlobStore chunk is missing");
+			}
+			if(trace_bool(--chunk.references == 0)) {
+				unreferenced.append(recipe, offset, Digest::Size);
+			}
+			_write(chunkKey, chunk);
+		}
+		if(trace_bool(!unreferenced.empty())) {
+			std::string	batch;
+
+			if(trace_bool(!_read(garbageKey, garbage))) {
+				garbage.references= 0;
+				garbage.contents= 0;
+				garbage.size= 0;
+			}
+			_append(batch, garbage.contents, sizeof(int64_t));
+			batch.append(unreferenced);
+			++garbage.references;
+			garbage.contents= allocate(batch, kFlagsGarbage).identifier();
+			garbage.size+= unreferenced.size() / Digest::Size;
+			_write(garbageKey, garbage);
+		}
+		return true;
+	}
+	/** Goes down the chain of garbage blocks from the newest, disposing each listed chunk that still has no references
+			along with its key, then the garbage block.
+		@return	The number of chunks disposed
+		@throw posix::err::EILSEQ_ErrNo if a garbage block is the wrong size
+	*/
+	inline int64_t BlobStore::_collect() {trace_scope
+		const std::string	garbageKey(1, 'g');
+		_Record				garbage, chunk;
+		std::string			batch;
+		int64_t				collected= 0;
+
+		if(trace_bool(!_read(garbageKey, garbage))) {
+			return 0;
+		}
+		for(int64_t identifier= garbage.contents; trace_bool(identifier != 0); ) {
+			Block	block= lookup(identifier);
+
+			block.read(batch);
+			if( (batch.size() < sizeof(int64_t)) || ((batch.size() - sizeof(int64_t)) % Digest::Size != 0) ) {
+				ErrnoCodeThrow(EILSEQ, "BlobStore garbage is corrupt");
+			}
+			for(size_t offset= sizeof(int64_t); trace_bool(offset < batch.size()); offset+= Digest::Size) {
+				const std::string	key= _key('c', batch.data() + offset);
+
+				if(trace_bool(_read(key, chunk)) && trace_bool(0 == chunk.references)) {
+					lookup(chunk.contents).dispose();
+					remove(key);
+					++collected;
+				}
+			}
+			identifier= static_cast<int64_t>(_extract(batch.data(), sizeof(int64_t)));
+			block.dispose();
+		}
+		remove(garbageKey);
+		return collected;
+	}
+	/**
+		@param chunk	The contents of the chunk
+		@param size		The number of bytes in chunk
+		@param recipe	The chunk's digest is appended
+	*/
+	inline void BlobStore::_reference(const uint8_t *chunk, size_t size, std::string &recipe) {trace_scope
+		const uint8_t		kFlagsChunk= 5;
+		const Digest		digest(chunk, size);
+		const std::string	key= _key('c', digest.buffer());
+		_Record				record;
+
+		if(trace_bool(!_read(key, record))) {
+			record.references= 0;
+			record.contents= allocate(std::string(reinterpret_cast<const char*>(chunk), size), kFlagsChunk).identifier();
+			record.size= static_cast<int64_t>(size);
+		}
+		++record.references;
+		_write(key, record);
+		recipe.append(reinterpret_cast<const char*>(digest.buffer()), Digest::Size);
+	}
+	/**
+		@param key		The index key
+		@param record	Set to the value of the key, if it is there
+		@return			true if the key is there
+		@throw posix::err::EILSEQ_ErrNo if the value is not a record
+	*/
+	inline bool BlobStore::_read(const std::string &key, _Record &record) {trace_scope
+		Block	block= find(key);
+		View	contents;
+
+		if(trace_bool(!block)) {
+			return false;
+		}
+		block.view(contents);
+		if(contents.contents().size() != 3 * sizeof(int64_t)) {
+			ErrnoCodeThrow(EILSEQ, "BlobStore record is corrupt");
+		}
+		record.references= static_cast<int64_t>(_extract(contents.contents().data(), sizeof(int64_t)));
+		record.contents= static_cast<int64_t>(_extract(contents.contents().data() + sizeof(int64_t), sizeof(int64_t)));
+		record.size= static_cast<int64_t>(_extract(contents.contents().data() + 2 * sizeof(int64_t), sizeof(int64_t)));
+		return true;
+	}
+	/**
+		@param key		The index key
+		@param record	The new value of the key
+	*/
+	inline void BlobStore::_write(const std::string &key, const _Record &record) {trace_scope
+		std::string	contents;
+
+		_append(contents, record.references, sizeof(int64_t));
+		_append(contents, record.contents, sizeof(int64_t));
+		_append(contents, record.size, sizeof(int64_t));
+		put(key, contents);
+	}
+	/**
+		@param kind		'b' for a blob, 'c' for a chunk
+		@param digest	The Digest::Size bytes of the digest
+		@return			The index key
+	*/
+	inline std::string BlobStore::_key(char kind, const void *digest) {trace_scope
+		return std::string(1, kind).append(reinterpret_cast<const char*>(digest), Digest::Size);
+	}
+}
+
+#endif // _BlobStore_h_
@@ -0,0 +1,270 @@
+#ifndef __ByteOrder_h__
+#define __ByteOrder_h__
+
+/** @file ByteOrder.h
+	Converting integers, and arrays of integers, between byte orders.
+	Single values use the compiler's byte swap builtins, arrays use SSSE3/AVX2 byte shuffles
+		when the CPU has them, and anything left over is swapped one at a time.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#if (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ >= 5 || defined(__clang__))
+	#include <immintrin.h>
+	#include <cpuid.h>
+	#define ByteOrderX86 1 ///< SSSE3 and AVX2 array swaps, used if the CPU has them
+#endif
+
+#ifndef trace_scope
+	#define trace_scope ///< in case Tracer.h is not included
+#endif
+#ifndef trace_bool
+	#define trace_bool(x) (x) ///< in case Tracer.h is not included
+#endif
+
+/// Byte order conversion.
+namespace endian {
+
+	/// Is the machine we are running on big endian.
+	bool nativeIsBigEndian();
+	/// Reverse the bytes in a single integer.
+	template<class Int> Int swap(Int value);
+	/// Copy count integers from source to destination, reversing the bytes of each.
+	template<class Int> void swap(const Int *source, Int *destination, size_t count);
+	/// Reverse the bytes of count integers in place.
+	template<class Int> void swap(Int *values, size_t count);
+	/// Copy count integers, reversing the bytes only if the native byte order is not the requested one.
+	template<class Int> void convert(const Int *source, Int *destination, size_t count, bool bigEndian);
+
+	/** Byte swapping for a specific integer size.
+		@tparam Size	The number of bytes in the integer.
+	*/
+	template<int Size> struct _Swapper {};
+	/// Single bytes have nothing to swap.
+	template<> struct _Swapper<1> {
+		typedef uint8_t	Unsigned; ///< The unsigned integer of this size
+		static Unsigned swap(Unsigned value) {trace_scope return value;} ///< @return value
+	};
+	/// 16-bit swap.
+	template<> struct _Swapper<2> {
+		typedef uint16_t	Unsigned; ///< The unsigned integer of this size
+		/// @return value with the bytes reversed
+		static Unsigned swap(Unsigned value) {trace_scope return static_cast<Unsigned>((value >> 8) | (value << 8));}
+	};
+	/// 32-bit swap.
+	template<> struct _Swapper<4> {
+		typedef uint32_t	Unsigned; ///< The unsigned integer of this size
+		/// @return value with the bytes reversed
+		static Unsigned swap(Unsigned value) {trace_scope
+#if __GNUC__
+			return __builtin_bswap32(value);
+#else
+			return (value >> 24) | ((value >> 8) & 0x0000FF00) | ((value << 8) & 0x00FF0000) | (value << 24);
+#endif
+		}
+	};
+	/// 64-bit swap.
+	template<> struct _Swapper<8> {
+		typedef uint64_t	Unsigned; ///< The unsigned integer of this size
+		/// @return value with the bytes reversed
+		static Unsigned swap(Unsigned value) {trace_scope
+#if __GNUC__
+			return __builtin_bswap64(value);
+#else
+			return (static_cast<Unsigned>(_Swapper<4>::swap(static_cast<uint32_t>(value))) << 32)
+					| _Swapper<4>::swap(static_cast<uint32_t>(value >> 32));
+#endif
+		}
+	};
+
+#if ByteOrderX86
+	/**
+		@return	true if the CPU has the SSSE3 byte shuffle
+	*/
+	inline bool _x86SSSE3() {trace_scope
+		const unsigned int	kSSSE3= 1 << 9; // leaf 1 ecx
+		unsigned int		eax= 0, ebx= 0, ecx= 0, edx= 0;
+
+		__cpuid(1, eax, ebx, ecx, edx);
+		return (ecx & kSSSE3) != 0;
+	}
+	/**
+		@return	true if the CPU has AVX2, and the operating system saves the registers
+	*/
+	inline bool _x86AVX2() {trace_scope
+		const unsigned int	kLeafExtendedFeatures= 7;
+		const unsigned int	kOSXSAVE= 1 << 27, kAVX= 1 << 28;	// leaf 1 ecx
+		const unsigned int	kAVX2= 1 << 5;						// leaf 7 ebx
+		const unsigned int	kYMMState= 6;						// XCR0 SSE and AVX state
+		unsigned int		eax= 0, ebx= 0, ecx= 0, edx= 0;
+
+		if(__get_cpuid_max(0, NULL) < kLeafExtendedFeatures) {
+			return false;
+		}
+		__cpuid(1, eax, ebx, ecx, edx);
+		if( ((ecx & kOSXSAVE) == 0) || ((ecx & kAVX) == 0) ) {
+			return false;
+		}
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		if( (eax & kYMMState) != kYMMState ) {
+			return false;
+		}
+		__cpuid_count(kLeafExtendedFeatures, 0, eax, ebx, ecx, edx);
+		return (ebx & kAVX2) != 0;
+	}
+	/**
+		@param elementSize	The size of each integer, 2, 4 or 8.
+		@return				The shuffle that reverses the bytes of each integer in 16 bytes.
+	*/
+	__attribute__((target("ssse3"))) inline __m128i _swapMask(size_t elementSize) {
+		if(2 == elementSize) {
+			return _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+		}
+		if(4 == elementSize) {
+			return _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+		}
+		return _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+	}
+	/**
+		@param in		The integers to swap.
+		@param out		Where to put the swapped integers.
+		@param bytes	The number of bytes in <code>in</code>.
+		@param mask		From _swapMask().
+		@param done		The number of bytes already swapped.
+		@return			The number of bytes swapped, a multiple of 16.
+	*/
+	__attribute__((target("ssse3"))) inline size_t _swap16(const char *in, char *out, size_t bytes, __m128i mask, size_t done) {
+		for(; trace_bool(done + sizeof(__m128i) <= bytes); done+= sizeof(__m128i)) {
+			const __m128i	value= _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[done]));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&out[done]), _mm_shuffle_epi8(value, mask));
+		}
+		return done;
+	}
+	/** Swaps 16 bytes at a time.
+		@param source		The integers to swap.
+		@param destination	Where to put the swapped integers (may be <code>source</code>).
+		@param bytes		The number of bytes in <code>source</code>.
+		@param elementSize	The size of each integer, 2, 4 or 8.
+		@return				The number of bytes that were swapped.
+	*/
+	__attribute__((target("ssse3"))) inline size_t _swapSSSE3(const void *source, void *destination, size_t bytes, size_t elementSize) {trace_scope
+		return _swap16(reinterpret_cast<const char*>(source), reinterpret_cast<char*>(destination), bytes, _swapMask(elementSize), 0);
+	}
+	/** Swaps 32 bytes at a time, then 16 bytes if there are that many left.
+		@param source		The integers to swap.
+		@param destination	Where to put the swapped integers (may be <code>source</code>).
+		@param bytes		The number of bytes in <code>source</code>.
+		@param elementSize	The size of each integer, 2, 4 or 8.
+		@return				The number of bytes that were swapped.
+	*/
+	__attribute__((target("avx2"))) inline size_t _swapAVX2(const void *source, void *destination, size_t bytes, size_t elementSize) {trace_scope
+		const char		*in= reinterpret_cast<const char*>(source);
+		char			*out= reinterpret_cast<char*>(destination);
+		const __m128i	mask= _swapMask(elementSize);
+		const __m256i	wideMask= _mm256_broadcastsi128_si256(mask);
+		size_t			done= 0;
+
+		for(; trace_bool(done + sizeof(__m256i) <= bytes); done+= sizeof(__m256i)) {
+			const __m256i	value= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&in[done]));
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[done]), _mm256_shuffle_epi8(value, wideMask));
+		}
+		return _swap16(in, out, bytes, mask, done);
+	}
+#endif
+	/** Swaps as many whole 16 (or 32) byte groups as possible with byte shuffles.
+		The shuffles are compiled for SSSE3 and AVX2 whatever the compiler is targeting, and picked
+			the first time through by what the CPU has, so the default build uses them too.
+		@param source		The integers to swap.
+		@param destination	Where to put the swapped integers (may be <code>source</code>).
+		@param bytes		The number of bytes in <code>source</code>.
+		@param elementSize	The size of each integer, 2, 4 or 8.
+		@return				The number of bytes that were swapped, the rest are left to the caller.
+	*/
+	inline size_t _swapVector(const void *source, void *destination, size_t bytes, size_t elementSize) {trace_scope
+#if ByteOrderX86
+		typedef size_t (*Swapper)(const void *source, void *destination, size_t bytes, size_t elementSize);
+		static const Swapper	swapper= _x86AVX2() ? _swapAVX2 : (_x86SSSE3() ? _swapSSSE3 : NULL);
+
+		if( (NULL == swapper) || ((2 != elementSize) && (4 != elementSize) && (8 != elementSize)) ) {
+			return 0;
+		}
+		return swapper(source, destination, bytes, elementSize);
+#else
+		void	*__unused__[]= {&source, &destination, &bytes, &elementSize, &__unused__};
+		return 0;
+#endif
+	}
+
+	/** Determined at runtime, but compilers reduce it to a constant.
+		@return	true if the most significant byte of an integer is stored first on this machine.
+	*/
+	inline bool nativeIsBigEndian() {trace_scope
+		const uint16_t	value= 1;
+
+		return trace_bool(*reinterpret_cast<const uint8_t*>(&value) == 0);
+	}
+	/**
+		@param value	The integer to swap.
+		@return			<code>value</code> with its bytes in the opposite order.
+	*/
+	template<class Int> inline Int swap(Int value) {trace_scope
+		typedef _Swapper<sizeof(Int)>		Swapper;
+		typename Swapper::Unsigned			bits;
+
+		memcpy(&bits, &value, sizeof(bits));
+		bits= Swapper::swap(bits);
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	/** <code>source</code> and <code>destination</code> may be the same array, but may not otherwise overlap.
+		Neither array needs to be aligned.
+		@param source		The integers to swap.
+		@param destination	Receives <code>count</code> swapped integers.
+		@param count		The number of integers (not bytes) in <code>source</code>.
+	*/
+	template<class Int> inline void swap(const Int *source, Int *destination, size_t count) {trace_scope
+		const char	*in= reinterpret_cast<const char*>(source);
+		char		*out= reinterpret_cast<char*>(destination);
+		size_t		index;
+
+		if(sizeof(Int) == 1) {
+			memmove(destination, source, count);
+			return;
+		}
+		index= _swapVector(source, destination, count * sizeof(Int), sizeof(Int)) / sizeof(Int);
+		for(; trace_bool(index < count); ++index) {
+			Int	value;
+
+			memcpy(&value, &in[index * sizeof(Int)], sizeof(value));
+			value= swap(value);
+			memcpy(&out[index * sizeof(Int)], &value, sizeof(value));
+		}
+	}
+	/**
+		@param values	The integers to swap.
+		@param count	The number of integers (not bytes) in <code>values</code>.
+	*/
+	template<class Int> inline void swap(Int *values, size_t count) {trace_scope
+		swap(const_cast<const Int*>(values), values, count);
+	}
+	/** When the native byte order matches, this is just a memmove.
+		@param source		The integers to copy.
+		@param destination	Receives <code>count</code> integers in the requested byte order.
+		@param count		The number of integers (not bytes) in <code>source</code>.
+		@param bigEndian	true if <code>destination</code> should be (or <code>source</code> is) big endian.
+	*/
+	template<class Int> inline void convert(const Int *source, Int *destination, size_t count, bool bigEndian) {trace_scope
+		if(trace_bool(nativeIsBigEndian() == bigEndian)) {
+			if(source != destination) {
+				memmove(destination, source, count * sizeof(Int));
+			}
+		} else {
+			swap(source, destination, count);
+		}
+	}
+}
+
+#endif // __ByteOrder_h__
@@ -3,7 +3,12 @@
 
 #include "Exception.h"
 #include "POSIXErrno.h"
+#include "ByteOrder.h"
 #include <string>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #ifndef trace_scope
 	#define trace_scope ///< in case Tracer.h is not included
@@ -36,13 +41,29 @@ namespace io {
 			enum Protection	{ReadOnly, ReadWrite, WriteIfPossible};
 			enum Relative	{FromHere, FromStart, FromEnd};
 			enum Endian		{BigEndian, LittleEndian, NativeEndian};
+			/// How far flush() pushes written data, from cheapest to most durable.
+			enum Durability	{
+				NoSync,			///< flush() does nothing, data stays in our buffers until a stronger flush or close
+				FlushToKernel,	///< Buffers are handed to the kernel, survives a process crash (the default)
+				SyncData,		///< Data (and the size) is on the disk, fdatasync (or a write barrier on Mac OS X)
+				SyncAll			///< Data and all metadata are on the disk, fsync (F_FULLFSYNC on Mac OS X)
+			};
 			File(const char *path, Method method, Protection protection);
 			File(const std::string &path, Method method, Protection protection);
 			virtual ~File();
 			off_t size() const;
+			off_t allocatedSize() const;
+			bool reserve(off_t bytes);
+			bool punchHole(off_t offset, off_t length);
 			void flush();
+			void flush(Durability durability);
+			Durability durability() const;
+			Durability durability(Durability newDurability);
+			bool cached() const;
+			bool cached(bool useCache);
 			off_t location() const;
 			bool writable() const;
+			int descriptor() const;
 			void moveto(off_t offset, Relative relative= FromStart) const;
 			void move(off_t offset, Relative relative= FromHere) const;
 			void read(void *buffer, size_t bufferSize, off_t offset= 0, Relative relative= FromHere) const;
@@ -51,10 +72,14 @@ namespace io {
 			void write(const std::string &buffer, off_t offset= 0, Relative relative= FromHere);
 			template<class Int> Int read(Endian endian, off_t offset= 0, Relative relative= FromHere) const;
 			template<class Int> void write(Int number, Endian endian, off_t offset= 0, Relative relative= FromHere);
+			template<class Int> void read(Int *numbers, size_t count, Endian endian, off_t offset= 0, Relative relative= FromHere) const;
+			template<class Int> void write(const Int *numbers, size_t count, Endian endian, off_t offset= 0, Relative relative= FromHere);
 			std::string &readline(std::string &buffer, off_t offset= 0, Relative relative= FromHere, size_t bufferSize= 4096) const;
 		private:
-			FILE	*_file;
-			bool	_readOnly;
+			FILE		*_file;
+			bool		_readOnly;
+			Durability	_durability;
+			bool		_cached;
 			static int _whence(Relative relative);
 			void _goto(off_t offset, Relative relative) const;
 			static Endian _actualEndian(Endian endian);
@@ -78,7 +103,7 @@ namespace io {
 		@todo Test!
 	*/
 	inline File::File(const char *path, Method method, Protection protection)
-		:_file(NULL), _readOnly(ReadOnly == protection) {trace_scope
+		:_file(NULL), _readOnly(ReadOnly == protection), _durability(FlushToKernel), _cached(true) {trace_scope
 		_file= _open(path, method, protection, _readOnly);
 		moveto(0);
 	}
@@ -86,7 +111,7 @@ namespace io {
 		@todo Test!
 	*/
 	inline File::File(const std::string &path, Method method, Protection protection)
-		:_file(NULL), _readOnly(ReadOnly == protection) {trace_scope
+		:_file(NULL), _readOnly(ReadOnly == protection), _durability(FlushToKernel), _cached(true) {trace_scope
 		_file= _open(path.c_str(), method, protection, _readOnly);
 		moveto(0);
 	}
@@ -108,11 +133,189 @@ namespace io {
 		moveto(here, FromStart);
 		return end;
 	}
-	/**
-		@todo Test!
+	/** The physical size, as opposed to size() which is the logical size.
+			Sparse files are smaller than size(), preallocated files may be bigger.
+		@return	The number of bytes of storage the file is using.
+	*/
+	inline off_t File::allocatedSize() const {trace_scope
+		const off_t	kStatBlockSize= 512;
+		struct stat	info;
+
+		ErrnoOnNegative(fflush(_file));
+		ErrnoOnNegative(fstat(fileno(_file), &info));
+		return kStatBlockSize * static_cast<off_t>(info.st_blocks);
+	}
+	/** Allocates storage for the file up front, without changing size(), so that appending
+			does not have to find space one write at a time.
+		Where there is only posix_fallocate(), which cannot allocate past size() without changing it,
+			just the storage below size() is filled in (the holes of a sparse file).
+		@param bytes	The number of bytes from the start of the file that should have storage.
+		@return			false if the file system does not support preallocation,
+							or bytes is past size() and only posix_fallocate() is available.
+	*/
+	inline bool File::reserve(off_t bytes) {trace_scope
+		const int	descriptor= fileno(_file);
+
+		AssertMessageException(!_readOnly);
+		ErrnoOnNegative(fflush(_file));
+#if defined(FALLOC_FL_KEEP_SIZE)
+		if(fallocate(descriptor, FALLOC_FL_KEEP_SIZE, 0, bytes) == 0) {
+			return true;
+		}
+		if( (EOPNOTSUPP != errno) && (ENOSYS != errno) ) {
+			ErrnoMessageThrow("fallocate");
+		}
+#elif defined(F_PREALLOCATE)
+		const off_t	needed= bytes - allocatedSize();
+		fstore_t	store= {F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, needed, 0};
+
+		if(needed <= 0) {
+			return true;
+		}
+		if(fcntl(descriptor, F_PREALLOCATE, &store) < 0) { // contiguous is only a preference
+			store.fst_flags= F_ALLOCATEALL;
+			if(fcntl(descriptor, F_PREALLOCATE, &store) < 0) {
+				if(ENOTSUP == errno) {
+					return false;
+				}
+				ErrnoMessageThrow("F_PREALLOCATE");
+			}
+		}
+		return true;
+#endif
+#if !defined(F_PREALLOCATE) && defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+		const off_t	logical= size();
+		const off_t	inside= (bytes < logical) ? bytes : logical;
+		const int	result= (inside > 0) ? posix_fallocate(descriptor, 0, inside) : 0;
+
+		if( (0 != result) && (EOPNOTSUPP != result) && (EINVAL != result) ) {
+			ErrnoCodeThrow(result, "posix_fallocate");
+		}
+		return trace_bool( (0 == result) && (bytes <= inside) );
+#elif !defined(F_PREALLOCATE)
+		void	*__unused__[]= {&descriptor, &bytes, &__unused__};
+
+		return false;
+#endif
+	}
+	/** Releases the storage behind a region of the file, which then reads back as zeros.
+		size() is not changed. The region may be rounded inward to the file system block size.
+		@param offset	The start of the region.
+		@param length	The number of bytes in the region.
+		@return			false if the file system does not support sparse files.
+	*/
+	inline bool File::punchHole(off_t offset, off_t length) {trace_scope
+		const int	descriptor= fileno(_file);
+
+		AssertMessageException(!_readOnly);
+		ErrnoOnNegative(fflush(_file));
+#if defined(FALLOC_FL_PUNCH_HOLE)
+		if(fallocate(descriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0) {
+			return true;
+		}
+		if( (EOPNOTSUPP == errno) || (ENOSYS == errno) ) {
+			return false;
+		}
+		ErrnoMessageThrow("fallocate");
+#elif defined(F_PUNCHHOLE)
+		struct stat		info;
+		fpunchhole_t	hole;
+
+		ErrnoOnNegative(fstat(descriptor, &info));
+		memset(&hole, 0, sizeof(hole));
+		hole.fp_offset= (offset + info.st_blksize - 1) / info.st_blksize * info.st_blksize;
+		hole.fp_length= (offset + length) / info.st_blksize * info.st_blksize - hole.fp_offset;
+		if(hole.fp_length <= 0) {
+			return true;
+		}
+		if(fcntl(descriptor, F_PUNCHHOLE, &hole) == 0) {
+			return true;
+		}
+		if(ENOTSUP == errno) {
+			return false;
+		}
+		ErrnoMessageThrow("F_PUNCHHOLE");
+#else
+		void	*__unused__[]= {&descriptor, &offset, &length, &__unused__};
+#endif
+		return false;
+	}
+	/** Flushes to the level set with durability(), which defaults to FlushToKernel.
 	*/
 	inline void File::flush() {trace_scope
+		flush(_durability);
+	}
+	/** Lets callers pay for durability only when they need it, for instance setting durability(NoSync)
+			so that the per-operation flush() calls are free, and then calling flush(SyncData) once for
+			a whole group of changes.
+		@param durability	How far to push the data written so far.
+	*/
+	inline void File::flush(Durability durability) {trace_scope
+		const int	descriptor= fileno(_file);
+
+		if(NoSync == durability) {
+			return;
+		}
 		ErrnoOnNegative(fflush(_file));
+		if(SyncData == durability) {
+#if defined(F_BARRIERFSYNC)
+			ErrnoOnNegative(fcntl(descriptor, F_BARRIERFSYNC));
+#elif __APPLE_CC__ || __APPLE__
+			ErrnoOnNegative(fsync(descriptor));
+#else
+			ErrnoOnNegative(fdatasync(descriptor));
+#endif
+		} else if(SyncAll == durability) {
+#if defined(F_FULLFSYNC)
+			if(fcntl(descriptor, F_FULLFSYNC) < 0) { // not all file systems support it
+				ErrnoOnNegative(fsync(descriptor));
+			}
+#else
+			ErrnoOnNegative(fsync(descriptor));
+#endif
+		}
+#if defined(POSIX_FADV_DONTNEED)
+		if(!_cached && (SyncData <= durability)) {
+			(void)posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+		}
+#endif
+	}
+	/**
+		@return	The level flush() uses.
+	*/
+	inline File::Durability File::durability() const {trace_scope
+		return _durability;
+	}
+	/**
+		@param newDurability	The level flush() (and therefore ArchiveFile's per-operation flushes) should use.
+		@return					The previous level.
+	*/
+	inline File::Durability File::durability(Durability newDurability) {trace_scope
+		const Durability	oldDurability= _durability;
+
+		_durability= newDurability;
+		return oldDurability;
+	}
+	/**
+		@return	false if we have asked the system not to keep this file's data cached.
+	*/
+	inline bool File::cached() const {trace_scope
+		return trace_bool(_cached);
+	}
+	/** Bypassing the cache keeps large write-once files from pushing everything else out of it.
+		On Mac OS X this is F_NOCACHE. Elsewhere stdio buffering cannot meet O_DIRECT's alignment rules,
+			so the pages are dropped from the cache after each SyncData or SyncAll flush() instead.
+		@param useCache	false to bypass the system cache.
+		@return			The previous setting.
+	*/
+	inline bool File::cached(bool useCache) {trace_scope
+		const bool	wasCached= _cached;
+
+#if defined(F_NOCACHE)
+		ErrnoOnNegative(fcntl(fileno(_file), F_NOCACHE, useCache ? 0 : 1));
+#endif
+		_cached= useCache;
+		return wasCached;
 	}
 	/**
 		@todo Test!
@@ -129,6 +332,14 @@ namespace io {
 	inline bool File::writable() const {trace_scope
 		return trace_bool(!_readOnly);
 	}
+	/** For handing the file to system calls that File does not wrap.
+			Call flush() first if there are buffered writes, and moveto() afterwards
+			if the call changed the file or its position.
+		@return	The file descriptor of the open file.
+	*/
+	inline int File::descriptor() const {trace_scope
+		return fileno(_file);
+	}
 	inline void File::moveto(off_t offset, Relative relative) const {trace_scope
 		ErrnoOnNegative(fseeko(_file, offset, _whence(relative)));
 	}
@@ -181,50 +392,53 @@ namespace io {
 		@todo Test!
 	*/
 	template<class Int> inline Int File::read(Endian endian, off_t offset, Relative relative) const {trace_scope
-		uint8_t	buffer[sizeof(Int)];
-		Int		value= 0;
-
-		read(buffer, sizeof(buffer), offset, relative);
-		endian= _actualEndian(endian);
-		for(unsigned int byte= 0; trace_bool(byte < sizeof(buffer)); ++byte) {
-			Int	byteAsInt(buffer[byte]);
-			int	shiftAmount;
-
-			if(BigEndian == endian) {
-				shiftAmount= 8 * (sizeof(buffer) - byte - 1);
-			} else {
-				shiftAmount= 8 * byte;
-			}
-			if(shiftAmount != 0) {
-				value |= ( byteAsInt << shiftAmount );
-			} else {
-				value |= byteAsInt;
-			}
-		}
+		Int		value;
+
+		read(&value, 1, endian, offset, relative);
 		return value;
 	}
 	/**
 		@todo Test!
 	*/
 	template<class Int> inline void File::write(Int number, Endian endian, off_t offset, Relative relative) {trace_scope
-		uint8_t	buffer[sizeof(Int)];
-
-		endian= _actualEndian(endian);
-		for(unsigned int byte= 0; trace_bool(byte < sizeof(buffer)); ++byte) {
-			int	shiftAmount;
+		write(&number, 1, endian, offset, relative);
+	}
+	/** Reads an array of integers with a single read and converts them in place.
+		@param numbers	Receives <code>count</code> integers.
+		@param count	The number of integers (not bytes) to read.
+		@param endian	The byte order the integers are stored in, in the file.
+		@param offset	See moveto().
+		@param relative	See moveto().
+	*/
+	template<class Int> inline void File::read(Int *numbers, size_t count, Endian endian, off_t offset, Relative relative) const {trace_scope
+		read(reinterpret_cast<void*>(numbers), count * sizeof(Int), offset, relative);
+		endian::convert(numbers, numbers, count, BigEndian == _actualEndian(endian));
+	}
+	/** If the byte order matches the native byte order, <code>numbers</code> is written directly,
+			otherwise the integers are converted in chunks and each chunk is written with a single write.
+		@param numbers	The integers to write.
+		@param count	The number of integers (not bytes) to write.
+		@param endian	The byte order to store the integers in, in the file.
+		@param offset	See moveto().
+		@param relative	See moveto().
+	*/
+	template<class Int> inline void File::write(const Int *numbers, size_t count, Endian endian, off_t offset, Relative relative) {trace_scope
+		const size_t	kChunkCount= 4096 / sizeof(Int);
+		Int				chunk[kChunkCount];
 
-			if(BigEndian == endian) {
-				shiftAmount= 8 * (sizeof(buffer) - byte - 1);
-			} else {
-				shiftAmount= 8 * byte;
-			}
-			if(shiftAmount != 0) {
-				buffer[byte]= 0xFF & ( number >> shiftAmount );
-			} else {
-				buffer[byte]= 0xFF & number;
-			}
+		if(endian::nativeIsBigEndian() == (BigEndian == _actualEndian(endian))) {
+			write(reinterpret_cast<const void*>(numbers), count * sizeof(Int), offset, relative);
+			return;
 		}
-		write(buffer, sizeof(buffer), offset, relative);
+		_goto(offset, relative);
+		do	{
+			const size_t	amount= count < kChunkCount ? count : kChunkCount;
+
+			endian::swap(numbers, chunk, amount);
+			write(reinterpret_cast<const void*>(chunk), amount * sizeof(Int));
+			numbers+= amount;
+			count-= amount;
+		} while(count > 0);
 	}
 	/**
 		@todo improve performance by resizing buffer and using read(void*) to read directly into appending buffer
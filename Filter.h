@@ -0,0 +1,542 @@
+#ifndef __Filter_h__
+#define __Filter_h__
+
+/** @file Filter.h
+	Filters that say quickly, and in a few bits per key, that a key is not in a set.
+*/
+
+#include "Hash.h"
+#include "File.h"
+#include "ReferencedString.h"
+#include "Exception.h"
+#include "POSIXErrno.h"
+#include <string>
+#include <vector>
+#include <string.h>
+
+#ifndef trace_scope
+	#define trace_scope ///< in case Tracer.h is not included
+#endif
+#ifndef trace_bool
+	#define trace_bool(x) (x) ///< in case Tracer.h is not included
+#endif
+
+/// Signature of the image of a BloomFilter
+#define hash_BloomFilter_Signature "\x89""BF\x0D\x0A\x1A\x0A"
+/// Signature of the image of a CuckooFilter
+#define hash_CuckooFilter_Signature "\x89""CF\x0D\x0A\x1A\x0A"
+
+namespace hash {
+	/** The table of a BloomFilter or CuckooFilter, in memory of its own or used in place in someone else's,
+			like a memory map of a file or an ArchiveFile::View.
+		The image of a filter is a 64 byte header, the signature of the kind of filter then the number of bytes
+			in the table and the number of keys as big endian 64 bit integers, then the table.
+			The table is read and written a byte at a time, so the image is the same on any CPU,
+			and it starts on a cache line when the image does.
+	*/
+	class Filter {
+		public:
+			/// Nothing to do in destructor.
+			virtual ~Filter();
+			/// The number of keys in the filter
+			int64_t size() const;
+			/// The number of bytes in the table
+			size_t bytes() const;
+			/// Can keys be added, false if the table is in someone else's memory
+			bool writable() const;
+			/// The image of the filter, to keep in a file or a block
+			std::string &image(std::string &buffer) const;
+			/// Write the image of the filter to a file
+			void write(io::File &file, off_t offset= 0) const;
+		protected:
+			/// An empty table
+			Filter(const char *signature, size_t bytes);
+			/// Read the image of a filter from a file
+			Filter(const char *signature, const io::File &file, off_t offset);
+			/// Use the image of a filter in place
+			Filter(const char *signature, const ReferencedString &image);
+			const uint8_t	*_table;	///< The table
+			uint8_t			*_writable;	///< The table, or NULL if it is in someone else's memory
+			size_t			_bytes;		///< The number of bytes in the table
+			int64_t			_count;		///< The number of keys in the filter
+		private:
+			const char		*_signature;	///< What kind of filter this is
+			std::string		_storage;		///< Holds the table, from a cache line boundary, if it is ours
+			/// Check the header of an image and get the size of the table and number of keys from it
+			size_t _header(const char *header, size_t size);
+			/// Set aside memory for the table
+			void _allocate();
+			Filter(const Filter&); ///< Prevent Usage
+			Filter &operator=(const Filter&); ///< Prevent Usage
+	};
+
+	/** A Bloom filter where each key sets one bit in each of the eight 64 bit words of one 64 byte block,
+			so adding or looking up a key touches one cache line (a split block Bloom filter).
+			The XXH3 hash of the key picks the block with its high half, and the low half times a different
+			odd constant for each word picks the bit in the word.
+		Keys are never missed. The rate of false positives is about 2% at 8 bits a key, 0.5% at 12 and 0.15% at 16.
+		contains() can be called from any number of threads at once, but not while a key is added.
+	*/
+	class BloomFilter : public Filter {
+		public:
+			/// An empty filter for a number of keys
+			BloomFilter(size_t keys, int bitsPerKey= 12);
+			/// Read a filter written with write()
+			BloomFilter(const io::File &file, off_t offset= 0);
+			/// Use the image() of a filter in place, it must stay there as long as the filter
+			BloomFilter(const ReferencedString &image);
+			/// Nothing to do in destructor.
+			virtual ~BloomFilter();
+			/// Add a key
+			void add(const ReferencedString &key);
+			/// Might the key have been added, false if it certainly was not
+			bool contains(const ReferencedString &key) const;
+			/// The number of 64 byte blocks
+			size_t blocks() const;
+		private:
+			/// The block for a hash
+			size_t _block(uint64_t hash) const;
+			/// The odd constant for each word of a block
+			static const uint32_t *_salts();
+			BloomFilter(const BloomFilter&); ///< Prevent Usage
+			BloomFilter &operator=(const BloomFilter&); ///< Prevent Usage
+	};
+
+	/** A cuckoo filter of 16 bit fingerprints, four to a bucket, which can have keys removed.
+		The XXH3 hash of a key gives its fingerprint (the top 16 bits, 0 meaning an empty slot) and its first bucket
+			(the low bits). Its other bucket is the first exclusive-ored with a hash of the fingerprint,
+			so a fingerprint can be moved to its other bucket without the key. Adding a key to two full buckets
+			moves fingerprints to their other buckets to make room, and gives up after 500 moves,
+			putting them back, when the filter is about 95% full.
+		Keys are never missed. The rate of false positives is about 0.012%, at about 17 bits a key when nearly full.
+		Only remove keys that were added, or another key with the same fingerprint and buckets may be removed instead.
+		contains() can be called from any number of threads at once, but not while keys are added or removed.
+	*/
+	class CuckooFilter : public Filter {
+		public:
+			/// An empty filter for a number of keys
+			CuckooFilter(size_t keys);
+			/// Read a filter written with write()
+			CuckooFilter(const io::File &file, off_t offset= 0);
+			/// Use the image() of a filter in place, it must stay there as long as the filter
+			CuckooFilter(const ReferencedString &image);
+			/// Nothing to do in destructor.
+			virtual ~CuckooFilter();
+			/// Add a key, false if the filter is too full (and the filter is unchanged)
+			bool add(const ReferencedString &key);
+			/// Might the key have been added, false if it certainly was not
+			bool contains(const ReferencedString &key) const;
+			/// Remove a key that was added, false if it is not there
+			bool remove(const ReferencedString &key);
+			/// The number of 8 byte buckets, a power of 2
+			size_t buckets() const;
+		private:
+			uint32_t	_random;	///< Picks the fingerprint to move out of a full bucket
+			/// The number of buckets for a number of keys
+			static size_t _buckets(size_t keys);
+			/// The fingerprint and first bucket of a key
+			void _locate(const ReferencedString &key, uint16_t &fingerprint, size_t &bucket) const;
+			/// The other bucket for a fingerprint
+			size_t _alternate(size_t bucket, uint16_t fingerprint) const;
+			/// The slot in a bucket holding a fingerprint, -1 if none do
+			int _find(size_t bucket, uint16_t fingerprint) const;
+			/// The fingerprint in a slot
+			uint16_t _get(size_t bucket, int slot) const;
+			/// Set the fingerprint in a slot
+			void _set(size_t bucket, int slot, uint16_t fingerprint);
+			CuckooFilter(const CuckooFilter&); ///< Prevent Usage
+			CuckooFilter &operator=(const CuckooFilter&); ///< Prevent Usage
+	};
+
+	/**
+		@param signature	What kind of filter this is
+		@param bytes		The number of bytes in the table
+	*/
+	inline Filter::Filter(const char *signature, size_t bytes)
+		:_table(NULL), _writable(NULL), _bytes(bytes), _count(0), _signature(signature), _storage() {trace_scope
+		_allocate();
+	}
+	/**
+		@param signature	What kind of filter this is
+		@param file			The file the image was written to
+		@param offset		Where in the file the image starts
+		@throw posix::err::EILSEQ_Errno if the image is not of this kind of filter
+	*/
+	inline Filter::Filter(const char *signature, const io::File &file, off_t offset)
+		:_table(NULL), _writable(NULL), _bytes(0), _count(0), _signature(signature), _storage() {trace_scope
+		const size_t	kHeaderSize= 64;
+		char			header[kHeaderSize];
+
+		file.read(header, sizeof(header), offset, io::File::FromStart);
+		_bytes= _header(header, static_cast<size_t>(-1));
+		_allocate();
+		file.read(_writable, _bytes, offset + static_cast<off_t>(kHeaderSize), io::File::FromStart);
+	}
+	/**
+		@param signature	What kind of filter this is
+		@param image		The image of the filter, which must stay there as long as the filter
+		@throw posix::err::EILSEQ_Errno if the image is not of this kind of filter
+	*/
+	inline Filter::Filter(const char *signature, const ReferencedString &image)
+		:_table(NULL), _writable(NULL), _bytes(0), _count(0), _signature(signature), _storage() {trace_scope
+		const size_t	kHeaderSize= 64;
+
+		_bytes= _header(image.data(), image.size());
+		_table= reinterpret_cast<const uint8_t*>(image.data()) + kHeaderSize;
+	}
+	inline Filter::~Filter() {trace_scope
+	}
+	inline int64_t Filter::size() const {trace_scope
+		return _count;
+	}
+	inline size_t Filter::bytes() const {trace_scope
+		return _bytes;
+	}
+	inline bool Filter::writable() const {trace_scope
+		return NULL != _writable;
+	}
+	/**
+		@param buffer	Set to the header and the table
+		@return			buffer
+	*/
+	inline std::string &Filter::image(std::string &buffer) const {trace_scope
+		const size_t	kHeaderSize= 64;
+		const size_t	kSignatureSize= 8;
+		uint8_t			header[kHeaderSize];
+
+		memset(header, 0, sizeof(header));
+		memcpy(header, _signature, kSignatureSize);
+		_storeBigEndian(static_cast<uint64_t>(_bytes), sizeof(uint64_t), header + kSignatureSize);
+		_storeBigEndian(static_cast<uint64_t>(_count), sizeof(uint64_t), header + kSignatureSize + sizeof(uint64_t));
+		buffer.assign(reinterpret_cast<const char*>(header), sizeof(header));
+		buffer.append(reinterpret_cast<const char*>(_table), _bytes);
+		return buffer;
+	}
+	/**
+		@param file		The file to write to
+		@param offset	Where in the file to write the image, a multiple of 64 keeps the table on cache lines when the file is mapped
+	*/
+	inline void Filter::write(io::File &file, off_t offset) const {trace_scope
+		std::string	buffer;
+
+		file.write(image(buffer), offset, io::File::FromStart);
+	}
+	/**
+		@param header	The start of the image
+		@param size		The number of bytes in the image, or -1 if the table has not been read yet
+		@return			The number of bytes in the table
+		@throw posix::err::EILSEQ_Errno if the signature is not this kind of filter or the image is the wrong size
+	*/
+	inline size_t Filter::_header(const char *header, size_t size) {trace_scope
+		const size_t	kHeaderSize= 64;
+		const size_t	kSignatureSize= 8;
+		uint64_t		bytes= 0, count= 0;
+
+		if( (size < kHeaderSize) || (memcmp(header, _signature, kSignatureSize) != 0) ) {
+			ErrnoCodeThrow(EILSEQ, "Filter image is the wrong kind");
+		}
+		for(size_t byte= 0; trace_bool(byte < sizeof(uint64_t)); ++byte) {
+			bytes= (bytes << 8) | static_cast<uint8_t>(header[kSignatureSize + byte]);
+			count= (count << 8) | static_cast<uint8_t>(header[kSignatureSize + sizeof(uint64_t) + byte]);
+		}
+		if( (bytes == 0) || (bytes % 8 != 0) || (bytes > static_cast<uint64_t>(-1) / 2)
+				|| ( (size != static_cast<size_t>(-1)) && (bytes != size - kHeaderSize) ) ) {
+			ErrnoCodeThrow(EILSEQ, "Filter image is the wrong size");
+		}
+		_count= static_cast<int64_t>(count);
+		return static_cast<size_t>(bytes);
+	}
+	/** The table starts on a cache line, so a block of a BloomFilter is one line.
+	*/
+	inline void Filter::_allocate() {trace_scope
+		const size_t	kLineSize= 64;
+
+		_storage.assign(_bytes + kLineSize, '\0');
+		_writable= reinterpret_cast<uint8_t*>(&_storage[0]);
+		_writable+= (kLineSize - reinterpret_cast<size_t>(_writable) % kLineSize) % kLineSize;
+		_table= _writable;
+	}
+	/**
+		@param keys			The number of keys the filter is for
+		@param bitsPerKey	The number of bits of table for each key, more for fewer false positives
+	*/
+	inline BloomFilter::BloomFilter(size_t keys, int bitsPerKey)
+		:Filter(hash_BloomFilter_Signature, 64 * ((keys * static_cast<size_t>(bitsPerKey > 0 ? bitsPerKey : 1) + 511) / 512 + (keys == 0 ? 1 : 0))) {trace_scope
+	}
+	/**
+		@param file		The file the filter was written to
+		@param offset	Where in the file write() put it
+		@throw posix::err::EILSEQ_Errno if the image is not a BloomFilter
+	*/
+	inline BloomFilter::BloomFilter(const io::File &file, off_t offset)
+		:Filter(hash_BloomFilter_Signature, file, offset) {trace_scope
+		if(bytes() % 64 != 0) {
+			ErrnoCodeThrow(EILSEQ, "BloomFilter image is the wrong size");
+		}
+	}
+	/**
+		@param image	The image() of a filter, which must stay there as long as the filter
+		@throw posix::err::EILSEQ_Errno if the image is not a BloomFilter
+	*/
+	inline BloomFilter::BloomFilter(const ReferencedString &image)
+		:Filter(hash_BloomFilter_Signature, image) {trace_scope
+		if(bytes() % 64 != 0) {
+			ErrnoCodeThrow(EILSEQ, "BloomFilter image is the wrong size");
+		}
+	}
+	inline BloomFilter::~BloomFilter() {trace_scope
+	}
+	/**
+		@param key	The key to add
+		@throw AssertMessageException if the filter is not writable()
+	*/
+	inline void BloomFilter::add(const ReferencedString &key) {trace_scope
+		const uint64_t	hash= XXH3Hasher::value(key.data(), key.size());
+		const uint32_t	*salts= _salts();
+
+		AssertMessageException(writable());
+		uint8_t			*block= _writable + 64 * _block(hash);
+
+		for(int word= 0; trace_bool(word < 8); ++word) {
+			const uint32_t	bit= (static_cast<uint32_t>(hash) * salts[word]) >> 26;
+
+			block[8 * word + (bit >> 3)]|= static_cast<uint8_t>(1 << (bit & 7));
+		}
+		++_count;
+	}
+	/**
+		@param key	The key to look for
+		@return		false if the key was not added, true if it probably was
+	*/
+	inline bool BloomFilter::contains(const ReferencedString &key) const {trace_scope
+		const uint64_t	hash= XXH3Hasher::value(key.data(), key.size());
+		const uint32_t	*salts= _salts();
+		const uint8_t	*block= _table + 64 * _block(hash);
+		int				missing= 0;
+
+		for(int word= 0; trace_bool(word < 8); ++word) {
+			const uint32_t	bit= (static_cast<uint32_t>(hash) * salts[word]) >> 26;
+
+			missing|= ~block[8 * word + (bit >> 3)] & (1 << (bit & 7));
+		}
+		return 0 == missing;
+	}
+	inline size_t BloomFilter::blocks() const {trace_scope
+		return bytes() / 64;
+	}
+	/** The high half of the hash times the number of blocks, divided by 2^32, is spread evenly over the blocks without a division.
+		@param hash	The hash of a key
+		@return		The block for the key
+	*/
+	inline size_t BloomFilter::_block(uint64_t hash) const {trace_scope
+		return static_cast<size_t>(((hash >> 32) * static_cast<uint64_t>(bytes() / 64)) >> 32);
+	}
+	/**
+		@return	Eight odd constants, one for each word of a block
+	*/
+	inline const uint32_t *BloomFilter::_salts() {trace_scope
+		static const uint32_t	kSalts[8]= {
+			0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+		};
+
+		return kSalts;
+	}
+	/**
+		@param keys	The number of keys the filter is for
+	*/
+	inline CuckooFilter::CuckooFilter(size_t keys)
+		:Filter(hash_CuckooFilter_Signature, 8 * _buckets(keys)), _random(1) {trace_scope
+	}
+	/**
+		@param file		The file the filter was written to
+		@param offset	Where in the file write() put it
+		@throw posix::err::EILSEQ_Errno if the image is not a CuckooFilter
+	*/
+	inline CuckooFilter::CuckooFilter(const io::File &file, off_t offset)
+		:Filter(hash_CuckooFilter_Signature, file, offset), _random(1) {trace_scope
+		if((buckets() & (buckets() - 1)) != 0) {
+			ErrnoCodeThrow(EILSEQ, "CuckooFilter image is the wrong size");
+		}
+	}
+	/**
+		@param image	The image() of a filter, which must stay there as long as the filter
+		@throw posix::err::EILSEQ_Errno if the image is not a CuckooFilter
+	*/
+	inline CuckooFilter::CuckooFilter(const ReferencedString &image)
+		:Filter(hash_CuckooFilter_Signature, image), _random(1) {trace_scope
+		if((buckets() & (buckets() - 1)) != 0) {
+			ErrnoCodeThrow(EILSEQ, "CuckooFilter image is the wrong size");
+		}
+	}
+	inline CuckooFilter::~CuckooFilter() {trace_scope
+	}
+	/** When both buckets are full, a random fingerprint in one of them is swapped for the one being added,
+			and moved to its other bucket, until one has room. The moves are undone if there are too many.
+		@param key	The key to add
+		@return		true if the key was added, false if the filter is too full
+		@throw AssertMessageException if the filter is not writable()
+	*/
+	inline bool CuckooFilter::add(const ReferencedString &key) {trace_scope
+		const int				kMaximumMoves= 500;
+		uint16_t				fingerprint;
+		size_t					bucket;
+		std::vector<size_t>		moved;
+		std::vector<int>		slots;
+
+		AssertMessageException(writable());
+		_locate(key, fingerprint, bucket);
+		for(int move= 0; trace_bool(move <= kMaximumMoves); ++move) {
+			const size_t	buckets[]= {bucket, _alternate(bucket, fingerprint)};
+
+			for(int which= 0; trace_bool(which < 2); ++which) {
+				const int	empty= _find(buckets[which], 0);
+
+				if(trace_bool(empty >= 0)) {
+					_set(buckets[which], empty, fingerprint);
+					++_count;
+					return true;
+				}
+			}
+			_random^= _random << 13;
+			_random^= _random >> 17;
+			_random^= _random << 5;
+			const int		slot= static_cast<int>(_random & 3);
+
+			bucket= buckets[(0 == move) ? (_random >> 31) : 0];
+			const uint16_t	evicted= _get(bucket, slot);
+
+			_set(bucket, slot, fingerprint);
+			moved.push_back(bucket);
+			slots.push_back(slot);
+			fingerprint= evicted;
+			bucket= _alternate(bucket, fingerprint);
+		}
+		while(trace_bool(!moved.empty())) {
+			const uint16_t	displaced= _get(moved.back(), slots.back());
+
+			_set(moved.back(), slots.back(), fingerprint);
+			fingerprint= displaced;
+			moved.pop_back();
+			slots.pop_back();
+		}
+		return false;
+	}
+	/**
+		@param key	The key to look for
+		@return		false if the key is not in the filter, true if it probably is
+	*/
+	inline bool CuckooFilter::contains(const ReferencedString &key) const {trace_scope
+		uint16_t	fingerprint;
+		size_t		bucket;
+
+		_locate(key, fingerprint, bucket);
+		return trace_bool(_find(bucket, fingerprint) >= 0) || trace_bool(_find(_alternate(bucket, fingerprint), fingerprint) >= 0);
+	}
+	/**
+		@param key	A key that was added
+		@return		true if it was in the filter
+		@throw AssertMessageException if the filter is not writable()
+	*/
+	inline bool CuckooFilter::remove(const ReferencedString &key) {trace_scope
+		uint16_t	fingerprint;
+		size_t		bucket;
+
+		AssertMessageException(writable());
+		_locate(key, fingerprint, bucket);
+		for(int which= 0; trace_bool(which < 2); ++which) {
+			const int	slot= _find(bucket, fingerprint);
+
+			if(trace_bool(slot >= 0)) {
+				_set(bucket, slot, 0);
+				--_count;
+				return true;
+			}
+			bucket= _alternate(bucket, fingerprint);
+		}
+		return false;
+	}
+	inline size_t CuckooFilter::buckets() const {trace_scope
+		return bytes() / 8;
+	}
+	/**
+		@param keys	The number of keys the filter is for
+		@return		The smallest power of 2 buckets that hold the keys when 95% full
+	*/
+	inline size_t CuckooFilter::_buckets(size_t keys) {trace_scope
+		size_t	buckets= 1;
+
+		while(trace_bool(static_cast<double>(buckets) * 4 * 0.95 < static_cast<double>(keys))) {
+			buckets*= 2;
+		}
+		return buckets;
+	}
+	/**
+		@param key			The key
+		@param fingerprint	Set to the top 16 bits of the hash of the key, or 1 if they are 0
+		@param bucket		Set to the key's first bucket, from the low bits of the hash
+	*/
+	inline void CuckooFilter::_locate(const ReferencedString &key, uint16_t &fingerprint, size_t &bucket) const {trace_scope
+		const uint64_t	hash= XXH3Hasher::value(key.data(), key.size());
+
+		fingerprint= static_cast<uint16_t>(hash >> 48);
+		fingerprint+= (0 == fingerprint) ? 1 : 0;
+		bucket= static_cast<size_t>(hash) & (buckets() - 1);
+	}
+	/** Exclusive-or with a hash of the fingerprint, so the alternate of the alternate is the first bucket.
+		@param bucket		One of the fingerprint's buckets
+		@param fingerprint	The fingerprint
+		@return				Its other bucket
+	*/
+	inline size_t CuckooFilter::_alternate(size_t bucket, uint16_t fingerprint) const {trace_scope
+		return (bucket ^ static_cast<size_t>(fingerprint * 0x5bd1e995U)) & (buckets() - 1);
+	}
+	/** The four fingerprints of the bucket are compared at once: a slot that matches is zero after the exclusive-or,
+			and subtracting 1 from a zero slot borrows into its top bit.
+			Slots above a matching one may borrow too, but the lowest top bit set is always a match.
+		@param bucket		The bucket to look in
+		@param fingerprint	The fingerprint to look for, 0 for an empty slot
+		@return				The first slot holding fingerprint, or -1
+	*/
+	inline int CuckooFilter::_find(size_t bucket, uint16_t fingerprint) const {trace_scope
+		const uint64_t	kLow= 0x0001000100010001ULL, kHigh= 0x8000800080008000ULL;
+		const uint64_t	difference= _littleEndian64(_table + 8 * bucket) ^ (kLow * fingerprint);
+		const uint64_t	zero= (difference - kLow) & ~difference & kHigh;
+
+		if(trace_bool(0 == zero)) {
+			return -1;
+		}
+#if __GNUC__
+		return __builtin_ctzll(zero) >> 4;
+#else
+		for(int slot= 0; trace_bool(slot < 4); ++slot) {
+			if(trace_bool(_get(bucket, slot) == fingerprint)) {
+				return slot;
+			}
+		}
+		return -1;
+#endif
+	}
+	/**
+		@param bucket	The bucket
+		@param slot		The slot in the bucket, 0 to 3
+		@return			The fingerprint in the slot, 0 if it is empty
+	*/
+	inline uint16_t CuckooFilter::_get(size_t bucket, int slot) const {trace_scope
+		const uint8_t	*bytes= _table + 8 * bucket + 2 * slot;
+
+		return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+	}
+	/**
+		@param bucket		The bucket
+		@param slot			The slot in the bucket, 0 to 3
+		@param fingerprint	The fingerprint to put in the slot, 0 to empty it
+	*/
+	inline void CuckooFilter::_set(size_t bucket, int slot, uint16_t fingerprint) {trace_scope
+		uint8_t	*bytes= _writable + 8 * bucket + 2 * slot;
+
+		bytes[0]= static_cast<uint8_t>(fingerprint);
+		bytes[1]= static_cast<uint8_t>(fingerprint >> 8);
+	}
+}
+
+#endif // __Filter_h__
@@ -2,7 +2,6 @@
 #define __Hash_h__
 
 /** @file Hash.h
-	@todo evaluate the ability to do partial hashes so not all the data needs to be in memory.
 	@todo document
 	@todo trace_bool in for loops
 */
@@ -10,10 +9,23 @@
 #include <string>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 #include "Exception.h"
+#include "File.h"
+#include "Buffer.h"
+#include "ReferencedString.h"
 
-#if __APPLE_CC__ || __APPLE__
-	#include <CommonCrypto/CommonDigest.h>
+#if (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ >= 5 || defined(__clang__))
+	#include <immintrin.h>
+	#include <cpuid.h>
+	#define HashX86 1 ///< SHA-NI and AVX2 compressors, used if the CPU has them
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2))
+	#include <arm_neon.h>
+	#if __linux__
+		#include <sys/auxv.h>
+		#include <asm/hwcap.h>
+	#endif
+	#define HashARMSHA 1 ///< ARMv8 crypto compressors (build with -march=armv8-a+crypto), used if the CPU has them
 #endif
 
 #ifndef trace_scope
@@ -49,9 +61,11 @@ namespace hash {
 			/// The name of the hashing function.
 			virtual const char *name() const= 0;
 	};
-	/** The specific instantiation of a Hash.
+	/** The specific instantiation of a Hash, just the bytes of the hash so it can be kept by the million.
+		Data can be hashed all at once, from the constructor or reset(), or a piece at a time with a Stream,
+			so files and streams do not need to be in memory.
 		@tparam Hasher	See SHA256Hasher below as an example.
-						Must implement name(), hash() and have a member Size.
+						Must implement name(), hash(), hashMany(), init(), update(), final() and have a member Size and type State.
 	*/
 	template<class Hasher>
 	class SpecificHash : public Hash {
@@ -84,62 +98,2231 @@ namespace hash {
 			virtual const uint8_t *buffer() const;
 			virtual uint32_t size() const;
 			virtual std::string &hex(std::string &value) const;
+			/// Writes the 2 * Size hex digits of the hash and a nul to value.
+			char *hex(char *value) const;
 			virtual void reset(const char *hash);
 			virtual void reset(const void *data, size_t count);
 			virtual void reset(const std::string &data);
 			virtual const char *name() const;
+			/// Hashes many messages at once, side by side where the CPU can.
+			static void hashMany(size_t count, const void * const *data, const size_t *sizes, SpecificHash *results);
+			/// Hashes data a piece at a time, with init(), update() and final().
+			class Stream {
+				public:
+					/// Starts hashing new data.
+					Stream();
+					/// Starts hashing new data again.
+					Stream &init();
+					/// Hashes more data.
+					Stream &update(const void *data, size_t count);
+					/// Hashes more data.
+					Stream &update(const std::string &data);
+					/// Hashes the contents of a buffer.
+					Stream &update(const Buffer &data);
+					/// Hashes the referenced data.
+					Stream &update(const ReferencedString &data);
+					/// Hashes part or all of a file.
+					Stream &update(const io::File &file, off_t offset= 0, off_t count= -1);
+					/// Finishes hashing the data passed to update() into hash.
+					SpecificHash &final(SpecificHash &hash);
+					/// Finishes hashing the data passed to update().
+					SpecificHash final();
+				private:
+					typename Hasher::State	_state;	///< The hash of the data passed to update() so far.
+			};
 		private:
-			uint8_t	_hash[Size];
+			uint8_t	_hash[Size];	///< The hash.
+	};
+
+	/// Compresses whole 64 byte blocks into the state of an MD5, SHA-1 or SHA-256 hash
+	typedef void (*BlockCompressor)(uint32_t *state, const uint8_t *blocks, size_t count);
+
+	/// The number of messages a LaneCompressor hashes side by side
+	const int	kLanes= 8;
+
+	/// Compresses a 64 byte block into each of kLanes hashes side by side. Word w of lane l is state[w * kLanes + l].
+	typedef void (*LaneCompressor)(uint32_t *state, const uint8_t * const *blocks);
+
+	/// An MD5, SHA-1 or SHA-256 hash part way through its data
+	struct BlockHashState {
+		uint32_t	words[8];		///< The hash of the whole blocks so far
+		uint8_t		pending[64];	///< The start of the next block
+		size_t		pendingSize;	///< The number of bytes in pending
+		uint64_t	length;			///< The number of bytes so far
+	};
+
+	/// An MD5 hasher (RFC 1321). See SpecificHash.
+	struct MD5Hasher {
+		enum {
+			Size= 16 ///< Every SpecificHash hasher must have a Size enum. This is the number of bytes in the hash.
+		};
+		/** Every SpecificHash hasher must have a name() method. This is the name of this hash.
+			@return	The name of this hash method.
+		*/
+		static const char *name() {trace_scope return "md5";}
+		/// Every SpecificHash hasher must have a hash() method. This computes the hash of the given data.
+		static void hash(const void *data, size_t dataSize, void *hash);
+		/// Every SpecificHash hasher must have a State, which a SpecificHash::Stream holds between init() and final().
+		typedef BlockHashState State;
+		/// Every SpecificHash hasher must have an init() method. This starts hashing new data.
+		static void init(State &state);
+		/// Every SpecificHash hasher must have an update() method. This hashes more data.
+		static void update(State &state, const void *data, size_t dataSize);
+		/// Every SpecificHash hasher must have a final() method. This finishes the hash of all the data passed to update().
+		static void final(State &state, void *hash);
+		/// Every SpecificHash hasher must have a hashMany() method. This computes the hashes of many messages.
+		static void hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes);
+		/// The lanes hashMany() uses, wide() if the CPU can, NULL to hash one message at a time (can be set to compare them)
+		static LaneCompressor &laneCompressor();
+		/// Compress a block of kLanes messages at once with the CPU's vector instructions, NULL if it does not have them
+		static LaneCompressor wide();
+		/// The compressor hash() uses (MD5 has no CPU instructions, so it is always portable())
+		static BlockCompressor &compressor();
+		/// Compress blocks in plain C++
+		static void portable(uint32_t *state, const uint8_t *blocks, size_t count);
+		/// There are no CPU instructions for MD5, so always NULL
+		static BlockCompressor accelerated();
+		/// The sines of 1 to 64 radians, one for each step
+		static const uint32_t *sines();
+	};
+
+	/// A SHA-1 hasher (FIPS 180-4), using the CPU's SHA instructions if it has them. See SpecificHash.
+	struct SHA1Hasher {
+		enum {
+			Size= 20 ///< Every SpecificHash hasher must have a Size enum. This is the number of bytes in the hash.
+		};
+		/** Every SpecificHash hasher must have a name() method. This is the name of this hash.
+			@return	The name of this hash method.
+		*/
+		static const char *name() {trace_scope return "sha1";}
+		/// Every SpecificHash hasher must have a hash() method. This computes the hash of the given data.
+		static void hash(const void *data, size_t dataSize, void *hash);
+		/// Every SpecificHash hasher must have a State, which a SpecificHash::Stream holds between init() and final().
+		typedef BlockHashState State;
+		/// Every SpecificHash hasher must have an init() method. This starts hashing new data.
+		static void init(State &state);
+		/// Every SpecificHash hasher must have an update() method. This hashes more data.
+		static void update(State &state, const void *data, size_t dataSize);
+		/// Every SpecificHash hasher must have a final() method. This finishes the hash of all the data passed to update().
+		static void final(State &state, void *hash);
+		/// Every SpecificHash hasher must have a hashMany() method. This computes the hashes of many messages.
+		static void hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes);
+		/// The compressor hash() uses, accelerated() if the CPU can, otherwise portable() (can be set to compare them)
+		static BlockCompressor &compressor();
+		/// Compress blocks in plain C++
+		static void portable(uint32_t *state, const uint8_t *blocks, size_t count);
+		/// Compress blocks with the CPU's SHA instructions, NULL if it does not have them
+		static BlockCompressor accelerated();
+	};
+
+	/// A SHA-256 hasher (FIPS 180-4), using the CPU's SHA instructions if it has them. See SpecificHash.
+	struct SHA256Hasher {
+		enum {
+			Size= 32 ///< Every SpecificHash hasher must have a Size enum. This is the number of bytes in the hash.
+		};
+		/** Every SpecificHash hasher must have a name() method. This is the name of this hash.
+			@return	The name of this hash method.
+		*/
+		static const char *name() {trace_scope return "sha256";}
+		/// Every SpecificHash hasher must have a hash() method. This computes the hash of the given data.
+		static void hash(const void *data, size_t dataSize, void *hash);
+		/// Every SpecificHash hasher must have a State, which a SpecificHash::Stream holds between init() and final().
+		typedef BlockHashState State;
+		/// Every SpecificHash hasher must have an init() method. This starts hashing new data.
+		static void init(State &state);
+		/// Every SpecificHash hasher must have an update() method. This hashes more data.
+		static void update(State &state, const void *data, size_t dataSize);
+		/// Every SpecificHash hasher must have a final() method. This finishes the hash of all the data passed to update().
+		static void final(State &state, void *hash);
+		/// Every SpecificHash hasher must have a hashMany() method. This computes the hashes of many messages.
+		static void hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes);
+		/// The lanes hashMany() uses, wide() if the CPU can, NULL to hash one message at a time (can be set to compare them)
+		static LaneCompressor &laneCompressor();
+		/// Compress a block of kLanes messages at once with the CPU's vector instructions, NULL if it does not have them
+		static LaneCompressor wide();
+		/// The compressor hash() uses, accelerated() if the CPU can, otherwise portable() (can be set to compare them)
+		static BlockCompressor &compressor();
+		/// Compress blocks in plain C++
+		static void portable(uint32_t *state, const uint8_t *blocks, size_t count);
+		/// Compress blocks with the CPU's SHA instructions, NULL if it does not have them
+		static BlockCompressor accelerated();
+		/// The round constants, also used by the accelerated compressors
+		static const uint32_t *rounds();
+	};
+
+	/// An XXH3 hash part way through its data
+	struct XXH3State {
+		uint64_t	accumulators[8];	///< The accumulated stripes, for data over 240 bytes
+		uint8_t		buffer[256];		///< Data not yet accumulated
+		uint8_t		previous[64];		///< The last stripe accumulated, in case it is needed for the last stripe
+		size_t		bufferSize;			///< The number of bytes in buffer
+		size_t		stripes;			///< The number of stripes accumulated since the last scramble
+		uint64_t	length;				///< The number of bytes so far
+	};
+
+	/// A 64 bit XXH3 hasher (xxHash 0.8), for hash tables and checksums, not for security. See SpecificHash.
+	struct XXH3Hasher {
+		enum {
+			Size= 8 ///< Every SpecificHash hasher must have a Size enum. This is the number of bytes in the hash.
+		};
+		/** Every SpecificHash hasher must have a name() method. This is the name of this hash.
+			@return	The name of this hash method.
+		*/
+		static const char *name() {trace_scope return "xxh3";}
+		/// Every SpecificHash hasher must have a hash() method. This computes the hash of the given data, most significant byte first.
+		static void hash(const void *data, size_t dataSize, void *hash);
+		/// Every SpecificHash hasher must have a State, which a SpecificHash::Stream holds between init() and final().
+		typedef XXH3State State;
+		/// Every SpecificHash hasher must have an init() method. This starts hashing new data.
+		static void init(State &state);
+		/// Every SpecificHash hasher must have an update() method. This hashes more data.
+		static void update(State &state, const void *data, size_t dataSize);
+		/// Every SpecificHash hasher must have a final() method. This finishes the hash of all the data passed to update().
+		static void final(State &state, void *hash);
+		/// Every SpecificHash hasher must have a hashMany() method. This computes the hashes of many messages.
+		static void hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes);
+		/// The hash as a number, without going through bytes
+		static uint64_t value(const void *data, size_t dataSize);
+		/// The hash of the 8 bytes of key, least significant first, for hash tables keyed on integers
+		static uint64_t value(uint64_t key);
+		/// The default secret, which the data is mixed with
+		static const uint8_t *secret();
+	};
+
+	/// A 128 bit XXH3 hasher (xxHash 0.8 XXH128), for hash tables and checksums, not for security. See SpecificHash.
+	struct XXH128Hasher {
+		enum {
+			Size= 16 ///< Every SpecificHash hasher must have a Size enum. This is the number of bytes in the hash.
+		};
+		/** Every SpecificHash hasher must have a name() method. This is the name of this hash.
+			@return	The name of this hash method.
+		*/
+		static const char *name() {trace_scope return "xxh128";}
+		/// Every SpecificHash hasher must have a hash() method. This computes the hash of the given data, most significant byte first.
+		static void hash(const void *data, size_t dataSize, void *hash);
+		/// Every SpecificHash hasher must have a State, which a SpecificHash::Stream holds between init() and final().
+		typedef XXH3State State;
+		/// Every SpecificHash hasher must have an init() method. This starts hashing new data.
+		static void init(State &state);
+		/// Every SpecificHash hasher must have an update() method. This hashes more data.
+		static void update(State &state, const void *data, size_t dataSize);
+		/// Every SpecificHash hasher must have a final() method. This finishes the hash of all the data passed to update().
+		static void final(State &state, void *hash);
+		/// Every SpecificHash hasher must have a hashMany() method. This computes the hashes of many messages.
+		static void hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes);
+		/// The hash as two numbers, without going through bytes
+		static uint64_t value(const void *data, size_t dataSize, uint64_t &high);
+	};
+
+	/// A CRC-32C (Castagnoli) checksum, using the CPU's SSE4.2 crc32 instruction if it has it. See SpecificHash.
+	struct CRC32CHasher {
+		enum {
+			Size= 4 ///< Every SpecificHash hasher must have a Size enum. This is the number of bytes in the hash.
+		};
+		/** Every SpecificHash hasher must have a name() method. This is the name of this hash.
+			@return	The name of this hash method.
+		*/
+		static const char *name() {trace_scope return "crc32c";}
+		/// Every SpecificHash hasher must have a hash() method. This computes the checksum of the given data, most significant byte first.
+		static void hash(const void *data, size_t dataSize, void *hash);
+		/// Every SpecificHash hasher must have a State, which a SpecificHash::Stream holds between init() and final().
+		typedef uint32_t State;
+		/// Every SpecificHash hasher must have an init() method. This starts hashing new data.
+		static void init(State &state);
+		/// Every SpecificHash hasher must have an update() method. This hashes more data.
+		static void update(State &state, const void *data, size_t dataSize);
+		/// Every SpecificHash hasher must have a final() method. This finishes the hash of all the data passed to update().
+		static void final(State &state, void *hash);
+		/// Every SpecificHash hasher must have a hashMany() method. This computes the hashes of many messages.
+		static void hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes);
+		/// The checksum as a number, continuing from the checksum of the data before it
+		static uint32_t value(const void *data, size_t dataSize, uint32_t previous= 0);
+		/// The checksum of the 8 bytes of key, least significant first, for hash tables keyed on integers
+		static uint32_t value(uint64_t key);
+		/// Adds data to a checksum in progress, with the crc32 instruction if the CPU has it (can be set to compare them)
+		typedef uint32_t (*Checksummer)(uint32_t crc, const uint8_t *data, size_t size);
+		/// The checksummer value() uses
+		static Checksummer &checksummer();
+		/// Checksum in plain C++, eight bytes at a time
+		static uint32_t portable(uint32_t crc, const uint8_t *data, size_t size);
+		/// Checksum with the CPU's crc32 instruction, NULL if it does not have it
+		static Checksummer accelerated();
+	};
+
+	/// Which half of each byte hex text has first
+	enum NibbleOrder {
+		HighNibbleFirst,	///< The usual way, 0xA5 is "a5"
+		LowNibbleFirst		///< The way SpecificHash::hex() used to be written, 0xA5 is "5a"
 	};
 
-#if __APPLE_CC__ || __APPLE__
+#ifdef USE_DEPRECATED_HASH_NIBBLE_ORDER
+	const NibbleOrder	kHashNibbleOrder= LowNibbleFirst;	///< SpecificHash::hex() and reset(const char*) read and write the old, low nibble first way
+#else
+	const NibbleOrder	kHashNibbleOrder= HighNibbleFirst;	///< SpecificHash::hex() and reset(const char*) read and write hashes the usual way
+#endif
+
+	/// Bytes to and from hex text in the caller's buffers, with the CPU's vector instructions if it has them.
+	struct HexCodec {
+		/// Writes 2 * size lower case hex digits for data, without a nul
+		static char *encode(const void *data, size_t size, char *hex, NibbleOrder order= HighNibbleFirst);
+		/// Reads 2 * size hex digits of either case into size bytes
+		static bool decode(const char *hex, size_t size, void *data, NibbleOrder order= HighNibbleFirst);
+		/// Writes hex digits for bytes (can be set to compare them)
+		typedef void (*Encoder)(const uint8_t *data, size_t size, char *hex, NibbleOrder order);
+		/// Reads hex digits into bytes, false if there is a character that is not a hex digit (can be set to compare them)
+		typedef bool (*Decoder)(const char *hex, size_t size, uint8_t *data, NibbleOrder order);
+		/// The encoder encode() uses
+		static Encoder &encoder();
+		/// The decoder decode() uses
+		static Decoder &decoder();
+		/// Encodes in plain C++, a table lookup per byte
+		static void portableEncode(const uint8_t *data, size_t size, char *hex, NibbleOrder order);
+		/// Decodes in plain C++, a table lookup per digit
+		static bool portableDecode(const char *hex, size_t size, uint8_t *data, NibbleOrder order);
+		/// Encodes with the CPU's AVX2 or SSSE3 instructions, NULL if it has neither
+		static Encoder acceleratedEncoder();
+		/// Decodes with the CPU's AVX2 or SSSE3 instructions, NULL if it has neither
+		static Decoder acceleratedDecoder();
+	};
+
+
+	/**
+	*/
+	inline Hash::Hash() {trace_scope
+	}
+	/**
+	*/
+	inline Hash::~Hash() {trace_scope
+	}
+
+	/**
+		@param value	A 32 bit value
+		@param bits		The number of bits to rotate left, 1 to 31
+		@return			value rotated left by bits
+	*/
+	inline uint32_t _rotateLeft(uint32_t value, int bits) {
+		return (value << bits) | (value >> (32 - bits));
+	}
+	/**
+		@param bytes	Four bytes, most significant first
+		@return			The 32 bit value
+	*/
+	inline uint32_t _bigEndian32(const uint8_t *bytes) {
+		return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+	}
+	/**
+		@param bytes	Four bytes, least significant first
+		@return			The 32 bit value
+	*/
+	inline uint32_t _littleEndian32(const uint8_t *bytes) {
+		return (static_cast<uint32_t>(bytes[3]) << 24) | (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[1]) << 8) | bytes[0];
+	}
+	/** Compresses the whole blocks of data and keeps the rest for the next update or final.
+		@param compress		Compresses whole blocks into state.words
+		@param state		The hash so far
+		@param data			The data to hash
+		@param size			The number of bytes in data
+	*/
+	inline void _updateBlocks(BlockCompressor compress, BlockHashState &state, const void *data, size_t size) {trace_scope
+		const size_t	kBlockSize= sizeof(state.pending);
+		const uint8_t	*bytes= reinterpret_cast<const uint8_t*>(data);
+
+		state.length+= size;
+		if(trace_bool(state.pendingSize > 0)) {
+			const size_t	fill= (size < kBlockSize - state.pendingSize) ? size : kBlockSize - state.pendingSize;
+
+			memcpy(state.pending + state.pendingSize, bytes, fill);
+			state.pendingSize+= fill;
+			bytes+= fill;
+			size-= fill;
+			if(trace_bool(state.pendingSize < kBlockSize)) {
+				return;
+			}
+			compress(state.words, state.pending, 1);
+			state.pendingSize= 0;
+		}
+		if(trace_bool(size >= kBlockSize)) {
+			compress(state.words, bytes, size / kBlockSize);
+		}
+		memcpy(state.pending, bytes + size / kBlockSize * kBlockSize, size % kBlockSize);
+		state.pendingSize= size % kBlockSize;
+	}
+	/** MD5, SHA-1 and SHA-256 pad the last block with 0x80, zeros and the length in bits.
+		@param last			Set to the last one or two blocks
+		@param pending		The data after the last whole block
+		@param pendingSize	The number of bytes in pending, less than a block
+		@param length		The number of bytes in all the data
+		@param bigEndian	SHA puts the length most significant byte first, MD5 least
+		@return				The number of blocks in last, 1 or 2
+	*/
+	inline size_t _padBlocks(uint8_t *last, const uint8_t *pending, size_t pendingSize, uint64_t length, bool bigEndian) {trace_scope
+		const size_t	kBlockSize= 64;
+		const size_t	kLengthSize= sizeof(uint64_t);
+		const size_t	lastSize= (pendingSize + 1 + kLengthSize <= kBlockSize) ? kBlockSize : 2 * kBlockSize;
+		const uint64_t	bits= length * 8;
+
+		memcpy(last, pending, pendingSize);
+		last[pendingSize]= 0x80;
+		memset(last + pendingSize + 1, 0, lastSize - pendingSize - 1);
+		for(size_t byte= 0; trace_bool(byte < kLengthSize); ++byte) {
+			last[bigEndian ? lastSize - 1 - byte : lastSize - kLengthSize + byte]= static_cast<uint8_t>(bits >> (8 * byte));
+		}
+		return lastSize / kBlockSize;
+	}
+	/**
+		@param state		The hash state
+		@param stride		The distance between words in state
+		@param words		The number of words that make up the hash
+		@param bigEndian	SHA puts the state words in the hash most significant byte first, MD5 least
+		@param hash			Set to the state words, words * 4 bytes
+	*/
+	inline void _storeWords(const uint32_t *state, int stride, int words, bool bigEndian, void *hash) {trace_scope
+		uint8_t	*out= reinterpret_cast<uint8_t*>(hash);
+
+		for(int word= 0; trace_bool(word < words); ++word) {
+			for(int byte= 0; trace_bool(byte < 4); ++byte) {
+				out[word * 4 + byte]= static_cast<uint8_t>(state[word * stride] >> (bigEndian ? 24 - 8 * byte : 8 * byte));
+			}
+		}
+	}
+	/**
+		@param compress		Compresses whole blocks into state.words
+		@param state		The hash so far, which is used up
+		@param words		The number of words in state.words, which make up the hash
+		@param bigEndian	SHA puts the length and the state words in the hash most significant byte first, MD5 least
+		@param hash			Set to the state words, words * 4 bytes
+	*/
+	inline void _finalBlocks(BlockCompressor compress, BlockHashState &state, int words, bool bigEndian, void *hash) {trace_scope
+		uint8_t	last[2 * sizeof(state.pending)];
+
+		compress(state.words, last, _padBlocks(last, state.pending, state.pendingSize, state.length, bigEndian));
+		_storeWords(state.words, 1, words, bigEndian, hash);
+	}
+	/**
+		@param state	Set to the start of a hash
+		@param initial	The initial words
+		@param words	The number of words in initial
+	*/
+	inline void _initBlocks(BlockHashState &state, const uint32_t *initial, int words) {trace_scope
+		memcpy(state.words, initial, words * sizeof(initial[0]));
+		state.pendingSize= 0;
+		state.length= 0;
+	}
+	/** Hashes many messages a block at a time in lanes side by side, starting the next message in a lane as soon as
+			the lane finishes one, so messages of different lengths keep all the lanes busy.
+		@param compress		Compresses a block in each lane
+		@param initial		The initial state words
+		@param words		The number of words in initial, which make up the hash
+		@param bigEndian	SHA puts the length and the state words in the hash most significant byte first, MD5 least
+		@param count		The number of messages
+		@param data			count pointers to the messages
+		@param sizes		count sizes of the messages
+		@param hashes		count pointers to memory for the hashes, words * 4 bytes each
+	*/
+	inline void _hashLanes(LaneCompressor compress, const uint32_t *initial, int words, bool bigEndian,
+							size_t count, const void * const *data, const size_t *sizes, void * const *hashes) {trace_scope
+		const int		kBlockSize= 64;
+		uint32_t		state[8 * kLanes];
+		uint8_t			last[kLanes][2 * kBlockSize];
+		const uint8_t	*blocks[kLanes];
+		size_t			message[kLanes], block[kLanes], whole[kLanes], total[kLanes];
+		size_t			next= 0;
+		int				busy= 0;
+
+		if(trace_bool(0 == count)) {
+			return;
+		}
+		memset(last, 0, sizeof(last));
+		for(int lane= 0; trace_bool(lane < kLanes); ++lane) {
+			total[lane]= 0;
+			block[lane]= 0;
+		}
+		do	{
+			for(int lane= 0; trace_bool(lane < kLanes); ++lane) {
+				if(trace_bool(block[lane] == total[lane]) && trace_bool(next < count)) {
+					const uint8_t	*bytes= reinterpret_cast<const uint8_t*>(data[next]);
+
+					message[lane]= next;
+					block[lane]= 0;
+					whole[lane]= sizes[next] / kBlockSize;
+					total[lane]= whole[lane] + _padBlocks(last[lane], bytes + whole[lane] * kBlockSize, sizes[next] % kBlockSize, sizes[next], bigEndian);
+					for(int word= 0; trace_bool(word < words); ++word) {
+						state[word * kLanes + lane]= initial[word];
+					}
+					++busy;
+					++next;
+				}
+				if(trace_bool(block[lane] < whole[lane])) {
+					blocks[lane]= reinterpret_cast<const uint8_t*>(data[message[lane]]) + block[lane] * kBlockSize;
+				} else if(trace_bool(block[lane] < total[lane])) {
+					blocks[lane]= last[lane] + (block[lane] - whole[lane]) * kBlockSize;
+				} else {
+					blocks[lane]= last[lane]; // idle, the state is thrown away
+				}
+			}
+			compress(state, blocks);
+			for(int lane= 0; trace_bool(lane < kLanes); ++lane) {
+				if(trace_bool(block[lane] < total[lane]) && trace_bool(++block[lane] == total[lane])) {
+					_storeWords(state + lane, kLanes, words, bigEndian, hashes[message[lane]]);
+					--busy;
+				}
+			}
+		} while(trace_bool(busy > 0) || trace_bool(next < count));
+	}
+	/**
+		@param compress		Compresses whole blocks
+		@param initial		The initial state words
+		@param words		The number of words in initial, which make up the hash
+		@param bigEndian	SHA puts the length and the state words in the hash most significant byte first, MD5 least
+		@param count		The number of messages
+		@param data			count pointers to the messages
+		@param sizes		count sizes of the messages
+		@param hashes		count pointers to memory for the hashes, words * 4 bytes each
+	*/
+	inline void _hashEach(BlockCompressor compress, const uint32_t *initial, int words, bool bigEndian,
+							size_t count, const void * const *data, const size_t *sizes, void * const *hashes) {trace_scope
+		BlockHashState	state;
+
+		for(size_t message= 0; trace_bool(message < count); ++message) {
+			_initBlocks(state, initial, words);
+			_updateBlocks(compress, state, data[message], sizes[message]);
+			_finalBlocks(compress, state, words, bigEndian, hashes[message]);
+		}
+	}
+#if HashX86
+	/**
+		@return	true if the CPU has the SHA extensions, and the SSSE3 and SSE4.1 instructions they are used with
+	*/
+	inline bool _x86SHA() {trace_scope
+		const unsigned int	kLeafExtendedFeatures= 7;
+		const unsigned int	kSSSE3= 1 << 9, kSSE41= 1 << 19;	// leaf 1 ecx
+		const unsigned int	kSHA= 1 << 29;						// leaf 7 ebx
+		unsigned int		eax= 0, ebx= 0, ecx= 0, edx= 0;
+
+		if(__get_cpuid_max(0, NULL) < kLeafExtendedFeatures) {
+			return false;
+		}
+		__cpuid(1, eax, ebx, ecx, edx);
+		if( ((ecx & kSSSE3) == 0) || ((ecx & kSSE41) == 0) ) {
+			return false;
+		}
+		__cpuid_count(kLeafExtendedFeatures, 0, eax, ebx, ecx, edx);
+		return (ebx & kSHA) != 0;
+	}
+	/** Intel's SHA-NI sequence: the message schedule of the next blocks is worked out alongside the rounds.
+		@param state	The hash state
+		@param blocks	count 64 byte blocks
+		@param count	The number of blocks
+	*/
+	__attribute__((target("sha,ssse3,sse4.1"))) inline void _sha1x86(uint32_t *state, const uint8_t *blocks, size_t count) {trace_scope
+		const __m128i	kByteSwap= _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+		__m128i			abcd= _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+		__m128i			e0= _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+		__m128i			e1, message[4];
+
+		for(; trace_bool(count > 0); --count, blocks+= 64) {
+			const __m128i	abcdSave= abcd, e0Save= e0;
+
+			#pragma GCC unroll 20
+			for(int group= 0; group < 20; ++group) {
+				__m128i	&e= (group % 2 == 0) ? e0 : e1;
+				__m128i	&next= (group % 2 == 0) ? e1 : e0;
+				__m128i	&current= message[group % 4];
+
+				if(group < 4) {
+					current= _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * group)), kByteSwap);
+				}
+				e= (0 == group) ? _mm_add_epi32(e, current) : _mm_sha1nexte_epu32(e, current);
+				next= abcd;
+				if( (group >= 3) && (group <= 18) ) {
+					message[(group + 1) % 4]= _mm_sha1msg2_epu32(message[(group + 1) % 4], current);
+				}
+				switch(group / 5) {
+					case 0:		abcd= _mm_sha1rnds4_epu32(abcd, e, 0); break;
+					case 1:		abcd= _mm_sha1rnds4_epu32(abcd, e, 1); break;
+					case 2:		abcd= _mm_sha1rnds4_epu32(abcd, e, 2); break;
+					default:	abcd= _mm_sha1rnds4_epu32(abcd, e, 3); break;
+				}
+				if( (group >= 1) && (group <= 16) ) {
+					message[(group + 3) % 4]= _mm_sha1msg1_epu32(message[(group + 3) % 4], current);
+				}
+				if( (group >= 2) && (group <= 17) ) {
+					message[(group + 2) % 4]= _mm_xor_si128(message[(group + 2) % 4], current);
+				}
+			}
+			e0= _mm_sha1nexte_epu32(e0, e0Save);
+			abcd= _mm_add_epi32(abcd, abcdSave);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+		state[4]= static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+	}
+	/** Intel's SHA-NI sequence: the state is kept as ABEF and CDGH, two rounds at a time.
+		@param state	The hash state
+		@param blocks	count 64 byte blocks
+		@param count	The number of blocks
+	*/
+	__attribute__((target("sha,ssse3,sse4.1"))) inline void _sha256x86(uint32_t *state, const uint8_t *blocks, size_t count) {trace_scope
+		const __m128i	kByteSwap= _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+		const uint32_t	*rounds= SHA256Hasher::rounds();
+		const __m128i	cdab= _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+		const __m128i	efgh= _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+		__m128i			abef= _mm_alignr_epi8(cdab, efgh, 8);
+		__m128i			cdgh= _mm_blend_epi16(efgh, cdab, 0xF0);
+		__m128i			message[4];
+
+		for(; trace_bool(count > 0); --count, blocks+= 64) {
+			const __m128i	abefSave= abef, cdghSave= cdgh;
+
+			#pragma GCC unroll 16
+			for(int group= 0; group < 16; ++group) {
+				__m128i	&current= message[group % 4];
+				__m128i	words;
+
+				if(group < 4) {
+					current= _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * group)), kByteSwap);
+				}
+				words= _mm_add_epi32(current, _mm_loadu_si128(reinterpret_cast<const __m128i*>(rounds + 4 * group)));
+				cdgh= _mm_sha256rnds2_epu32(cdgh, abef, words);
+				if( (group >= 3) && (group <= 14) ) {
+					__m128i	&following= message[(group + 1) % 4];
+
+					following= _mm_add_epi32(following, _mm_alignr_epi8(current, message[(group + 3) % 4], 4));
+					following= _mm_sha256msg2_epu32(following, current);
+				}
+				abef= _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(words, 0x0E));
+				if( (group >= 1) && (group <= 12) ) {
+					message[(group + 3) % 4]= _mm_sha256msg1_epu32(message[(group + 3) % 4], current);
+				}
+			}
+			abef= _mm_add_epi32(abef, abefSave);
+			cdgh= _mm_add_epi32(cdgh, cdghSave);
+		}
+		const __m128i	feba= _mm_shuffle_epi32(abef, 0x1B);
+		const __m128i	dchg= _mm_shuffle_epi32(cdgh, 0xB1);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+	}
+	/**
+		@return	true if the CPU has AVX2, and the operating system saves the registers
+	*/
+	inline bool _x86AVX2() {trace_scope
+		const unsigned int	kLeafExtendedFeatures= 7;
+		const unsigned int	kOSXSAVE= 1 << 27, kAVX= 1 << 28;	// leaf 1 ecx
+		const unsigned int	kAVX2= 1 << 5;						// leaf 7 ebx
+		const unsigned int	kYMMState= 6;						// XCR0 SSE and AVX state
+		unsigned int		eax= 0, ebx= 0, ecx= 0, edx= 0;
+
+		if(__get_cpuid_max(0, NULL) < kLeafExtendedFeatures) {
+			return false;
+		}
+		__cpuid(1, eax, ebx, ecx, edx);
+		if( ((ecx & kOSXSAVE) == 0) || ((ecx & kAVX) == 0) ) {
+			return false;
+		}
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		if( (eax & kYMMState) != kYMMState ) {
+			return false;
+		}
+		__cpuid_count(kLeafExtendedFeatures, 0, eax, ebx, ecx, edx);
+		return (ebx & kAVX2) != 0;
+	}
+	/**
+		@param value	Eight 32 bit values
+		@param bits		The number of bits to rotate left, 1 to 31
+		@return			Each value rotated left by bits
+	*/
+	__attribute__((target("avx2"))) inline __m256i _rotateLeft8(__m256i value, int bits) {
+		return _mm256_or_si256(_mm256_slli_epi32(value, bits), _mm256_srli_epi32(value, 32 - bits));
+	}
+	/** Transposes the words of the blocks, so that each register holds the same word from every lane.
+		@param blocks	A block from each of the eight lanes
+		@param words	Set to the 16 words of the blocks, as stored in memory (little endian)
+	*/
+	__attribute__((target("avx2"))) inline void _laneWords(const uint8_t * const *blocks, __m256i *words) {
+		for(int half= 0; half < 2; ++half) {
+			__m256i	rows[kLanes], pairs[kLanes], quads[kLanes];
+
+			for(int lane= 0; lane < kLanes; ++lane) {
+				rows[lane]= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks[lane] + 32 * half));
+			}
+			for(int lane= 0; lane < kLanes; lane+= 2) {
+				pairs[lane]= _mm256_unpacklo_epi32(rows[lane], rows[lane + 1]);
+				pairs[lane + 1]= _mm256_unpackhi_epi32(rows[lane], rows[lane + 1]);
+			}
+			for(int lane= 0; lane < kLanes; lane+= 4) {
+				quads[lane]= _mm256_unpacklo_epi64(pairs[lane], pairs[lane + 2]);
+				quads[lane + 1]= _mm256_unpackhi_epi64(pairs[lane], pairs[lane + 2]);
+				quads[lane + 2]= _mm256_unpacklo_epi64(pairs[lane + 1], pairs[lane + 3]);
+				quads[lane + 3]= _mm256_unpackhi_epi64(pairs[lane + 1], pairs[lane + 3]);
+			}
+			for(int word= 0; word < 4; ++word) {
+				words[8 * half + word]= _mm256_permute2x128_si256(quads[word], quads[word + 4], 0x20);
+				words[8 * half + word + 4]= _mm256_permute2x128_si256(quads[word], quads[word + 4], 0x31);
+			}
+		}
+	}
+	/** RFC 1321 in eight lanes, one message in each 32 bit lane of the AVX2 registers.
+		@param state	The hash state of eight messages, see LaneCompressor
+		@param blocks	A block from each message
+	*/
+	__attribute__((target("avx2"))) inline void _md5x8(uint32_t *state, const uint8_t * const *blocks) {
+		static const int	kShifts[4][4]= {{7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21}};
+		const uint32_t		*sines= MD5Hasher::sines();
+		const __m256i		kOnes= _mm256_set1_epi32(-1);
+		__m256i				words[16];
+		__m256i				a= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state));
+		__m256i				b= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + kLanes));
+		__m256i				c= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + 2 * kLanes));
+		__m256i				d= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + 3 * kLanes));
+		const __m256i		aSave= a, bSave= b, cSave= c, dSave= d;
+
+		_laneWords(blocks, words);
+		#pragma GCC unroll 64
+		for(int step= 0; step < 64; ++step) {
+			__m256i	mixed;
+			int		word;
+
+			if(step < 16) {
+				mixed= _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+				word= step;
+			} else if(step < 32) {
+				mixed= _mm256_xor_si256(c, _mm256_and_si256(d, _mm256_xor_si256(b, c)));
+				word= (5 * step + 1) % 16;
+			} else if(step < 48) {
+				mixed= _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+				word= (3 * step + 5) % 16;
+			} else {
+				mixed= _mm256_xor_si256(c, _mm256_or_si256(b, _mm256_xor_si256(d, kOnes)));
+				word= (7 * step) % 16;
+			}
+			mixed= _mm256_add_epi32(_mm256_add_epi32(mixed, a), _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(sines[step])), words[word]));
+			a= d;
+			d= c;
+			c= b;
+			b= _mm256_add_epi32(b, _rotateLeft8(mixed, kShifts[step / 16][step % 4]));
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(state), _mm256_add_epi32(a, aSave));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + kLanes), _mm256_add_epi32(b, bSave));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + 2 * kLanes), _mm256_add_epi32(c, cSave));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + 3 * kLanes), _mm256_add_epi32(d, dSave));
+	}
+	/** FIPS 180-4 6.2.2 in eight lanes, one message in each 32 bit lane of the AVX2 registers.
+		@param state	The hash state of eight messages, see LaneCompressor
+		@param blocks	A block from each message
+	*/
+	__attribute__((target("avx2"))) inline void _sha256x8(uint32_t *state, const uint8_t * const *blocks) {
+		const uint32_t	*rounds= SHA256Hasher::rounds();
+		const __m256i	kByteSwap= _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+		__m256i			words[16], working[8], saved[8];
+
+		for(int word= 0; word < 8; ++word) {
+			working[word]= saved[word]= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + word * kLanes));
+		}
+		_laneWords(blocks, words);
+		#pragma GCC unroll 64
+		for(int step= 0; step < 64; ++step) {
+			__m256i	&a= working[(64 - step) % 8], &b= working[(65 - step) % 8], &c= working[(66 - step) % 8], &d= working[(67 - step) % 8];
+			__m256i	&e= working[(68 - step) % 8], &f= working[(69 - step) % 8], &g= working[(70 - step) % 8], &h= working[(71 - step) % 8];
+
+			if(step < 16) {
+				words[step]= _mm256_shuffle_epi8(words[step], kByteSwap);
+			} else {
+				const __m256i	w15= words[(step - 15) % 16], w2= words[(step - 2) % 16];
+				const __m256i	s0= _mm256_xor_si256(_mm256_xor_si256(_rotateLeft8(w15, 25), _rotateLeft8(w15, 14)), _mm256_srli_epi32(w15, 3));
+				const __m256i	s1= _mm256_xor_si256(_mm256_xor_si256(_rotateLeft8(w2, 15), _rotateLeft8(w2, 13)), _mm256_srli_epi32(w2, 10));
+
+				words[step % 16]= _mm256_add_epi32(_mm256_add_epi32(words[step % 16], s0), _mm256_add_epi32(words[(step - 7) % 16], s1));
+			}
+			const __m256i	sum1= _mm256_xor_si256(_mm256_xor_si256(_rotateLeft8(e, 26), _rotateLeft8(e, 21)), _rotateLeft8(e, 7));
+			const __m256i	choose= _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+			const __m256i	t1= _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, sum1), _mm256_add_epi32(choose, words[step % 16])),
+												_mm256_set1_epi32(static_cast<int>(rounds[step])));
+			const __m256i	sum0= _mm256_xor_si256(_mm256_xor_si256(_rotateLeft8(a, 30), _rotateLeft8(a, 19)), _rotateLeft8(a, 10));
+			const __m256i	majority= _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+
+			d= _mm256_add_epi32(d, t1);
+			h= _mm256_add_epi32(t1, _mm256_add_epi32(sum0, majority));
+		}
+		for(int word= 0; word < 8; ++word) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + word * kLanes), _mm256_add_epi32(working[word], saved[word]));
+		}
+	}
+#endif
+#if HashARMSHA
+	/**
+		@return	true if the CPU has the ARMv8 SHA-1 and SHA-256 instructions
+	*/
+	inline bool _armSHA() {trace_scope
+	#if __linux__
+		const unsigned long	capabilities= getauxval(AT_HWCAP);
+
+		return ((capabilities & HWCAP_SHA1) != 0) && ((capabilities & HWCAP_SHA2) != 0);
+	#else
+		return true; // the compiler was told the CPU has them
+	#endif
+	}
+	/**
+		@param state	The hash state
+		@param blocks	count 64 byte blocks
+		@param count	The number of blocks
+	*/
+	inline void _sha1arm(uint32_t *state, const uint8_t *blocks, size_t count) {trace_scope
+		const uint32_t	kRounds[]= {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+		uint32x4_t		abcd= vld1q_u32(state);
+		uint32_t		e0= state[4];
+		uint32x4_t		message[4];
+
+		for(; trace_bool(count > 0); --count, blocks+= 64) {
+			const uint32x4_t	abcdSave= abcd;
+			const uint32_t		e0Save= e0;
+
+			for(int group= 0; group < 4; ++group) {
+				message[group]= vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16 * group)));
+			}
+			for(int group= 0; group < 20; ++group) {
+				uint32x4_t		&current= message[group % 4];
+				const uint32x4_t	words= vaddq_u32(current, vdupq_n_u32(kRounds[group / 5]));
+				const uint32_t	e1= vsha1h_u32(vgetq_lane_u32(abcd, 0));
+
+				if(group < 16) {
+					current= vsha1su1q_u32(vsha1su0q_u32(current, message[(group + 1) % 4], message[(group + 2) % 4]), message[(group + 3) % 4]);
+				}
+				switch(group / 5) {
+					case 0:		abcd= vsha1cq_u32(abcd, e0, words); break;
+					case 2:		abcd= vsha1mq_u32(abcd, e0, words); break;
+					default:	abcd= vsha1pq_u32(abcd, e0, words); break;
+				}
+				e0= e1;
+			}
+			e0+= e0Save;
+			abcd= vaddq_u32(abcd, abcdSave);
+		}
+		vst1q_u32(state, abcd);
+		state[4]= e0;
+	}
+	/**
+		@param state	The hash state
+		@param blocks	count 64 byte blocks
+		@param count	The number of blocks
+	*/
+	inline void _sha256arm(uint32_t *state, const uint8_t *blocks, size_t count) {trace_scope
+		const uint32_t	*rounds= SHA256Hasher::rounds();
+		uint32x4_t		abcd= vld1q_u32(state);
+		uint32x4_t		efgh= vld1q_u32(state + 4);
+		uint32x4_t		message[4];
+
+		for(; trace_bool(count > 0); --count, blocks+= 64) {
+			const uint32x4_t	abcdSave= abcd, efghSave= efgh;
+
+			for(int group= 0; group < 4; ++group) {
+				message[group]= vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16 * group)));
+			}
+			for(int group= 0; group < 16; ++group) {
+				uint32x4_t			&current= message[group % 4];
+				const uint32x4_t	words= vaddq_u32(current, vld1q_u32(rounds + 4 * group));
+				const uint32x4_t	previous= abcd;
+
+				if(group < 12) {
+					current= vsha256su1q_u32(vsha256su0q_u32(current, message[(group + 1) % 4]), message[(group + 2) % 4], message[(group + 3) % 4]);
+				}
+				abcd= vsha256hq_u32(abcd, efgh, words);
+				efgh= vsha256h2q_u32(efgh, previous, words);
+			}
+			abcd= vaddq_u32(abcd, abcdSave);
+			efgh= vaddq_u32(efgh, efghSave);
+		}
+		vst1q_u32(state, abcd);
+		vst1q_u32(state + 4, efgh);
+	}
+#endif
+
+	/**
+		@param data		The data to hash.
+		@param dataSize	The number of bytes in <code>data</code> to hash.
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void MD5Hasher::hash(const void *data, size_t dataSize, void *hash) {trace_scope
+		State	state;
+
+		init(state);
+		update(state, data, dataSize);
+		final(state, hash);
+	}
+	/**
+		@param state	Set to the start of a hash
+	*/
+	inline void MD5Hasher::init(State &state) {trace_scope
+		const uint32_t	kInitial[]= {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+		_initBlocks(state, kInitial, 4);
+	}
+	/**
+		@param state	The hash so far
+		@param data		More data to hash
+		@param dataSize	The number of bytes in <code>data</code>
+	*/
+	inline void MD5Hasher::update(State &state, const void *data, size_t dataSize) {trace_scope
+		_updateBlocks(compressor(), state, data, dataSize);
+	}
+	/**
+		@param state	The hash so far, which must be init() again to be used again
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void MD5Hasher::final(State &state, void *hash) {trace_scope
+		_finalBlocks(compressor(), state, 4, false, hash);
+	}
+	/**
+		@param count	The number of messages
+		@param data		count pointers to the messages
+		@param sizes	count sizes of the messages
+		@param hashes	count pointers to areas of memory, each at least <code>Size</code> bytes in length, that will hold the hashes
+	*/
+	inline void MD5Hasher::hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes) {trace_scope
+		const LaneCompressor	lanes= laneCompressor();
+		State					start;
+
+		init(start);
+		if(trace_bool(NULL != lanes) && trace_bool(count > 1)) {
+			_hashLanes(lanes, start.words, 4, false, count, data, sizes, hashes);
+		} else {
+			_hashEach(compressor(), start.words, 4, false, count, data, sizes, hashes);
+		}
+	}
+	/**
+		@return	The lanes hashMany() uses, chosen the first time it is called
+	*/
+	inline LaneCompressor &MD5Hasher::laneCompressor() {trace_scope
+		static LaneCompressor	lanes= wide();
+
+		return lanes;
+	}
+	/**
+		@return	The lane compressor for the CPU's vector instructions, NULL if it does not have them
+	*/
+	inline LaneCompressor MD5Hasher::wide() {trace_scope
+	#if HashX86
+		static const bool	available= _x86AVX2();
+
+		return available ? _md5x8 : NULL;
+	#else
+		return NULL;
+	#endif
+	}
+	/**
+		@return	The compressor hash() uses
+	*/
+	inline BlockCompressor &MD5Hasher::compressor() {trace_scope
+		static BlockCompressor	compress= portable;
+
+		return compress;
+	}
+	/** RFC 1321, with the four rounds written as loops.
+		@param state	The hash state
+		@param blocks	count 64 byte blocks
+		@param count	The number of blocks
+	*/
+	inline void MD5Hasher::portable(uint32_t *state, const uint8_t *blocks, size_t count) {trace_scope
+		static const int	kShifts[4][4]= {{7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21}};
+		const uint32_t		*sines= MD5Hasher::sines();
+
+		for(; trace_bool(count > 0); --count, blocks+= 64) {
+			uint32_t	words[16];
+			uint32_t	a= state[0], b= state[1], c= state[2], d= state[3];
+
+			for(int word= 0; word < 16; ++word) {
+				words[word]= _littleEndian32(blocks + 4 * word);
+			}
+			#pragma GCC unroll 64
+			for(int step= 0; step < 64; ++step) {
+				uint32_t	mixed;
+				int			word;
+
+				if(step < 16) {
+					mixed= d ^ (b & (c ^ d));
+					word= step;
+				} else if(step < 32) {
+					mixed= c ^ (d & (b ^ c));
+					word= (5 * step + 1) % 16;
+				} else if(step < 48) {
+					mixed= b ^ c ^ d;
+					word= (3 * step + 5) % 16;
+				} else {
+					mixed= c ^ (b | ~d);
+					word= (7 * step) % 16;
+				}
+				mixed+= a + sines[step] + words[word];
+				a= d;
+				d= c;
+				c= b;
+				b+= _rotateLeft(mixed, kShifts[step / 16][step % 4]);
+			}
+			state[0]+= a;
+			state[1]+= b;
+			state[2]+= c;
+			state[3]+= d;
+		}
+	}
+	inline BlockCompressor MD5Hasher::accelerated() {trace_scope
+		return NULL;
+	}
+	/**
+		@return	The 64 sine constants, the integer part of 2^32 * abs(sin(step + 1))
+	*/
+	inline const uint32_t *MD5Hasher::sines() {trace_scope
+		static const uint32_t	kSines[64]= {
+			0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+			0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+			0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+			0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+			0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+			0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+			0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+			0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+		};
+
+		return kSines;
+	}
+	/**
+		@param data		The data to hash.
+		@param dataSize	The number of bytes in <code>data</code> to hash.
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void SHA1Hasher::hash(const void *data, size_t dataSize, void *hash) {trace_scope
+		State	state;
+
+		init(state);
+		update(state, data, dataSize);
+		final(state, hash);
+	}
+	/**
+		@param state	Set to the start of a hash
+	*/
+	inline void SHA1Hasher::init(State &state) {trace_scope
+		const uint32_t	kInitial[]= {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+		_initBlocks(state, kInitial, 5);
+	}
+	/**
+		@param state	The hash so far
+		@param data		More data to hash
+		@param dataSize	The number of bytes in <code>data</code>
+	*/
+	inline void SHA1Hasher::update(State &state, const void *data, size_t dataSize) {trace_scope
+		_updateBlocks(compressor(), state, data, dataSize);
+	}
+	/**
+		@param state	The hash so far, which must be init() again to be used again
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void SHA1Hasher::final(State &state, void *hash) {trace_scope
+		_finalBlocks(compressor(), state, 5, true, hash);
+	}
+	/**
+		@param count	The number of messages
+		@param data		count pointers to the messages
+		@param sizes	count sizes of the messages
+		@param hashes	count pointers to areas of memory, each at least <code>Size</code> bytes in length, that will hold the hashes
+	*/
+	inline void SHA1Hasher::hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes) {trace_scope
+		State	start;
+
+		init(start);
+		_hashEach(compressor(), start.words, 5, true, count, data, sizes, hashes);
+	}
+	/**
+		@return	The compressor hash() uses, chosen the first time it is called
+	*/
+	inline BlockCompressor &SHA1Hasher::compressor() {trace_scope
+		static BlockCompressor	compress= (NULL != accelerated()) ? accelerated() : portable;
+
+		return compress;
+	}
+	/** FIPS 180-4 6.1.2, with the message schedule kept in a 16 word circle.
+		@param state	The hash state
+		@param blocks	count 64 byte blocks
+		@param count	The number of blocks
+	*/
+	inline void SHA1Hasher::portable(uint32_t *state, const uint8_t *blocks, size_t count) {trace_scope
+		for(; trace_bool(count > 0); --count, blocks+= 64) {
+			uint32_t	words[16];
+			uint32_t	a= state[0], b= state[1], c= state[2], d= state[3], e= state[4];
+
+			#pragma GCC unroll 80
+			for(int step= 0; step < 80; ++step) {
+				uint32_t	mixed;
+
+				if(step < 16) {
+					words[step]= _bigEndian32(blocks + 4 * step);
+				} else {
+					words[step % 16]= _rotateLeft(words[(step - 3) % 16] ^ words[(step - 8) % 16] ^ words[(step - 14) % 16] ^ words[step % 16], 1);
+				}
+				if(step < 20) {
+					mixed= (d ^ (b & (c ^ d))) + 0x5A827999;
+				} else if(step < 40) {
+					mixed= (b ^ c ^ d) + 0x6ED9EBA1;
+				} else if(step < 60) {
+					mixed= ((b & c) | (d & (b | c))) + 0x8F1BBCDC;
+				} else {
+					mixed= (b ^ c ^ d) + 0xCA62C1D6;
+				}
+				mixed+= _rotateLeft(a, 5) + e + words[step % 16];
+				e= d;
+				d= c;
+				c= _rotateLeft(b, 30);
+				b= a;
+				a= mixed;
+			}
+			state[0]+= a;
+			state[1]+= b;
+			state[2]+= c;
+			state[3]+= d;
+			state[4]+= e;
+		}
+	}
+	/**
+		@return	The compressor for the CPU's SHA instructions, NULL if it does not have them
+	*/
+	inline BlockCompressor SHA1Hasher::accelerated() {trace_scope
+	#if HashX86
+		static const bool	available= _x86SHA();
+
+		return available ? _sha1x86 : NULL;
+	#elif HashARMSHA
+		static const bool	available= _armSHA();
+
+		return available ? _sha1arm : NULL;
+	#else
+		return NULL;
+	#endif
+	}
+	/**
+		@param data		The data to hash.
+		@param dataSize	The number of bytes in <code>data</code> to hash.
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void SHA256Hasher::hash(const void *data, size_t dataSize, void *hash) {trace_scope
+		State	state;
+
+		init(state);
+		update(state, data, dataSize);
+		final(state, hash);
+	}
+	/**
+		@param state	Set to the start of a hash
+	*/
+	inline void SHA256Hasher::init(State &state) {trace_scope
+		const uint32_t	kInitial[]= {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+		_initBlocks(state, kInitial, 8);
+	}
+	/**
+		@param state	The hash so far
+		@param data		More data to hash
+		@param dataSize	The number of bytes in <code>data</code>
+	*/
+	inline void SHA256Hasher::update(State &state, const void *data, size_t dataSize) {trace_scope
+		_updateBlocks(compressor(), state, data, dataSize);
+	}
+	/**
+		@param state	The hash so far, which must be init() again to be used again
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void SHA256Hasher::final(State &state, void *hash) {trace_scope
+		_finalBlocks(compressor(), state, 8, true, hash);
+	}
+	/**
+		@param count	The number of messages
+		@param data		count pointers to the messages
+		@param sizes	count sizes of the messages
+		@param hashes	count pointers to areas of memory, each at least <code>Size</code> bytes in length, that will hold the hashes
+	*/
+	inline void SHA256Hasher::hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes) {trace_scope
+		const LaneCompressor	lanes= laneCompressor();
+		State					start;
+
+		init(start);
+		if(trace_bool(NULL != lanes) && trace_bool(count > 1)) {
+			_hashLanes(lanes, start.words, 8, true, count, data, sizes, hashes);
+		} else {
+			_hashEach(compressor(), start.words, 8, true, count, data, sizes, hashes);
+		}
+	}
+	/**
+		@return	The lanes hashMany() uses, chosen the first time it is called
+	*/
+	inline LaneCompressor &SHA256Hasher::laneCompressor() {trace_scope
+		static LaneCompressor	lanes= (NULL != accelerated()) ? NULL : wide();
+
+		return lanes;
+	}
+	/**
+		@return	The lane compressor for the CPU's vector instructions, NULL if it does not have them
+	*/
+	inline LaneCompressor SHA256Hasher::wide() {trace_scope
+	#if HashX86
+		static const bool	available= _x86AVX2();
+
+		return available ? _sha256x8 : NULL;
+	#else
+		return NULL;
+	#endif
+	}
+	/**
+		@return	The compressor hash() uses, chosen the first time it is called
+	*/
+	inline BlockCompressor &SHA256Hasher::compressor() {trace_scope
+		static BlockCompressor	compress= (NULL != accelerated()) ? accelerated() : portable;
+
+		return compress;
+	}
+	/** FIPS 180-4 6.2.2, with the message schedule kept in a 16 word circle.
+		@param state	The hash state
+		@param blocks	count 64 byte blocks
+		@param count	The number of blocks
+	*/
+	inline void SHA256Hasher::portable(uint32_t *state, const uint8_t *blocks, size_t count) {trace_scope
+		const uint32_t	*rounds= SHA256Hasher::rounds();
+
+		for(; trace_bool(count > 0); --count, blocks+= 64) {
+			uint32_t	words[16];
+			uint32_t	a= state[0], b= state[1], c= state[2], d= state[3], e= state[4], f= state[5], g= state[6], h= state[7];
+
+			#pragma GCC unroll 64
+			for(int step= 0; step < 64; ++step) {
+				if(step < 16) {
+					words[step]= _bigEndian32(blocks + 4 * step);
+				} else {
+					const uint32_t	w15= words[(step - 15) % 16], w2= words[(step - 2) % 16];
+
+					words[step % 16]+= (_rotateLeft(w15, 25) ^ _rotateLeft(w15, 14) ^ (w15 >> 3))
+										+ words[(step - 7) % 16] + (_rotateLeft(w2, 15) ^ _rotateLeft(w2, 13) ^ (w2 >> 10));
+				}
+				const uint32_t	t1= h + (_rotateLeft(e, 26) ^ _rotateLeft(e, 21) ^ _rotateLeft(e, 7)) + (g ^ (e & (f ^ g))) + rounds[step] + words[step % 16];
+				const uint32_t	t2= (_rotateLeft(a, 30) ^ _rotateLeft(a, 19) ^ _rotateLeft(a, 10)) + ((a & b) | (c & (a | b)));
+
+				h= g;
+				g= f;
+				f= e;
+				e= d + t1;
+				d= c;
+				c= b;
+				b= a;
+				a= t1 + t2;
+			}
+			state[0]+= a;
+			state[1]+= b;
+			state[2]+= c;
+			state[3]+= d;
+			state[4]+= e;
+			state[5]+= f;
+			state[6]+= g;
+			state[7]+= h;
+		}
+	}
+	/**
+		@return	The compressor for the CPU's SHA instructions, NULL if it does not have them
+	*/
+	inline BlockCompressor SHA256Hasher::accelerated() {trace_scope
+	#if HashX86
+		static const bool	available= _x86SHA();
+
+		return available ? _sha256x86 : NULL;
+	#elif HashARMSHA
+		static const bool	available= _armSHA();
+
+		return available ? _sha256arm : NULL;
+	#else
+		return NULL;
+	#endif
+	}
+	/**
+		@return	The 64 round constants, the cube roots of the first primes
+	*/
+	inline const uint32_t *SHA256Hasher::rounds() {trace_scope
+		static const uint32_t	kRounds[64]= {
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+		};
+
+		return kRounds;
+	}
+	/**
+		@param bytes	Eight bytes, least significant first
+		@return			The 64 bit value
+	*/
+	inline uint64_t _littleEndian64(const uint8_t *bytes) {
+		return static_cast<uint64_t>(_littleEndian32(bytes)) | (static_cast<uint64_t>(_littleEndian32(bytes + 4)) << 32);
+	}
+	/**
+		@param value	A 64 bit value
+		@param bits		The number of bits to rotate left, 1 to 63
+		@return			value rotated left by bits
+	*/
+	inline uint64_t _rotateLeft64(uint64_t value, int bits) {
+		return (value << bits) | (value >> (64 - bits));
+	}
+	/**
+		@param value	A 64 bit value
+		@return			value with its bytes in the opposite order
+	*/
+	inline uint64_t _swap64(uint64_t value) {
+		value= ((value & 0x00FF00FF00FF00FFULL) << 8) | ((value >> 8) & 0x00FF00FF00FF00FFULL);
+		value= ((value & 0x0000FFFF0000FFFFULL) << 16) | ((value >> 16) & 0x0000FFFF0000FFFFULL);
+		return (value << 32) | (value >> 32);
+	}
+	/**
+		@param value	A 32 bit value
+		@return			value with its bytes in the opposite order
+	*/
+	inline uint32_t _swap32(uint32_t value) {
+		return (value << 24) | ((value & 0xFF00) << 8) | ((value >> 8) & 0xFF00) | (value >> 24);
+	}
+	/**
+		@param left		A 64 bit value
+		@param right	Another 64 bit value
+		@param high		Set to the most significant 64 bits of left * right
+		@return			The least significant 64 bits of left * right
+	*/
+	inline uint64_t _multiply128(uint64_t left, uint64_t right, uint64_t &high) {
+	#if defined(__SIZEOF_INT128__)
+		const unsigned __int128	product= static_cast<unsigned __int128>(left) * right;
+
+		high= static_cast<uint64_t>(product >> 64);
+		return static_cast<uint64_t>(product);
+	#else
+		const uint64_t	lowLow= (left & 0xFFFFFFFF) * (right & 0xFFFFFFFF);
+		const uint64_t	highLow= (left >> 32) * (right & 0xFFFFFFFF);
+		const uint64_t	lowHigh= (left & 0xFFFFFFFF) * (right >> 32);
+		const uint64_t	highHigh= (left >> 32) * (right >> 32);
+		const uint64_t	cross= (lowLow >> 32) + (highLow & 0xFFFFFFFF) + lowHigh;
+
+		high= (highLow >> 32) + (cross >> 32) + highHigh;
+		return (cross << 32) | (lowLow & 0xFFFFFFFF);
+	#endif
+	}
+	/**
+		@return	The 128 bit product of left and right, folded to 64 bits
+	*/
+	inline uint64_t _multiplyFold(uint64_t left, uint64_t right) {
+		uint64_t	high;
+		const uint64_t	low= _multiply128(left, right, high);
+
+		return low ^ high;
+	}
+	/// The xxHash primes
+	enum {
+		_kPrime32_1= 0x9E3779B1U, _kPrime32_2= 0x85EBCA77U, _kPrime32_3= 0xC2B2AE3DU
+	};
+	const uint64_t	_kPrime64_1= 0x9E3779B185EBCA87ULL, _kPrime64_2= 0xC2B2AE3D27D4EB4FULL, _kPrime64_3= 0x165667B19E3779F9ULL;
+	const uint64_t	_kPrime64_4= 0x85EBCA77C2B2AE63ULL, _kPrime64_5= 0x27D4EB2F165667C5ULL;
+	const uint64_t	_kPrimeMix1= 0x165667919E3779F9ULL, _kPrimeMix2= 0x9FB21C651E98DF25ULL;
+
+	/// XXH64's final mix
+	inline uint64_t _xxh64Avalanche(uint64_t value) {
+		value^= value >> 33;
+		value*= _kPrime64_2;
+		value^= value >> 29;
+		value*= _kPrime64_3;
+		return value ^ (value >> 32);
+	}
+	/// XXH3's final mix
+	inline uint64_t _xxh3Avalanche(uint64_t value) {
+		value^= value >> 37;
+		value*= _kPrimeMix1;
+		return value ^ (value >> 32);
+	}
+	/// XXH3's final mix for 4 to 8 bytes
+	inline uint64_t _xxh3Mix4To8(uint64_t value, uint64_t length) {
+		value^= _rotateLeft64(value, 49) ^ _rotateLeft64(value, 24);
+		value*= _kPrimeMix2;
+		value^= (value >> 35) + length;
+		value*= _kPrimeMix2;
+		return value ^ (value >> 28);
+	}
+	/// Mixes 16 bytes of data with 16 bytes of secret
+	inline uint64_t _xxh3Mix16(const uint8_t *data, const uint8_t *secret) {
+		return _multiplyFold(_littleEndian64(data) ^ _littleEndian64(secret), _littleEndian64(data + 8) ^ _littleEndian64(secret + 8));
+	}
+	/// Mixes two 16 byte pieces of data into a 128 bit accumulator
+	inline void _xxh3Mix32(uint64_t &low, uint64_t &high, const uint8_t *first, const uint8_t *second, const uint8_t *secret) {
+		low+= _xxh3Mix16(first, secret);
+		low^= _littleEndian64(second) + _littleEndian64(second + 8);
+		high+= _xxh3Mix16(second, secret + 16);
+		high^= _littleEndian64(first) + _littleEndian64(first + 8);
+	}
+	/** Adds a 64 byte stripe of data to the accumulators.
+		@param accumulators	The eight accumulators
+		@param stripe		64 bytes of data
+		@param secret		64 bytes of the secret, starting 8 bytes further on for each stripe of a block
+	*/
+	inline void _xxh3Accumulate(uint64_t *accumulators, const uint8_t *stripe, const uint8_t *secret) {
+		for(int lane= 0; lane < 8; ++lane) {
+			const uint64_t	value= _littleEndian64(stripe + 8 * lane);
+			const uint64_t	keyed= value ^ _littleEndian64(secret + 8 * lane);
+
+			accumulators[lane ^ 1]+= value;
+			accumulators[lane]+= (keyed & 0xFFFFFFFF) * (keyed >> 32);
+		}
+	}
+	/// Scrambles the accumulators after each block of 16 stripes
+	inline void _xxh3Scramble(uint64_t *accumulators, const uint8_t *secret) {
+		for(int lane= 0; lane < 8; ++lane) {
+			uint64_t	value= accumulators[lane];
+
+			value^= value >> 47;
+			value^= _littleEndian64(secret + 8 * lane);
+			accumulators[lane]= value * _kPrime32_1;
+		}
+	}
+#if HashX86 && defined(__x86_64__)
+	/** _xxh3Stripes() with the eight accumulators in two AVX2 registers.
+		@param accumulators	The eight accumulators
+		@param stripes		The number of stripes in the block so far, updated
+		@param data			count stripes
+		@param count		The number of stripes in data
+		@param secret		XXH3Hasher::secret()
+	*/
+	__attribute__((target("avx2"))) inline void _xxh3StripesAVX2(uint64_t *accumulators, size_t &stripes, const uint8_t *data, size_t count, const uint8_t *secret) {
+		const size_t	kStripesPerBlock= 16;
+		const __m256i	kPrime= _mm256_set1_epi32(static_cast<int>(_kPrime32_1));
+		__m256i			sums[2];
+
+		sums[0]= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulators));
+		sums[1]= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulators + 4));
+		for(; count > 0; --count, data+= 64) {
+			for(int half= 0; half < 2; ++half) {
+				const __m256i	value= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32 * half));
+				const __m256i	keyed= _mm256_xor_si256(value, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret + 8 * stripes + 32 * half)));
+				const __m256i	product= _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+
+				sums[half]= _mm256_add_epi64(_mm256_add_epi64(sums[half], _mm256_shuffle_epi32(value, 0x4E)), product);
+			}
+			if(++stripes == kStripesPerBlock) {
+				for(int half= 0; half < 2; ++half) {
+					const __m256i	key= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret + 192 - 64 + 32 * half));
+					const __m256i	mixed= _mm256_xor_si256(_mm256_xor_si256(sums[half], _mm256_srli_epi64(sums[half], 47)), key);
+
+					sums[half]= _mm256_add_epi64(_mm256_mul_epu32(mixed, kPrime),
+												_mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(mixed, 32), kPrime), 32));
+				}
+				stripes= 0;
+			}
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(accumulators), sums[0]);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(accumulators + 4), sums[1]);
+	}
+#endif
+	/** Accumulates stripes, scrambling after every 16.
+		@param accumulators	The eight accumulators
+		@param stripes		The number of stripes in the block so far, updated
+		@param data			count stripes
+		@param count		The number of stripes in data
+	*/
+	inline void _xxh3Stripes(uint64_t *accumulators, size_t &stripes, const uint8_t *data, size_t count) {trace_scope
+		const size_t	kStripesPerBlock= 16;
+		const uint8_t	*secret= XXH3Hasher::secret();
+
+	#if HashX86 && defined(__x86_64__)
+		static const bool	wide= _x86AVX2();
+
+		if(trace_bool(wide)) {
+			_xxh3StripesAVX2(accumulators, stripes, data, count, secret);
+			return;
+		}
+	#endif
+		for(; trace_bool(count > 0); --count, data+= 64) {
+			_xxh3Accumulate(accumulators, data, secret + 8 * stripes);
+			if(trace_bool(++stripes == kStripesPerBlock)) {
+				_xxh3Scramble(accumulators, secret + 192 - 64);
+				stripes= 0;
+			}
+		}
+	}
+	/// Merges the accumulators into 64 bits
+	inline uint64_t _xxh3Merge(const uint64_t *accumulators, const uint8_t *secret, uint64_t start) {
+		for(int pair= 0; pair < 4; ++pair) {
+			start+= _multiplyFold(accumulators[2 * pair] ^ _littleEndian64(secret + 16 * pair),
+									accumulators[2 * pair + 1] ^ _littleEndian64(secret + 16 * pair + 8));
+		}
+		return _xxh3Avalanche(start);
+	}
+	/** XXH3 of data under 241 bytes, or XXH128 if high is not NULL.
+		@param data		The data
+		@param size		The number of bytes in data, 0 to 240
+		@param high		NULL for a 64 bit hash, otherwise set to the most significant 64 bits of the 128 bit hash
+		@return			The hash, or the least significant 64 bits of the 128 bit hash
+	*/
+	inline uint64_t _xxh3Short(const uint8_t *data, size_t size, uint64_t *high) {trace_scope
+		const uint8_t	*secret= XXH3Hasher::secret();
+		const uint64_t	length= size;
+
+		if(trace_bool(0 == size)) {
+			if(trace_bool(NULL != high)) {
+				*high= _xxh64Avalanche(_littleEndian64(secret + 80) ^ _littleEndian64(secret + 88));
+				return _xxh64Avalanche(_littleEndian64(secret + 64) ^ _littleEndian64(secret + 72));
+			}
+			return _xxh64Avalanche(_littleEndian64(secret + 56) ^ _littleEndian64(secret + 64));
+		}
+		if(trace_bool(size <= 3)) {
+			const uint32_t	combined= (static_cast<uint32_t>(data[0]) << 16) | (static_cast<uint32_t>(data[size >> 1]) << 24)
+										| data[size - 1] | (static_cast<uint32_t>(size) << 8);
+			const uint64_t	low= _xxh64Avalanche(combined ^ static_cast<uint64_t>(_littleEndian32(secret) ^ _littleEndian32(secret + 4)));
+
+			if(trace_bool(NULL != high)) {
+				const uint32_t	swapped= _swap32(combined);
+
+				*high= _xxh64Avalanche(_rotateLeft(swapped, 13) ^ static_cast<uint64_t>(_littleEndian32(secret + 8) ^ _littleEndian32(secret + 12)));
+			}
+			return low;
+		}
+		if(trace_bool(size <= 8)) {
+			const uint64_t	first= _littleEndian32(data), last= _littleEndian32(data + size - 4);
+
+			if(trace_bool(NULL != high)) {
+				uint64_t	mixedHigh;
+				uint64_t	mixedLow= _multiply128((first + (last << 32)) ^ (_littleEndian64(secret + 16) ^ _littleEndian64(secret + 24)),
+											_kPrime64_1 + (length << 2), mixedHigh);
+
+				mixedHigh+= mixedLow << 1;
+				mixedLow^= mixedHigh >> 3;
+				mixedLow^= mixedLow >> 35;
+				mixedLow*= _kPrimeMix2;
+				mixedLow^= mixedLow >> 28;
+				*high= _xxh3Avalanche(mixedHigh);
+				return mixedLow;
+			}
+			return _xxh3Mix4To8((last + (first << 32)) ^ (_littleEndian64(secret + 8) ^ _littleEndian64(secret + 16)), length);
+		}
+		if(trace_bool(size <= 16)) {
+			const uint64_t	first= _littleEndian64(data), last= _littleEndian64(data + size - 8);
+
+			if(trace_bool(NULL != high)) {
+				const uint64_t	lastKeyed= last ^ (_littleEndian64(secret + 48) ^ _littleEndian64(secret + 56));
+				uint64_t		mixedHigh, resultHigh;
+				uint64_t		mixedLow= _multiply128(first ^ last ^ (_littleEndian64(secret + 32) ^ _littleEndian64(secret + 40)), _kPrime64_1, mixedHigh);
+
+				mixedLow+= (length - 1) << 54;
+				mixedHigh+= lastKeyed + (lastKeyed & 0xFFFFFFFF) * (_kPrime32_2 - 1);
+				mixedLow^= _swap64(mixedHigh);
+				const uint64_t	resultLow= _multiply128(mixedLow, _kPrime64_2, resultHigh);
+
+				resultHigh+= mixedHigh * _kPrime64_2;
+				*high= _xxh3Avalanche(resultHigh);
+				return _xxh3Avalanche(resultLow);
+			}
+			const uint64_t	firstKeyed= first ^ (_littleEndian64(secret + 24) ^ _littleEndian64(secret + 32));
+			const uint64_t	lastKeyed= last ^ (_littleEndian64(secret + 40) ^ _littleEndian64(secret + 48));
+
+			return _xxh3Avalanche(length + _swap64(firstKeyed) + lastKeyed + _multiplyFold(firstKeyed, lastKeyed));
+		}
+		uint64_t	low= length * _kPrime64_1, highSum= 0;
+
+		if(trace_bool(size <= 128)) {
+			if(trace_bool(NULL != high)) {
+				for(size_t piece= (size - 1) / 32 + 1; trace_bool(piece > 0); --piece) {
+					_xxh3Mix32(low, highSum, data + 16 * (piece - 1), data + size - 16 * piece, secret + 32 * (piece - 1));
+				}
+			} else {
+				for(size_t piece= (size - 1) / 32 + 1; trace_bool(piece > 0); --piece) {
+					low+= _xxh3Mix16(data + 16 * (piece - 1), secret + 32 * (piece - 1));
+					low+= _xxh3Mix16(data + size - 16 * piece, secret + 32 * (piece - 1) + 16);
+				}
+				return _xxh3Avalanche(low);
+			}
+		} else if(trace_bool(NULL != high)) {
+			for(size_t piece= 0; trace_bool(piece < 4); ++piece) {
+				_xxh3Mix32(low, highSum, data + 32 * piece, data + 32 * piece + 16, secret + 32 * piece);
+			}
+			low= _xxh3Avalanche(low);
+			highSum= _xxh3Avalanche(highSum);
+			for(size_t piece= 4; trace_bool(piece < size / 32); ++piece) {
+				_xxh3Mix32(low, highSum, data + 32 * piece, data + 32 * piece + 16, secret + 3 + 32 * (piece - 4));
+			}
+			_xxh3Mix32(low, highSum, data + size - 16, data + size - 32, secret + 136 - 17 - 16);
+		} else {
+			for(size_t piece= 0; trace_bool(piece < 8); ++piece) {
+				low+= _xxh3Mix16(data + 16 * piece, secret + 16 * piece);
+			}
+			low= _xxh3Avalanche(low);
+			for(size_t piece= 8; trace_bool(piece < size / 16); ++piece) {
+				low+= _xxh3Mix16(data + 16 * piece, secret + 16 * (piece - 8) + 3);
+			}
+			return _xxh3Avalanche(low + _xxh3Mix16(data + size - 16, secret + 136 - 17));
+		}
+		*high= 0 - _xxh3Avalanche(low * _kPrime64_1 + highSum * _kPrime64_4 + length * _kPrime64_2);
+		return _xxh3Avalanche(low + highSum);
+	}
+	/** Finishes XXH3 or XXH128 of the data passed to XXH3Hasher::update().
+		@param state	The hash so far
+		@param high		NULL for a 64 bit hash, otherwise set to the most significant 64 bits of the 128 bit hash
+		@return			The hash, or the least significant 64 bits of the 128 bit hash
+	*/
+	inline uint64_t _xxh3Final(const XXH3State &state, uint64_t *high) {trace_scope
+		const size_t	kStripe= 64;
+		const uint8_t	*secret= XXH3Hasher::secret();
+		uint64_t		accumulators[8];
+		size_t			stripes= state.stripes;
+		uint8_t			last[kStripe];
+
+		if(trace_bool(state.length <= 240)) {
+			return _xxh3Short(state.buffer, state.bufferSize, high);
+		}
+		memcpy(accumulators, state.accumulators, sizeof(accumulators));
+		if(trace_bool(state.bufferSize >= kStripe)) {
+			_xxh3Stripes(accumulators, stripes, state.buffer, (state.bufferSize - 1) / kStripe);
+			memcpy(last, state.buffer + state.bufferSize - kStripe, kStripe);
+		} else {
+			memcpy(last, state.previous + state.bufferSize, kStripe - state.bufferSize);
+			memcpy(last + kStripe - state.bufferSize, state.buffer, state.bufferSize);
+		}
+		_xxh3Accumulate(accumulators, last, secret + 192 - kStripe - 7);
+		if(trace_bool(NULL != high)) {
+			*high= _xxh3Merge(accumulators, secret + 192 - 64 - 11, ~(state.length * _kPrime64_2));
+		}
+		return _xxh3Merge(accumulators, secret + 11, state.length * _kPrime64_1);
+	}
+	/**
+		@param state	Set to the start of a hash
+	*/
+	inline void _xxh3Init(XXH3State &state) {trace_scope
+		const uint64_t	kInitial[]= {_kPrime32_3, _kPrime64_1, _kPrime64_2, _kPrime64_3, _kPrime64_4, _kPrime32_2, _kPrime64_5, _kPrime32_1};
+
+		memcpy(state.accumulators, kInitial, sizeof(kInitial));
+		state.bufferSize= 0;
+		state.stripes= 0;
+		state.length= 0;
+	}
+	/** Holds data until there is more than the buffer holds, so short data is hashed all at once by final,
+			and keeps at least a byte back, so the last stripe is accumulated by final.
+		@param state	The hash so far
+		@param data		More data
+		@param size		The number of bytes in data
+	*/
+	inline void _xxh3Update(XXH3State &state, const void *data, size_t size) {trace_scope
+		const size_t	kStripe= 64;
+		const uint8_t	*bytes= reinterpret_cast<const uint8_t*>(data);
+
+		state.length+= size;
+		if(trace_bool(state.bufferSize + size <= sizeof(state.buffer))) {
+			memcpy(state.buffer + state.bufferSize, bytes, size);
+			state.bufferSize+= size;
+			return;
+		}
+		if(trace_bool(state.bufferSize > 0)) {
+			const size_t	fill= sizeof(state.buffer) - state.bufferSize;
 
-	/// An MD5 example of a hasher. See SpecificHash.
-	struct MD5Hasher {
-		enum {
-			Size= CC_MD5_DIGEST_LENGTH ///< Every SpecificHash hasher must have a Size enum. This is the number of bytes in the hash.
-		};
-		/** Every SpecificHash hasher must have a name() method. This is the name of this hash.
-			@return	The name of this hash method.
-		*/
-		static const char *name() {trace_scope return "md5";}
-		/** Every SpecificHash hasher must have a hash() method. This computes the hash of the given data.
-			@param data		The data to hash.
-			@param dataSize	The number of bytes in <code>data</code> to hash.
-			@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
-		*/
-		static void hash(const void *data, size_t dataSize, void *hash) {trace_scope CC_MD5(data, dataSize, reinterpret_cast<unsigned char*>(hash));}
-	};
+			memcpy(state.buffer + state.bufferSize, bytes, fill);
+			bytes+= fill;
+			size-= fill;
+			_xxh3Stripes(state.accumulators, state.stripes, state.buffer, sizeof(state.buffer) / kStripe);
+			memcpy(state.previous, state.buffer + sizeof(state.buffer) - kStripe, kStripe);
+			state.bufferSize= 0;
+		}
+		if(trace_bool(size > sizeof(state.buffer))) {
+			const size_t	stripes= (size - 1) / kStripe;
 
-	/// A SHA256 example of a hasher. See SpecificHash.
-	struct SHA256Hasher {
-		enum {
-			Size= CC_SHA256_DIGEST_LENGTH ///< Every SpecificHash hasher must have a Size enum. This is the number of bytes in the hash.
+			_xxh3Stripes(state.accumulators, state.stripes, bytes, stripes);
+			memcpy(state.previous, bytes + (stripes - 1) * kStripe, kStripe);
+			bytes+= stripes * kStripe;
+			size-= stripes * kStripe;
+		}
+		memcpy(state.buffer, bytes, size);
+		state.bufferSize= size;
+	}
+	/**
+		@param data		The data to hash.
+		@param size		The number of bytes in <code>data</code> to hash.
+		@param high		NULL for a 64 bit hash, otherwise set to the most significant 64 bits of the 128 bit hash
+		@return			The hash, or the least significant 64 bits of the 128 bit hash
+	*/
+	inline uint64_t _xxh3(const void *data, size_t size, uint64_t *high) {trace_scope
+		XXH3State	state;
+
+		if(trace_bool(size <= 240)) {
+			return _xxh3Short(reinterpret_cast<const uint8_t*>(data), size, high);
+		}
+		_xxh3Init(state);
+		_xxh3Update(state, data, size);
+		return _xxh3Final(state, high);
+	}
+	/**
+		@param value	The value to store
+		@param bytes	The number of bytes of value to store
+		@param out		Set to value, most significant byte first
+	*/
+	inline void _storeBigEndian(uint64_t value, int bytes, uint8_t *out) {
+		for(int byte= 0; byte < bytes; ++byte) {
+			out[byte]= static_cast<uint8_t>(value >> (8 * (bytes - 1 - byte)));
+		}
+	}
+
+	/**
+		@param data		The data to hash.
+		@param dataSize	The number of bytes in <code>data</code> to hash.
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void XXH3Hasher::hash(const void *data, size_t dataSize, void *hash) {trace_scope
+		_storeBigEndian(value(data, dataSize), Size, reinterpret_cast<uint8_t*>(hash));
+	}
+	/**
+		@param state	Set to the start of a hash
+	*/
+	inline void XXH3Hasher::init(State &state) {trace_scope
+		_xxh3Init(state);
+	}
+	/**
+		@param state	The hash so far
+		@param data		More data to hash
+		@param dataSize	The number of bytes in <code>data</code>
+	*/
+	inline void XXH3Hasher::update(State &state, const void *data, size_t dataSize) {trace_scope
+		_xxh3Update(state, data, dataSize);
+	}
+	/**
+		@param state	The hash so far, which must be init() again to be used again
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void XXH3Hasher::final(State &state, void *hash) {trace_scope
+		_storeBigEndian(_xxh3Final(state, NULL), Size, reinterpret_cast<uint8_t*>(hash));
+	}
+	/**
+		@param count	The number of messages
+		@param data		count pointers to the messages
+		@param sizes	count sizes of the messages
+		@param hashes	count pointers to areas of memory, each at least <code>Size</code> bytes in length, that will hold the hashes
+	*/
+	inline void XXH3Hasher::hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes) {trace_scope
+		for(size_t message= 0; trace_bool(message < count); ++message) {
+			hash(data[message], sizes[message], hashes[message]);
+		}
+	}
+	/**
+		@param data		The data to hash.
+		@param dataSize	The number of bytes in <code>data</code> to hash.
+		@return			The hash
+	*/
+	inline uint64_t XXH3Hasher::value(const void *data, size_t dataSize) {trace_scope
+		return _xxh3(data, dataSize, NULL);
+	}
+	/** The same as value(&key, sizeof(key)) on a little endian machine, without a trip through memory.
+		@param key	The key to hash
+		@return		The hash
+	*/
+	inline uint64_t XXH3Hasher::value(uint64_t key) {trace_scope
+		static const uint64_t	keyMask= _littleEndian64(secret() + 8) ^ _littleEndian64(secret() + 16);
+
+		return _xxh3Mix4To8(_rotateLeft64(key, 32) ^ keyMask, sizeof(key));
+	}
+	/**
+		@return	The 192 byte default secret
+	*/
+	inline const uint8_t *XXH3Hasher::secret() {trace_scope
+		static const uint8_t	kSecret[192]= {
+			0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+			0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+			0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+			0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+			0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+			0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+			0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+			0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+			0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+			0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+			0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+			0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e
 		};
-		/** Every SpecificHash hasher must have a name() method. This is the name of this hash.
-			@return	The name of this hash method.
-		*/
-		static const char *name() {trace_scope return "sha256";}
-		/** Every SpecificHash hasher must have a hash() method. This computes the hash of the given data.
-			@param data		The data to hash.
-			@param dataSize	The number of bytes in <code>data</code> to hash.
-			@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
-		*/
-		static void hash(const void *data, size_t dataSize, void *hash) {trace_scope CC_SHA256(data, dataSize, reinterpret_cast<unsigned char*>(hash));}
-	};
 
+		return kSecret;
+	}
+	/**
+		@param data		The data to hash.
+		@param dataSize	The number of bytes in <code>data</code> to hash.
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void XXH128Hasher::hash(const void *data, size_t dataSize, void *hash) {trace_scope
+		uint64_t		high;
+		const uint64_t	low= value(data, dataSize, high);
+
+		_storeBigEndian(high, 8, reinterpret_cast<uint8_t*>(hash));
+		_storeBigEndian(low, 8, reinterpret_cast<uint8_t*>(hash) + 8);
+	}
+	/**
+		@param state	Set to the start of a hash
+	*/
+	inline void XXH128Hasher::init(State &state) {trace_scope
+		_xxh3Init(state);
+	}
+	/**
+		@param state	The hash so far
+		@param data		More data to hash
+		@param dataSize	The number of bytes in <code>data</code>
+	*/
+	inline void XXH128Hasher::update(State &state, const void *data, size_t dataSize) {trace_scope
+		_xxh3Update(state, data, dataSize);
+	}
+	/**
+		@param state	The hash so far, which must be init() again to be used again
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void XXH128Hasher::final(State &state, void *hash) {trace_scope
+		uint64_t		high;
+		const uint64_t	low= _xxh3Final(state, &high);
+
+		_storeBigEndian(high, 8, reinterpret_cast<uint8_t*>(hash));
+		_storeBigEndian(low, 8, reinterpret_cast<uint8_t*>(hash) + 8);
+	}
+	/**
+		@param count	The number of messages
+		@param data		count pointers to the messages
+		@param sizes	count sizes of the messages
+		@param hashes	count pointers to areas of memory, each at least <code>Size</code> bytes in length, that will hold the hashes
+	*/
+	inline void XXH128Hasher::hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes) {trace_scope
+		for(size_t message= 0; trace_bool(message < count); ++message) {
+			hash(data[message], sizes[message], hashes[message]);
+		}
+	}
+	/**
+		@param data		The data to hash.
+		@param dataSize	The number of bytes in <code>data</code> to hash.
+		@param high		Set to the most significant 64 bits of the hash
+		@return			The least significant 64 bits of the hash
+	*/
+	inline uint64_t XXH128Hasher::value(const void *data, size_t dataSize, uint64_t &high) {trace_scope
+		return _xxh3(data, dataSize, &high);
+	}
+
+#if HashX86
+	/**
+		@return	true if the CPU has the SSE4.2 crc32 instruction
+	*/
+	inline bool _x86CRC32() {trace_scope
+		const unsigned int	kSSE42= 1 << 20; // leaf 1 ecx
+		unsigned int		eax= 0, ebx= 0, ecx= 0, edx= 0;
+
+		__cpuid(1, eax, ebx, ecx, edx);
+		return (ecx & kSSE42) != 0;
+	}
+	/**
+		@param crc		The checksum register so far
+		@param data		The data to add
+		@param size		The number of bytes in data
+		@return			The checksum register after data
+	*/
+	__attribute__((target("sse4.2"))) inline uint32_t _crc32cX86(uint32_t crc, const uint8_t *data, size_t size) {trace_scope
+	#if defined(__x86_64__)
+		uint64_t	wide= crc;
+
+		for(; trace_bool(size >= 8); size-= 8, data+= 8) {
+			uint64_t	value;
+
+			memcpy(&value, data, sizeof(value));
+			wide= _mm_crc32_u64(wide, value);
+		}
+		crc= static_cast<uint32_t>(wide);
+	#endif
+		for(; trace_bool(size >= 4); size-= 4, data+= 4) {
+			uint32_t	value;
+
+			memcpy(&value, data, sizeof(value));
+			crc= _mm_crc32_u32(crc, value);
+		}
+		for(; trace_bool(size > 0); --size, ++data) {
+			crc= _mm_crc32_u8(crc, *data);
+		}
+		return crc;
+	}
+	/**
+		@return	true if the CPU has the SSSE3 byte shuffle
+	*/
+	inline bool _x86SSSE3() {trace_scope
+		const unsigned int	kSSSE3= 1 << 9; // leaf 1 ecx
+		unsigned int		eax= 0, ebx= 0, ecx= 0, edx= 0;
+
+		__cpuid(1, eax, ebx, ecx, edx);
+		return (ecx & kSSSE3) != 0;
+	}
+	/**
+		@param data		16 bytes
+		@param hex		Set to the 32 hex digits of data
+		@param order	Which nibble of each byte goes first
+	*/
+	__attribute__((target("ssse3"))) inline void _hexEncode16(const uint8_t *data, char *hex, NibbleOrder order) {
+		const __m128i	digits= _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+		const __m128i	nibble= _mm_set1_epi8(0x0F);
+		const __m128i	bytes= _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+		const __m128i	high= _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+		const __m128i	low= _mm_shuffle_epi8(digits, _mm_and_si128(bytes, nibble));
+		const __m128i	first= (HighNibbleFirst == order) ? high : low, second= (HighNibbleFirst == order) ? low : high;
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(hex), _mm_unpacklo_epi8(first, second));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 16), _mm_unpackhi_epi8(first, second));
+	}
+	/**
+		@param characters	16 characters
+		@return				The value of each hex digit, 0xFF for characters that are not hex digits
+	*/
+	__attribute__((target("ssse3"))) inline __m128i _hexValues16(__m128i characters) {
+		const __m128i	digits= _mm_sub_epi8(characters, _mm_set1_epi8('0'));
+		const __m128i	letters= _mm_sub_epi8(_mm_or_si128(characters, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+		const __m128i	isDigit= _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+		const __m128i	isLetter= _mm_cmpeq_epi8(_mm_min_epu8(letters, _mm_set1_epi8(5)), letters);
+		const __m128i	values= _mm_or_si128(_mm_and_si128(isDigit, digits), _mm_and_si128(isLetter, _mm_add_epi8(letters, _mm_set1_epi8(10))));
+
+		return _mm_or_si128(values, _mm_andnot_si128(_mm_or_si128(isDigit, isLetter), _mm_set1_epi8(-1)));
+	}
+	/** Each pair of digit values is multiplied by 16 and 1 and added, as 16 bit numbers which are then packed into bytes.
+		@param hex		32 hex digits
+		@param data		Set to the 16 bytes
+		@param order	Which nibble of each byte comes first
+		@return			false if any of the characters is not a hex digit
+	*/
+	__attribute__((target("ssse3"))) inline bool _hexDecode16(const char *hex, uint8_t *data, NibbleOrder order) {
+		const __m128i	weights= _mm_set1_epi16((HighNibbleFirst == order) ? 0x0110 : 0x1001);
+		const __m128i	first= _hexValues16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex)));
+		const __m128i	second= _hexValues16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + 16)));
+
+		if(_mm_movemask_epi8(_mm_or_si128(first, second)) != 0) {
+			return false;
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data), _mm_packus_epi16(_mm_maddubs_epi16(first, weights), _mm_maddubs_epi16(second, weights)));
+		return true;
+	}
+	/**
+		@param data		The bytes to encode
+		@param size		The number of bytes in data
+		@param hex		Set to the 2 * size hex digits of data
+		@param order	Which nibble of each byte goes first
+	*/
+	__attribute__((target("ssse3"))) inline void _hexEncodeSSSE3(const uint8_t *data, size_t size, char *hex, NibbleOrder order) {trace_scope
+		for(; trace_bool(size >= 16); size-= 16, data+= 16, hex+= 32) {
+			_hexEncode16(data, hex, order);
+		}
+		HexCodec::portableEncode(data, size, hex, order);
+	}
+	/**
+		@param hex		The 2 * size hex digits to decode
+		@param size		The number of bytes in data
+		@param data		Set to the bytes
+		@param order	Which nibble of each byte comes first
+		@return			false if any of the characters is not a hex digit
+	*/
+	__attribute__((target("ssse3"))) inline bool _hexDecodeSSSE3(const char *hex, size_t size, uint8_t *data, NibbleOrder order) {trace_scope
+		for(; trace_bool(size >= 16); size-= 16, data+= 16, hex+= 32) {
+			if(!_hexDecode16(hex, data, order)) {
+				return false;
+			}
+		}
+		return HexCodec::portableDecode(hex, size, data, order);
+	}
+	/** Shuffles and unpacks stay in their 128 bit half, so the halves of the digits are swapped back into order before storing.
+		@param data		The bytes to encode
+		@param size		The number of bytes in data
+		@param hex		Set to the 2 * size hex digits of data
+		@param order	Which nibble of each byte goes first
+	*/
+	__attribute__((target("avx2"))) inline void _hexEncodeAVX2(const uint8_t *data, size_t size, char *hex, NibbleOrder order) {trace_scope
+		const __m256i	digits= _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+												'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+		const __m256i	nibble= _mm256_set1_epi8(0x0F);
+
+		for(; trace_bool(size >= 32); size-= 32, data+= 32, hex+= 64) {
+			const __m256i	bytes= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+			const __m256i	high= _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+			const __m256i	low= _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, nibble));
+			const __m256i	first= (HighNibbleFirst == order) ? high : low, second= (HighNibbleFirst == order) ? low : high;
+			const __m256i	lower= _mm256_unpacklo_epi8(first, second), upper= _mm256_unpackhi_epi8(first, second);
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(hex), _mm256_permute2x128_si256(lower, upper, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(hex + 32), _mm256_permute2x128_si256(lower, upper, 0x31));
+		}
+		_hexEncodeSSSE3(data, size, hex, order);
+	}
+	/** Packing stays in each 128 bit half, so the quarters of the bytes are put back in order before storing.
+		@param hex		The 2 * size hex digits to decode
+		@param size		The number of bytes in data
+		@param data		Set to the bytes
+		@param order	Which nibble of each byte comes first
+		@return			false if any of the characters is not a hex digit
+	*/
+	__attribute__((target("avx2"))) inline bool _hexDecodeAVX2(const char *hex, size_t size, uint8_t *data, NibbleOrder order) {trace_scope
+		const __m256i	weights= _mm256_set1_epi16((HighNibbleFirst == order) ? 0x0110 : 0x1001);
+		const __m256i	zero= _mm256_set1_epi8('0'), lowerCase= _mm256_set1_epi8(0x20), a= _mm256_set1_epi8('a');
+		const __m256i	nine= _mm256_set1_epi8(9), five= _mm256_set1_epi8(5), ten= _mm256_set1_epi8(10);
+
+		for(; trace_bool(size >= 32); size-= 32, data+= 32, hex+= 64) {
+			__m256i	values[2];
+
+			for(int half= 0; half < 2; ++half) {
+				const __m256i	characters= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex + 32 * half));
+				const __m256i	digits= _mm256_sub_epi8(characters, zero);
+				const __m256i	letters= _mm256_sub_epi8(_mm256_or_si256(characters, lowerCase), a);
+				const __m256i	isDigit= _mm256_cmpeq_epi8(_mm256_min_epu8(digits, nine), digits);
+				const __m256i	isLetter= _mm256_cmpeq_epi8(_mm256_min_epu8(letters, five), letters);
+
+				values[half]= _mm256_or_si256(_mm256_and_si256(isDigit, digits), _mm256_and_si256(isLetter, _mm256_add_epi8(letters, ten)));
+				values[half]= _mm256_or_si256(values[half], _mm256_andnot_si256(_mm256_or_si256(isDigit, isLetter), _mm256_set1_epi8(-1)));
+			}
+			if(_mm256_movemask_epi8(_mm256_or_si256(values[0], values[1])) != 0) {
+				return false;
+			}
+			const __m256i	packed= _mm256_packus_epi16(_mm256_maddubs_epi16(values[0], weights), _mm256_maddubs_epi16(values[1], weights));
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(data), _mm256_permute4x64_epi64(packed, 0xD8));
+		}
+		return _hexDecodeSSSE3(hex, size, data, order);
+	}
 #endif
 
+	/**
+		@param data		The data to hash.
+		@param dataSize	The number of bytes in <code>data</code> to hash.
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the hash.
+	*/
+	inline void CRC32CHasher::hash(const void *data, size_t dataSize, void *hash) {trace_scope
+		_storeBigEndian(value(data, dataSize), Size, reinterpret_cast<uint8_t*>(hash));
+	}
+	/**
+		@param state	Set to the start of a checksum
+	*/
+	inline void CRC32CHasher::init(State &state) {trace_scope
+		state= 0xFFFFFFFF;
+	}
+	/**
+		@param state	The checksum so far
+		@param data		More data to hash
+		@param dataSize	The number of bytes in <code>data</code>
+	*/
+	inline void CRC32CHasher::update(State &state, const void *data, size_t dataSize) {trace_scope
+		state= checksummer()(state, reinterpret_cast<const uint8_t*>(data), dataSize);
+	}
+	/**
+		@param state	The checksum so far, which must be init() again to be used again
+		@param hash		An area of memory, at least <code>Size</code> bytes in length that will hold the checksum.
+	*/
+	inline void CRC32CHasher::final(State &state, void *hash) {trace_scope
+		_storeBigEndian(~state, Size, reinterpret_cast<uint8_t*>(hash));
+	}
+	/**
+		@param count	The number of messages
+		@param data		count pointers to the messages
+		@param sizes	count sizes of the messages
+		@param hashes	count pointers to areas of memory, each at least <code>Size</code> bytes in length, that will hold the checksums
+	*/
+	inline void CRC32CHasher::hashMany(size_t count, const void * const *data, const size_t *sizes, void * const *hashes) {trace_scope
+		for(size_t message= 0; trace_bool(message < count); ++message) {
+			hash(data[message], sizes[message], hashes[message]);
+		}
+	}
+	/** Checksums can be continued: value(ab, 2) == value(b, 1, value(a, 1))
+		@param data		The data to checksum.
+		@param dataSize	The number of bytes in <code>data</code> to checksum.
+		@param previous	The checksum of the data before data, or 0
+		@return			The checksum
+	*/
+	inline uint32_t CRC32CHasher::value(const void *data, size_t dataSize, uint32_t previous) {trace_scope
+		return ~checksummer()(~previous, reinterpret_cast<const uint8_t*>(data), dataSize);
+	}
+	/** The same as value(&key, sizeof(key)) on a little endian machine.
+		@param key	The key to checksum
+		@return		The checksum
+	*/
+	inline uint32_t CRC32CHasher::value(uint64_t key) {trace_scope
+		uint8_t	bytes[sizeof(key)];
 
+		for(size_t byte= 0; trace_bool(byte < sizeof(key)); ++byte) {
+			bytes[byte]= static_cast<uint8_t>(key >> (8 * byte));
+		}
+		return value(bytes, sizeof(bytes));
+	}
 	/**
+		@return	The checksummer value() uses, chosen the first time it is called
 	*/
-	inline Hash::Hash() {trace_scope
+	inline CRC32CHasher::Checksummer &CRC32CHasher::checksummer() {trace_scope
+		static Checksummer	checksum= (NULL != accelerated()) ? accelerated() : portable;
+
+		return checksum;
+	}
+	/// The tables for CRC32CHasher::portable(), built once
+	struct _CRC32CTables {
+		uint32_t	entries[8][256]; ///< entries[n][b] is the register after b and then n zero bytes
+		/// Builds the tables for the Castagnoli polynomial
+		_CRC32CTables()
+			:entries() {trace_scope
+			const uint32_t	kPolynomial= 0x82F63B78; // reversed
+
+			for(uint32_t byte= 0; trace_bool(byte < 256); ++byte) {
+				uint32_t	value= byte;
+
+				for(int bit= 0; trace_bool(bit < 8); ++bit) {
+					value= (value >> 1) ^ ((value & 1) ? kPolynomial : 0);
+				}
+				entries[0][byte]= value;
+			}
+			for(uint32_t byte= 0; trace_bool(byte < 256); ++byte) {
+				for(int table= 1; trace_bool(table < 8); ++table) {
+					entries[table][byte]= (entries[table - 1][byte] >> 8) ^ entries[0][entries[table - 1][byte] & 0xFF];
+				}
+			}
+		}
+	};
+	/** Slicing by 8: eight tables, so eight bytes take eight lookups and no shifts between them.
+		@param crc		The checksum register so far
+		@param data		The data to add
+		@param size		The number of bytes in data
+		@return			The checksum register after data
+	*/
+	inline uint32_t CRC32CHasher::portable(uint32_t crc, const uint8_t *data, size_t size) {trace_scope
+		static const _CRC32CTables	tables;
+		const uint32_t				(&entries)[8][256]= tables.entries;
+
+		for(; trace_bool(size >= 8); size-= 8, data+= 8) {
+			const uint32_t	low= crc ^ _littleEndian32(data), high= _littleEndian32(data + 4);
+
+			crc= entries[7][low & 0xFF] ^ entries[6][(low >> 8) & 0xFF] ^ entries[5][(low >> 16) & 0xFF] ^ entries[4][low >> 24]
+				^ entries[3][high & 0xFF] ^ entries[2][(high >> 8) & 0xFF] ^ entries[1][(high >> 16) & 0xFF] ^ entries[0][high >> 24];
+		}
+		for(; trace_bool(size > 0); --size, ++data) {
+			crc= (crc >> 8) ^ entries[0][(crc ^ *data) & 0xFF];
+		}
+		return crc;
 	}
 	/**
+		@return	The checksummer for the CPU's crc32 instruction, NULL if it does not have it
 	*/
-	inline Hash::~Hash() {trace_scope
+	inline CRC32CHasher::Checksummer CRC32CHasher::accelerated() {trace_scope
+	#if HashX86
+		static const bool	available= _x86CRC32();
+
+		return available ? _crc32cX86 : NULL;
+	#else
+		return NULL;
+	#endif
+	}
+	/**
+		@param data		The bytes to encode
+		@param size		The number of bytes in data
+		@param hex		At least 2 * size characters, set to the hex digits of data
+		@param order	Which nibble of each byte goes first
+		@return			The character after the last digit, where a nul would go
+	*/
+	inline char *HexCodec::encode(const void *data, size_t size, char *hex, NibbleOrder order) {trace_scope
+		encoder()(reinterpret_cast<const uint8_t*>(data), size, hex, order);
+		return hex + 2 * size;
+	}
+	/**
+		@param hex		At least 2 * size hex digits, 0-9, a-f or A-F
+		@param size		The number of bytes to decode
+		@param data		At least size bytes, set to the value of the digits. Only some may be set if false is returned.
+		@param order	Which nibble of each byte comes first
+		@return			false if any of the characters is not a hex digit
+	*/
+	inline bool HexCodec::decode(const char *hex, size_t size, void *data, NibbleOrder order) {trace_scope
+		return decoder()(hex, size, reinterpret_cast<uint8_t*>(data), order);
+	}
+	/**
+		@return	The encoder encode() uses, chosen the first time it is called
+	*/
+	inline HexCodec::Encoder &HexCodec::encoder() {trace_scope
+		static Encoder	encode= (NULL != acceleratedEncoder()) ? acceleratedEncoder() : portableEncode;
+
+		return encode;
+	}
+	/**
+		@return	The decoder decode() uses, chosen the first time it is called
+	*/
+	inline HexCodec::Decoder &HexCodec::decoder() {trace_scope
+		static Decoder	decode= (NULL != acceleratedDecoder()) ? acceleratedDecoder() : portableDecode;
+
+		return decode;
+	}
+	/// The tables for HexCodec::portableEncode() and portableDecode(), built once
+	struct _HexTables {
+		char	pairs[2][256][2];	///< pairs[order][byte] are the two digits of byte, in NibbleOrder order
+		int8_t	values[256];		///< The value of each hex digit, -1 for other characters
+		/// Builds the tables
+		_HexTables()
+			:pairs(), values() {trace_scope
+			const char * const	kDigits= "0123456789abcdef";
+
+			for(int byte= 0; trace_bool(byte < 256); ++byte) {
+				pairs[HighNibbleFirst][byte][0]= pairs[LowNibbleFirst][byte][1]= kDigits[byte >> 4];
+				pairs[HighNibbleFirst][byte][1]= pairs[LowNibbleFirst][byte][0]= kDigits[byte & 0x0F];
+				values[byte]= -1;
+			}
+			for(int digit= 0; trace_bool(digit < 16); ++digit) {
+				values[static_cast<uint8_t>(kDigits[digit])]= static_cast<int8_t>(digit);
+				values[static_cast<uint8_t>(toupper(kDigits[digit]))]= static_cast<int8_t>(digit);
+			}
+		}
+	};
+	/**
+		@param data		The bytes to encode
+		@param size		The number of bytes in data
+		@param hex		Set to the 2 * size hex digits of data
+		@param order	Which nibble of each byte goes first
+	*/
+	inline void HexCodec::portableEncode(const uint8_t *data, size_t size, char *hex, NibbleOrder order) {trace_scope
+		static const _HexTables	tables;
+		const char				(&pairs)[256][2]= tables.pairs[order];
+
+		for(; trace_bool(size > 0); --size, ++data, hex+= 2) {
+			hex[0]= pairs[*data][0];
+			hex[1]= pairs[*data][1];
+		}
+	}
+	/**
+		@param hex		The 2 * size hex digits to decode
+		@param size		The number of bytes in data
+		@param data		Set to the bytes
+		@param order	Which nibble of each byte comes first
+		@return			false if any of the characters is not a hex digit
+	*/
+	inline bool HexCodec::portableDecode(const char *hex, size_t size, uint8_t *data, NibbleOrder order) {trace_scope
+		static const _HexTables	tables;
+		const int				kFirstShift= (HighNibbleFirst == order) ? 4 : 0;
+
+		for(; trace_bool(size > 0); --size, ++data, hex+= 2) {
+			const int	first= tables.values[static_cast<uint8_t>(hex[0])], second= tables.values[static_cast<uint8_t>(hex[1])];
+
+			if(trace_bool((first | second) < 0)) {
+				return false;
+			}
+			*data= static_cast<uint8_t>((first << kFirstShift) | (second << (4 - kFirstShift)));
+		}
+		return true;
 	}
+	/**
+		@return	The encoder for the CPU's vector instructions, NULL if it does not have them
+	*/
+	inline HexCodec::Encoder HexCodec::acceleratedEncoder() {trace_scope
+	#if HashX86
+		static const Encoder	encode= _x86AVX2() ? _hexEncodeAVX2 : (_x86SSSE3() ? _hexEncodeSSSE3 : NULL);
+
+		return encode;
+	#else
+		return NULL;
+	#endif
+	}
+	/**
+		@return	The decoder for the CPU's vector instructions, NULL if it does not have them
+	*/
+	inline HexCodec::Decoder HexCodec::acceleratedDecoder() {trace_scope
+	#if HashX86
+		static const Decoder	decode= _x86AVX2() ? _hexDecodeAVX2 : (_x86SSSE3() ? _hexDecodeSSSE3 : NULL);
 
+		return decode;
+	#else
+		return NULL;
+	#endif
+	}
 	/**
 		@todo TEST!
 	*/
@@ -224,34 +2407,33 @@ namespace hash {
 	template<class Hasher> inline uint32_t SpecificHash<Hasher>::size() const {trace_scope
 		return Hasher::Size;
 	}
+	/** Written the usual way, most significant nibble first, unless USE_DEPRECATED_HASH_NIBBLE_ORDER is defined.
+		@param value	Set to the hex digits of the hash
+		@return			value
+	*/
 	template<class Hasher> inline std::string &SpecificHash<Hasher>::hex(std::string &value) const {trace_scope
-		const char * const	hexDigits= "0123456789abcdef";
-
-		value.clear();
-		for(int i= 0; trace_bool(i < static_cast<int>(sizeof(_hash))); ++i) {trace_scope
-			value.append(1, hexDigits[_hash[i] & 0x0F]);
-			value.append(1, hexDigits[_hash[i] >> 4]);
-		}
+		value.resize(2 * Size);
+		HexCodec::encode(_hash, Size, &value[0], kHashNibbleOrder);
+		return value;
+	}
+	/** Written the usual way, most significant nibble first, unless USE_DEPRECATED_HASH_NIBBLE_ORDER is defined.
+		@param value	At least 2 * Size + 1 characters, set to the hex digits of the hash and a nul
+		@return			value
+	*/
+	template<class Hasher> inline char *SpecificHash<Hasher>::hex(char *value) const {trace_scope
+		*HexCodec::encode(_hash, Size, value, kHashNibbleOrder)= '\0';
 		return value;
 	}
+	/** Read in the order hex() writes. A shorter string sets the start of the hash, and the rest is zero.
+		@param hash	An even number of hex digits, up to 2 * Size
+		@throw AssertMessageException if hash is too long, an odd length, or has characters that are not hex digits
+	*/
 	template<class Hasher> inline void SpecificHash<Hasher>::reset(const char *hash) {trace_scope
-		std::string	hexDigits("0123456789abcdef");
-		bool		eosFound= false;
-		AssertMessageException(strlen(hash) <= Size * 2);
-		for(int byte= 0; trace_bool(byte < static_cast<int>(sizeof(_hash))); ++byte) {trace_scope
-			const int	nibble1= byte * 2;
-			eosFound= trace_bool(trace_bool(eosFound) || trace_bool(hash[nibble1] == '\0'));
-			std::string::size_type	found1= eosFound ? 0 : hexDigits.find(hash[nibble1]);
-
-			const int	nibble2= nibble1 + 1;
-			eosFound= trace_bool(trace_bool(eosFound) || trace_bool(hash[nibble1] == '\0'));
-			std::string::size_type	found2= eosFound ? 0 : hexDigits.find(hash[nibble2]);
+		const size_t	length= strlen(hash);
 
-			AssertMessageException(found1 != std::string::npos);
-			AssertMessageException(found2 != std::string::npos);
-			_hash[byte]= (found2 << 4) | found1;
-		}
-		AssertMessageException(hash[sizeof(_hash)*2] == '\0');
+		AssertMessageException( (length <= Size * 2) && (length % 2 == 0) );
+		memset(_hash, 0, sizeof(_hash));
+		AssertMessageException(HexCodec::decode(hash, length / 2, _hash, kHashNibbleOrder));
 	}
 	/**
 		@todo TEST!
@@ -271,6 +2453,111 @@ namespace hash {
 	template<class Hasher> inline const char *SpecificHash<Hasher>::name() const {trace_scope
 		return Hasher::name();
 	}
+	/** Many short messages hash several times faster together than one at a time.
+		@param count	The number of messages
+		@param data		count pointers to the messages
+		@param sizes	count sizes of the messages
+		@param results	count hashes, set to the hash of each message
+	*/
+	template<class Hasher> inline void SpecificHash<Hasher>::hashMany(size_t count, const void * const *data, const size_t *sizes, SpecificHash *results) {trace_scope
+		const size_t	kBatchSize= 256;
+		void			*hashes[kBatchSize];
+
+		for(size_t first= 0; trace_bool(first < count); first+= kBatchSize) {
+			const size_t	batch= (count - first < kBatchSize) ? count - first : kBatchSize;
+
+			for(size_t message= 0; trace_bool(message < batch); ++message) {
+				hashes[message]= results[first + message]._hash;
+			}
+			Hasher::hashMany(batch, data + first, sizes + first, hashes);
+		}
+	}
+	template<class Hasher> inline SpecificHash<Hasher>::Stream::Stream()
+		:_state() {trace_scope
+		Hasher::init(_state);
+	}
+	/** Drops anything passed to update() since the last final().
+		@return	*this
+	*/
+	template<class Hasher> inline typename SpecificHash<Hasher>::Stream &SpecificHash<Hasher>::Stream::init() {trace_scope
+		Hasher::init(_state);
+		return *this;
+	}
+	/**
+		@param data		The next data to hash
+		@param count	The number of bytes in data
+		@return			*this
+	*/
+	template<class Hasher> inline typename SpecificHash<Hasher>::Stream &SpecificHash<Hasher>::Stream::update(const void *data, size_t count) {trace_scope
+		Hasher::update(_state, data, count);
+		return *this;
+	}
+	/**
+		@param data		The next data to hash
+		@return			*this
+	*/
+	template<class Hasher> inline typename SpecificHash<Hasher>::Stream &SpecificHash<Hasher>::Stream::update(const std::string &data) {trace_scope
+		Hasher::update(_state, data.data(), data.size());
+		return *this;
+	}
+	/**
+		@param data		The next data to hash, all size() bytes from start()
+		@return			*this
+	*/
+	template<class Hasher> inline typename SpecificHash<Hasher>::Stream &SpecificHash<Hasher>::Stream::update(const Buffer &data) {trace_scope
+		Hasher::update(_state, data.start(), data.size());
+		return *this;
+	}
+	/**
+		@param data		The next data to hash
+		@return			*this
+	*/
+	template<class Hasher> inline typename SpecificHash<Hasher>::Stream &SpecificHash<Hasher>::Stream::update(const ReferencedString &data) {trace_scope
+		Hasher::update(_state, data.data(), data.size());
+		return *this;
+	}
+	/** Reads the file a piece at a time, so only a small buffer is needed however big the range.
+		@param file		The file to read
+		@param offset	The offset in the file of the data to hash
+		@param count	The number of bytes to hash, or -1 for everything up to the end of the file
+		@return			*this
+		@throw AssertMessageException if offset + count is past the end of the file
+	*/
+	template<class Hasher> inline typename SpecificHash<Hasher>::Stream &SpecificHash<Hasher>::Stream::update(const io::File &file, off_t offset, off_t count) {trace_scope
+		const off_t	kChunkSize= 64 * 1024;
+		char		chunk[kChunkSize];
+
+		if(trace_bool(count < 0)) {
+			count= file.size() - offset;
+		}
+		AssertMessageException(count >= 0);
+		file.moveto(offset);
+		while(trace_bool(count > 0)) {
+			const off_t	readSize= count < kChunkSize ? count : kChunkSize;
+
+			file.read(chunk, static_cast<size_t>(readSize));
+			Hasher::update(_state, chunk, static_cast<size_t>(readSize));
+			count-= readSize;
+		}
+		return *this;
+	}
+	/** Starts hashing new data afterwards.
+		@param hash	Set to the hash of all the data passed to update() since init()
+		@return		hash
+	*/
+	template<class Hasher> inline SpecificHash<Hasher> &SpecificHash<Hasher>::Stream::final(SpecificHash<Hasher> &hash) {trace_scope
+		Hasher::final(_state, hash.buffer());
+		Hasher::init(_state);
+		return hash;
+	}
+	/** Starts hashing new data afterwards.
+		@return	The hash of all the data passed to update() since init()
+	*/
+	template<class Hasher> inline SpecificHash<Hasher> SpecificHash<Hasher>::Stream::final() {trace_scope
+		SpecificHash<Hasher>	hash;
+
+		return final(hash);
+	}
 }
 
 #endif // __Hash_h__
@@ -0,0 +1,484 @@
+#ifndef _KeyedArchive_h_
+#define _KeyedArchive_h_
+
+#include <os/ArchiveFile.h>
+#include <os/RWLock.h>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#ifndef trace_scope
+	#define trace_scope ///< in case Tracer.h is not included
+#endif
+#ifndef trace_bool
+	#define trace_bool(x) (x) ///< in case Tracer.h is not included
+#endif
+
+/// Signature of a KeyedArchive, so a plain ArchiveFile is not opened as one
+#define io_KeyedArchive_Signature "\x89""KA\x0D\x0A\x1A\x0A"
+
+namespace io {
+	/** An ArchiveFile with a persistent hash index from byte string keys to the blocks holding their values.
+		The index is a linear hash: the low bits of the key's hash pick a bucket, a block listing
+			(hash, key, value identifier) for its keys. When a put() leaves a bucket bigger than
+			about 2 KiB, the next bucket in turn is split in two, so the buckets grow one at a time
+			with the keys and a lookup reads one bucket and the value, whatever the number of keys.
+			Buckets are not merged again as keys are removed.
+		The bucket identifiers are kept in table blocks of 512, which are listed in the root block,
+			the first block of the file.
+		Each put() and remove() is a transaction, or part of the one started with startTransaction(),
+			and the buckets, tables and root are changed with replace(), so after a crash the index
+			and the values are as they were at a commit. Putting many keys in one transaction is
+			much quicker, since each commit syncs the file twice.
+		Each value is a block of its own, with the identifier find() returns, so it can be read in place
+			with view(). Putting a key that is already there replace()s its value, keeping the identifier.
+		Other blocks can be allocated in the same file, but the index blocks must not be changed or disposed.
+		find() and get() can be called from any number of threads at once, put() and remove() wait for them.
+		Call rollback() on the KeyedArchive, not the ArchiveFile, so the index in memory is loaded again.
+	*/
+	class KeyedArchive : public ArchiveFile {
+		public:
+			/// Open or Create KeyedArchive at given path
+			KeyedArchive(const char *path, Protection protection= WriteIfPossible);
+			/// Open or Create KeyedArchive at given path
+			KeyedArchive(const std::string &path, Protection protection= WriteIfPossible);
+			/// Destructor
+			virtual ~KeyedArchive();
+			/// The block holding the value for the key, or an invalid block if the key is not there
+			Block find(const std::string &key);
+			/// Get the value for the key, false if the key is not there
+			bool get(const std::string &key, std::string &value);
+			/// Set the value for the key, returns the block the value is in
+			Block put(const std::string &key, const std::string &value);
+			/// Remove the key and dispose its value, false if the key is not there
+			bool remove(const std::string &key);
+			/// Forget all changes since startTransaction(), and load the index again
+			void rollback();
+			/// The number of buckets in the index
+			int64_t buckets();
+		protected:
+			/// Add a big endian integer of the given number of bytes to a buffer
+			static void _append(std::string &buffer, uint64_t value, size_t bytes);
+			/// Get a big endian integer of the given number of bytes from memory
+			static uint64_t _extract(const char *data, size_t bytes);
+		private:
+			int64_t					_root;		///< The identifier of the root block
+			int						_level;		///< Buckets below 2^_level are addressed by _level bits of the hash
+			int64_t					_split;		///< The next bucket to split, buckets before it are addressed by one more bit
+			std::vector<int64_t>	_buckets;	///< The identifier of each bucket
+			std::vector<int64_t>	_tables;	///< The identifiers of the blocks _buckets is kept in
+			exec::RWLock			_lock;		///< Shared to read the index, held alone to change it
+			/// Create the index in a new file, or load it
+			void _init();
+			/// Read the root and tables
+			void _load();
+			/// rollback() without locking
+			void _rollback();
+			/// find() without locking
+			Block _find(const std::string &key);
+			/// put() in a transaction
+			Block _put(const std::string &key, const std::string &value);
+			/// Split the bucket at _split
+			void _splitBucket();
+			/// The contents of the root block
+			std::string _rootContents();
+			/// The contents of a table block
+			std::string _tableContents(size_t table);
+			/// The index in _buckets of the bucket for a hash
+			size_t _bucket(uint32_t hash);
+			/// Find the entry for a key in the contents of a bucket
+			static size_t _entry(const char *data, size_t size, const std::string &key, uint32_t hash);
+			/// The hash of a key
+			static uint32_t _hash(const std::string &key);
+			KeyedArchive(const KeyedArchive&); ///< Prevent Usage
+			KeyedArchive &operator=(const KeyedArchive&); ///< Prevent Usage
+	};
+
+	/**
+		@param path			The path to the file
+		@param protection	How to open the file
+		@throw posix::err::EILSEQ_ErrNo if the file is an ArchiveFile but its first block is not an index root
+	*/
+	inline KeyedArchive::KeyedArchive(const char *path, Protection protection)
+		:ArchiveFile(path, protection, 1, io_KeyedArchive_Signature),
+			_root(0), _level(0), _split(0), _buckets(), _tables(), _lock() {trace_scope
+		_init();
+	}
+	/**
+		@param path			The path to the file
+		@param protection	How to open the file
+		@throw posix::err::EILSEQ_ErrNo if the file is an ArchiveFile but its first block is not an index root
+	*/
+	inline KeyedArchive::KeyedArchive(const std::string &path, Protection protection)
+		:ArchiveFile(path, protection, 1, io_KeyedArchive_Signature),
+			_root(0), _level(0), _split(0), _buckets(), _tables(), _lock() {trace_scope
+		_init();
+	}
+	inline KeyedArchive::~KeyedArchive() {trace_scope
+	}
+	/** The identifier of the block is fixed until the key is removed, but hold on to the identifier
+			rather than the Block, since a put() of the key writes the value to another block.
+		@param key	The key to look up
+		@return		The block with the value, or an invalid block
+	*/
+	inline ArchiveFile::Block KeyedArchive::find(const std::string &key) {trace_scope
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Read);
+
+		return _find(key);
+	}
+	/**
+		@param key		The key to look up
+		@param value	Set to the value, if the key is there
+		@return			true if the key was found
+	*/
+	inline bool KeyedArchive::get(const std::string &key, std::string &value) {trace_scope
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Read);
+		Block					block= _find(key);
+
+		if(trace_bool(!block)) {
+			return false;
+		}
+		block.read(value);
+		return true;
+	}
+	/**
+		@param key		The key, any bytes
+		@param value	The value, any bytes
+		@return			The block the value was written to
+	*/
+	inline ArchiveFile::Block KeyedArchive::put(const std::string &key, const std::string &value) {trace_scope
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Write);
+		Block					block;
+
+		if(trace_bool(transaction())) {
+			return _put(key, value);
+		}
+		startTransaction();
+		try {
+			block= _put(key, value);
+			commit();
+		} catch(const std::exception &) {
+			_rollback();
+			throw;
+		}
+		return block;
+	}
+	/** The value block is disposed when the transaction is committed.
+		@param key	The key to remove
+		@return		true if the key was there
+	*/
+	inline bool KeyedArchive::remove(const std::string &key) {trace_scope
+		const uint8_t			kFlagsBucket= 3;
+		const int64_t			kEntryHeader= 16;
+		const int64_t			kEntryKeySize= 4;
+		const int64_t			kEntryValue= 8;
+		const uint32_t			hash= _hash(key);
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Write);
+		const int64_t			identifier= _buckets[_bucket(hash)];
+		const bool				started= !transaction();
+		std::string				contents;
+
+		lookup(identifier).read(contents);
+		const size_t	entry= _entry(contents.data(), contents.size(), key, hash);
+
+		if(trace_bool(std::string::npos == entry)) {
+			return false;
+		}
+		const int64_t	value= static_cast<int64_t>(_extract(contents.data() + entry + kEntryValue, sizeof(int64_t)));
+
+		contents.erase(entry, kEntryHeader + _extract(contents.data() + entry + kEntryKeySize, sizeof(uint32_t)));
+		if(started) {
+			startTransaction();
+		}
+		try {
+			replace(identifier, contents, kFlagsBucket);
+			lookup(value).dispose();
+			if(started) {
+				commit();
+			}
+		} catch(const std::exception &) {
+			if(started) {
+				_rollback();
+			}
+			throw;
+		}
+		return true;
+	}
+	/** ArchiveFile::rollback() puts the blocks back as they were, then the index is read from them.
+	*/
+	inline void KeyedArchive::rollback() {trace_scope
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Write);
+
+		_rollback();
+	}
+	inline int64_t KeyedArchive::buckets() {trace_scope
+		exec::RWLock::Locker	locker(_lock, exec::RWLock::Read);
+
+		return _buckets.size();
+	}
+	/** A new file gets a root, one empty bucket and a table, in one transaction.
+		@throw posix::err::EILSEQ_ErrNo if the first block is not an index root
+	*/
+	inline void KeyedArchive::_init() {trace_scope
+		const uint8_t	kFlagsRoot= 1;
+		const uint8_t	kFlagsTable= 2;
+		const uint8_t	kFlagsBucket= 3;
+		Block			root;
+
+		_root= begin().offset(false);
+		root= lookup(_root);
+		if(trace_bool(!root.free())) {
+			if(root.flags() != kFlagsRoot) {
+				ErrnoCodeThrow(EILSEQ, "KeyedArchive index is missing");
+			}
+			_load();
+			return;
+		}
+		startTransaction();
+		try {
+			AssertMessageException(allocate(std::string(), kFlagsRoot).offset(false) == _root);
+			_buckets.push_back(allocate(std::string(), kFlagsBucket).identifier());
+			_tables.push_back(allocate(_tableContents(0), kFlagsTable).identifier());
+			replace(_root, _rootContents(), kFlagsRoot);
+			commit();
+		} catch(const std::exception &) {
+			ArchiveFile::rollback();
+			throw;
+		}
+	}
+	/** The root is the level, the next bucket to split, the number of buckets, then the table identifiers,
+			each a big endian 64 bit integer. A table is the identifiers of (up to) 512 buckets.
+		@throw posix::err::EILSEQ_ErrNo if the root or tables are the wrong size
+	*/
+	inline void KeyedArchive::_load() {trace_scope
+		const size_t	kTableSize= 512;
+		const size_t	kRootHeader= 3 * sizeof(int64_t);
+		std::string		contents;
+
+		lookup(_root).read(contents);
+		if( (contents.size() < kRootHeader) || (contents.size() % sizeof(int64_t) != 0) ) {
+			ErrnoCodeThrow(EILSEQ, "KeyedArchive root is corrupt");
+		}
+		_level= static_cast<int>(_extract(contents.data(), sizeof(int64_t)));
+		_split= static_cast<int64_t>(_extract(contents.data() + sizeof(int64_t), sizeof(int64_t)));
+		_buckets.resize(static_cast<size_t>(_extract(contents.data() + 2 * sizeof(int64_t), sizeof(int64_t))));
+		_tables.clear();
+		for(size_t offset= kRootHeader; trace_bool(offset < contents.size()); offset+= sizeof(int64_t)) {
+			_tables.push_back(static_cast<int64_t>(_extract(contents.data() + offset, sizeof(int64_t))));
+		}
+		if(_tables.size() != (_buckets.size() + kTableSize - 1) / kTableSize) {
+			ErrnoCodeThrow(EILSEQ, "KeyedArchive root is corrupt");
+		}
+		for(size_t table= 0; trace_bool(table < _tables.size()); ++table) {
+			const size_t	first= table * kTableSize;
+			const size_t	count= (_buckets.size() - first < kTableSize) ? _buckets.size() - first : kTableSize;
+
+			lookup(_tables[table]).read(contents);
+			if(contents.size() != count * sizeof(int64_t)) {
+				ErrnoCodeThrow(EILSEQ, "KeyedArchive table is corrupt");
+			}
+			for(size_t bucket= 0; trace_bool(bucket < count); ++bucket) {
+				_buckets[first + bucket]= static_cast<int64_t>(_extract(contents.data() + bucket * sizeof(int64_t), sizeof(int64_t)));
+			}
+		}
+	}
+	inline void KeyedArchive::_rollback() {trace_scope
+		ArchiveFile::rollback();
+		_load();
+	}
+	/**
+		@param key	The key to look up
+		@return		The block with the value, or an invalid block
+	*/
+	inline ArchiveFile::Block KeyedArchive::_find(const std::string &key) {trace_scope
+		const int64_t	kEntryValue= 8;
+		const uint32_t	hash= _hash(key);
+		View			bucket;
+
+		view(_buckets[_bucket(hash)], bucket);
+		const char		*data= bucket.contents().data();
+		const size_t	entry= _entry(data, bucket.contents().size(), key, hash);
+
+		if(trace_bool(std::string::npos == entry)) {
+			return Block();
+		}
+		return lookup(static_cast<int64_t>(_extract(data + entry + kEntryValue, sizeof(int64_t))));
+	}
+	/** A bucket entry is the hash (4 bytes), key size (4 bytes), value identifier (8 bytes) then the key.
+		A new key's value is allocated and its entry added to the bucket, a key that is there has its value replaced,
+			so its bucket does not change.
+		@param key		The key
+		@param value	The value
+		@return			The block the value was written to
+	*/
+	inline ArchiveFile::Block KeyedArchive::_put(const std::string &key, const std::string &value) {trace_scope
+		const uint8_t	kFlagsBucket= 3;
+		const uint8_t	kFlagsValue= 4;
+		const int64_t	kEntryValue= 8;
+		const size_t	kBucketSize= 2048;
+		const uint32_t	hash= _hash(key);
+		const int64_t	identifier= _buckets[_bucket(hash)];
+		std::string		contents;
+
+		lookup(identifier).read(contents);
+		const size_t	entry= _entry(contents.data(), contents.size(), key, hash);
+
+		if(trace_bool(std::string::npos != entry)) {
+			return replace(static_cast<int64_t>(_extract(contents.data() + entry + kEntryValue, sizeof(int64_t))), value, kFlagsValue);
+		}
+		Block	block= allocate(value, kFlagsValue);
+
+		_append(contents, hash, sizeof(uint32_t));
+		_append(contents, key.size(), sizeof(uint32_t));
+		_append(contents, block.identifier(), sizeof(int64_t));
+		contents.append(key);
+		replace(identifier, contents, kFlagsBucket);
+		if(trace_bool(contents.size() > kBucketSize)) {
+			_splitBucket();
+		}
+		return block;
+	}
+	/** The bucket at _split is split between itself and a new bucket at the end, by the next bit of the hash.
+		The new bucket's table is replaced, or allocated if it is the first in it, and the root is replaced.
+	*/
+	inline void KeyedArchive::_splitBucket() {trace_scope
+		const uint8_t	kFlagsRoot= 1;
+		const uint8_t	kFlagsTable= 2;
+		const uint8_t	kFlagsBucket= 3;
+		const size_t	kTableSize= 512;
+		const size_t	kEntryHeader= 16;
+		const size_t	kEntryKeySize= 4;
+		const uint64_t	bit= static_cast<uint64_t>(1) << _level;
+		std::string		contents, stay, move;
+
+		lookup(_buckets[_split]).read(contents);
+		for(size_t entry= 0; trace_bool(entry < contents.size()); ) {
+			const size_t	entrySize= kEntryHeader + _extract(contents.data() + entry + kEntryKeySize, sizeof(uint32_t));
+
+			if(trace_bool(_extract(contents.data() + entry, sizeof(uint32_t)) & bit)) {
+				move.append(contents, entry, entrySize);
+			} else {
+				stay.append(contents, entry, entrySize);
+			}
+			entry+= entrySize;
+		}
+		replace(_buckets[_split], stay, kFlagsBucket);
+		_buckets.push_back(allocate(move, kFlagsBucket).identifier());
+		if(trace_bool(++_split == static_cast<int64_t>(bit))) {
+			++_level;
+			_split= 0;
+		}
+		const size_t	table= (_buckets.size() - 1) / kTableSize;
+
+		if(trace_bool(table == _tables.size())) {
+			_tables.push_back(allocate(_tableContents(table), kFlagsTable).identifier());
+		} else {
+			replace(_tables[table], _tableContents(table), kFlagsTable);
+		}
+		replace(_root, _rootContents(), kFlagsRoot);
+	}
+	inline std::string KeyedArchive::_rootContents() {trace_scope
+		std::string	contents;
+
+		_append(contents, _level, sizeof(int64_t));
+		_append(contents, _split, sizeof(int64_t));
+		_append(contents, _buckets.size(), sizeof(int64_t));
+		for(std::vector<int64_t>::iterator table= _tables.begin(); trace_bool(table != _tables.end()); ++table) {
+			_append(contents, *table, sizeof(int64_t));
+		}
+		return contents;
+	}
+	/**
+		@param table	Which table, it holds the identifiers of buckets from table * 512
+		@return			The contents of the table block
+	*/
+	inline std::string KeyedArchive::_tableContents(size_t table) {trace_scope
+		const size_t	kTableSize= 512;
+		const size_t	end= (table + 1) * kTableSize < _buckets.size() ? (table + 1) * kTableSize : _buckets.size();
+		std::string		contents;
+
+		for(size_t bucket= table * kTableSize; trace_bool(bucket < end); ++bucket) {
+			_append(contents, _buckets[bucket], sizeof(int64_t));
+		}
+		return contents;
+	}
+	/** Buckets before _split have been split, so they and the buckets split from them use one more bit.
+		@param hash	The hash of a key
+		@return		The index in _buckets
+	*/
+	inline size_t KeyedArchive::_bucket(uint32_t hash) {trace_scope
+		const uint64_t	bucket= hash & ((static_cast<uint64_t>(1) << _level) - 1);
+
+		if(trace_bool(bucket < static_cast<uint64_t>(_split))) {
+			return static_cast<size_t>(hash & ((static_cast<uint64_t>(2) << _level) - 1));
+		}
+		return static_cast<size_t>(bucket);
+	}
+	/**
+		@param data	The contents of a bucket
+		@param size	The size of the contents
+		@param key	The key to find
+		@param hash	The hash of the key
+		@return		The offset of the key's entry, or std::string::npos if it is not there
+		@throw posix::err::EILSEQ_ErrNo if an entry runs past the end of the bucket
+	*/
+	inline size_t KeyedArchive::_entry(const char *data, size_t size, const std::string &key, uint32_t hash) {trace_scope
+		const size_t	kEntryHeader= 16;
+		const size_t	kEntryKeySize= 4;
+
+		for(size_t entry= 0; trace_bool(entry < size); ) {
+			if(size - entry < kEntryHeader) {
+				ErrnoCodeThrow(EILSEQ, "KeyedArchive bucket is corrupt");
+			}
+			const size_t	keySize= _extract(data + entry + kEntryKeySize, sizeof(uint32_t));
+
+			if(size - entry - kEntryHeader < keySize) {
+				ErrnoCodeThrow(EILSEQ, "KeyedArchive bucket is corrupt");
+			}
+			if( (_extract(data + entry, sizeof(uint32_t)) == hash) && (keySize == key.size())
+					&& (memcmp(data + entry + kEntryHeader, key.data(), keySize) == 0) ) {
+				return entry;
+			}
+			entry+= kEntryHeader + keySize;
+		}
+		return std::string::npos;
+	}
+	/** FNV-1a, with the high half folded into the low bits, which pick the bucket.
+		@param key	The key
+		@return		The hash of the key
+	*/
+	inline uint32_t KeyedArchive::_hash(const std::string &key) {trace_scope
+		uint64_t	hash= 14695981039346656037ULL;
+
+		for(std::string::const_iterator byte= key.begin(); trace_bool(byte != key.end()); ++byte) {
+			hash^= static_cast<uint8_t>(*byte);
+			hash*= 1099511628211ULL;
+		}
+		return static_cast<uint32_t>(hash ^ (hash >> 32));
+	}
+	/**
+		@param buffer	The buffer to append to
+		@param value	The value to append
+		@param bytes	The number of low bytes of value to append, most significant first
+	*/
+	inline void KeyedArchive::_append(std::string &buffer, uint64_t value, size_t bytes) {trace_scope
+		for(size_t byte= bytes; trace_bool(byte > 0); --byte) {
+			buffer.append(1, static_cast<char>(value >> ((byte - 1) * 8)));
+		}
+	}
+	/**
+		@param data		Where the integer is
+		@param bytes	The number of bytes in the integer, most significant first
+		@return			The integer
+	*/
+	inline uint64_t KeyedArchive::_extract(const char *data, size_t bytes) {trace_scope
+		uint64_t	value= 0;
+
+		for(size_t byte= 0; trace_bool(byte < bytes); ++byte) {
+			value= (value << 8) | static_cast<uint8_t>(data[byte]);
+		}
+		return value;
+	}
+}
+
+#endif // _KeyedArchive_h_
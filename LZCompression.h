@@ -0,0 +1,273 @@
+#ifndef __LZCompression_h__
+#define __LZCompression_h__
+
+/** @file LZCompression.h
+	A fast LZ77 compressor with no dependencies, for when zlib is too slow or not linked.
+	The compressed data is in the LZ4 block format: sequences of a token (literal count in the high nibble,
+		match length - 4 in the low nibble, 15 meaning more length bytes follow), the literals,
+		and a two byte little endian offset back to the match. The last sequence is just literals.
+	The block does not record how big the uncompressed data is, the caller has to keep that.
+*/
+
+#include "Exception.h"
+#include "POSIXErrno.h"
+#include <string>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef trace_scope
+	#define trace_scope ///< in case Tracer.h is not included
+#endif
+#ifndef trace_bool
+	#define trace_bool(x) (x) ///< in case Tracer.h is not included
+#endif
+
+/** LZ4 block compression.
+*/
+namespace lz {
+	/// The most that sourceSize bytes can compress to.
+	size_t bound(size_t sourceSize);
+	/// Compress source into destination, which must be at least bound(sourceSize) bytes.
+	size_t compress(const void *source, size_t sourceSize, void *destination, size_t destinationSize);
+	/// Compress source into destination.
+	std::string &compress(const std::string &source, std::string &destination);
+	/// Uncompress source into destination, which must be big enough for all of it.
+	size_t uncompress(const void *source, size_t sourceSize, void *destination, size_t destinationSize);
+	/// Uncompress source, which was originally size bytes, into destination.
+	std::string &uncompress(const std::string &source, std::string &destination, size_t size);
+
+	/// Unaligned native order read, only compared with other reads.
+	template<class Int> inline Int _read(const uint8_t *data) {trace_scope
+		Int	value;
+
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+	/** Writes the part of a length that did not fit in a token nibble.
+		@param destination	Where to write the length bytes
+		@param length		The length minus the 15 in the token
+		@return				After the length bytes
+	*/
+	inline uint8_t *_writeLength(uint8_t *destination, size_t length) {trace_scope
+		while(trace_bool(length >= 255)) {
+			*destination++= 255;
+			length-= 255;
+		}
+		*destination++= static_cast<uint8_t>(length);
+		return destination;
+	}
+	/** Reads the part of a length that did not fit in a token nibble.
+		@param source	The length bytes, moved past them
+		@param end		The end of the compressed data
+		@return			The length to add to the 15 in the token
+		@throw posix::err::EILSEQ_ErrNo if the data ends in the length
+	*/
+	inline size_t _readLength(const uint8_t *&source, const uint8_t *end) {trace_scope
+		size_t	length= 0;
+		uint8_t	byte;
+
+		do {
+			if(source >= end) {
+				ErrnoCodeThrow(EILSEQ, "Compressed data is truncated");
+			}
+			byte= *source++;
+			length+= byte;
+		} while(trace_bool(255 == byte));
+		return length;
+	}
+	/**
+		@param sourceSize	The number of bytes to compress
+		@return				The size of destination buffer that is always big enough
+	*/
+	inline size_t bound(size_t sourceSize) {trace_scope
+		return sourceSize + sourceSize / 255 + 16;
+	}
+	/** Candidate matches are found through a hash table of the last position each four bytes were seen,
+			sized to the input so small blocks don't pay to clear a big table.
+			The longer no match is found the further ahead it looks, so incompressible data goes quickly.
+		@param source			The data to compress
+		@param sourceSize		The number of bytes in source
+		@param destination		Where to put the compressed data
+		@param destinationSize	The size of destination, at least bound(sourceSize)
+		@return					The number of bytes of compressed data
+	*/
+	inline size_t compress(const void *source, size_t sourceSize, void *destination, size_t destinationSize) {trace_scope
+		const size_t	kMinMatch= 4;
+		const size_t	kLastLiterals= 5; // the last match ends at least this far from the end
+		const size_t	kSearchEnd= 12; // the last match starts at least this far from the end
+		const size_t	kMaxOffset= 65535;
+		const int		kMaxHashBits= 14;
+		const uint8_t	*in= reinterpret_cast<const uint8_t*>(source);
+		const uint8_t	*end= in + sourceSize;
+		const uint8_t	*anchor= in;
+		uint8_t			*out= reinterpret_cast<uint8_t*>(destination);
+		uint32_t		table[1 << kMaxHashBits];
+		int				hashBits= 8;
+
+		AssertMessageException(destinationSize >= bound(sourceSize));
+		while(trace_bool(hashBits < kMaxHashBits) && trace_bool((static_cast<size_t>(1) << hashBits) < sourceSize)) {
+			++hashBits;
+		}
+		memset(table, 0, sizeof(table[0]) << hashBits);
+		if(sourceSize > kSearchEnd) {
+			const uint8_t	*searchLimit= end - kSearchEnd;
+			const uint8_t	*matchLimit= end - kLastLiterals;
+			const uint8_t	*position= in + 1;
+
+			while(trace_bool(position < searchLimit)) {
+				const uint32_t	sequence= _read<uint32_t>(position);
+				const uint32_t	hash= (sequence * 2654435761U) >> (32 - hashBits);
+				const uint8_t	*match= in + table[hash];
+
+				table[hash]= static_cast<uint32_t>(position - in);
+				if( (match >= position) || (static_cast<size_t>(position - match) > kMaxOffset) || (_read<uint32_t>(match) != sequence) ) {
+					position+= 1 + ((position - anchor) >> 6);
+					continue;
+				}
+				while(trace_bool(position > anchor) && trace_bool(match > in) && trace_bool(position[-1] == match[-1])) {
+					--position;
+					--match;
+				}
+				const uint8_t	*start= position;
+				const size_t	literals= start - anchor;
+				const uint16_t	offset= static_cast<uint16_t>(start - match);
+				uint8_t			*token= out++;
+
+				position+= kMinMatch;
+				match+= kMinMatch;
+				while(trace_bool(position + sizeof(uint64_t) <= matchLimit) && trace_bool(_read<uint64_t>(position) == _read<uint64_t>(match))) {
+					position+= sizeof(uint64_t);
+					match+= sizeof(uint64_t);
+				}
+				while(trace_bool(position < matchLimit) && trace_bool(*position == *match)) {
+					++position;
+					++match;
+				}
+				const size_t	matchLength= position - start - kMinMatch;
+
+				*token= static_cast<uint8_t>(((literals < 15 ? literals : 15) << 4) | (matchLength < 15 ? matchLength : 15));
+				if(literals >= 15) {
+					out= _writeLength(out, literals - 15);
+				}
+				memcpy(out, anchor, literals);
+				out+= literals;
+				*out++= static_cast<uint8_t>(offset & 0xFF);
+				*out++= static_cast<uint8_t>(offset >> 8);
+				if(matchLength >= 15) {
+					out= _writeLength(out, matchLength - 15);
+				}
+				anchor= position;
+				if(position - 2 > in) {
+					table[(_read<uint32_t>(position - 2) * 2654435761U) >> (32 - hashBits)]= static_cast<uint32_t>(position - 2 - in);
+				}
+			}
+		}
+		const size_t	literals= end - anchor;
+
+		*out++= static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+		if(literals >= 15) {
+			out= _writeLength(out, literals - 15);
+		}
+		memcpy(out, anchor, literals);
+		out+= literals;
+		return out - reinterpret_cast<uint8_t*>(destination);
+	}
+	/**
+		@param source		The data to compress
+		@param destination	Replaced with the compressed data
+		@return				destination
+	*/
+	inline std::string &compress(const std::string &source, std::string &destination) {trace_scope
+		const size_t	maxDestination= bound(source.size());
+
+		destination.assign(maxDestination, '\0');
+		destination.resize(compress(source.data(), source.size(), const_cast<char*>(destination.data()), maxDestination));
+		return destination;
+	}
+	/** Every length and offset is checked, so corrupt data throws rather than reading or writing out of bounds.
+		@param source			The compressed data
+		@param sourceSize		The number of bytes in source
+		@param destination		Where to put the uncompressed data
+		@param destinationSize	The size of destination
+		@return					The number of bytes uncompressed
+		@throw posix::err::EILSEQ_ErrNo if the data is corrupt or does not fit in destination
+	*/
+	inline size_t uncompress(const void *source, size_t sourceSize, void *destination, size_t destinationSize) {trace_scope
+		const size_t	kMinMatch= 4;
+		const size_t	kShortCopy= 16; // short copies are done whole when there is room, it is cheaper than the exact length
+		const uint8_t	*in= reinterpret_cast<const uint8_t*>(source);
+		const uint8_t	*end= in + sourceSize;
+		uint8_t			*start= reinterpret_cast<uint8_t*>(destination);
+		uint8_t			*out= start;
+		uint8_t			*outEnd= start + destinationSize;
+
+		while(trace_bool(in < end)) {
+			const uint8_t	token= *in++;
+			size_t			literals= token >> 4;
+			size_t			matchLength= token & 0x0F;
+
+			if(15 == literals) {
+				literals+= _readLength(in, end);
+			}
+			if( (literals > static_cast<size_t>(end - in)) || (literals > static_cast<size_t>(outEnd - out)) ) {
+				ErrnoCodeThrow(EILSEQ, "Compressed data is corrupt");
+			}
+			if( (literals <= kShortCopy) && (static_cast<size_t>(end - in) >= kShortCopy) && (static_cast<size_t>(outEnd - out) >= kShortCopy) ) {
+				memcpy(out, in, kShortCopy);
+			} else {
+				memcpy(out, in, literals);
+			}
+			in+= literals;
+			out+= literals;
+			if(in == end) {
+				break;
+			}
+			if(end - in < 2) {
+				ErrnoCodeThrow(EILSEQ, "Compressed data is truncated");
+			}
+			const size_t	offset= in[0] | (static_cast<size_t>(in[1]) << 8);
+
+			in+= 2;
+			if( (0 == offset) || (offset > static_cast<size_t>(out - start)) ) {
+				ErrnoCodeThrow(EILSEQ, "Compressed data is corrupt");
+			}
+			if(15 == matchLength) {
+				matchLength+= _readLength(in, end);
+			}
+			matchLength+= kMinMatch;
+			if(matchLength > static_cast<size_t>(outEnd - out)) {
+				ErrnoCodeThrow(EILSEQ, "Compressed data is corrupt");
+			}
+			const uint8_t	*match= out - offset;
+
+			if( (offset >= kShortCopy) && (matchLength <= kShortCopy) && (static_cast<size_t>(outEnd - out) >= kShortCopy) ) {
+				memcpy(out, match, kShortCopy);
+				out+= matchLength;
+			} else if(offset >= matchLength) {
+				memcpy(out, match, matchLength);
+				out+= matchLength;
+			} else { // the match repeats what it is writing
+				for(size_t index= 0; trace_bool(index < matchLength); ++index) {
+					*out++= *match++;
+				}
+			}
+		}
+		return out - start;
+	}
+	/**
+		@param source		The compressed data
+		@param destination	Replaced with the uncompressed data
+		@param size			The size of the data before it was compressed
+		@return				destination
+		@throw posix::err::EILSEQ_ErrNo if the data is corrupt or does not uncompress to size bytes
+	*/
+	inline std::string &uncompress(const std::string &source, std::string &destination, size_t size) {trace_scope
+		destination.assign(size, '\0');
+		if(uncompress(source.data(), source.size(), const_cast<char*>(destination.data()), size) != size) {
+			ErrnoCodeThrow(EILSEQ, "Compressed data is truncated");
+		}
+		return destination;
+	}
+}
+
+#endif // __LZCompression_h__
@@ -218,7 +218,7 @@ namespace exec {
 		@return			Reference to *this
 	*/
 	template<typename ReferenceCountedType>
-	ReferenceCounted::Ptr<ReferenceCountedType> &ReferenceCounted::Ptr<ReferenceCountedType>::operator=(const ReferenceCounted::Ptr<ReferenceCountedType>::Ptr &other) {trace_scope;
+	ReferenceCounted::Ptr<ReferenceCountedType> &ReferenceCounted::Ptr<ReferenceCountedType>::operator=(const Ptr &other) {trace_scope;
 		if(this != &other) {
 			return assign(other._ptr, Retain);
 		}
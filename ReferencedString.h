@@ -5,6 +5,13 @@
 	@todo trace_bool in for loops
 */
 #include <string>
+#include <string.h>
+#include <stdint.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ >= 5 || defined(__clang__))
+	#include <immintrin.h>
+	#define ReferencedStringX86 1 ///< SSE2 and AVX2 substring filters, used if the CPU has them
+#endif
 
 #ifndef trace_scope
 	#define trace_scope ///< in case Tracer.h is not included
@@ -70,6 +77,8 @@ class ReferencedString {
 		bool valid() const;
 		/// Compare two strings.
 		int compare(const ReferencedString &str) const;
+		/// The first 8 bytes as a big endian integer, so integers order like the strings.
+		uint64_t prefix() const;
 		/// Removes count bytes from the beginning of the string.
 		ReferencedString &trimFromStart(size_t count);
 		/// Removes count bytes from the end of the string.
@@ -82,12 +91,32 @@ class ReferencedString {
 		size_t find(char character, size_t offset= 0) const;
 		/// Finds the given substring in this string.
 		size_t find(const ReferencedString &str, size_t offset= 0) const;
+		/// Finds the last position of the given character.
+		size_t rfind(char character, size_t offset= npos) const;
+		/// Finds the last position of the given substring in this string.
+		size_t rfind(const ReferencedString &str, size_t offset= npos) const;
+		/// Finds the first position of any of the given characters.
+		size_t find_first_of(const ReferencedString &characters, size_t offset= 0) const;
+		/// Finds one substring over and over.
+		class Searcher;
+		/// A string with its prefix() beside it, for sorting and looking up many strings.
+		class Key;
 	private:
 		const void *_buffer;	///< The start of this string in the buffer.
 		size_t		_size;		///< The number of bytes of this string in the buffer.
+		/// Needles up to this long are found by their first and last bytes, longer ones with Searcher.
+		static const size_t	_kShortNeedle= 32;
 
 		/// Raw search for the given character starting at the given offset.
 		size_t _find(char character, size_t offset) const;
+		/// Raw search for a needle of 2 to _kShortNeedle bytes starting at the given offset.
+		size_t _findShort(const ReferencedString &str, size_t offset) const;
+#if ReferencedStringX86
+		/// Compares the first and last bytes of the needle at 16 positions at a time.
+		__attribute__((target("sse2"))) static size_t _findSSE2(const char *haystack, size_t size, const char *needle, size_t needleSize, size_t &searched);
+		/// Compares the first and last bytes of the needle at 32 positions at a time.
+		__attribute__((target("avx2"))) static size_t _findAVX2(const char *haystack, size_t size, const char *needle, size_t needleSize, size_t &searched);
+#endif
 		/// Calculates the address to use for a substring.
 		template<class String>
 		static const void *_substringAddress(const String &str, size_t offset, size_t subSize);
@@ -96,6 +125,75 @@ class ReferencedString {
 		static size_t _substringSize(const String &str, size_t offset, size_t subSize);
 };
 
+/** Finds a needle in any number of haystacks, working out how to skip ahead in the haystack once.
+	Needles up to 32 bytes are found by looking for their first and last bytes together, 16 or 32 positions at a time
+		with SSE2 or AVX2, and comparing the rest where both match.
+	Longer needles are found with the Two-Way algorithm, which compares the right part of the needle (from its critical
+		factorization) left to right then the left part, and never looks at a byte of the haystack more than twice,
+		so repetitive haystacks are not quadratic. A Boyer-Moore-Horspool table of the last byte of each window
+		skips ahead when it does not end the needle.
+	@note The needle <b>must</b> be valid for the life of the Searcher.
+*/
+class ReferencedString::Searcher {
+	public:
+		/// Work out how to find a needle.
+		Searcher(const ReferencedString &needle);
+		/// Nothing to do in destructor.
+		~Searcher();
+		/// The needle this finds.
+		const ReferencedString &needle() const;
+		/// Finds the needle in a haystack.
+		size_t find(const ReferencedString &haystack, size_t offset= 0) const;
+	private:
+		ReferencedString	_needle;		///< What to find
+		size_t				_suffix;		///< Where the right part of the critical factorization starts
+		size_t				_period;		///< The period of the needle, or a safe shift if it is not periodic
+		bool				_periodic;		///< Does the left part repeat in the right, so matches overlap
+		size_t				_shift[256];	///< How far to skip when a window ends in each byte
+		/// Finds a maximal suffix of the needle and its period, in forward or reverse byte order.
+		size_t _maximalSuffix(bool reverse, size_t &period) const;
+		/// Finds a needle longer than _kShortNeedle.
+		size_t _twoWay(const unsigned char *haystack, size_t size, size_t offset) const;
+};
+
+/** A ReferencedString with its prefix() kept beside it (the layout of a "German string"),
+		so most comparisons while sorting or looking up a large set of strings are one integer compare,
+		and the bytes are only read when the first 8 are the same.
+	@note The string <b>must</b> be valid for the life of the Key.
+*/
+class ReferencedString::Key {
+	public:
+		/// An empty string.
+		Key();
+		/// Keep the prefix of a string.
+		Key(const ReferencedString &str);
+		/// Nothing to do in destructor.
+		~Key();
+		/// The string.
+		const ReferencedString &value() const;
+		/// The first 8 bytes of the string, see ReferencedString::prefix().
+		uint64_t prefix() const;
+		/// Compare two strings, like ReferencedString::compare().
+		int compare(const Key &other) const;
+		/// Binary patterns are the same.
+		bool operator==(const Key &other) const;
+		/// Binary patterns are not the same.
+		bool operator!=(const Key &other) const;
+		/// Binary pattern is less than another.
+		bool operator<(const Key &other) const;
+		/// Binary pattern is greater than another.
+		bool operator>(const Key &other) const;
+		/// Binary pattern is less than or equal to another.
+		bool operator<=(const Key &other) const;
+		/// Binary pattern is greater than or equal to another.
+		bool operator>=(const Key &other) const;
+	private:
+		uint64_t			_prefix;	///< The first 8 bytes of _string
+		ReferencedString	_string;	///< The string
+		/// Compare the bytes after the prefix, then the sizes.
+		int _compareRest(const Key &other) const;
+};
+
 /** @name Constructors and Destructors
 */ // @{
 /** An invalid, empty string.
@@ -187,7 +285,7 @@ inline bool ReferencedString::operator==(const ReferencedString &str) const {tra
 	if(_buffer == str._buffer) {trace_scope
 		return true;
 	}
-	return compare(str) == 0;
+	return memcmp(_buffer, str._buffer, _size) == 0;
 }
 /** See compare(const ReferencedString&).
 	@param str	The string to compare.
@@ -200,7 +298,7 @@ inline bool ReferencedString::operator!=(const ReferencedString &str) const {tra
 	if(_buffer == str._buffer) {trace_scope
 		return false;
 	}
-	return compare(str) != 0;
+	return memcmp(_buffer, str._buffer, _size) != 0;
 }
 /** See compare(const ReferencedString&).
 	@param str	The string to compare.
@@ -324,6 +422,8 @@ inline bool ReferencedString::valid() const {trace_scope
 }
 /** Compares the bytes, starting at index 0. The bytes are compared as unsigned characters.
 	The first non-matching byte index is used for the comparison.
+	When both strings have 8 bytes, the first 8 are compared as one integer (see prefix()),
+		and the rest with memcmp.
 	@return <ul>
 				<li><b>-1</b> if <code>this</code> is less than <code>str</code>
 				<li><b>0</b> if <code>this</code> identical to <code>str</code>
@@ -332,15 +432,23 @@ inline bool ReferencedString::valid() const {trace_scope
 */
 // @}
 inline int ReferencedString::compare(const ReferencedString &str) const {trace_scope
-	const unsigned char	*s1= reinterpret_cast<const unsigned char*>(_buffer);
-	const unsigned char	*s2= reinterpret_cast<const unsigned char*>(str._buffer);
-
-	for(size_t index= 0; trace_bool(index < _size) && trace_bool(index < str._size); ++index) {trace_scope
-		if(s1[index] < s2[index]) {trace_scope
-			return -1;
-		} else if(s1[index] > s2[index]) {trace_scope
-			return 1;
+	const size_t	common= (_size < str._size) ? _size : str._size;
+	size_t			start= 0;
+	int				result= 0;
+
+	if(trace_bool(common >= 8)) {trace_scope
+		const uint64_t	mine= prefix(), theirs= str.prefix();
+
+		if(trace_bool(mine != theirs)) {trace_scope
+			return (mine < theirs) ? -1 : 1;
 		}
+		start= 8;
+	}
+	if(trace_bool(common > start)) {trace_scope
+		result= memcmp(reinterpret_cast<const char*>(_buffer) + start, reinterpret_cast<const char*>(str._buffer) + start, common - start);
+	}
+	if(trace_bool(result != 0)) {trace_scope
+		return (result < 0) ? -1 : 1;
 	}
 	if(_size < str._size) {trace_scope
 		return -1;
@@ -349,6 +457,25 @@ inline int ReferencedString::compare(const ReferencedString &str) const {trace_s
 	}
 	return 0;
 }
+/** Strings shorter than 8 bytes are padded with zeros, so strings that only differ in trailing zeros
+		have the same prefix, and the sizes decide.
+	@return	The first 8 bytes, the first in the most significant byte.
+*/
+inline uint64_t ReferencedString::prefix() const {trace_scope
+	const unsigned char	*bytes= reinterpret_cast<const unsigned char*>(_buffer);
+	uint64_t			value= 0;
+
+	if(trace_bool(_size >= 8)) {trace_scope
+		return (static_cast<uint64_t>(bytes[0]) << 56) | (static_cast<uint64_t>(bytes[1]) << 48)
+				| (static_cast<uint64_t>(bytes[2]) << 40) | (static_cast<uint64_t>(bytes[3]) << 32)
+				| (static_cast<uint64_t>(bytes[4]) << 24) | (static_cast<uint64_t>(bytes[5]) << 16)
+				| (static_cast<uint64_t>(bytes[6]) << 8) | static_cast<uint64_t>(bytes[7]);
+	}
+	for(size_t index= 0; trace_bool(index < _size); ++index) {
+		value|= static_cast<uint64_t>(bytes[index]) << (56 - 8 * index);
+	}
+	return value;
+}
 /** If everything is removed, this string becomes invalid. See valid(). See operator bool().
 	<code>this</code> is modified in place.
 	@param count	The number of bytes to remove from the beginning of the string.
@@ -390,22 +517,91 @@ inline size_t ReferencedString::find(char character, size_t offset) const {trace
 }
 /** Short circuits the search if <code>this</code> or <code>str</code> is not valid,
 		or <code>str</code> could not fit in the space left after offset.
+	Single bytes are found with memchr, short needles by their first and last bytes, and long ones by a Searcher.
 	@param str			The substring to search for.
 	@param offset		The position to start looking for <code>str</code>. Default is index 0.
 */
 inline size_t ReferencedString::find(const ReferencedString &str, size_t offset) const {trace_scope
 	if( trace_bool(NULL == _buffer) || trace_bool(0 == _size)
 		|| trace_bool(NULL == str._buffer) || trace_bool(0 == str._size)
-		|| trace_bool(offset + str._size >= _size) ) {trace_scope
+		|| trace_bool(offset >= _size) || trace_bool(str._size > _size - offset) ) {trace_scope
 		return npos;
 	}
-	while(npos != offset) {trace_scope
-		offset= _find(str[0], offset);
-		if(npos != offset) {trace_scope
-			if(substring(offset, str._size) == str) {trace_scope
-				return offset;
-			}
-			++offset;
+	if(trace_bool(1 == str._size)) {trace_scope
+		return _find(str.getRaw(0), offset);
+	}
+	if(trace_bool(str._size <= _kShortNeedle)) {trace_scope
+		return _findShort(str, offset);
+	}
+	return Searcher(str).find(*this, offset);
+}
+/**
+	@param character	The byte to search for.
+	@param offset		The last position <code>character</code> may be at. Default is the end.
+	@return				The position of the last <code>character</code> at or before offset, or npos.
+*/
+inline size_t ReferencedString::rfind(char character, size_t offset) const {trace_scope
+	const char	*start= reinterpret_cast<const char*>(_buffer);
+
+	if( trace_bool(NULL == _buffer) || trace_bool(0 == _size) ) {trace_scope
+		return npos;
+	}
+	for(size_t position= (offset < _size) ? offset + 1 : _size; trace_bool(position > 0); --position) {
+		if(trace_bool(start[position - 1] == character)) {trace_scope
+			return position - 1;
+		}
+	}
+	return npos;
+}
+/** Checks the last byte, then the first, before comparing the rest at each position, working back from offset.
+	@param str			The substring to search for.
+	@param offset		The last position <code>str</code> may start at. Default is the end.
+	@return				The position of the last <code>str</code> starting at or before offset, or npos.
+*/
+inline size_t ReferencedString::rfind(const ReferencedString &str, size_t offset) const {trace_scope
+	const char	*start= reinterpret_cast<const char*>(_buffer);
+
+	if( trace_bool(NULL == _buffer) || trace_bool(0 == _size)
+		|| trace_bool(NULL == str._buffer) || trace_bool(0 == str._size)
+		|| trace_bool(str._size > _size) ) {trace_scope
+		return npos;
+	}
+	const char	first= str.getRaw(0), last= str.getRaw(str._size - 1);
+
+	for(size_t position= (offset < _size - str._size ? offset : _size - str._size) + 1; trace_bool(position > 0); --position) {
+		const char	*window= start + position - 1;
+
+		if( trace_bool(window[str._size - 1] == last) && trace_bool(window[0] == first)
+				&& trace_bool(memcmp(window, str._buffer, str._size) == 0) ) {trace_scope
+			return position - 1;
+		}
+	}
+	return npos;
+}
+/**
+	@param characters	The bytes to search for.
+	@param offset		The position to start looking. Default is index 0.
+	@return				The position of the first byte that is in <code>characters</code>, or npos.
+*/
+inline size_t ReferencedString::find_first_of(const ReferencedString &characters, size_t offset) const {trace_scope
+	const unsigned char	*start= reinterpret_cast<const unsigned char*>(_buffer);
+	const unsigned char	*set= reinterpret_cast<const unsigned char*>(characters._buffer);
+	bool				member[256];
+
+	if( trace_bool(NULL == _buffer) || trace_bool(0 == _size) || trace_bool(offset >= _size)
+		|| trace_bool(NULL == characters._buffer) || trace_bool(0 == characters._size) ) {trace_scope
+		return npos;
+	}
+	if(trace_bool(1 == characters._size)) {trace_scope
+		return _find(characters.getRaw(0), offset);
+	}
+	memset(member, 0, sizeof(member));
+	for(size_t index= 0; trace_bool(index < characters._size); ++index) {
+		member[set[index]]= true;
+	}
+	for(size_t position= offset; trace_bool(position < _size); ++position) {
+		if(trace_bool(member[start[position]])) {trace_scope
+			return position;
 		}
 	}
 	return npos;
@@ -428,6 +624,99 @@ inline size_t ReferencedString::_find(char character, size_t offset) const {trac
 	}
 	return found - start;
 }
+/** Looks for the first and last bytes of the needle together, with AVX2 or SSE2 if the CPU has them,
+		and memchr for the first byte otherwise, and compares the bytes between where both match.
+	_buffer and _size must be valid, and the needle must fit after offset, before calling.
+	@param str		The needle, 2 to _kShortNeedle bytes.
+	@param offset	The position to start looking for <code>str</code>.
+*/
+inline size_t ReferencedString::_findShort(const ReferencedString &str, size_t offset) const {trace_scope
+	const char	*start= reinterpret_cast<const char*>(_buffer);
+	const char	*needle= reinterpret_cast<const char*>(str._buffer);
+	const char	last= needle[str._size - 1];
+	const size_t	end= _size - str._size + 1;
+
+#if ReferencedStringX86
+	static const int	available= __builtin_cpu_supports("avx2") ? 2 : (__builtin_cpu_supports("sse2") ? 1 : 0);
+	size_t				searched= 0;
+	size_t				found= npos;
+
+	if(trace_bool(2 == available)) {trace_scope
+		found= _findAVX2(start + offset, _size - offset, needle, str._size, searched);
+	} else if(trace_bool(1 == available)) {trace_scope
+		found= _findSSE2(start + offset, _size - offset, needle, str._size, searched);
+	}
+	if(trace_bool(npos != found)) {trace_scope
+		return offset + found;
+	}
+	offset+= searched;
+#endif
+	while(trace_bool(offset < end)) {
+		const char	*candidate= reinterpret_cast<const char*>(memchr(start + offset, needle[0], end - offset));
+
+		if(trace_bool(NULL == candidate)) {trace_scope
+			return npos;
+		}
+		if( trace_bool(candidate[str._size - 1] == last)
+				&& trace_bool(memcmp(candidate + 1, needle + 1, str._size - 2) == 0) ) {trace_scope
+			return candidate - start;
+		}
+		offset= candidate - start + 1;
+	}
+	return npos;
+}
+#if ReferencedStringX86
+/** Each bit of the mask is a position where both the first and last bytes of the needle match.
+	@param haystack		Where to search.
+	@param size			The number of bytes in haystack.
+	@param needle		The needle, 2 or more bytes.
+	@param needleSize	The number of bytes in needle, no more than size.
+	@param searched		Set to the number of positions looked at, the rest are left for the caller.
+	@return				The position of the needle in the positions looked at, or npos.
+*/
+__attribute__((target("sse2"))) inline size_t ReferencedString::_findSSE2(const char *haystack, size_t size, const char *needle, size_t needleSize, size_t &searched) {trace_scope
+	const __m128i	first= _mm_set1_epi8(needle[0]);
+	const __m128i	last= _mm_set1_epi8(needle[needleSize - 1]);
+
+	for(searched= 0; trace_bool(searched + needleSize - 1 + 16 <= size); searched+= 16) {
+		const __m128i	starts= _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + searched));
+		const __m128i	ends= _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + searched + needleSize - 1));
+		unsigned int	mask= static_cast<unsigned int>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, starts), _mm_cmpeq_epi8(last, ends))));
+
+		while(trace_bool(0 != mask)) {
+			const size_t	position= searched + __builtin_ctz(mask);
+
+			if(trace_bool(memcmp(haystack + position + 1, needle + 1, needleSize - 2) == 0)) {trace_scope
+				return position;
+			}
+			mask&= mask - 1;
+		}
+	}
+	return npos;
+}
+/** See _findSSE2().
+*/
+__attribute__((target("avx2"))) inline size_t ReferencedString::_findAVX2(const char *haystack, size_t size, const char *needle, size_t needleSize, size_t &searched) {trace_scope
+	const __m256i	first= _mm256_set1_epi8(needle[0]);
+	const __m256i	last= _mm256_set1_epi8(needle[needleSize - 1]);
+
+	for(searched= 0; trace_bool(searched + needleSize - 1 + 32 <= size); searched+= 32) {
+		const __m256i	starts= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + searched));
+		const __m256i	ends= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + searched + needleSize - 1));
+		unsigned int	mask= static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, starts), _mm256_cmpeq_epi8(last, ends))));
+
+		while(trace_bool(0 != mask)) {
+			const size_t	position= searched + __builtin_ctz(mask);
+
+			if(trace_bool(memcmp(haystack + position + 1, needle + 1, needleSize - 2) == 0)) {trace_scope
+				return position;
+			}
+			mask&= mask - 1;
+		}
+	}
+	return npos;
+}
+#endif
 /** Helper function for constructor's ctor list.
 	@param str		The string to get the address of.
 	@param offset	The offset in <code>str</code>.
@@ -471,4 +760,234 @@ size_t ReferencedString::_substringSize(const String &str, size_t offset, size_t
 	return subSize;
 }
 
+/** @name Searcher
+*/ // @{
+/** Long needles get their critical factorization (the later of the maximal suffixes in forward and reverse byte order)
+		and a table of how far the last byte of a window lets the search skip.
+	@param needle	The substring to find. It <b>must</b> be valid for the life of the Searcher.
+*/
+inline ReferencedString::Searcher::Searcher(const ReferencedString &needle)
+	:_needle(needle), _suffix(0), _period(1), _periodic(false), _shift() {trace_scope
+	const unsigned char	*bytes= reinterpret_cast<const unsigned char*>(_needle._buffer);
+	size_t				forwardPeriod, reversePeriod;
+
+	if(trace_bool(_needle._size <= _kShortNeedle)) {trace_scope
+		return;
+	}
+	const size_t	forward= _maximalSuffix(false, forwardPeriod);
+	const size_t	reverse= _maximalSuffix(true, reversePeriod);
+
+	_suffix= (reverse + 1 < forward + 1) ? forward + 1 : reverse + 1;
+	_period= (reverse + 1 < forward + 1) ? forwardPeriod : reversePeriod;
+	_periodic= memcmp(bytes, bytes + _period, _suffix) == 0;
+	if(trace_bool(!_periodic)) {trace_scope
+		_period= (_suffix > _needle._size - _suffix ? _suffix : _needle._size - _suffix) + 1;
+	}
+	for(size_t byte= 0; trace_bool(byte < sizeof(_shift) / sizeof(_shift[0])); ++byte) {
+		_shift[byte]= _needle._size;
+	}
+	for(size_t index= 0; trace_bool(index < _needle._size); ++index) {
+		_shift[bytes[index]]= _needle._size - index - 1;
+	}
+}
+/** Does nothing. */
+inline ReferencedString::Searcher::~Searcher() {trace_scope}
+inline const ReferencedString &ReferencedString::Searcher::needle() const {trace_scope
+	return _needle;
+}
+/**
+	@param haystack	The string to search.
+	@param offset	The position to start looking. Default is index 0.
+	@return			The position of the first needle at or after offset, or npos.
+*/
+inline size_t ReferencedString::Searcher::find(const ReferencedString &haystack, size_t offset) const {trace_scope
+	if(trace_bool(_needle._size <= _kShortNeedle)) {trace_scope
+		return haystack.find(_needle, offset);
+	}
+	if( trace_bool(NULL == haystack._buffer) || trace_bool(offset >= haystack._size)
+			|| trace_bool(_needle._size > haystack._size - offset) ) {trace_scope
+		return npos;
+	}
+	return _twoWay(reinterpret_cast<const unsigned char*>(haystack._buffer), haystack._size, offset);
+}
+/** Crochemore and Perrin's maximal suffix: the suffix that is greatest in (reversed) byte order,
+		along with its period.
+	@param reverse	Order the bytes from 255 to 0.
+	@param period	Set to the period of the suffix.
+	@return			One before where the suffix starts, npos if it is the whole needle.
+*/
+inline size_t ReferencedString::Searcher::_maximalSuffix(bool reverse, size_t &period) const {trace_scope
+	const unsigned char	*bytes= reinterpret_cast<const unsigned char*>(_needle._buffer);
+	size_t				suffix= npos, candidate= 0, match= 1;
+
+	period= 1;
+	while(trace_bool(candidate + match < _needle._size)) {
+		const unsigned char	next= bytes[candidate + match], current= bytes[suffix + match];
+
+		if(trace_bool(next == current)) {
+			if(trace_bool(match != period)) {
+				++match;
+			} else {
+				candidate+= period;
+				match= 1;
+			}
+		} else if(trace_bool(reverse ? (next > current) : (next < current))) {
+			candidate+= match;
+			match= 1;
+			period= candidate - suffix;
+		} else {
+			suffix= candidate++;
+			match= period= 1;
+		}
+	}
+	return suffix;
+}
+/** Each window of the haystack is checked at its last byte, then the right part of the needle left to right,
+		then the left part right to left. A periodic needle remembers how much of its left part matched
+		the last window, so nothing is compared twice.
+	@param haystack	The bytes to search.
+	@param size		The number of bytes in haystack.
+	@param offset	The position to start looking, the needle fits after it.
+	@return			The position of the needle, or npos.
+*/
+inline size_t ReferencedString::Searcher::_twoWay(const unsigned char *haystack, size_t size, size_t offset) const {trace_scope
+	const unsigned char	*needle= reinterpret_cast<const unsigned char*>(_needle._buffer);
+	const size_t		length= _needle._size;
+	size_t				memory= 0;
+
+	for(size_t window= offset; trace_bool(window <= size - length); ) {
+		size_t	shift= _shift[haystack[window + length - 1]];
+
+		if(trace_bool(shift > 0)) {
+			if( trace_bool(memory > 0) && trace_bool(shift < _period) ) {
+				shift= length - _period;
+			}
+			memory= 0;
+			window+= shift;
+			continue;
+		}
+		size_t	index= (_suffix > memory) ? _suffix : memory;
+
+		while( trace_bool(index < length - 1) && trace_bool(needle[index] == haystack[window + index]) ) {
+			++index;
+		}
+		if(trace_bool(index < length - 1)) {
+			window+= index - _suffix + 1;
+			memory= 0;
+			continue;
+		}
+		index= _suffix;
+		while( trace_bool(index > memory) && trace_bool(needle[index - 1] == haystack[window + index - 1]) ) {
+			--index;
+		}
+		if(trace_bool(index <= memory)) {trace_scope
+			return window;
+		}
+		window+= _period;
+		memory= _periodic ? length - _period : 0;
+	}
+	return npos;
+}
+// @}
+/** @name Key
+*/ // @{
+/** An empty string, the same as ReferencedString().
+*/
+inline ReferencedString::Key::Key()
+	:_prefix(0), _string() {trace_scope
+}
+/**
+	@param str	The string. It <b>must</b> be valid for the life of the Key.
+*/
+inline ReferencedString::Key::Key(const ReferencedString &str)
+	:_prefix(str.prefix()), _string(str) {trace_scope
+}
+/** Does nothing. */
+inline ReferencedString::Key::~Key() {trace_scope}
+inline const ReferencedString &ReferencedString::Key::value() const {trace_scope
+	return _string;
+}
+inline uint64_t ReferencedString::Key::prefix() const {trace_scope
+	return _prefix;
+}
+/**
+	@param other	The string to compare.
+	@return			-1, 0 or 1, see ReferencedString::compare().
+*/
+inline int ReferencedString::Key::compare(const Key &other) const {trace_scope
+	if(trace_bool(_prefix != other._prefix)) {trace_scope
+		return (_prefix < other._prefix) ? -1 : 1;
+	}
+	return _compareRest(other);
+}
+/**
+	@param other	The string to compare.
+	@return			<code>true</code> if the strings are identical.
+*/
+inline bool ReferencedString::Key::operator==(const Key &other) const {trace_scope
+	return trace_bool(_prefix == other._prefix) && trace_bool(_string._size == other._string._size)
+			&& trace_bool( trace_bool(_string._size <= 8)
+				|| trace_bool(memcmp(reinterpret_cast<const char*>(_string._buffer) + 8, reinterpret_cast<const char*>(other._string._buffer) + 8, _string._size - 8) == 0) );
+}
+/**
+	@param other	The string to compare.
+	@return			<code>true</code> if the strings are not identical.
+*/
+inline bool ReferencedString::Key::operator!=(const Key &other) const {trace_scope
+	return !(*this == other);
+}
+/**
+	@param other	The string to compare.
+	@return			<code>true</code> if this string is less.
+*/
+inline bool ReferencedString::Key::operator<(const Key &other) const {trace_scope
+	if(trace_bool(_prefix != other._prefix)) {trace_scope
+		return _prefix < other._prefix;
+	}
+	return _compareRest(other) < 0;
+}
+/**
+	@param other	The string to compare.
+	@return			<code>true</code> if this string is greater.
+*/
+inline bool ReferencedString::Key::operator>(const Key &other) const {trace_scope
+	return other < *this;
+}
+/**
+	@param other	The string to compare.
+	@return			<code>true</code> if this string is less or identical.
+*/
+inline bool ReferencedString::Key::operator<=(const Key &other) const {trace_scope
+	return !(other < *this);
+}
+/**
+	@param other	The string to compare.
+	@return			<code>true</code> if this string is greater or identical.
+*/
+inline bool ReferencedString::Key::operator>=(const Key &other) const {trace_scope
+	return !(*this < other);
+}
+/** The prefixes are the same, so the first 8 bytes (or all of a shorter string, and zeros in the other) are too.
+	@param other	The string to compare, with the same prefix.
+	@return			-1, 0 or 1, see ReferencedString::compare().
+*/
+inline int ReferencedString::Key::_compareRest(const Key &other) const {trace_scope
+	const size_t	common= (_string._size < other._string._size) ? _string._size : other._string._size;
+
+	if(trace_bool(common > 8)) {trace_scope
+		const int	result= memcmp(reinterpret_cast<const char*>(_string._buffer) + 8, reinterpret_cast<const char*>(other._string._buffer) + 8, common - 8);
+
+		if(trace_bool(result != 0)) {trace_scope
+			return (result < 0) ? -1 : 1;
+		}
+	}
+	if(_string._size < other._string._size) {trace_scope
+		return -1;
+	} else if(_string._size > other._string._size) {trace_scope
+		return 1;
+	}
+	return 0;
+}
+// @}
+
 #endif // __ReferencedString_h__
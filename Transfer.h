@@ -0,0 +1,272 @@
+#ifndef __Transfer_h__
+#define __Transfer_h__
+
+/** @file Transfer.h
+	Moving ranges of a File to a Socket or another File without bringing the bytes into our memory.
+*/
+
+#include "File.h"
+#include "Socket.h"
+#include "BufferAddress.h"
+#include "POSIXErrno.h"
+#include <string>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#if __linux__
+	#include <sys/sendfile.h>
+	#include <sys/syscall.h>
+#endif
+
+#ifndef trace_scope
+	#define trace_scope ///< in case Tracer.h is not included
+#endif
+#ifndef trace_bool
+	#define trace_bool(x) (x) ///< in case Tracer.h is not included
+#endif
+
+namespace io {
+
+	/** Sends file ranges to sockets (sendfile) and copies file ranges between files
+			(copy_file_range, then sendfile) in the kernel.
+		When the system or the file systems involved can't do that, the bytes are copied through a
+			buffer that the Transfer keeps between calls, so keep one Transfer around (per thread)
+			for repeated transfers.
+	*/
+	class Transfer {
+		public:
+			/// How to move the bytes.
+			enum Method {
+				ZeroCopy,	///< In the kernel if possible, otherwise Buffered
+				Buffered	///< Always read into our buffer and write it out
+			};
+			/// Keeps a buffer of the given size for when we can't copy in the kernel.
+			Transfer(size_t bufferSize= 256 * 1024);
+			/// Releases the buffer.
+			~Transfer();
+			/// Send a range of a file out a socket.
+			off_t send(File &source, off_t offset, off_t length, net::Socket &destination, Method method= ZeroCopy);
+			/// Copy a range of a file into another file.
+			off_t copy(File &source, off_t offset, off_t length, File &destination, off_t destinationOffset, Method method= ZeroCopy);
+		private:
+			std::string	_buffer;	///< The reusable buffer for Buffered transfers
+			/// Limits length to the end of the file.
+			static off_t _available(File &source, off_t offset, off_t length);
+			/// Is the error one that means this kind of kernel copy is not available.
+			static bool _unsupported(int error);
+			/// Sends whatever is left using our buffer.
+			off_t _sendBuffered(File &source, off_t offset, off_t length, net::Socket &destination);
+			/// Copies whatever is left using our buffer.
+			off_t _copyBuffered(File &source, off_t offset, off_t length, File &destination, off_t destinationOffset);
+	};
+
+	/**
+		@param bufferSize	The size of buffer to use when we cannot copy in the kernel.
+	*/
+	inline Transfer::Transfer(size_t bufferSize)
+		:_buffer(bufferSize, '\0') {trace_scope
+	}
+	inline Transfer::~Transfer() {trace_scope
+	}
+	/** Buffered writes to <code>source</code> are flushed first.
+		If <code>destination</code> is non-blocking, this waits for it to have room rather than returning early.
+		@param source		The file to read from.
+		@param offset		The offset in <code>source</code> to start at.
+		@param length		The number of bytes to send, limited to the end of <code>source</code>.
+		@param destination	The socket to send them out.
+		@param method		Buffered to force reading the bytes into memory first.
+		@return				The number of bytes sent.
+	*/
+	inline off_t Transfer::send(File &source, off_t offset, off_t length, net::Socket &destination, Method method) {trace_scope
+		off_t	sent= 0;
+
+		length= _available(source, offset, length);
+		if(Buffered == method) {
+			return _sendBuffered(source, offset, length, destination);
+		}
+		source.flush(File::FlushToKernel);
+		while(sent < length) {
+#if __linux__
+			off_t	position= offset + sent;
+			const size_t	chunk= static_cast<size_t>(length - sent < (1 << 30) ? length - sent : (1 << 30));
+			const ssize_t	amount= ::sendfile(destination.descriptor(), source.descriptor(), &position, chunk);
+
+			if(amount > 0) {
+				sent+= amount;
+				continue;
+			}
+			if(0 == amount) {
+				break;
+			}
+#elif __APPLE_CC__ || __APPLE__
+			off_t	amount= length - sent;
+			int		result= ::sendfile(source.descriptor(), destination.descriptor(), offset + sent, &amount, NULL, 0);
+
+			sent+= amount;
+			if(0 == result) {
+				if(0 == amount) {
+					break;
+				}
+				continue;
+			}
+#else
+			errno= ENOSYS;
+#endif
+			if(EINTR == errno) {
+				continue;
+			}
+			if( (EAGAIN == errno) || (EWOULDBLOCK == errno) ) { // non-blocking socket is full, wait for room
+				struct pollfd	writable= {destination.descriptor(), POLLOUT, 0};
+
+				if( (::poll(&writable, 1, -1) < 0) && (EINTR != errno) ) {
+					ErrnoMessageThrow("poll");
+				}
+				continue;
+			}
+			if(_unsupported(errno)) {
+				return sent + _sendBuffered(source, offset + sent, length - sent, destination);
+			}
+			ErrnoMessageThrow("sendfile");
+		}
+		return sent;
+	}
+	/** Buffered writes to either file are flushed first, and <code>destination</code>'s stdio
+			buffers are discarded afterwards so it sees the new contents.
+		The current position of <code>destination</code> is unchanged.
+		@param source				The file to read from.
+		@param offset				The offset in <code>source</code> to start at.
+		@param length				The number of bytes to copy, limited to the end of <code>source</code>.
+		@param destination			The file to write to.
+		@param destinationOffset	Where in <code>destination</code> to put the bytes.
+		@param method				Buffered to force reading the bytes into memory first.
+		@return						The number of bytes copied.
+	*/
+	inline off_t Transfer::copy(File &source, off_t offset, off_t length, File &destination, off_t destinationOffset, Method method) {trace_scope
+		const off_t	position= destination.location();
+		off_t		copied= 0;
+
+		AssertMessageException(destination.writable());
+		length= _available(source, offset, length);
+		if(Buffered == method) {
+			copied= _copyBuffered(source, offset, length, destination, destinationOffset);
+			destination.moveto(position);
+			return copied;
+		}
+		source.flush(File::FlushToKernel);
+		destination.flush(File::FlushToKernel);
+#if __linux__ && defined(__NR_copy_file_range)
+		while(copied < length) {
+			loff_t			in= offset + copied, out= destinationOffset + copied;
+			const ssize_t	amount= ::syscall(__NR_copy_file_range, source.descriptor(), &in,
+												destination.descriptor(), &out,
+												static_cast<size_t>(length - copied), 0);
+
+			if(amount > 0) {
+				copied+= amount;
+			} else if(0 == amount) {
+				break;
+			} else if(EINTR != errno) {
+				if(!_unsupported(errno)) {
+					ErrnoMessageThrow("copy_file_range");
+				}
+				break;
+			}
+		}
+#endif
+#if __linux__
+		if(copied < length) { // sendfile writes at the descriptor's position
+			ErrnoOnNegative(::lseek(destination.descriptor(), destinationOffset + copied, SEEK_SET));
+		}
+		while(copied < length) {
+			off_t			in= offset + copied;
+			const size_t	chunk= static_cast<size_t>(length - copied < (1 << 30) ? length - copied : (1 << 30));
+			const ssize_t	amount= ::sendfile(destination.descriptor(), source.descriptor(), &in, chunk);
+
+			if(amount > 0) {
+				copied+= amount;
+			} else if(0 == amount) {
+				break;
+			} else if(EINTR != errno) {
+				if(!_unsupported(errno)) {
+					ErrnoMessageThrow("sendfile");
+				}
+				break;
+			}
+		}
+#endif
+		if(copied < length) {
+			copied+= _copyBuffered(source, offset + copied, length - copied, destination, destinationOffset + copied);
+		}
+		destination.moveto(position); // discards stdio buffers and resyncs the descriptor position
+		return copied;
+	}
+	/**
+		@param source	The file we are reading from.
+		@param offset	The offset we start reading from.
+		@param length	The number of bytes requested.
+		@return			<code>length</code> or the number of bytes left after <code>offset</code>, whichever is smaller.
+	*/
+	inline off_t Transfer::_available(File &source, off_t offset, off_t length) {trace_scope
+		const off_t	size= source.size();
+
+		if(offset >= size) {
+			return 0;
+		}
+		return trace_bool(length > size - offset) ? size - offset : length;
+	}
+	/**
+		@param error	The errno from the kernel copy call.
+		@return			true if we should fall back to another method instead of throwing.
+	*/
+	inline bool Transfer::_unsupported(int error) {trace_scope
+		return trace_bool(ENOSYS == error) || trace_bool(EINVAL == error) || trace_bool(EXDEV == error)
+				|| trace_bool(ENOTSUP == error) || trace_bool(EOPNOTSUPP == error) || trace_bool(ENOTSOCK == error);
+	}
+	/**
+		@param source		The file to read from.
+		@param offset		The offset in <code>source</code> to start at.
+		@param length		The number of bytes to send, must be available in <code>source</code>.
+		@param destination	The socket to write to.
+		@return				<code>length</code>
+	*/
+	inline off_t Transfer::_sendBuffered(File &source, off_t offset, off_t length, net::Socket &destination) {trace_scope
+		off_t	sent= 0;
+
+		while(sent < length) {
+			const size_t	chunk= static_cast<size_t>(length - sent < static_cast<off_t>(_buffer.size()) ? length - sent : _buffer.size());
+			size_t			written= 0;
+
+			source.read(const_cast<char*>(_buffer.data()), chunk, offset + sent, File::FromStart);
+			while(written < chunk) {
+				BufferAddress	left(const_cast<char*>(_buffer.data()) + written, chunk - written);
+
+				written+= destination.write(left);
+			}
+			sent+= chunk;
+		}
+		return sent;
+	}
+	/**
+		@param source				The file to read from.
+		@param offset				The offset in <code>source</code> to start at.
+		@param length				The number of bytes to copy, must be available in <code>source</code>.
+		@param destination			The file to write to.
+		@param destinationOffset	Where in <code>destination</code> to put the bytes.
+		@return						<code>length</code>
+	*/
+	inline off_t Transfer::_copyBuffered(File &source, off_t offset, off_t length, File &destination, off_t destinationOffset) {trace_scope
+		off_t	copied= 0;
+
+		while(copied < length) {
+			const size_t	chunk= static_cast<size_t>(length - copied < static_cast<off_t>(_buffer.size()) ? length - copied : _buffer.size());
+
+			source.read(const_cast<char*>(_buffer.data()), chunk, offset + copied, File::FromStart);
+			destination.write(_buffer.data(), chunk, destinationOffset + copied, File::FromStart);
+			copied+= chunk;
+		}
+		return copied;
+	}
+}
+
+#endif // __Transfer_h__
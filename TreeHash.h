@@ -0,0 +1,340 @@
+#ifndef __TreeHash_h__
+#define __TreeHash_h__
+
+/** @file TreeHash.h
+	Hashing big files on all the processors.
+*/
+
+#include "Hash.h"
+#include "File.h"
+#include "Thread.h"
+#include "Queue.h"
+#include "Mutex.h"
+#include "Exception.h"
+#include "POSIXErrno.h"
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef trace_scope
+	#define trace_scope ///< in case Tracer.h is not included
+#endif
+#ifndef trace_bool
+	#define trace_bool(x) (x) ///< in case Tracer.h is not included
+#endif
+
+namespace hash {
+
+	/** Hashes data as a tree of chunks, so the chunks can be hashed on many threads at once and then combined.
+		With H the Hasher and C the chunk size, the tree is laid out as:
+		- The data is split into chunks of C bytes, the last of which may be shorter. No data is one empty chunk.
+		- Each chunk is a leaf, <code>H(0x00 || chunk)</code>.
+		- Each level pairs the nodes below it from the left, <code>H(0x01 || left || right)</code>,
+			and an odd node at the end moves up a level as it is, until there is one node.
+		- The hash is <code>H(0x02 || C || length || top node)</code>, with C and the length of the data
+			as 8 bytes, most significant first, so a tree hash is never the same as a plain hash or one with another C.
+		The result does not depend on the number of threads, so it can be checked on a machine with fewer.
+		hash() can be called from many threads at once, but their chunks are hashed one call after another,
+			since each call waits for as many finished jobs as it queued on the one pair of queues.
+		@tparam Hasher	Any SpecificHash hasher, see SHA256Hasher.
+	*/
+	template<class Hasher>
+	class TreeHash {
+		public:
+			/// The hash of the whole tree
+			typedef SpecificHash<Hasher>	Hash;
+			/// Starts the threads that hash the chunks
+			TreeHash(int threads= 0, size_t chunkSize= 1024 * 1024);
+			/// Stops the threads
+			~TreeHash();
+			/// Hashes part or all of a file, mapped into memory a window at a time
+			Hash &hash(const io::File &file, Hash &result, off_t offset= 0, off_t count= -1);
+			/// Hashes data in memory
+			Hash &hash(const void *data, size_t size, Hash &result);
+			/// The number of threads hashing chunks
+			int threads() const;
+			/// The number of bytes in each leaf of the tree
+			size_t chunkSize() const;
+			/// The number of processors online, the default number of threads
+			static int processors();
+		private:
+			/// Chunks to hash and where their hashes go
+			struct _Job {
+				const uint8_t	*data;		///< The first chunk
+				size_t			size;		///< The number of bytes in all the chunks
+				uint8_t			*leaves;	///< Where the hash of each chunk goes
+			};
+			/// Hashes the chunks of jobs until it is given NULL
+			class _Worker : public exec::Thread {
+				public:
+					/// Starts hashing the chunks of tree's jobs
+					_Worker(TreeHash &tree);
+					virtual ~_Worker();
+				protected:
+					/// Hash jobs until NULL
+					virtual void *run();
+				private:
+					TreeHash	&_tree;	///< Where the jobs come from
+					_Worker(const _Worker&); ///< Prevent Usage
+					_Worker &operator=(const _Worker&); ///< Prevent Usage
+			};
+			/// A read-only memory map of part of a file
+			class _Map {
+				public:
+					/// Maps size bytes of the file from offset
+					_Map(int descriptor, off_t offset, size_t size);
+					/// Unmaps the file
+					~_Map();
+					/// Where offset is in memory
+					const uint8_t *data() const;
+				private:
+					void	*_address;	///< Where the map starts, at a page boundary at or before offset
+					size_t	_size;		///< The number of bytes mapped
+					size_t	_skip;		///< The number of bytes from _address to offset
+					_Map(const _Map&); ///< Prevent Usage
+					_Map &operator=(const _Map&); ///< Prevent Usage
+			};
+			size_t					_chunkSize;	///< The number of bytes in each leaf
+			exec::Queue<_Job*>		_jobs;		///< Chunks waiting to be hashed, NULL to stop a worker
+			exec::Queue<_Job*>		_done;		///< Jobs whose chunks have been hashed
+			std::vector<_Worker*>	_workers;	///< The threads hashing chunks, none if there is just the calling thread
+			exec::Mutex				_calls;		///< Held while a call's jobs are on the queues, so no call takes another's
+			/// Hashes the chunks of data into leaves, on the workers if there are any
+			void _leaves(const uint8_t *data, size_t size, uint8_t *leaves);
+			/// Hashes one chunk into a leaf
+			static void _leaf(const uint8_t *chunk, size_t size, uint8_t *leaf);
+			/// Combines the leaves into the hash of the tree
+			Hash &_root(std::vector<uint8_t> &leaves, uint64_t length, Hash &result);
+			TreeHash(const TreeHash&); ///< Prevent Usage
+			TreeHash &operator=(const TreeHash&); ///< Prevent Usage
+	};
+
+	/**
+		@param threads		The number of threads to hash chunks on, 0 for processors(). With 1 the calling thread does it all.
+		@param chunkSize	The number of bytes in each leaf of the tree, which is part of the hash
+		@throw AssertMessageException if chunkSize is 0
+	*/
+	template<class Hasher> inline TreeHash<Hasher>::TreeHash(int threads, size_t chunkSize)
+			:_chunkSize(chunkSize), _jobs(), _done(), _workers(), _calls() {trace_scope
+		AssertMessageException(chunkSize > 0);
+		if(trace_bool(threads <= 0)) {
+			threads= processors();
+		}
+		for(int thread= 0; trace_bool(threads > 1) && trace_bool(thread < threads); ++thread) {
+			_workers.push_back(new _Worker(*this));
+			_workers.back()->start();
+		}
+	}
+	template<class Hasher> inline TreeHash<Hasher>::~TreeHash() {trace_scope
+		for(size_t worker= 0; trace_bool(worker < _workers.size()); ++worker) {
+			_jobs.enqueue(NULL);
+		}
+		for(size_t worker= 0; trace_bool(worker < _workers.size()); ++worker) {
+			_workers[worker]->join();
+			delete _workers[worker];
+		}
+	}
+	/** Only a window of the file is mapped at a time, so files bigger than the address space can be hashed.
+			Call file.flush() first if it has been written to.
+		@param file		The file to hash
+		@param result	Set to the hash of the tree
+		@param offset	The offset in the file of the data to hash
+		@param count	The number of bytes to hash, or -1 for everything up to the end of the file
+		@return			result
+		@throw AssertMessageException if offset + count is past the end of the file
+		@throw posix::err::ErrNo if the file cannot be mapped
+	*/
+	template<class Hasher>
+	inline typename TreeHash<Hasher>::Hash &TreeHash<Hasher>::hash(const io::File &file, Hash &result, off_t offset, off_t count) {trace_scope
+		const off_t				kWindowSize= (sizeof(void*) < 8 ? 64 : 1024) * 1024 * 1024;
+		const off_t				size= file.size();
+		const off_t				chunksPerWindow= kWindowSize / static_cast<off_t>(_chunkSize) > 0 ? kWindowSize / static_cast<off_t>(_chunkSize) : 1;
+		const off_t				window= chunksPerWindow * static_cast<off_t>(_chunkSize);
+		std::vector<uint8_t>	leaves;
+
+		if(trace_bool(count < 0)) {
+			count= size - offset;
+		}
+		AssertMessageException( (offset >= 0) && (count >= 0) && (offset + count <= size) );
+		leaves.resize((count == 0 ? 1 : (count - 1) / static_cast<off_t>(_chunkSize) + 1) * Hash::Size);
+		if(trace_bool(0 == count)) {
+			_leaf(NULL, 0, &leaves[0]);
+		}
+		for(off_t start= 0; trace_bool(start < count); start+= window) {
+			const size_t	length= static_cast<size_t>(count - start < window ? count - start : window);
+			_Map			map(file.descriptor(), offset + start, length);
+
+			_leaves(map.data(), length, &leaves[static_cast<size_t>(start / static_cast<off_t>(_chunkSize)) * Hash::Size]);
+		}
+		return _root(leaves, static_cast<uint64_t>(count), result);
+	}
+	/**
+		@param data		The data to hash
+		@param size		The number of bytes in data
+		@param result	Set to the hash of the tree
+		@return			result
+	*/
+	template<class Hasher>
+	inline typename TreeHash<Hasher>::Hash &TreeHash<Hasher>::hash(const void *data, size_t size, Hash &result) {trace_scope
+		std::vector<uint8_t>	leaves((size == 0 ? 1 : (size - 1) / _chunkSize + 1) * Hash::Size);
+
+		if(trace_bool(0 == size)) {
+			_leaf(NULL, 0, &leaves[0]);
+		} else {
+			_leaves(reinterpret_cast<const uint8_t*>(data), size, &leaves[0]);
+		}
+		return _root(leaves, size, result);
+	}
+	/**
+		@return	The number of threads hashing chunks, 1 if it is just the calling thread
+	*/
+	template<class Hasher> inline int TreeHash<Hasher>::threads() const {trace_scope
+		return _workers.size() > 0 ? static_cast<int>(_workers.size()) : 1;
+	}
+	template<class Hasher> inline size_t TreeHash<Hasher>::chunkSize() const {trace_scope
+		return _chunkSize;
+	}
+	/**
+		@return	The number of processors online, at least 1
+	*/
+	template<class Hasher> inline int TreeHash<Hasher>::processors() {trace_scope
+		const long	online= ::sysconf(_SC_NPROCESSORS_ONLN);
+
+		return online > 0 ? static_cast<int>(online) : 1;
+	}
+	/** Small chunks are hashed a few to a job, so the queues are not the bottleneck.
+		The jobs of one call at a time are on the queues, so the jobs taken off _done are this call's,
+			and none of them is still being hashed when jobs goes away.
+		@param data		The data to hash, at least a byte
+		@param size		The number of bytes in data
+		@param leaves	Set to the hash of each chunk of data
+	*/
+	template<class Hasher> inline void TreeHash<Hasher>::_leaves(const uint8_t *data, size_t size, uint8_t *leaves) {trace_scope
+		const size_t		kMinimumJobSize= 256 * 1024;
+		const size_t		chunksPerJob= _chunkSize < kMinimumJobSize ? (kMinimumJobSize + _chunkSize - 1) / _chunkSize : 1;
+		const size_t		jobSize= chunksPerJob * _chunkSize;
+		std::vector<_Job>	jobs((size - 1) / jobSize + 1);
+
+		for(size_t job= 0; trace_bool(job < jobs.size()); ++job) {
+			jobs[job].data= data + job * jobSize;
+			jobs[job].size= (size - job * jobSize < jobSize) ? size - job * jobSize : jobSize;
+			jobs[job].leaves= leaves + job * chunksPerJob * Hash::Size;
+		}
+		if(trace_bool(_workers.empty())) {
+			for(size_t job= 0; trace_bool(job < jobs.size()); ++job) {
+				for(size_t chunk= 0; trace_bool(chunk * _chunkSize < jobs[job].size); ++chunk) {
+					const size_t	remaining= jobs[job].size - chunk * _chunkSize;
+
+					_leaf(jobs[job].data + chunk * _chunkSize, remaining < _chunkSize ? remaining : _chunkSize, jobs[job].leaves + chunk * Hash::Size);
+				}
+			}
+			return;
+		}
+		mutex_section(_calls);
+		for(size_t job= 0; trace_bool(job < jobs.size()); ++job) {
+			_jobs.enqueue(&jobs[job]);
+		}
+		for(size_t job= 0; trace_bool(job < jobs.size()); ++job) {
+			_done.dequeue();
+		}
+	}
+	/**
+		@param chunk	The chunk to hash
+		@param size		The number of bytes in chunk
+		@param leaf		Set to <code>H(0x00 || chunk)</code>
+	*/
+	template<class Hasher> inline void TreeHash<Hasher>::_leaf(const uint8_t *chunk, size_t size, uint8_t *leaf) {trace_scope
+		const uint8_t			kLeaf= 0x00;
+		typename Hasher::State	state;
+
+		Hasher::init(state);
+		Hasher::update(state, &kLeaf, sizeof(kLeaf));
+		Hasher::update(state, chunk, size);
+		Hasher::final(state, leaf);
+	}
+	/** Each level is written over the one below it, which is twice as big.
+		@param leaves	The hash of each chunk, used up
+		@param length	The number of bytes of data
+		@param result	Set to the hash of the tree
+		@return			result
+	*/
+	template<class Hasher>
+	inline typename TreeHash<Hasher>::Hash &TreeHash<Hasher>::_root(std::vector<uint8_t> &leaves, uint64_t length, Hash &result) {trace_scope
+		const uint8_t			kNode= 0x01, kRoot= 0x02;
+		const size_t			kSize= Hash::Size;
+		uint8_t					sizes[2 * sizeof(uint64_t)];
+		typename Hash::Stream	root;
+
+		for(size_t nodes= leaves.size() / kSize; trace_bool(nodes > 1); nodes= (nodes + 1) / 2) {
+			for(size_t node= 0; trace_bool(node < nodes / 2); ++node) {
+				typename Hasher::State	state;
+				uint8_t					combined[kSize];
+
+				Hasher::init(state);
+				Hasher::update(state, &kNode, sizeof(kNode));
+				Hasher::update(state, &leaves[2 * node * kSize], 2 * kSize);
+				Hasher::final(state, combined);
+				memcpy(&leaves[node * kSize], combined, kSize);
+			}
+			if(trace_bool(nodes % 2 == 1)) {
+				memmove(&leaves[nodes / 2 * kSize], &leaves[(nodes - 1) * kSize], kSize);
+			}
+		}
+		for(size_t byte= 0; trace_bool(byte < sizeof(uint64_t)); ++byte) {
+			sizes[byte]= static_cast<uint8_t>(static_cast<uint64_t>(_chunkSize) >> (8 * (sizeof(uint64_t) - 1 - byte)));
+			sizes[sizeof(uint64_t) + byte]= static_cast<uint8_t>(length >> (8 * (sizeof(uint64_t) - 1 - byte)));
+		}
+		return root.update(&kRoot, sizeof(kRoot)).update(sizes, sizeof(sizes)).update(&leaves[0], kSize).final(result);
+	}
+	/**
+		@param tree	The TreeHash whose jobs to hash
+	*/
+	template<class Hasher> inline TreeHash<Hasher>::_Worker::_Worker(TreeHash &tree)
+			:exec::Thread(KeepAroundAfterFinish), _tree(tree) {trace_scope
+	}
+	template<class Hasher> inline TreeHash<Hasher>::_Worker::~_Worker() {trace_scope
+	}
+	template<class Hasher> inline void *TreeHash<Hasher>::_Worker::run() {trace_scope
+		_Job	*job;
+
+		while(trace_bool(NULL != (job= _tree._jobs.dequeue()))) {
+			for(size_t chunk= 0; trace_bool(chunk * _tree._chunkSize < job->size); ++chunk) {
+				const size_t	remaining= job->size - chunk * _tree._chunkSize;
+
+				_leaf(job->data + chunk * _tree._chunkSize, remaining < _tree._chunkSize ? remaining : _tree._chunkSize, job->leaves + chunk * Hash::Size);
+			}
+			_tree._done.enqueue(job);
+		}
+		return NULL;
+	}
+	/**
+		@param descriptor	The open file to map
+		@param offset		Where in the file to start, which need not be on a page boundary
+		@param size			The number of bytes to map, more than 0
+		@throw posix::err::ErrNo if the file cannot be mapped
+	*/
+	template<class Hasher> inline TreeHash<Hasher>::_Map::_Map(int descriptor, off_t offset, size_t size)
+			:_address(MAP_FAILED), _size(0), _skip(0) {trace_scope
+		const off_t	page= static_cast<off_t>(::sysconf(_SC_PAGESIZE));
+
+		_skip= static_cast<size_t>(offset % page);
+		_size= size + _skip;
+		_address= ::mmap(NULL, _size, PROT_READ, MAP_SHARED, descriptor, offset - static_cast<off_t>(_skip));
+		const bool	mapped= (MAP_FAILED != _address); // so the traced condition does not read as a test failure
+
+		if(!mapped) {
+			ErrnoCodeThrow(errno, "mmap");
+		}
+	#ifdef MADV_SEQUENTIAL
+		::madvise(_address, _size, MADV_SEQUENTIAL);
+	#endif
+	}
+	template<class Hasher> inline TreeHash<Hasher>::_Map::~_Map() {trace_scope
+		::munmap(_address, _size);
+	}
+	template<class Hasher> inline const uint8_t *TreeHash<Hasher>::_Map::data() const {trace_scope
+		return reinterpret_cast<const uint8_t*>(_address) + _skip;
+	}
+}
+
+#endif // __TreeHash_h__
@@ -1,8 +1,15 @@
+#include "os/2clean/ZCompression.h"
 #include "os/ArchiveFile.h"
+#include "os/DateTime.h"
+#include "os/Thread.h"
+#include "os/AtomicInteger.h"
+#include "os/Mutex.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <vector>
 
 // clang++ ArchiveFile_test.cpp -I .. -o /tmp/test -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings
-// /tmp/test | grep ArchiveFile.h | sort | uniq | wc -l
+// /tmp/test bin/logs/ [benchmark] | grep ArchiveFile.h | sort | uniq | wc -l
 // rm /tmp/*.archive
 // 133
 
@@ -38,6 +45,961 @@ void printBlocks(io::ArchiveFile::Block begin, io::ArchiveFile::Block end) {
 		); \
 	}
 
+/** Fills a new archive with count blocks, frees every other one and fills the holes again.
+*/
+void allocationBenchmark(const std::string &path, int count) {
+	std::vector<int64_t>	identifiers;
+	dt::DateTime			start;
+	double					fillTime, refillTime, openTime, scanTime;
+
+	unlink(path.c_str());
+	{
+		io::ArchiveFile	file(path);
+
+		file.durability(io::File::NoSync);
+		for(int i= 0; i < count; ++i) {
+			identifiers.push_back(file.allocate(16 + i % 64, i % 128).identifier());
+		}
+		fillTime= dt::DateTime() - start;
+		for(int i= 0; i < count; i+= 2) {
+			file.lookup(identifiers[i]).dispose();
+		}
+		start= dt::DateTime();
+		for(int i= 0; i < count; i+= 2) {
+			io::ArchiveFile::Block	block= file.allocate(16 + i % 64, i % 128);
+
+			if(block.identifier() != identifiers[i]) {
+				printf("FAIL: block %d was not reused (%d instead of %d)\n", i,
+						static_cast<int>(block.identifier()), static_cast<int>(identifiers[i]));
+				break;
+			}
+		}
+		refillTime= dt::DateTime() - start;
+		testBlocks(file, count + 1);
+		int64_t	merged= -(sizeof(uint8_t) + sizeof(int64_t));
+		for(int i= 2; i < 6 && i < count; ++i) { // dispose in order so free blocks sit next to each other unmerged
+			io::ArchiveFile::Block	block= file.lookup(identifiers[i]);
+
+			merged+= block.size(false);
+			block.dispose();
+		}
+		if( (count > 6) && (file.allocate(merged).identifier() != identifiers[2]) ) {
+			printf("FAIL: adjacent free blocks were not merged\n");
+		}
+	}
+	start= dt::DateTime();
+	{
+		io::ArchiveFile	file(path);
+
+		openTime= dt::DateTime() - start;
+		file.directory(false);
+		if(file.allocate(16).identifier() < identifiers.back()) {
+			printf("FAIL: reopened file allocated from a used block\n");
+		}
+	}
+	start= dt::DateTime();
+	{
+		io::ArchiveFile	file(path);
+		std::string		contents;
+		int64_t			last;
+
+		scanTime= dt::DateTime() - start;
+		file.durability(io::File::NoSync);
+		file.checkpoint();
+		last= file.allocate(16).identifier(); // the directory on disk is now out of date
+		file.read(contents, file.size(), 0, io::File::FromStart);
+		{
+			io::File	crash(path + ".crash", io::File::Binary, io::File::ReadWrite);
+
+			crash.write(contents, 0, io::File::FromStart);
+		}
+		{
+			io::ArchiveFile	crashed(path + ".crash");
+
+			if(crashed.allocate(16).identifier() <= last) {
+				printf("FAIL: crashed file used an out of date directory\n");
+			}
+		}
+		unlink((path + ".crash").c_str());
+	}
+	{
+		io::ArchiveFile	file(path);
+
+		testBlocks(file, count); // four blocks merged into one, two more allocated
+	}
+	unlink(path.c_str());
+	printf("allocate %7d blocks: %10.0f/sec fill %10.0f/sec refill, open %0.3fs with directory %0.3fs scanning\n", count,
+			count / (fillTime > 0 ? fillTime : 1e-9), (count / 2) / (refillTime > 0 ? refillTime : 1e-9), openTime, scanTime);
+}
+
+void copyFile(const std::string &from, const std::string &to) {
+	std::string	contents;
+
+	unlink(to.c_str());
+	io::File(from, io::File::Binary, io::File::ReadOnly).read(contents);
+	io::File(to, io::File::Binary, io::File::ReadWrite).write(contents, 0, io::File::FromStart);
+}
+
+/** Inserts small records with a durable commit every batchSize records (0 for no transactions,
+		just SyncData durability), then checks that a commit can be replayed from the journal.
+*/
+void journalBenchmark(const std::string &path, int count, int batchSize) {
+	const std::string		record("A small record of about fifty bytes of user data.");
+	std::vector<int64_t>	identifiers;
+	dt::DateTime			start;
+	double					seconds;
+
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	{
+		io::ArchiveFile	file(path);
+
+		if(0 == batchSize) {
+			file.durability(io::File::SyncData);
+		}
+		for(int i= 0; i < count; ++i) {
+			if( (batchSize > 0) && (i % batchSize == 0) ) {
+				file.startTransaction();
+			}
+			identifiers.push_back(file.allocate(record).identifier());
+			if( (batchSize > 0) && ( (i % batchSize == batchSize - 1) || (i == count - 1) ) ) {
+				file.commit();
+			}
+		}
+		seconds= dt::DateTime() - start;
+		if(batchSize > 0) {
+			file.startTransaction();
+			file.lookup(identifiers[0]).dispose();
+			if(file.allocate(record).identifier() == identifiers[0]) {
+				printf("FAIL: block disposed in the transaction was reused before commit\n");
+			}
+			file.rollback();
+			testBlocks(file, count + 1);
+			if(file.lookup(identifiers[0]).free() || (file.lookup(identifiers[0]).read() != record)) {
+				printf("FAIL: rollback did not restore the block\n");
+			}
+			copyFile(path, path + ".before");
+			file.startTransaction();
+			file.lookup(identifiers[1]).dispose();
+			file.lookup(identifiers[2]).dispose();
+			identifiers.push_back(file.allocate(record).identifier());
+			file.commit();
+			copyFile(path + "-journal", path + ".before-journal"); // as if we crashed before the headers were written in place
+		}
+	}
+	if(batchSize > 0) {
+		io::ArchiveFile	file(path + ".before");
+
+		testBlocks(file, count + 2); // two adjacent free blocks are not merged until the next allocate
+		if(!file.lookup(identifiers[1]).free() || file.lookup(identifiers.back()).free()) {
+			printf("FAIL: journal was not replayed\n");
+		}
+		unlink((path + ".before").c_str());
+		if(0 == access((path + ".before-journal").c_str(), F_OK)) {
+			printf("FAIL: journal was not removed after replay\n");
+		}
+	}
+	unlink(path.c_str());
+	printf("insert %6d records %4d per commit: %10.0f/sec\n", count, batchSize, count / (seconds > 0 ? seconds : 1e-9));
+}
+
+static std::string record(int index) {
+	return std::string(1 + (index * 37) % 90, static_cast<char>('A' + index % 26));
+}
+
+/// Counts the blocks that cannot be found by identifier or do not hold what was written to them
+static int badBlocks(io::ArchiveFile &file, const std::vector<int64_t> &identifiers, const std::vector<std::string> &contents) {
+	int	bad= 0;
+
+	for(size_t index= 0; index < identifiers.size(); ++index) {
+		if(0 != identifiers[index]) {
+			io::ArchiveFile::Block	block= file.lookup(identifiers[index]);
+
+			if(block.free() || (block.identifier() != identifiers[index]) || (block.read() != contents[index])) {
+				++bad;
+			}
+		}
+	}
+	return bad;
+}
+
+static void printFragmentation(const char *name, const io::ArchiveFile::Fragmentation &fragmentation) {
+	printf("\t%-6s %10lld bytes %8lld free blocks %10lld free bytes %6lld mini largest %6lld %7lld relocated\n", name,
+			static_cast<long long>(fragmentation.size), static_cast<long long>(fragmentation.freeBlocks),
+			static_cast<long long>(fragmentation.freeBytes), static_cast<long long>(fragmentation.miniBlocks),
+			static_cast<long long>(fragmentation.largestFree), static_cast<long long>(fragmentation.relocated));
+}
+
+/** Fills an archive with count blocks, disposes two out of three and allocates a few more to leave
+		small fragments, then compacts it a short slice at a time while still replacing blocks,
+		checking that every block can still be found by its identifier, before and after reopening.
+*/
+void compactionBenchmark(const std::string &path, int count) {
+	std::vector<int64_t>			identifiers;
+	std::vector<std::string>		contents;
+	io::ArchiveFile::Fragmentation	before, after;
+	dt::DateTime					start;
+	double							seconds, longest= 0;
+	int								slices= 0, passes= 0;
+	size_t							oldest= 0;
+	int64_t							lastPass;
+	bool							finished;
+
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	{
+		io::ArchiveFile	file(path);
+
+		file.durability(io::File::NoSync);
+		for(int i= 0; i < count; ++i) {
+			contents.push_back(record(i));
+			identifiers.push_back(file.allocate(contents.back(), i % 128).identifier());
+		}
+		for(int i= 0; i < count; ++i) {
+			if(i % 3 != 0) {
+				file.lookup(identifiers[i]).dispose();
+				identifiers[i]= 0;
+			}
+		}
+		for(int i= 0; i < count / 3; ++i) {
+			contents.push_back(record(i * 7 + 3));
+			identifiers.push_back(file.allocate(contents.back()).identifier());
+		}
+		before= file.fragmentation();
+		lastPass= before.freeBytes;
+		start= dt::DateTime();
+		do { // until a pass after the third frees less than 1% of the free space
+			dt::DateTime	sliceStart;
+			double			slice;
+
+			finished= file.compact(0.002);
+			slice= dt::DateTime() - sliceStart;
+			longest= slice > longest ? slice : longest;
+			++slices;
+			if(slices % 32 == 0) { // live traffic between slices
+				while(0 == identifiers[oldest]) {
+					++oldest;
+				}
+				file.lookup(identifiers[oldest]).dispose();
+				identifiers[oldest]= 0;
+				contents.push_back(record(slices));
+				identifiers.push_back(file.allocate(contents.back()).identifier());
+			}
+			if(finished) { // the relocation blocks written in a pass are moved in the next one
+				const int64_t	freeBytes= file.fragmentation().freeBytes;
+
+				++passes;
+				finished= ( (passes >= 3) && (freeBytes >= lastPass - lastPass / 100) ) || (passes >= 20);
+				lastPass= freeBytes;
+			}
+		} while(!finished);
+		seconds= dt::DateTime() - start;
+		after= file.fragmentation();
+		if( (after.size >= before.size) || (after.freeBytes >= before.freeBytes) || (file.size() != after.size) ) {
+			printf("FAIL: compaction did not shrink the file\n");
+		}
+		if( (count > 10) && (after.relocated == 0) ) {
+			printf("FAIL: no blocks were moved\n");
+		}
+		if(badBlocks(file, identifiers, contents) != 0) {
+			printf("FAIL: %d blocks lost after compaction\n", badBlocks(file, identifiers, contents));
+		}
+	}
+	{
+		io::ArchiveFile	file(path);
+		const int64_t	relocated= file.fragmentation().relocated;
+
+		if(relocated != after.relocated) {
+			printf("FAIL: relocation map was not read with the directory\n");
+		}
+		if(badBlocks(file, identifiers, contents) != 0) {
+			printf("FAIL: %d blocks lost after reopening\n", badBlocks(file, identifiers, contents));
+		}
+		for(size_t index= 0; index < identifiers.size(); ++index) {
+			if( (0 != identifiers[index]) && (file.lookup(identifiers[index]).offset(false) != identifiers[index]) ) {
+				file.lookup(identifiers[index]).dispose();
+				identifiers[index]= 0;
+				break;
+			}
+		}
+		if( (relocated > 0) && (file.fragmentation().relocated != relocated - 1) ) {
+			printf("FAIL: disposed block is still in the relocation map\n");
+		}
+		file.directory(false);
+	}
+	{
+		io::ArchiveFile	file(path);
+
+		if( (file.fragmentation().relocated != (after.relocated > 0 ? after.relocated - 1 : 0)) ) {
+			printf("FAIL: relocation map was not found by scanning\n");
+		}
+		for(int i= 0; i < count / 3; ++i) { // some land on the identifiers of moved blocks
+			contents.push_back(record(i + 11));
+			identifiers.push_back(file.allocate(contents.back()).identifier());
+		}
+		if(badBlocks(file, identifiers, contents) != 0) {
+			printf("FAIL: %d blocks lost after allocating over moved identifiers\n", badBlocks(file, identifiers, contents));
+		}
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	printf("compact %7d blocks: %d passes, %d slices, longest %0.4fs, %0.3fs total\n", count, passes, slices, longest, seconds);
+	printFragmentation("before", before);
+	printFragmentation("after", after);
+}
+
+/// A log-like record of words and numbers
+static std::string textRecord(size_t size) {
+	const char * const	words[]= {"the", "archive", "block", "of", "compressed", "file", "and", "a", "checksum", "read",
+									"written", "to", "error", "request", "from", "server", "at", "with", "size", "offset"};
+	std::string			result;
+	char				number[32];
+
+	while(result.size() < size) {
+		snprintf(number, sizeof(number), "%ld: ", random() % 100000);
+		result.append(number);
+		for(int word= random() % 12 + 3; word > 0; --word) {
+			result.append(words[random() % (sizeof(words) / sizeof(words[0]))]);
+			result.append(1, word == 1 ? '\n' : ' ');
+		}
+	}
+	result.resize(size);
+	return result;
+}
+
+/** Writes count text records of the given size with each codec (and unencoded), then reads them
+		all back, reporting the throughput and the size of the file. Then checks that corruption is
+		caught by read(), and that encoded blocks keep their flags and survive compact() and reopening.
+*/
+void compressionBenchmark(const std::string &path, int count, size_t size) {
+	const char * const					names[]= {"plain", "stored", "fast", "deflate"};
+	const io::ArchiveFile::Codec		codecs[]= {io::ArchiveFile::Stored, io::ArchiveFile::Stored, io::ArchiveFile::Fast, io::ArchiveFile::Deflate};
+	std::vector<std::string>			contents;
+	const double						megabytes= static_cast<double>(count) * static_cast<double>(size) / (1024.0 * 1024.0);
+
+	srandom(count);
+	for(int i= 0; i < count; ++i) {
+		contents.push_back(textRecord(size));
+	}
+	for(size_t codec= 0; codec < sizeof(codecs) / sizeof(codecs[0]); ++codec) {
+		std::vector<int64_t>	identifiers;
+		dt::DateTime			start;
+		double					writeSeconds, readSeconds;
+		int64_t					fileSize;
+		std::string				buffer;
+
+		unlink(path.c_str());
+		{
+			io::ArchiveFile	file(path);
+
+			file.durability(io::File::NoSync);
+			for(int i= 0; i < count; ++i) {
+				if(0 == codec) {
+					identifiers.push_back(file.allocate(contents[i], i % 128).identifier());
+				} else {
+					identifiers.push_back(file.allocate(contents[i], i % 128, codecs[codec]).identifier());
+				}
+			}
+			file.flush();
+			writeSeconds= dt::DateTime() - start;
+			fileSize= file.fragmentation().size;
+			start= dt::DateTime();
+			for(int i= 0; i < count; ++i) {
+				if(file.lookup(identifiers[i]).read(buffer) != contents[i]) {
+					printf("FAIL: %s block %d did not read back\n", names[codec], i);
+				}
+			}
+			readSeconds= dt::DateTime() - start;
+			if( (0 != codec) && (file.lookup(identifiers[0]).flags() != 0 || file.lookup(identifiers[count - 1]).flags() != (count - 1) % 128) ) {
+				printf("FAIL: %s block lost its flags\n", names[codec]);
+			}
+			if( (0 != codec) != file.lookup(identifiers[0]).encoded() ) {
+				printf("FAIL: %s block is%s encoded\n", names[codec], file.lookup(identifiers[0]).encoded() ? "" : " not");
+			}
+		}
+		printf("%-8s %6d x %6lu: write %8.1f MiB/s read %8.1f MiB/s %6.1f%% of the data\n", names[codec], count, static_cast<unsigned long>(size),
+				megabytes / (writeSeconds > 0 ? writeSeconds : 1e-9), megabytes / (readSeconds > 0 ? readSeconds : 1e-9),
+				100.0 * static_cast<double>(fileSize) / (megabytes * 1024.0 * 1024.0));
+	}
+	{
+		io::ArchiveFile			file(path);
+		io::ArchiveFile::Block	block= file.allocate(contents[0], 5, io::ArchiveFile::Fast);
+		const int64_t			identifier= block.identifier();
+
+		if( (block.flags(9) != 5) || (block.flags() != 9) || (file.lookup(identifier).read() != contents[0]) ) {
+			printf("FAIL: changing the flags of an encoded block\n");
+		}
+		if(block.resize(block.size() / 2)) {
+			printf("FAIL: resized an encoded block\n");
+		}
+		if(file.allocate(std::string(), 0, io::ArchiveFile::Fast).read() != std::string()) {
+			printf("FAIL: empty encoded block\n");
+		}
+		if(file.allocate(std::string(1000, 'x'), 0, io::ArchiveFile::Deflate).size() > 100) {
+			printf("FAIL: deflate did not compress\n");
+		}
+		file.write("!", 1, block.offset() + block.size() - 1, io::File::FromStart);
+		try	{
+			file.lookup(identifier).read();
+			printf("FAIL: corrupt block was read\n");
+		} catch(const posix::err::EILSEQ_Errno &) {
+			// expected
+		}
+
+		io::ArchiveFile::Block	longer= file.allocate(contents[0], 0, io::ArchiveFile::Fast);
+		const size_t			kSizeOffset= 6, kCodecOffset= 5, kChecksumOffset= 1;
+		std::string				raw;
+		uint32_t				crc;
+
+		file.read(raw, longer.size(), longer, longer); // say it uncompresses to one byte more, with a good checksum
+		raw[kSizeOffset + 7]= static_cast<char>(raw[kSizeOffset + 7] + 1);
+		crc= hash::CRC32CHasher::value(raw.data() + kCodecOffset, raw.size() - kCodecOffset);
+		for(size_t index= 0; index < sizeof(crc); ++index) {
+			raw[kChecksumOffset + index]= static_cast<char>(crc >> (8 * (sizeof(crc) - 1 - index)));
+		}
+		file.write(raw, longer, longer);
+		try	{
+			longer.read();
+			printf("FAIL: block that uncompressed short was read\n");
+		} catch(const posix::err::EILSEQ_Errno &) {
+			// expected
+		}
+	}
+	unlink(path.c_str());
+	{
+		const int				blocks= count < 1000 ? count : 1000;
+		io::ArchiveFile			file(path);
+		std::vector<int64_t>	identifiers;
+		int						bad= 0;
+
+		for(int i= 0; i < blocks; ++i) {
+			identifiers.push_back(file.allocate(contents[i], 0, io::ArchiveFile::Fast).identifier());
+		}
+		for(int i= 0; i + 1 < blocks; i+= 2) {
+			file.lookup(identifiers[i]).dispose();
+			identifiers[i]= 0;
+		}
+		while(!file.compact()) {
+		}
+		for(int i= 0; i < blocks; ++i) {
+			try	{
+				if( (0 != identifiers[i]) && (file.lookup(identifiers[i]).read() != contents[i]) ) {
+					++bad;
+				}
+			} catch(const posix::err::EILSEQ_Errno &) {
+				++bad;
+			}
+		}
+		if( (0 != bad) || (file.fragmentation().relocated == 0) ) {
+			printf("FAIL: %d encoded blocks lost after compaction (%lld moved)\n", bad, static_cast<long long>(file.fragmentation().relocated));
+		}
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+}
+
+/** Reads lookups random blocks out of count blocks of the given size, copying with read() and in place with view(),
+		reporting the time per read. Then checks that Views survive the file growing and being compacted,
+		that encoded blocks can be viewed, and that free blocks cannot.
+*/
+void viewBenchmark(const std::string &path, int count, size_t size, int lookups) {
+	std::vector<std::string>	contents;
+	std::vector<int64_t>		identifiers;
+	std::vector<int>			order;
+
+	srandom(count);
+	unlink(path.c_str());
+	for(int i= 0; i < count; ++i) {
+		contents.push_back(textRecord(size));
+	}
+	for(int i= 0; i < lookups; ++i) {
+		order.push_back(random() % count);
+	}
+	{
+		io::ArchiveFile	file(path);
+
+		file.durability(io::File::NoSync);
+		for(int i= 0; i < count; ++i) {
+			identifiers.push_back(file.allocate(contents[i]).identifier());
+		}
+		file.flush();
+	}
+	for(int readOnly= 0; readOnly < 2; ++readOnly) {
+		io::ArchiveFile		file(path, readOnly ? io::File::ReadOnly : io::File::ReadWrite);
+		io::ArchiveFile::View	view;
+		std::string			buffer;
+		dt::DateTime		start;
+		double				readSeconds, viewSeconds;
+		size_t				sum= 0;
+
+		for(int i= 0; i < lookups; ++i) {
+			sum+= file.lookup(identifiers[order[i]]).read(buffer).size();
+		}
+		readSeconds= dt::DateTime() - start;
+		start= dt::DateTime();
+		for(int i= 0; i < lookups; ++i) {
+			sum-= file.view(identifiers[order[i]], view).contents().size();
+		}
+		viewSeconds= dt::DateTime() - start;
+		printf("%-10s %6d x %6lu: read %8.0f ns view %8.0f ns\n", readOnly ? "read-only" : "read-write", count, static_cast<unsigned long>(size),
+				1e9 * readSeconds / lookups, 1e9 * viewSeconds / lookups);
+		if(0 != sum) {
+			printf("FAIL: views and reads are not the same size\n");
+		}
+		for(int i= 0; i < count; ++i) {
+			if( (file.view(identifiers[i], view).contents() != ReferencedString(contents[i])) || (view.epoch() != 1) ) {
+				printf("FAIL: block %d did not view (epoch %lld)\n", i, static_cast<long long>(view.epoch()));
+			}
+		}
+	}
+	unlink(path.c_str());
+	if(count > 100) { // compact() looks at every block before a hole
+		count= 100;
+	}
+	{
+		io::ArchiveFile			file(path);
+		io::ArchiveFile::View	first, copy, encoded, stored;
+		io::ArchiveFile::Block	added;
+		const int				kept= count / 2;
+		int64_t					before;
+
+		for(int i= 0; i < count; ++i) {
+			identifiers[i]= file.allocate(contents[i]).identifier();
+		}
+		file.view(identifiers[0], first);
+		added= file.allocate(contents[1]);
+		if( (added.view(copy).contents() != ReferencedString(contents[1])) || (copy.epoch() != 2) || (file.epoch() != 2) ) {
+			printf("FAIL: growing the file did not map it again (epoch %lld)\n", static_cast<long long>(copy.epoch()));
+		}
+		copy= first;
+		if( (first.contents() != ReferencedString(contents[0])) || (copy.contents() != ReferencedString(contents[0])) || (copy.epoch() != 1) ) {
+			printf("FAIL: view did not survive the file being mapped again\n");
+		}
+		first.clear();
+		if( (file.allocate(contents[2], 3, io::ArchiveFile::Stored).view(stored).contents() != ReferencedString(contents[2])) || (0 == stored.epoch()) ) {
+			printf("FAIL: stored block did not view in place\n");
+		}
+		if( (file.allocate(contents[3], 4, io::ArchiveFile::Fast).view(encoded).contents() != ReferencedString(contents[3])) || (0 != encoded.epoch()) ) {
+			printf("FAIL: compressed block did not view\n");
+		}
+		first= encoded;
+		encoded.clear();
+		if(first.contents() != ReferencedString(contents[3])) {
+			printf("FAIL: copy of a compressed view\n");
+		}
+		for(int i= kept; i < count; ++i) {
+			file.lookup(identifiers[i]).dispose();
+		}
+		added.dispose();
+		try	{
+			file.view(identifiers[kept], first);
+			printf("FAIL: viewed a free block\n");
+		} catch(const posix::err::EINVAL_Errno &) {
+			// expected
+		}
+		before= file.size();
+		while(!file.compact()) {
+		}
+		if( (file.size() != before) || (copy.contents() != ReferencedString(contents[0])) ) {
+			printf("FAIL: file was truncated under a view\n");
+		}
+		copy.clear();
+		stored.clear();
+		while(!file.compact()) {
+		}
+		if(file.size() >= before) {
+			printf("FAIL: file was not truncated after the views were gone\n");
+		}
+		if( (file.view(identifiers[kept - 1], first).contents() != ReferencedString(contents[kept - 1])) || (first.epoch() != file.epoch()) ) {
+			printf("FAIL: view after truncating\n");
+		}
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+}
+
+/// Counts the blocks a Scanner sees that are not the ones Block::next() sees, with the same contents
+static int scanMismatches(io::ArchiveFile &file, io::ArchiveFile::Scanner::Reading reading, io::ArchiveFile::Scanner::Prefetch prefetch, size_t chunkSize) {
+	io::ArchiveFile::Scanner	scan(file, reading, prefetch, chunkSize);
+	io::ArchiveFile::Block		b= file.begin();
+	int							bad= 0;
+
+	for(; scan && (b != file.end()); ++scan, ++b) {
+		if( (scan.block().offset(false) != b.offset(false)) || (scan.block().size(false) != b.size(false))
+				|| (scan.block().flags() != b.flags()) || (scan.block().free() != b.free()) ) {
+			++bad;
+		} else if(!b.free() && !b.reserved() && (scan.contents() != ReferencedString(b.read()))) {
+			++bad;
+		}
+	}
+	return bad + (scan ? 1 : 0) + ((b != file.end()) ? 1 : 0);
+}
+
+/** Scans an archive with free blocks too small for a header, encoded blocks, blocks moved by compact()
+		and headers changed in a transaction, with chunks smaller than a header up to bigger than the file.
+*/
+void scanTest(const std::string &path) {
+	const io::ArchiveFile::Scanner::Reading		readings[]= {io::ArchiveFile::Scanner::HeadersOnly, io::ArchiveFile::Scanner::WithContents};
+	const io::ArchiveFile::Scanner::Prefetch	prefetches[]= {io::ArchiveFile::Scanner::NoPrefetch, io::ArchiveFile::Scanner::PrefetchThread};
+	const size_t								chunkSizes[]= {1, 7, 100, 4096, 1024 * 1024};
+	std::vector<int64_t>						identifiers;
+
+	srandom(13);
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	{
+		io::ArchiveFile	file(path);
+
+		for(int i= 0; i < 200; ++i) {
+			const std::string	contents= textRecord(random() % 300);
+
+			switch(i % 4) {
+				case 0: identifiers.push_back(file.allocate(contents, i % 128).identifier()); break;
+				case 1: identifiers.push_back(file.allocate(contents, 1, io::ArchiveFile::Stored).identifier()); break;
+				case 2: identifiers.push_back(file.allocate(contents, 2, io::ArchiveFile::Fast).identifier()); break;
+				default: identifiers.push_back(file.allocate(std::string(5000, 'x'), 3).identifier()); break;
+			}
+		}
+		for(size_t i= 0; i < identifiers.size(); i+= 3) {
+			file.lookup(identifiers[i]).dispose();
+		}
+		for(int i= 0; i < 20; ++i) { // fills holes leaving free blocks of a few bytes
+			file.allocate(std::string(static_cast<size_t>(5000 - 9 - i % 8), 'y'), 4);
+		}
+		file.compact();
+		if(file.fragmentation().relocated == 0) {
+			printf("FAIL: scanTest did not move any blocks\n");
+		}
+		file.startTransaction();
+		file.lookup(identifiers[1]).dispose();
+		file.allocate("in the transaction", 5);
+		for(int r= 0; r < 2; ++r) {
+			for(int p= 0; p < 2; ++p) {
+				for(size_t c= 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); ++c) {
+					const int	bad= scanMismatches(file, readings[r], prefetches[p], chunkSizes[c]);
+
+					if(0 != bad) {
+						printf("FAIL: scan %d/%d with %lu byte chunks: %d blocks\n", r, p, static_cast<unsigned long>(chunkSizes[c]), bad);
+					}
+				}
+			}
+		}
+		file.commit();
+		{
+			io::ArchiveFile::Scanner	scan(file, io::ArchiveFile::Scanner::WithContents, io::ArchiveFile::Scanner::PrefetchThread, 64);
+			int							count= 0;
+
+			for(; scan && (count < 10); ++scan) { // stop the prefetch thread part way
+				++count;
+			}
+			try {
+				while(scan.block().free()) {
+					++scan;
+				}
+				scan.contents();
+				while(!scan.block().free()) {
+					++scan;
+				}
+				scan.contents();
+				printf("FAIL: scanned contents of a free block\n");
+			} catch(const posix::err::EINVAL_Errno &) {
+				// expected
+			}
+		}
+	}
+	{
+		io::ArchiveFile	file(path, io::File::ReadOnly);
+
+		if(scanMismatches(file, io::ArchiveFile::Scanner::WithContents, io::ArchiveFile::Scanner::PrefetchThread, 4096) != 0) {
+			printf("FAIL: scan of a read-only archive\n");
+		}
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+}
+
+/** Goes through count blocks of size bytes with Block::next(), and with Scanner with and without contents and prefetching.
+*/
+void scanBenchmark(const std::string &path, int count, size_t size) {
+	const char * const	names[]= {"headers", "headers prefetch", "contents", "contents prefetch"};
+	std::string			contents= textRecord(size);
+
+	srandom(count);
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	{
+		io::ArchiveFile	file(path);
+
+		file.durability(io::File::NoSync);
+		for(int i= 0; i < count; ++i) {
+			file.allocate(contents, i % 2 == 0 ? 1 : 2);
+		}
+	}
+	{
+		io::ArchiveFile	file(path, io::File::ReadOnly);
+		dt::DateTime	start;
+		int64_t			total= 0, blocks= 0;
+		double			seconds;
+
+		for(io::ArchiveFile::Block b= file.begin(); b != file.end(); ++b) {
+			total+= b.flags();
+			++blocks;
+		}
+		seconds= dt::DateTime() - start;
+		printf("scan %7d x %5lu: %-18s %10.0f blocks/sec\n", count, static_cast<unsigned long>(size), "next()", blocks / (seconds > 0 ? seconds : 1e-9));
+		for(int mode= 0; mode < 4; ++mode) {
+			int64_t	scanned= 0, flags= 0;
+
+			start= dt::DateTime();
+			for(io::ArchiveFile::Scanner scan(file, mode < 2 ? io::ArchiveFile::Scanner::HeadersOnly : io::ArchiveFile::Scanner::WithContents,
+						mode % 2 == 0 ? io::ArchiveFile::Scanner::NoPrefetch : io::ArchiveFile::Scanner::PrefetchThread); scan; ++scan) {
+				flags+= scan.block().flags();
+				if( (mode >= 2) && !scan.block().free() && (scan.contents().size() != size) ) {
+					flags= -1;
+				}
+				++scanned;
+			}
+			seconds= dt::DateTime() - start;
+			printf("scan %7d x %5lu: %-18s %10.0f blocks/sec\n", count, static_cast<unsigned long>(size), names[mode], scanned / (seconds > 0 ? seconds : 1e-9));
+			if( (scanned != blocks) || (flags != total) ) {
+				printf("FAIL: %s scanned %lld blocks, not %lld\n", names[mode], static_cast<long long>(scanned), static_cast<long long>(blocks));
+			}
+		}
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+}
+
+/// Reads random blocks, with read() or view(), counting the ones that do not read back
+class Reader : public exec::Thread {
+	public:
+		Reader(io::ArchiveFile &file, const std::vector<int64_t> &identifiers, const std::vector<std::string> &contents,
+					int lookups, bool view, exec::Mutex *lock, unsigned int seed)
+				:exec::Thread(exec::Thread::KeepAroundAfterFinish), _file(file), _identifiers(identifiers), _contents(contents),
+					_lookups(lookups), _view(view), _lock(lock), _seed(seed), _bad(0) {
+			start();
+		}
+		virtual ~Reader() {}
+		int bad() {return _bad;}
+	protected:
+		virtual void *run() {
+			std::string				buffer;
+			io::ArchiveFile::View	view;
+
+			for(int i= 0; i < _lookups; ++i) {
+				const size_t	index= rand_r(&_seed) % _identifiers.size();
+
+				if(_view) {
+					if(_file.view(_identifiers[index], view).contents() != ReferencedString(_contents[index])) {
+						++_bad;
+					}
+				} else if(NULL != _lock) {
+					mutex_section(*_lock);
+
+					if(_file.lookup(_identifiers[index]).read(buffer) != _contents[index]) {
+						++_bad;
+					}
+				} else if(_file.lookup(_identifiers[index]).read(buffer) != _contents[index]) {
+					++_bad;
+				}
+			}
+			return NULL;
+		}
+	private:
+		io::ArchiveFile					&_file;
+		const std::vector<int64_t>		&_identifiers;
+		const std::vector<std::string>	&_contents;
+		int								_lookups;
+		bool							_view;
+		exec::Mutex						*_lock;
+		unsigned int					_seed;
+		int								_bad;
+		Reader(const Reader&);
+		Reader &operator=(const Reader&);
+};
+
+/// Allocates, checks and disposes blocks of its own until told to stop (at least 50 times)
+class Writer : public exec::Thread {
+	public:
+		Writer(io::ArchiveFile &file, const std::string &data)
+				:exec::Thread(exec::Thread::KeepAroundAfterFinish), _file(file), _data(data), _stop(0), _writes(0), _bad(0) {
+			start();
+		}
+		virtual ~Writer() {}
+		void stop() {_stop.valueAfterIncrement();}
+		int writes() {return _writes;}
+		int bad() {return _bad;}
+	protected:
+		virtual void *run() {
+			std::vector<int64_t>	mine;
+
+			while( (_stop.value() == 0) || (_writes < 50) ) {
+				mine.push_back(_file.allocate(_data, 1, 0 == _writes % 2 ? io::ArchiveFile::Stored : io::ArchiveFile::Fast).identifier());
+				if(mine.size() > 20) {
+					if(_file.lookup(mine.front()).read() != _data) {
+						++_bad;
+					}
+					_file.lookup(mine.front()).dispose();
+					mine.erase(mine.begin());
+				}
+				++_writes;
+			}
+			return NULL;
+		}
+	private:
+		io::ArchiveFile		&_file;
+		std::string			_data;
+		exec::AtomicInteger	_stop;
+		int					_writes;
+		int					_bad;
+		Writer(const Writer&);
+		Writer &operator=(const Writer&);
+};
+
+/** Reads random blocks from 1 to 16 threads at once: through a mutex around the whole file
+		(the way we shared an ArchiveFile before it was thread-safe), with read() and with view().
+		Then reads while another thread allocates and disposes blocks, checking what every thread reads.
+*/
+void threadBenchmark(const std::string &path, int count, size_t size, int lookups) {
+	const char * const			names[]= {"mutex", "read", "view"};
+	std::vector<std::string>	contents;
+	std::vector<int64_t>		identifiers;
+
+	srandom(count);
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	for(int i= 0; i < count; ++i) {
+		contents.push_back(textRecord(size));
+	}
+	{
+		io::ArchiveFile	file(path);
+
+		file.durability(io::File::NoSync);
+		for(int i= 0; i < count; ++i) {
+			identifiers.push_back(file.allocate(contents[i]).identifier());
+		}
+	}
+	{
+		io::ArchiveFile	file(path, io::File::ReadOnly);
+		exec::Mutex		lock;
+
+		for(int threads= 1; threads <= 16; threads*= 2) {
+			printf("%2d thread%s %6d x %6lu:", threads, 1 == threads ? " " : "s", count, static_cast<unsigned long>(size));
+			for(int mode= 0; mode < 3; ++mode) {
+				std::vector<Reader*>	readers;
+				dt::DateTime			start;
+				double					seconds;
+				int						bad= 0;
+
+				for(int thread= 0; thread < threads; ++thread) {
+					readers.push_back(new Reader(file, identifiers, contents, lookups / threads, 2 == mode, 0 == mode ? &lock : NULL, thread + 1));
+				}
+				for(int thread= 0; thread < threads; ++thread) {
+					readers[thread]->join();
+					bad+= readers[thread]->bad();
+					delete readers[thread];
+				}
+				seconds= dt::DateTime() - start;
+				printf(" %s %9.0f/s", names[mode], (lookups / threads) * threads / (seconds > 0 ? seconds : 1e-9));
+				if(0 != bad) {
+					printf("\nFAIL: %d %s reads did not match\n", bad, names[mode]);
+				}
+			}
+			printf("\n");
+		}
+	}
+	{
+		io::ArchiveFile			file(path);
+		std::vector<Reader*>	readers;
+		Writer					writer(file, contents[0]);
+		dt::DateTime			start;
+		double					seconds;
+		int						bad= 0;
+
+		for(int thread= 0; thread < 4; ++thread) {
+			readers.push_back(new Reader(file, identifiers, contents, lookups / 4, 0 != thread % 2, NULL, thread + 1));
+		}
+		for(int thread= 0; thread < 4; ++thread) {
+			readers[thread]->join();
+			bad+= readers[thread]->bad();
+			delete readers[thread];
+		}
+		seconds= dt::DateTime() - start;
+		writer.stop();
+		writer.join();
+		printf(" 4 threads + writer:      %9.0f reads/s %9.0f writes/s\n", lookups / 4 * 4 / (seconds > 0 ? seconds : 1e-9),
+				writer.writes() / (seconds > 0 ? seconds : 1e-9));
+		if( (0 != bad) || (0 != writer.bad()) ) {
+			printf("FAIL: %d reads and %d writes did not match with a writer\n", bad, writer.bad());
+		}
+		if(writer.writes() == 0) {
+			printf("FAIL: writer did not get to write\n");
+		}
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+}
+
+/** Appending reserves storage past the end of the file, disposing a big block gives its storage back
+		without touching the blocks around it, and compact() lets go of it all when it truncates.
+*/
+void storageTest(const std::string &path) {
+	const off_t			kMegabyte= 1024 * 1024;
+	const std::string	big(4 * kMegabyte, 'x');
+	bool				canReserve, canPunch;
+
+	{
+		io::File	probe(path + ".probe", io::File::Binary, io::File::ReadWrite);
+
+		canReserve= probe.reserve(kMegabyte);
+		canPunch= probe.punchHole(0, kMegabyte);
+	}
+	unlink((path + ".probe").c_str());
+	unlink(path.c_str());
+	io::ArchiveFile	file(path);
+	const int64_t	first= file.allocate("first").identifier();
+	const int64_t	bigBlock= file.allocate(big).identifier();
+	const int64_t	last= file.allocate("last").identifier();
+	off_t			before;
+
+	if(canReserve && (file.allocatedSize() <= file.size())) {
+		printf("FAIL: nothing was reserved past the end of the file\n");
+	}
+	before= file.allocatedSize();
+	file.durability(io::File::NoSync);
+	file.lookup(bigBlock).dispose();
+	if(file.allocatedSize() < before - 3 * kMegabyte) {
+		printf("FAIL: a big block was punched out before its free header was synced\n");
+	}
+	file.flush(io::File::SyncData);
+	file.durability(io::File::FlushToKernel);
+	if(canPunch && (file.allocatedSize() > before - 3 * kMegabyte)) {
+		printf("FAIL: disposing a big block did not give back its storage\n");
+	}
+	if( (file.lookup(first).read() != "first") || (file.lookup(last).read() != "last") ) {
+		printf("FAIL: punching out a disposed block changed the blocks next to it\n");
+	}
+	file.durability(io::File::NoSync);
+	file.lookup(file.allocate(big).identifier()).dispose();
+	const int64_t	reused= file.allocate(big).identifier();
+	file.flush(io::File::SyncData);
+	file.durability(io::File::FlushToKernel);
+	if(file.lookup(reused).read() != big) {
+		printf("FAIL: a block disposed and allocated again before the sync was punched out\n");
+	}
+	file.lookup(reused).dispose();
+	while(!file.compact(1.0)) {
+	}
+	if(file.allocatedSize() >= kMegabyte) {
+		printf("FAIL: compact() kept storage past the end of the file: %ld\n", static_cast<long>(file.allocatedSize()));
+	}
+	if(file.lookup(last).read() != "last") {
+		printf("FAIL: compact() lost the last block\n");
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+}
+
 int main(int argc,const char * const argv[]) {
 	try	{
 		std::string	path("bin/logs/");
@@ -177,6 +1139,90 @@ int main(int argc,const char * const argv[]) {
 			blocks[0].merge();
 			testBlocks(file, 1);
 		}
+		{
+			io::ArchiveFile	file(path+"replace.archive");
+			const int64_t	first= file.allocate("first", 5).identifier();
+			const int64_t	second= file.allocate("second").identifier();
+
+			if( (file.replace(first, "replaced first", 6).identifier() != first) || (file.lookup(first).read() != "replaced first")
+					|| (file.lookup(first).flags() != 6) || (file.lookup(second).read() != "second") ) {
+				printf("FAIL: replace did not keep the identifier\n");
+			}
+			file.startTransaction();
+			file.replace(first, std::string(5000, 'x'), 7, io::ArchiveFile::Fast);
+			if(file.lookup(first).read() != std::string(5000, 'x')) {
+				printf("FAIL: replace in a transaction was not seen\n");
+			}
+			file.rollback();
+			if(file.lookup(first).read() != "replaced first") {
+				printf("FAIL: rollback did not undo replace\n");
+			}
+			file.lookup(second).dispose();
+			try {
+				file.replace(second, "disposed");
+				printf("FAIL: replaced a free block\n");
+			} catch(const posix::err::EINVAL_Errno &) {
+				// expected
+			}
+		}
+		{
+			io::ArchiveFile	file(path+"replace.archive");
+
+			if(file.lookup(file.begin().offset(false)).read() != "replaced first") {
+				printf("FAIL: replace was not durable\n");
+			}
+		}
+		unlink((path+"replace.archive").c_str());
+		unlink((path+"replace.archive-journal").c_str());
+		storageTest(path+"storage.archive");
+#ifdef __Tracer_h__
+		allocationBenchmark(path+"benchmark.archive", 20);
+		journalBenchmark(path+"journal.archive", 10, 0);
+		journalBenchmark(path+"journal.archive", 10, 3);
+		compactionBenchmark(path+"compaction.archive", 30);
+		compressionBenchmark(path+"compression.archive", 20, 3000);
+		viewBenchmark(path+"view.archive", 10, 1000, 20);
+		threadBenchmark(path+"thread.archive", 20, 1000, 40);
+		scanTest(path+"scan.archive");
+		scanBenchmark(path+"scan.archive", 100, 100);
+#else
+		const bool	benchmark= (argc >= 3) && (std::string("benchmark") == argv[2]);
+
+		if(benchmark) { // the sizes the commit messages' numbers come from, minutes
+			journalBenchmark(path+"journal.archive", 1000, 0);
+			for(int batchSize= 1; batchSize <= 1000; batchSize*= 10) {
+				journalBenchmark(path+"journal.archive", 10000, batchSize);
+			}
+			compactionBenchmark(path+"compaction.archive", 10000);
+			compactionBenchmark(path+"compaction.archive", 100000);
+			compressionBenchmark(path+"compression.archive", 100000, 1000);
+			compressionBenchmark(path+"compression.archive", 4000, 64 * 1024);
+			viewBenchmark(path+"view.archive", 100000, 1000, 1000000);
+			viewBenchmark(path+"view.archive", 4000, 64 * 1024, 100000);
+			threadBenchmark(path+"thread.archive", 20000, 1000, 200000);
+			scanTest(path+"scan.archive");
+			scanBenchmark(path+"scan.archive", 1000000, 100);
+			scanBenchmark(path+"scan.archive", 10000, 64 * 1024);
+			allocationBenchmark(path+"benchmark.archive", 10000);
+			allocationBenchmark(path+"benchmark.archive", 100000);
+			allocationBenchmark(path+"benchmark.archive", 1000000);
+		} else {
+			journalBenchmark(path+"journal.archive", 100, 0);
+			for(int batchSize= 1; batchSize <= 1000; batchSize*= 10) {
+				journalBenchmark(path+"journal.archive", 1000, batchSize);
+			}
+			compactionBenchmark(path+"compaction.archive", 10000);
+			compressionBenchmark(path+"compression.archive", 5000, 1000);
+			compressionBenchmark(path+"compression.archive", 200, 64 * 1024);
+			viewBenchmark(path+"view.archive", 5000, 1000, 50000);
+			viewBenchmark(path+"view.archive", 200, 64 * 1024, 5000);
+			threadBenchmark(path+"thread.archive", 2000, 1000, 20000);
+			scanTest(path+"scan.archive");
+			scanBenchmark(path+"scan.archive", 50000, 100);
+			scanBenchmark(path+"scan.archive", 500, 64 * 1024);
+			allocationBenchmark(path+"benchmark.archive", 10000);
+		}
+#endif
 	} catch(const std::exception &exception) {
 		printf("EXCEPTION: %s\n", exception.what());
 	}
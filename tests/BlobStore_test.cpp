@@ -0,0 +1,269 @@
+#include "os/BlobStore.h"
+#include "os/DateTime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+#include <vector>
+
+// g++ BlobStore_test.cpp -I.. -o /tmp/test -O2 -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings -lpthread
+// /tmp/test bin/logs/ [benchmark]
+
+#define dotest(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
+	}
+
+/// Bytes that do not repeat, the same for the same seed
+static std::string randomData(size_t size, uint32_t seed) {
+	std::string	data(size, '\0');
+
+	for(size_t i= 0; i < size; ++i) {
+		seed= seed * 1103515245 + 12345;
+		data[i]= static_cast<char>(seed >> 23);
+	}
+	return data;
+}
+
+/// The digests of the chunks data is cut into
+static std::vector<std::string> chunks(const std::string &data, size_t chunkSize) {
+	std::vector<std::string>	result;
+
+	for(size_t offset= 0; offset < data.size(); ) {
+		const size_t	length= io::BlobStore::boundary(data.data() + offset, data.size() - offset, chunkSize);
+
+		result.push_back(data.substr(offset, length));
+		offset+= length;
+	}
+	return result;
+}
+
+/** Checks the chunk sizes stay in their bounds and average near the chunk size, and that an insertion only
+		changes the chunks around it.
+*/
+static void boundaryTest(size_t size, size_t chunkSize) {
+	const std::string			data= randomData(size, 7);
+	std::string					edited= data;
+	std::vector<std::string>	original= chunks(data, chunkSize), changed;
+	std::set<std::string>		before;
+	size_t						shared= 0, total= 0;
+
+	for(size_t chunk= 0; chunk < original.size(); ++chunk) {
+		dotest( (original[chunk].size() >= chunkSize / 4) || (chunk == original.size() - 1) );
+		dotest(original[chunk].size() <= 8 * chunkSize);
+		before.insert(original[chunk]);
+		total+= original[chunk].size();
+	}
+	dotest(total == data.size());
+	dotest(original.size() * chunkSize / 2 < data.size());
+	dotest(original.size() * chunkSize * 2 > data.size());
+	edited.insert(data.size() / 3, "seven b");
+	edited.erase(2 * data.size() / 3, 5);
+	changed= chunks(edited, chunkSize);
+	for(size_t chunk= 0; chunk < changed.size(); ++chunk) {
+		shared+= before.count(changed[chunk]);
+	}
+	dotest(shared + 6 >= original.size());
+	dotest(io::BlobStore::boundary(data.data(), data.size(), 0) == data.size());
+	dotest(io::BlobStore::boundary(data.data(), chunkSize / 4, chunkSize) == chunkSize / 4);
+	dotest(io::BlobStore::boundary(data.data(), 0, chunkSize) == 0);
+}
+
+/** Stores, fetches and releases blobs that share chunks, through collect(), a reopen and a rollback.
+*/
+static void blobTest(const std::string &path, size_t size) {
+	const std::string			base= randomData(size, 1);
+	std::string					near= base, found;
+	std::vector<std::string>	small;
+	io::BlobStore::Digest		baseDigest, nearDigest, emptyDigest;
+	std::vector<io::BlobStore::Digest>	smallDigests;
+	int64_t						used;
+
+	near.replace(size / 2, 10, "ten bytes!");
+	for(int i= 0; i < 20; ++i) {
+		small.push_back(randomData(i * 13, 100 + i));
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	{
+		io::BlobStore	store(path, io::File::WriteIfPossible, 1024);
+
+		dotest(store.chunkSize() == 1024);
+		dotest(!store.fetch(io::BlobStore::Digest(base), found));
+		dotest(!store.release(io::BlobStore::Digest(base)));
+		dotest(store.references(io::BlobStore::Digest(base)) == 0);
+		dotest(store.collect() == 0);
+		baseDigest= store.store(base);
+		dotest(baseDigest == io::BlobStore::Digest(base));
+		used= store.fragmentation().size - store.fragmentation().freeBytes;
+		dotest(store.store(base) == baseDigest);
+		dotest(store.references(baseDigest) == 2);
+		dotest(store.fragmentation().size - store.fragmentation().freeBytes < used + static_cast<int64_t>(size) / 10);
+		used= store.fragmentation().size - store.fragmentation().freeBytes;
+		nearDigest= store.store(near);
+		dotest(store.fragmentation().size - store.fragmentation().freeBytes < used + static_cast<int64_t>(size) / 4);
+		emptyDigest= store.store(std::string());
+		store.startTransaction();
+		for(size_t i= 0; i < small.size(); ++i) {
+			smallDigests.push_back(store.store(small[i]));
+		}
+		store.commit();
+		dotest(store.fetch(baseDigest, found) && (found == base));
+		dotest(store.fetch(nearDigest, found) && (found == near));
+		dotest(store.fetch(emptyDigest, found) && found.empty());
+		dotest(store.release(baseDigest));
+		dotest(store.collect() == 0);
+		dotest(store.fetch(baseDigest, found) && (found == base));
+		dotest(store.release(baseDigest));
+		dotest(store.references(baseDigest) == 0);
+		dotest(!store.fetch(baseDigest, found));
+		dotest(store.fetch(nearDigest, found) && (found == near));
+	}
+	{
+		io::BlobStore	store(path, io::File::WriteIfPossible, 1024);
+		const int64_t	collected= store.collect();
+
+		dotest(collected > 0);
+		dotest(collected < static_cast<int64_t>(size / 1024));
+		dotest(store.collect() == 0);
+		dotest(store.fetch(nearDigest, found) && (found == near));
+		for(size_t i= 0; i < small.size(); ++i) {
+			dotest(store.fetch(smallDigests[i], found) && (found == small[i]));
+		}
+		dotest(store.release(nearDigest));
+		dotest(store.store(near) == nearDigest); // before collect(), so its chunks come back
+		dotest(store.collect() == 0);
+		dotest(store.fetch(nearDigest, found) && (found == near));
+
+		store.startTransaction();
+		dotest(store.store(base) == baseDigest);
+		dotest(store.release(nearDigest));
+		dotest(store.fetch(baseDigest, found) && (found == base));
+		store.rollback();
+		dotest(!store.fetch(baseDigest, found));
+		dotest(store.fetch(nearDigest, found) && (found == near));
+		dotest(store.release(nearDigest));
+		dotest(store.release(emptyDigest));
+		for(size_t i= 0; i < small.size(); ++i) {
+			dotest(store.release(smallDigests[i]));
+		}
+		dotest(store.collect() > 0);
+		dotest(store.fragmentation().size - store.fragmentation().freeBytes < static_cast<int64_t>(size) / 10);
+	}
+	try {
+		io::BlobStore	store(path, io::File::WriteIfPossible, 1000);
+
+		fprintf(stderr, "FAIL: chunk size that is not a power of 2\n");
+	} catch(const msg::Exception &) {
+		// expected
+	}
+	unlink((path + "-journal").c_str());
+	unlink(path.c_str());
+}
+
+/** Stores a corpus of new documents, copies of earlier ones and copies with a few bytes changed,
+		fetches them all, then releases half and collects.
+*/
+static void blobBenchmark(const std::string &path, int count, size_t chunkSize) {
+	std::vector<std::string>			corpus;
+	std::vector<io::BlobStore::Digest>	digests(count);
+	std::string							found;
+	double								storeTime, fetchTime, collectTime, logical= 0;
+	int64_t								stored, afterCollect, collected;
+	int									bad= 0;
+
+	srandom(count);
+	for(int i= 0; i < count; ++i) {
+		const int	kind= (i < 10) ? 0 : static_cast<int>(random() % 10);
+
+		if(kind < 4) {
+			corpus.push_back(randomData(4096 + random() % (256 * 1024), static_cast<uint32_t>(random())));
+		} else if(kind < 7) {
+			corpus.push_back(corpus[random() % corpus.size()]);
+		} else {
+			std::string	edited= corpus[random() % corpus.size()];
+
+			edited.insert(random() % edited.size(), randomData(1 + random() % 40, static_cast<uint32_t>(i)));
+			edited.erase(random() % (edited.size() - 100), random() % 100);
+			corpus.push_back(edited);
+		}
+		logical+= corpus.back().size();
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	{
+		io::BlobStore	store(path, io::File::WriteIfPossible, chunkSize);
+		dt::DateTime	start;
+
+		store.durability(io::File::NoSync);
+		for(int i= 0; i < count; ++i) {
+			if(i % 100 == 0) {
+				store.startTransaction();
+			}
+			digests[i]= store.store(corpus[i]);
+			if( (i % 100 == 99) || (i == count - 1) ) {
+				store.commit();
+			}
+		}
+		storeTime= dt::DateTime() - start;
+		stored= store.fragmentation().size - store.fragmentation().freeBytes;
+		start= dt::DateTime();
+		for(int i= count - 1; i >= 0; --i) {
+			if(!store.fetch(digests[i], found) || (found != corpus[i])) {
+				++bad;
+			}
+		}
+		fetchTime= dt::DateTime() - start;
+		start= dt::DateTime();
+		store.startTransaction();
+		for(int i= 0; i < count; i+= 2) {
+			if(!store.release(digests[i])) {
+				++bad;
+			}
+		}
+		collected= store.collect();
+		store.commit();
+		collectTime= dt::DateTime() - start;
+		afterCollect= store.fragmentation().size - store.fragmentation().freeBytes;
+		for(int i= 1; i < count; i+= 2) {
+			if(!store.fetch(digests[i], found) || (found != corpus[i])) {
+				++bad;
+			}
+		}
+	}
+	dotest(0 == bad);
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	printf("%5d blobs %7.1f MB chunks %5d: store %7.1f MB/s %6.1f MB on disk (dedup %5.2fx) fetch %7.1f MB/s"
+			" release half + collect %6.3fs %6d chunks, %6.1f MB left\n",
+			count, logical / 1048576.0, static_cast<int>(chunkSize), logical / 1048576.0 / (storeTime > 0 ? storeTime : 1e-9),
+			stored / 1048576.0, logical / (stored > 0 ? stored : 1), logical / 1048576.0 / (fetchTime > 0 ? fetchTime : 1e-9),
+			collectTime, static_cast<int>(collected), afterCollect / 1048576.0);
+}
+
+int main(int argc, const char * const argv[]) {
+	try {
+		std::string	path("bin/logs/");
+
+		if(argc >= 2) {
+			path= argv[1];
+		}
+#ifdef __Tracer_h__
+		boundaryTest(64 * 1024, 1024);
+		blobTest(path + "blob.store", 16 * 1024);
+		blobBenchmark(path + "blob.store", 12, 4096);
+#else
+		const bool	benchmark= (argc >= 3) && (std::string("benchmark") == argv[2]);
+		const int	blobs= benchmark ? 2000 : 200; // 2000 for the commit message numbers, 256 MB
+
+		boundaryTest(1024 * 1024, 1024);
+		boundaryTest(8 * 1024 * 1024, 8192);
+		blobTest(path + "blob.store", 256 * 1024);
+		blobBenchmark(path + "blob.store", blobs, 0);
+		blobBenchmark(path + "blob.store", blobs, 4096);
+		blobBenchmark(path + "blob.store", blobs, 8192);
+#endif
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include "os/ByteOrder.h"
+#include "os/DateTime.h"
+#include <stdio.h>
+#include <vector>
+
+#define dotest(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
+	}
+
+// g++ -o /tmp/test tests/ByteOrder_test.cpp -I.. -O2 -mssse3 -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings
+// /tmp/test
+
+/// The byte at a time conversion io::File used before ByteOrder.h, for comparison.
+template<class Int>
+void shiftConvert(const Int *source, Int *destination, size_t count) {
+	for(size_t index= 0; index < count; ++index) {
+		const uint8_t	*bytes= reinterpret_cast<const uint8_t*>(&source[index]);
+		Int				value= 0;
+
+		for(unsigned int byte= 0; byte < sizeof(Int); ++byte) {
+			value|= static_cast<Int>(bytes[byte]) << (8 * (sizeof(Int) - byte - 1));
+		}
+		destination[index]= value;
+	}
+}
+
+template<class Int>
+void benchmark(const char *name, size_t totalValues, size_t chunkValues) {
+	std::vector<Int>	source(chunkValues), destination(chunkValues);
+	dt::DateTime		start;
+	double				shiftTime, swapTime;
+
+	for(size_t index= 0; index < chunkValues; ++index) {
+		source[index]= static_cast<Int>(index * 0x0102030405060708ULL);
+	}
+	for(size_t done= 0; done < totalValues; done+= chunkValues) {
+		shiftConvert(&source[0], &destination[0], chunkValues);
+	}
+	shiftTime= dt::DateTime() - start;
+	start= dt::DateTime();
+	for(size_t done= 0; done < totalValues; done+= chunkValues) {
+		endian::swap(&source[0], &destination[0], chunkValues);
+	}
+	swapTime= dt::DateTime() - start;
+	dotest(destination[1] == endian::swap(source[1]));
+	printf("%s: %lu values shift %0.3fs swap %0.3fs\n", name, static_cast<unsigned long>(totalValues), shiftTime, swapTime);
+}
+
+int main(int /*argc*/, char * /*argv*/[]) {
+	size_t	totalValues= 100 * 1000 * 1000;
+	size_t	chunkValues= 1000 * 1000;
+#ifdef __Tracer_h__
+	totalValues= 40;
+	chunkValues= 40;
+#endif
+	try {
+		const uint16_t	values16[]= {0x0102, 0xA1B2, 0x0000, 0xFFEE, 0x1234, 0x5678, 0x9ABC, 0xDEF0, 0x1122};
+		const uint32_t	values32[]= {0x01020304, 0xA1B2C3D4, 0, 0xFFEEDDCC, 0x12345678};
+		const uint64_t	values64[]= {0x0102030405060708ULL, 0xA1B2C3D4E5F60718ULL, 0, 0x1122334455667788ULL, 7};
+		uint16_t		swapped16[sizeof(values16)/sizeof(values16[0])];
+		uint32_t		swapped32[sizeof(values32)/sizeof(values32[0])];
+		uint64_t		swapped64[sizeof(values64)/sizeof(values64[0])];
+		char			unaligned[sizeof(values64) + 1];
+
+		dotest(endian::swap<uint16_t>(0x0102) == 0x0201);
+		dotest(endian::swap<uint32_t>(0x01020304) == 0x04030201);
+		dotest(endian::swap<uint64_t>(0x0102030405060708ULL) == 0x0807060504030201ULL);
+		dotest(endian::swap<int32_t>(-2) == static_cast<int32_t>(0xFEFFFFFF));
+		dotest(endian::swap<uint8_t>(0x12) == 0x12);
+		endian::swap(values16, swapped16, sizeof(values16)/sizeof(values16[0]));
+		endian::swap(values32, swapped32, sizeof(values32)/sizeof(values32[0]));
+		endian::swap(values64, swapped64, sizeof(values64)/sizeof(values64[0]));
+		for(size_t index= 0; index < sizeof(values16)/sizeof(values16[0]); ++index) {
+			dotest(swapped16[index] == endian::swap(values16[index]));
+		}
+		for(size_t index= 0; index < sizeof(values32)/sizeof(values32[0]); ++index) {
+			dotest(swapped32[index] == endian::swap(values32[index]));
+		}
+		for(size_t index= 0; index < sizeof(values64)/sizeof(values64[0]); ++index) {
+			dotest(swapped64[index] == endian::swap(values64[index]));
+		}
+		endian::swap(swapped64, sizeof(values64)/sizeof(values64[0]));
+		dotest(memcmp(swapped64, values64, sizeof(values64)) == 0);
+		endian::convert(values64, reinterpret_cast<uint64_t*>(&unaligned[1]), sizeof(values64)/sizeof(values64[0]), true);
+		dotest(unaligned[1] == 0x01);
+		dotest(unaligned[8] == 0x08);
+		endian::convert(values64, swapped64, sizeof(values64)/sizeof(values64[0]), !endian::nativeIsBigEndian());
+		dotest(memcmp(swapped64, values64, sizeof(values64)) != 0);
+		endian::convert(values64, swapped64, sizeof(values64)/sizeof(values64[0]), endian::nativeIsBigEndian());
+		dotest(memcmp(swapped64, values64, sizeof(values64)) == 0);
+
+		benchmark<uint32_t>("uint32_t", totalValues, chunkValues);
+		benchmark<uint64_t>("uint64_t", totalValues, chunkValues);
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
+	return 0;
+}
@@ -1,11 +1,92 @@
 #include <stdio.h>
 #include "os/File.h"
+#include "os/DateTime.h"
+
+/** Appends small records, flushing after each one, and reports how long each durability level takes.
+*/
+void durabilityBenchmark(const std::string &path, int appends) {
+	const io::File::Durability	levels[]= {io::File::NoSync, io::File::FlushToKernel, io::File::SyncData, io::File::SyncAll};
+	const char * const			names[]= {"NoSync", "FlushToKernel", "SyncData", "SyncAll"};
+	const std::string			record(64, 'x');
+
+	for(unsigned int level= 0; level < sizeof(levels)/sizeof(levels[0]); ++level) {
+		io::File		file(path, io::File::Binary, io::File::ReadWrite);
+		dt::DateTime	start;
+		double			duration;
+
+		file.durability(levels[level]);
+		if(file.durability() != levels[level]) {
+			printf("FAIL: durability was not set\n");
+		}
+		for(int append= 0; append < appends; ++append) {
+			file.write(record, 0, io::File::FromEnd);
+			file.flush();
+		}
+		file.flush(io::File::SyncData); // group commit whatever is left
+		duration= dt::DateTime() - start;
+		printf("%-14s %d appends of %d bytes: %0.3fs (%0.1f appends/s)\n", names[level], appends,
+				static_cast<int>(record.size()), duration, static_cast<double>(appends) / duration);
+	}
+}
+
+/** Appends blocks to a new file with and without reserving the space first,
+		then punches a hole in the middle and checks the physical size dropped.
+*/
+void reserveBenchmark(const std::string &path, int appends) {
+	const std::string	block(4096, 'r');
+
+	for(int reserve= 0; reserve < 2; ++reserve) {
+		dt::DateTime	start;
+		double			duration;
+
+		unlink(path.c_str());
+		io::File		file(path, io::File::Binary, io::File::ReadWrite);
+		bool			reserved= false;
+
+		if(reserve) {
+			reserved= file.reserve(static_cast<off_t>(appends) * block.size());
+			if(reserved && (file.size() != 0)) {
+				printf("FAIL: reserve changed the logical size\n");
+			}
+			if(reserved && (file.allocatedSize() < static_cast<off_t>(appends) * static_cast<off_t>(block.size()))) {
+				printf("FAIL: reserve did not allocate\n");
+			}
+		}
+		for(int append= 0; append < appends; ++append) {
+			file.write(block);
+		}
+		file.flush(io::File::SyncData);
+		duration= dt::DateTime() - start;
+		printf("%s %d appends of %d bytes: %0.3fs (%0.1f MB/s) logical %ld physical %ld\n",
+				reserve ? (reserved ? "reserved  " : "unreserved") : "growing   ",
+				appends, static_cast<int>(block.size()), duration,
+				static_cast<double>(appends) * block.size() / duration / 1024.0 / 1024.0,
+				static_cast<long>(file.size()), static_cast<long>(file.allocatedSize()));
+		if(reserve && (appends >= 64)) {
+			const off_t	before= file.allocatedSize();
+
+			if(file.punchHole(16 * block.size(), 32 * block.size())) {
+				if(file.allocatedSize() >= before) {
+					printf("FAIL: punchHole did not free storage\n");
+				}
+				if(file.read<uint8_t>(io::File::BigEndian, 20 * block.size(), io::File::FromStart) != 0) {
+					printf("FAIL: punched hole does not read as zero\n");
+				}
+				if(file.size() != static_cast<off_t>(appends) * static_cast<off_t>(block.size())) {
+					printf("FAIL: punchHole changed the logical size\n");
+				}
+			}
+		}
+	}
+}
 
 int main(int argc,const char * const argv[]) {
 	int	iterations= 300;
 #ifdef __Tracer_h__
 	iterations= 1;
 #endif
+	durabilityBenchmark(std::string(argc < 2 ? "bin/logs/testFile.txt" : argv[1]) + ".durability", iterations);
+	reserveBenchmark(std::string(argc < 2 ? "bin/logs/testFile.txt" : argv[1]) + ".reserve", 16 * iterations);
 	for(int i= 0; i < iterations; ++i) {
 		const char * const	kTestFilePath= argc < 2 ? "bin/logs/testFile.txt" : argv[1];
 		io::File	test(kTestFilePath, io::File::Binary, io::File::ReadWrite);
@@ -14,6 +95,22 @@ int main(int argc,const char * const argv[]) {
 		test.moveto(1024, io::File::FromHere);
 		test.write("Testing");
 
+		const uint32_t	numbers[]= {0x01020304, 0xA1B2C3D4, 7};
+		uint32_t		readBack[sizeof(numbers)/sizeof(numbers[0])];
+		const off_t		numbersAt= test.location();
+
+		test.write(numbers, sizeof(numbers)/sizeof(numbers[0]), io::File::BigEndian);
+		test.read(readBack, sizeof(readBack)/sizeof(readBack[0]), io::File::BigEndian, numbersAt, io::File::FromStart);
+		if(memcmp(numbers, readBack, sizeof(numbers)) != 0) {
+			printf("FAIL: bulk integers did not round trip\n");
+		}
+		if(test.read<uint8_t>(io::File::BigEndian, numbersAt, io::File::FromStart) != 0x01) {
+			printf("FAIL: bulk integers were not big endian\n");
+		}
+		if(test.read<uint32_t>(io::File::LittleEndian, numbersAt + 4, io::File::FromStart) != 0xD4C3B2A1) {
+			printf("FAIL: single integer did not match bulk write\n");
+		}
+
 		io::File	source("File.h", io::File::Text, io::File::ReadOnly);
 		std::string	line;
 
@@ -0,0 +1,268 @@
+#include "os/Filter.h"
+#include "os/DateTime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+#include <vector>
+
+// g++ Filter_test.cpp -I.. -o /tmp/test -O2 -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings -lpthread
+// /tmp/test bin/logs/ [benchmark]
+
+#define dotest(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
+	}
+
+/// Distinct keys, the added ones are even and the others odd
+static std::vector<std::string> makeKeys(int count, int parity) {
+	std::vector<std::string>	keys;
+	char						buffer[64];
+
+	for(int i= 0; i < count; ++i) {
+		snprintf(buffer, sizeof(buffer), "key %d/%08x", 2 * i + parity, (2 * i + parity) * 2654435761U);
+		keys.push_back(buffer);
+	}
+	return keys;
+}
+
+/// The fraction of keys the filter says it might contain
+template<class Filter>
+static double positives(const Filter &filter, const std::vector<std::string> &keys) {
+	int	found= 0;
+
+	for(size_t i= 0; i < keys.size(); ++i) {
+		found+= filter.contains(keys[i]) ? 1 : 0;
+	}
+	return static_cast<double>(found) / static_cast<double>(keys.size());
+}
+
+/** Checks a filter read back from a file and one used in place in its image find the same keys,
+		that the one in place is read only, and that images of the other kind, or cut short, are refused.
+*/
+template<class Filter, class Other>
+static void imageTest(const std::string &path, const Filter &filter, const std::vector<std::string> &added,
+						const std::vector<std::string> &missing) {
+	std::string	buffer;
+
+	unlink(path.c_str());
+	{
+		io::File	file(path, io::File::Binary, io::File::ReadWrite);
+
+		file.write(std::string(100, 'x'));
+		filter.write(file, 128);
+	}
+	io::File				file(path, io::File::Binary, io::File::ReadOnly);
+	Filter					loaded(file, 128);
+	const ReferencedString	image(filter.image(buffer));
+	Filter					mapped(image);
+
+	dotest(loaded.writable());
+	dotest(!mapped.writable());
+	dotest(loaded.size() == filter.size());
+	dotest(mapped.size() == filter.size());
+	dotest(loaded.bytes() == filter.bytes());
+	dotest(mapped.bytes() == filter.bytes());
+	dotest(positives(loaded, added) == 1.0);
+	dotest(positives(mapped, added) == 1.0);
+	dotest(positives(loaded, missing) == positives(filter, missing));
+	dotest(positives(mapped, missing) == positives(filter, missing));
+	try {
+		mapped.add(missing[0]);
+		fprintf(stderr, "FAIL: added to a filter in someone else's memory\n");
+	} catch(const msg::Exception &) {
+		// expected
+	}
+	try {
+		Other	other(image);
+
+		fprintf(stderr, "FAIL: used the image of the other kind of filter\n");
+	} catch(const posix::err::EILSEQ_Errno &) {
+		// expected
+	}
+	try {
+		Filter	shortened(ReferencedString(buffer.substr(0, buffer.size() - 8)));
+
+		fprintf(stderr, "FAIL: used an image that was cut short\n");
+	} catch(const posix::err::EILSEQ_Errno &) {
+		// expected
+	}
+	try {
+		Filter	shortened(file, 0);
+
+		fprintf(stderr, "FAIL: read a filter where there is none\n");
+	} catch(const posix::err::EILSEQ_Errno &) {
+		// expected
+	}
+	unlink(path.c_str());
+}
+
+/** Checks no key that was added is missed and the rate of false positives for several sizes.
+*/
+static void bloomTest(const std::string &path, int count) {
+	const std::vector<std::string>	added= makeKeys(count, 0), missing= makeKeys(count, 1);
+	const int						bitsPerKey[]= {8, 12, 16};
+	const double					bound[]= {0.03, 0.008, 0.0025};
+
+	for(size_t b= 0; b < sizeof(bitsPerKey) / sizeof(bitsPerKey[0]); ++b) {
+		hash::BloomFilter	filter(added.size(), bitsPerKey[b]);
+
+		dotest(filter.blocks() * 512 >= added.size() * bitsPerKey[b]);
+		dotest(filter.blocks() * 512 < added.size() * bitsPerKey[b] + 512);
+		dotest(positives(filter, added) == 0.0);
+		for(size_t i= 0; i < added.size(); ++i) {
+			filter.add(added[i]);
+		}
+		dotest(filter.size() == static_cast<int64_t>(added.size()));
+		dotest(positives(filter, added) == 1.0);
+		dotest(positives(filter, missing) < bound[b]);
+		if(positives(filter, missing) >= bound[b]) {
+			printf("%d bits per key false positives %.4f%%\n", bitsPerKey[b], 100.0 * positives(filter, missing));
+		}
+		if(bitsPerKey[b] == 12) {
+			imageTest<hash::BloomFilter, hash::CuckooFilter>(path, filter, added, missing);
+		}
+	}
+	hash::BloomFilter	empty(0);
+
+	dotest(empty.blocks() == 1);
+	dotest(!empty.contains(added[0]));
+	empty.add(added[0]);
+	dotest(empty.contains(added[0]));
+}
+
+/** Checks keys are found until removed, the rate of false positives, and that a filter too full to add a key
+		is left as it was.
+*/
+static void cuckooTest(const std::string &path, int count) {
+	const std::vector<std::string>	added= makeKeys(count, 0), missing= makeKeys(count, 1);
+	hash::CuckooFilter				filter(added.size());
+	std::vector<std::string>		kept, removed;
+	int								extra= 0;
+
+	dotest((filter.buckets() & (filter.buckets() - 1)) == 0);
+	dotest(filter.buckets() * 4 * 0.95 >= added.size());
+	dotest(filter.buckets() * 2 * 0.95 < added.size());
+	dotest(!filter.remove(added[0]));
+	for(size_t i= 0; i < added.size(); ++i) {
+		dotest(filter.add(added[i]));
+	}
+	dotest(filter.size() == static_cast<int64_t>(added.size()));
+	dotest(positives(filter, added) == 1.0);
+	dotest(positives(filter, missing) < 0.0005);
+	imageTest<hash::CuckooFilter, hash::BloomFilter>(path, filter, added, missing);
+	for(size_t i= 0; i < added.size(); ++i) {
+		(i % 3 == 0 ? removed : kept).push_back(added[i]);
+	}
+	for(size_t i= 0; i < removed.size(); ++i) {
+		dotest(filter.remove(removed[i]));
+	}
+	dotest(filter.size() == static_cast<int64_t>(kept.size()));
+	dotest(positives(filter, kept) == 1.0);
+	dotest(positives(filter, removed) < 0.0005);
+	for(size_t i= 0; i < removed.size(); ++i) {
+		dotest(filter.add(removed[i]));
+	}
+	dotest(positives(filter, added) == 1.0);
+
+	hash::CuckooFilter	full(1000);
+	std::string			before, after;
+
+	while(full.add(added[extra % added.size()] + missing[extra / added.size()])) {
+		full.image(before);
+		++extra;
+	}
+	dotest(extra >= static_cast<int>(full.buckets() * 4 * 0.9));
+	dotest(full.image(after) == before);
+	dotest(full.size() == extra);
+	for(int i= 0; i < extra; ++i) {
+		dotest(full.contains(added[i % added.size()] + missing[i / added.size()]));
+	}
+}
+
+/** Adds keys to each kind of filter and looks up keys that were added and keys that were not,
+		against a std::set of the keys.
+*/
+static void lookupBenchmark(int count, int rounds) {
+	const std::vector<std::string>	added= makeKeys(count, 0), missing= makeKeys(count, 1);
+	std::vector<ReferencedString>	hits, misses;
+	hash::BloomFilter				bloom(added.size(), 12);
+	hash::CuckooFilter				cuckoo(added.size());
+	std::set<std::string>			set(added.begin(), added.end());
+	dt::DateTime					start;
+	double							bloomAdd, cuckooAdd, times[3][2];
+	int								found[3][2];
+
+	for(size_t i= 0; i < added.size(); ++i) {
+		hits.push_back(added[i]);
+		misses.push_back(missing[i]);
+	}
+	for(size_t i= 0; i < hits.size(); ++i) {
+		bloom.add(hits[i]);
+	}
+	bloomAdd= dt::DateTime() - start;
+	start= dt::DateTime();
+	for(size_t i= 0; i < hits.size(); ++i) {
+		cuckoo.add(hits[i]);
+	}
+	cuckooAdd= dt::DateTime() - start;
+	for(int which= 0; which < 2; ++which) {
+		const std::vector<ReferencedString>	&keys= (0 == which) ? hits : misses;
+		const std::vector<std::string>		&strings= (0 == which) ? added : missing;
+
+		for(int kind= 0; kind < 3; ++kind) {
+			found[kind][which]= 0;
+			start= dt::DateTime();
+			for(int round= 0; round < rounds; ++round) {
+				for(size_t i= 0; i < keys.size(); ++i) {
+					found[kind][which]+= (0 == kind) ? bloom.contains(keys[i])
+											: (1 == kind) ? cuckoo.contains(keys[i])
+											: static_cast<int>(set.count(strings[i]));
+				}
+			}
+			times[kind][which]= dt::DateTime() - start;
+		}
+	}
+	for(int kind= 0; kind < 3; ++kind) {
+		dotest(found[kind][0] == count * rounds);
+	}
+	dotest(found[2][1] == 0);
+	printf("%8d keys: add bloom %6.1fM/s cuckoo %6.1fM/s\n", count,
+			count / 1e6 / (bloomAdd > 0 ? bloomAdd : 1e-9), count / 1e6 / (cuckooAdd > 0 ? cuckooAdd : 1e-9));
+	for(int kind= 0; kind < 3; ++kind) {
+		const char	*names[]= {"bloom 12 bits", "cuckoo", "std::set"};
+		const double	bits= (0 == kind) ? 8.0 * bloom.bytes() / count : (1 == kind) ? 8.0 * cuckoo.bytes() / count : 0.0;
+
+		printf("%8d keys %-13s %5.1f bits/key: hits %7.2fM lookups/s misses %7.2fM lookups/s (%.4f%% false positives)\n",
+				count, names[kind], bits,
+				static_cast<double>(count) * rounds / 1e6 / (times[kind][0] > 0 ? times[kind][0] : 1e-9),
+				static_cast<double>(count) * rounds / 1e6 / (times[kind][1] > 0 ? times[kind][1] : 1e-9),
+				100.0 * found[kind][1] / count / rounds);
+	}
+}
+
+int main(int argc, const char * const argv[]) {
+	std::string	path("bin/logs/");
+
+	if(argc >= 2) {
+		path= argv[1];
+	}
+	try {
+	#ifdef __Tracer_h__
+		bloomTest(path + "filter.data", 2000);
+		cuckooTest(path + "filter.data", 2000);
+		lookupBenchmark(1000, 1);
+	#else
+		const bool	benchmark= (argc >= 3) && (std::string("benchmark") == argv[2]);
+
+		bloomTest(path + "filter.data", 200000);
+		cuckooTest(path + "filter.data", 200000);
+		lookupBenchmark(100000, 20);
+		if(benchmark) { // the size the commit message numbers come from, past the caches
+			lookupBenchmark(4000000, 1);
+		}
+	#endif
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
+	return 0;
+}
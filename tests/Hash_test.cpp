@@ -1,5 +1,10 @@
 #include "os/Hash.h"
+#include "os/DateTime.h"
+#include "os/BufferString.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <vector>
 
 #define dotest(condition) \
 	if(!(condition)) { \
@@ -7,10 +12,543 @@
 	}
 
 // g++ -o /tmp/test tests/Hash_test.cpp -I. -g -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings
-// /tmp/test
+// /tmp/test bin/logs/ [benchmark]
 
-int main(int /*argc*/, char * /*argv*/[]) {
-	int	iterations= 100000;
+/// The bytes of a hash written the usual way, most significant nibble first
+static std::string bytes(const char *hex) {
+	std::string	result;
+
+	for(; hex[0] != '\0' && hex[1] != '\0'; hex+= 2) {
+		result.append(1, static_cast<char>(strtol(std::string(hex, 2).c_str(), NULL, 16)));
+	}
+	return result;
+}
+
+template<class Hasher>
+static std::string digest(const std::string &data) {
+	hash::SpecificHash<Hasher>	value(data);
+
+	return std::string(reinterpret_cast<const char*>(value.buffer()), value.size());
+}
+
+/** Checks the published test vectors, and that every compressor the CPU has gives the same hashes at every length
+		around the 64 byte blocks and the 56 byte padding boundary.
+*/
+template<class Hasher>
+static void vectorTest(const char *empty, const char *abc, const char *twoBlocks, const char *millionAs) {
+	const hash::BlockCompressor	original= Hasher::compressor();
+	hash::BlockCompressor		compressors[]= {Hasher::portable, Hasher::accelerated()};
+	std::string					data;
+
+	for(int i= 0; i < 300; ++i) {
+		data.append(1, static_cast<char>(i * 131 + 7));
+	}
+	for(size_t which= 0; which < sizeof(compressors)/sizeof(compressors[0]); ++which) {
+		if(NULL == compressors[which]) {
+			continue;
+		}
+		Hasher::compressor()= compressors[which];
+		dotest(digest<Hasher>(std::string()) == bytes(empty));
+		dotest(digest<Hasher>("abc") == bytes(abc));
+		dotest(digest<Hasher>("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") == bytes(twoBlocks));
+	#ifndef __Tracer_h__
+		dotest(digest<Hasher>(std::string(1000000, 'a')) == bytes(millionAs));
+	#else
+		const void	*__unused__[]= {&millionAs, &__unused__};
+	#endif
+		for(size_t size= 0; size <= data.size(); ++size) {
+			Hasher::compressor()= Hasher::portable;
+			const std::string	expected= digest<Hasher>(data.substr(0, size));
+
+			Hasher::compressor()= compressors[which];
+			dotest(digest<Hasher>(data.substr(0, size)) == expected);
+		}
+	}
+	Hasher::compressor()= original;
+}
+
+/** Hashes data in pieces of every size, and through each kind of update(), and checks against hashing it all at once.
+*/
+template<class Hasher>
+static void incrementalTest(const std::string &path) {
+	typedef hash::SpecificHash<Hasher>	Hash;
+	std::string							data;
+
+	for(int i= 0; i < 1000; ++i) {
+		data.append(1, static_cast<char>(i * 37 + 11));
+	}
+	const Hash				expected(data);
+	typename Hash::Stream	pieces, copy;
+
+	dotest(sizeof(Hash) <= 2 * sizeof(void*) + Hash::Size); // just the digest, no stream state
+	dotest(typename Hash::Stream().final() == Hash(std::string()));
+	for(size_t piece= 1; piece <= 130; ++piece) {
+		for(size_t offset= 0; offset < data.size(); offset+= piece) {
+			pieces.update(data.data() + offset, data.size() - offset < piece ? data.size() - offset : piece);
+		}
+		dotest(pieces.final() == expected);
+	}
+	pieces.update(data.substr(0, 100));
+	copy= pieces;
+	pieces.update(ReferencedString(data, 100, 400));
+	copy.update(data.substr(100, 400));
+	BufferString	rest(data);
+
+	dotest(pieces.update(data.substr(500)).final() == expected);
+	dotest(copy.update(data.substr(500)).final() == expected);
+	dotest(pieces.update(rest).final() == expected);
+	pieces.update(std::string("ignored")).init();
+	dotest(pieces.update(data).final() == expected);
+	unlink(path.c_str());
+	{
+		io::File	file(path, io::File::Binary, io::File::ReadWrite);
+
+		file.write(data);
+		dotest(pieces.update(file).final() == expected);
+		dotest(pieces.update(file, 0, 10).update(file, 10, 490).update(file, 500).final() == expected);
+		dotest(pieces.update(file, 100, 200).final() == Hash(data.substr(100, 200)));
+		try {
+			pieces.update(file, 900, 200);
+			fprintf(stderr, "FAIL: hashed past the end of the file\n");
+		} catch(const std::exception &) {
+			// expected
+		}
+	}
+	unlink(path.c_str());
+}
+
+/** Hashes a file bigger than the buffers a piece at a time, and shows the process does not grow by the size of the file.
+*/
+template<class Hasher>
+static void streamBenchmark(const std::string &path, int megabytes) {
+	hash::SpecificHash<Hasher>					streamed;
+	typename hash::SpecificHash<Hasher>::Stream	stream;
+	std::string									block(1024 * 1024, 's');
+	struct rusage								before, after;
+
+	unlink(path.c_str());
+	{
+		io::File	file(path, io::File::Binary, io::File::ReadWrite);
+
+		for(int i= 0; i < megabytes; ++i) {
+			block[0]= static_cast<char>(i);
+			file.write(block);
+		}
+	}
+	getrusage(RUSAGE_SELF, &before);
+	dt::DateTime	start;
+	{
+		io::File	file(path, io::File::Binary, io::File::ReadOnly);
+
+		stream.update(file).final(streamed);
+	}
+	const double	time= dt::DateTime() - start;
+
+	getrusage(RUSAGE_SELF, &after);
+	dotest(streamed.valid());
+	dotest(after.ru_maxrss - before.ru_maxrss < 4 * 1024); // KB
+	unlink(path.c_str());
+	printf("%-6s streamed %5d MB file %8.1f MB/s, peak memory grew %ld KB\n", Hasher::name(), megabytes,
+			megabytes / (time > 0 ? time : 1e-9), static_cast<long>(after.ru_maxrss - before.ru_maxrss));
+}
+
+/** Hashes messages of random sizes together, in lanes and one at a time, and checks them against hashing each alone.
+*/
+template<class Hasher>
+static void batchTest(int count) {
+	typedef hash::SpecificHash<Hasher>	Hash;
+	const hash::LaneCompressor			original= Hasher::laneCompressor();
+	hash::LaneCompressor				compressors[]= {NULL, Hasher::wide()};
+	std::vector<std::string>			messages(count);
+	std::vector<const void*>			data(count);
+	std::vector<size_t>					sizes(count);
+
+	srandom(count);
+	for(int i= 0; i < count; ++i) {
+		messages[i].assign(i < count / 2 ? 64 : random() % 300, static_cast<char>(i)); // lanes all finishing together, then not
+		data[i]= messages[i].data();
+		sizes[i]= messages[i].size();
+	}
+	for(size_t which= 0; which < sizeof(compressors)/sizeof(compressors[0]); ++which) {
+		std::vector<Hash>	results(count);
+
+		if( (which > 0) && (NULL == compressors[which]) ) {
+			continue;
+		}
+		Hasher::laneCompressor()= compressors[which];
+		Hash::hashMany(count, &data[0], &sizes[0], &results[0]);
+		for(int i= 0; i < count; ++i) {
+			dotest(results[i] == Hash(messages[i]));
+		}
+		Hash::hashMany(1, &data[0], &sizes[0], &results[0]);
+		Hash::hashMany(0, NULL, NULL, NULL);
+		dotest(results[0] == Hash(messages[0]));
+	}
+	Hasher::laneCompressor()= original;
+}
+
+/** Prints hashes/sec for count messages of each size, one at a time, with hashMany() one at a time, and hashMany() in lanes.
+*/
+template<class Hasher>
+static void batchBenchmark(int count) {
+	typedef hash::SpecificHash<Hasher>	Hash;
+	const hash::LaneCompressor			original= Hasher::laneCompressor();
+	const size_t						kSizes[]= {16, 64, 1024};
+	std::string							buffer(count * 1024, 'b');
+	std::vector<const void*>			data(count);
+	std::vector<size_t>					sizes(count);
+	std::vector<Hash>					results(count);
+
+	for(size_t size= 0; size < sizeof(kSizes)/sizeof(kSizes[0]); ++size) {
+		double	single, each, lanes= 0.0;
+
+		for(int i= 0; i < count; ++i) {
+			buffer[i * kSizes[size]]= static_cast<char>(i);
+			data[i]= buffer.data() + i * kSizes[size];
+			sizes[i]= kSizes[size];
+		}
+		dt::DateTime	start;
+
+		for(int i= 0; i < count; ++i) {
+			results[i].reset(data[i], sizes[i]);
+		}
+		single= dt::DateTime() - start;
+		Hasher::laneCompressor()= NULL;
+		start= dt::DateTime();
+		Hash::hashMany(count, &data[0], &sizes[0], &results[0]);
+		each= dt::DateTime() - start;
+		if(NULL != Hasher::wide()) {
+			Hasher::laneCompressor()= Hasher::wide();
+			start= dt::DateTime();
+			Hash::hashMany(count, &data[0], &sizes[0], &results[0]);
+			lanes= dt::DateTime() - start;
+		}
+		Hasher::laneCompressor()= original;
+		printf("%-6s %4d byte messages: one at a time %9.0f/sec hashMany %9.0f/sec in %d lanes %9.0f/sec\n",
+				Hasher::name(), static_cast<int>(kSizes[size]), count / (single > 0 ? single : 1e-9), count / (each > 0 ? each : 1e-9),
+				hash::kLanes, lanes > 0 ? count / lanes : 0.0);
+	}
+}
+
+/** Checks XXH3, XXH128 and CRC-32C against published values, and the number and byte forms against each other.
+*/
+static void fastTest() {
+	const hash::CRC32CHasher::Checksummer	original= hash::CRC32CHasher::checksummer();
+	hash::CRC32CHasher::Checksummer			checksummers[]= {hash::CRC32CHasher::portable, hash::CRC32CHasher::accelerated()};
+	std::string								data;
+	uint64_t								high;
+
+	dotest(std::string("xxh3") == hash::XXH3Hasher::name());
+	dotest(std::string("xxh128") == hash::XXH128Hasher::name());
+	dotest(std::string("crc32c") == hash::CRC32CHasher::name());
+	dotest(digest<hash::XXH3Hasher>(std::string()) == bytes("2d06800538d394c2"));
+	dotest(digest<hash::XXH3Hasher>("abc") == bytes("78af5f94892f3950"));
+	dotest(digest<hash::XXH3Hasher>(std::string(1000, 'a')) == bytes("b3e7af627147db7c"));
+	dotest(digest<hash::XXH3Hasher>(std::string(1000000, 'a')) == bytes("b1fd6fae5285c4eb"));
+	dotest(digest<hash::XXH128Hasher>(std::string()) == bytes("99aa06d3014798d86001c324468d497f"));
+	dotest(digest<hash::XXH128Hasher>("abc") == bytes("06b05ab6733a618578af5f94892f3950"));
+	dotest(digest<hash::XXH128Hasher>(std::string(1000, 'a')) == bytes("b01da365eddaa29cb3e7af627147db7c"));
+	dotest(digest<hash::XXH128Hasher>(std::string(1000000, 'a')) == bytes("a545df8e384a9579b1fd6fae5285c4eb"));
+	dotest(hash::XXH3Hasher::value("abc", 3) == 0x78af5f94892f3950ULL);
+	dotest(hash::XXH128Hasher::value("abc", 3, high) == 0x78af5f94892f3950ULL);
+	dotest(high == 0x06b05ab6733a6185ULL);
+	for(int i= 0; i < 300; ++i) {
+		const uint64_t	key= 0x0123456789ABCDEFULL * static_cast<uint64_t>(i);
+		uint8_t			keyBytes[sizeof(key)];
+
+		for(size_t byte= 0; byte < sizeof(key); ++byte) {
+			keyBytes[byte]= static_cast<uint8_t>(key >> (8 * byte));
+		}
+		dotest(hash::XXH3Hasher::value(key) == hash::XXH3Hasher::value(keyBytes, sizeof(keyBytes)));
+		dotest(hash::CRC32CHasher::value(key) == hash::CRC32CHasher::value(keyBytes, sizeof(keyBytes)));
+		data.append(1, static_cast<char>(i * 73 + 5));
+	}
+	for(size_t which= 0; which < sizeof(checksummers)/sizeof(checksummers[0]); ++which) {
+		if(NULL == checksummers[which]) {
+			continue;
+		}
+		hash::CRC32CHasher::checksummer()= checksummers[which];
+		dotest(digest<hash::CRC32CHasher>(std::string()) == bytes("00000000"));
+		dotest(digest<hash::CRC32CHasher>("123456789") == bytes("e3069283"));
+		dotest(hash::CRC32CHasher::value("123456789", 9) == 0xe3069283);
+		dotest(hash::CRC32CHasher::value("6789", 4, hash::CRC32CHasher::value("12345", 5)) == 0xe3069283);
+		for(size_t size= 0; size <= data.size(); ++size) {
+			hash::CRC32CHasher::checksummer()= hash::CRC32CHasher::portable;
+			const uint32_t	expected= hash::CRC32CHasher::value(data.data(), size);
+
+			hash::CRC32CHasher::checksummer()= checksummers[which];
+			dotest(hash::CRC32CHasher::value(data.data(), size) == expected);
+		}
+	}
+	hash::CRC32CHasher::checksummer()= original;
+}
+
+/** Checks both nibble orders with every codec at every length up to <code>length</code> and bad characters at every position,
+		and that SpecificHash::hex() and reset() round trip and read hashes the usual way.
+	@param length	the longest input, past the widest vector block so every codec runs its loop and its tail
+*/
+static void hexTest(const size_t length) {
+	typedef hash::SpecificHash<hash::SHA256Hasher>	SHA256;
+	const hash::HexCodec::Encoder					originalEncoder= hash::HexCodec::encoder();
+	const hash::HexCodec::Decoder					originalDecoder= hash::HexCodec::decoder();
+	hash::HexCodec::Encoder							encoders[]= {hash::HexCodec::portableEncode, hash::HexCodec::acceleratedEncoder()};
+	hash::HexCodec::Decoder							decoders[]= {hash::HexCodec::portableDecode, hash::HexCodec::acceleratedDecoder()};
+	const hash::NibbleOrder							orders[]= {hash::HighNibbleFirst, hash::LowNibbleFirst};
+	const std::string								bad("/:@G`g \xFF");
+	const char * const								abc= "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+	std::string										data, hex;
+	uint8_t											decoded[4];
+	char											text[2 * SHA256::Size + 1];
+
+	for(size_t i= 0; i < length; ++i) {
+		data.append(1, static_cast<char>(i * 37 + 11));
+	}
+	for(size_t which= 0; which < sizeof(encoders)/sizeof(encoders[0]); ++which) {
+		if( (NULL == encoders[which]) || (NULL == decoders[which]) ) {
+			continue;
+		}
+		hash::HexCodec::encoder()= encoders[which];
+		hash::HexCodec::decoder()= decoders[which];
+		hex.assign(9, '#');
+		dotest(hash::HexCodec::encode("\x01\x23\xAB\xFF", 4, &hex[0]) == &hex[8]);
+		dotest(hex == "0123abff#");
+		hash::HexCodec::encode("\x01\x23\xAB\xFF", 4, &hex[0], hash::LowNibbleFirst);
+		dotest(hex == "1032baff#");
+		dotest(hash::HexCodec::decode("0123ABff", 4, decoded));
+		dotest(std::string(reinterpret_cast<char*>(decoded), 4) == "\x01\x23\xAB\xFF");
+		dotest(hash::HexCodec::decode("1032BAff", 4, decoded, hash::LowNibbleFirst));
+		dotest(std::string(reinterpret_cast<char*>(decoded), 4) == "\x01\x23\xAB\xFF");
+		for(size_t order= 0; order < sizeof(orders)/sizeof(orders[0]); ++order) {
+			for(size_t size= 0; size <= data.size(); ++size) {
+				std::string	expected, upper, back(size + 1, '#');
+
+				for(size_t byte= 0; byte < size; ++byte) {
+					const char	*digits= "0123456789abcdef", *upperDigits= "0123456789ABCDEF";
+					const int	first= (hash::HighNibbleFirst == orders[order]) ? 4 : 0;
+
+					expected.append(1, digits[(static_cast<uint8_t>(data[byte]) >> first) & 0x0F]).append(1, digits[(static_cast<uint8_t>(data[byte]) >> (4 - first)) & 0x0F]);
+					upper.append(1, upperDigits[(static_cast<uint8_t>(data[byte]) >> first) & 0x0F]).append(1, upperDigits[(static_cast<uint8_t>(data[byte]) >> (4 - first)) & 0x0F]);
+				}
+				hex.assign(2 * size + 1, '#');
+				dotest(hash::HexCodec::encode(data.data(), size, &hex[0], orders[order]) == &hex[2 * size]);
+				dotest(hex == expected + "#");
+				dotest(hash::HexCodec::decode(expected.data(), size, &back[0], orders[order]));
+				dotest(back == data.substr(0, size) + "#");
+				back.assign(size + 1, '#');
+				dotest(hash::HexCodec::decode(upper.data(), size, &back[0], orders[order]));
+				dotest(back == data.substr(0, size) + "#");
+			}
+			for(size_t position= 0; position < 2 * data.size(); ++position) {
+				for(size_t character= 0; character < bad.size(); ++character) {
+					std::string	corrupt(2 * data.size(), '7'), back(data.size(), '#');
+
+					corrupt[position]= bad[character];
+					dotest(!hash::HexCodec::decode(corrupt.data(), data.size(), &back[0], orders[order]));
+				}
+			}
+		}
+	}
+	hash::HexCodec::encoder()= originalEncoder;
+	hash::HexCodec::decoder()= originalDecoder;
+	SHA256("abc", 3).hex(hex);
+	dotest(hex == std::string(text, hash::HexCodec::encode(bytes(abc).data(), SHA256::Size, text, hash::kHashNibbleOrder) - text));
+	dotest(SHA256(hex.c_str()) == SHA256("abc", 3));
+	dotest(std::string(SHA256("abc", 3).hex(text)) == hex);
+	if(hash::HighNibbleFirst == hash::kHashNibbleOrder) {
+		dotest(hex == abc);
+		dotest(SHA256(abc) == SHA256("abc", 3));
+	}
+	dotest(!SHA256("").valid());
+	dotest(SHA256("ab").buffer()[0] == (hash::HighNibbleFirst == hash::kHashNibbleOrder ? 0xAB : 0xBA));
+	dotest(!SHA256(std::string(SHA256("ab").hex(text) + 2).c_str()).valid());
+	try {
+		SHA256	odd("abc");
+
+		fprintf(stderr, "FAIL: odd number of hex digits read\n");
+	} catch(const msg::Exception &) {
+		// expected
+	}
+	try {
+		SHA256	tooLong((hex + "00").c_str());
+
+		fprintf(stderr, "FAIL: too many hex digits read\n");
+	} catch(const msg::Exception &) {
+		// expected
+	}
+	try {
+		SHA256	notHex((hex.substr(0, 62) + "0g").c_str());
+
+		fprintf(stderr, "FAIL: characters that are not hex digits read\n");
+	} catch(const msg::Exception &) {
+		// expected
+	}
+}
+
+/// Prints MB/s for each hasher at several sizes, and integer keys/sec for the uint64_t fast paths
+template<class Hasher>
+static void sizeBenchmark(int megabytes) {
+	const size_t	kSizes[]= {8, 64, 1024, 1024 * 1024};
+	std::string		data(1024 * 1024, 'z');
+	uint8_t			result[Hasher::Size];
+
+	printf("%-7s", Hasher::name());
+	for(size_t size= 0; size < sizeof(kSizes)/sizeof(kSizes[0]); ++size) {
+		const int		count= static_cast<int>(megabytes * 1024.0 * 1024.0 / kSizes[size]);
+		dt::DateTime	start;
+
+		for(int i= 0; i < count; ++i) {
+			data[0]= static_cast<char>(i);
+			Hasher::hash(data.data(), kSizes[size], result);
+		}
+		const double	time= dt::DateTime() - start;
+
+		printf(" %7d bytes %8.1f MB/s", static_cast<int>(kSizes[size]), megabytes / (time > 0 ? time : 1e-9));
+	}
+	printf("\n");
+}
+
+/// Prints integer keys/sec through XXH3Hasher::value(uint64_t) and CRC32CHasher::value(uint64_t)
+static void keyBenchmark(int count) {
+	uint64_t		sum= 0;
+	dt::DateTime	start;
+
+	for(int i= 0; i < count; ++i) {
+		sum+= hash::XXH3Hasher::value(static_cast<uint64_t>(i));
+	}
+	const double	xxh3Time= dt::DateTime() - start;
+
+	start= dt::DateTime();
+	for(int i= 0; i < count; ++i) {
+		sum+= hash::CRC32CHasher::value(static_cast<uint64_t>(i));
+	}
+	const double	crcTime= dt::DateTime() - start;
+
+	dotest(sum != 0);
+	printf("uint64_t keys: xxh3 %10.0f/sec crc32c %10.0f/sec\n",
+			count / (xxh3Time > 0 ? xxh3Time : 1e-9), count / (crcTime > 0 ? crcTime : 1e-9));
+}
+
+/// Prints MB/s of hex digits for each codec in 64 KB blocks and as SHA-256 sized digests, and digests/sec through SpecificHash
+static void hexBenchmark(int megabytes) {
+	typedef hash::SpecificHash<hash::SHA256Hasher>	SHA256;
+	const hash::HexCodec::Encoder					originalEncoder= hash::HexCodec::encoder();
+	const hash::HexCodec::Decoder					originalDecoder= hash::HexCodec::decoder();
+	hash::HexCodec::Encoder							encoders[]= {hash::HexCodec::portableEncode, hash::HexCodec::acceleratedEncoder()};
+	hash::HexCodec::Decoder							decoders[]= {hash::HexCodec::portableDecode, hash::HexCodec::acceleratedDecoder()};
+	const char										*names[]= {"portable", "accelerated"};
+	const size_t									kBlock= 64 * 1024, kDigest= SHA256::Size;
+	const int										blocks= static_cast<int>(megabytes * 1048576.0 / kBlock);
+	const int										digests= static_cast<int>(megabytes * 1048576.0 / kDigest);
+	std::string										data(kBlock, 'h'), hex(2 * kBlock, '0');
+	int												bad= 0;
+
+	for(size_t which= 0; which < sizeof(encoders)/sizeof(encoders[0]); ++which) {
+		if( (NULL == encoders[which]) || (NULL == decoders[which]) ) {
+			continue;
+		}
+		hash::HexCodec::encoder()= encoders[which];
+		hash::HexCodec::decoder()= decoders[which];
+		dt::DateTime	start;
+
+		for(int i= 0; i < blocks; ++i) {
+			data[0]= static_cast<char>(i);
+			hash::HexCodec::encode(data.data(), kBlock, &hex[0]);
+		}
+		const double	encodeTime= dt::DateTime() - start;
+
+		start= dt::DateTime();
+		for(int i= 0; i < blocks; ++i) {
+			hex[0]= "0123456789abcdef"[i & 0x0F];
+			bad+= hash::HexCodec::decode(hex.data(), kBlock, &data[0]) ? 0 : 1;
+		}
+		const double	decodeTime= dt::DateTime() - start;
+
+		start= dt::DateTime();
+		for(int i= 0; i < digests; ++i) {
+			data[0]= static_cast<char>(i);
+			hash::HexCodec::encode(data.data(), kDigest, &hex[0]);
+		}
+		const double	digestEncodeTime= dt::DateTime() - start;
+
+		start= dt::DateTime();
+		for(int i= 0; i < digests; ++i) {
+			hex[0]= "0123456789abcdef"[i & 0x0F];
+			bad+= hash::HexCodec::decode(hex.data(), kDigest, &data[0]) ? 0 : 1;
+		}
+		const double	digestDecodeTime= dt::DateTime() - start;
+
+		printf("hex %-11s 64 KB encode %8.1f MB/s decode %8.1f MB/s, 32 bytes encode %8.1f MB/s decode %8.1f MB/s\n", names[which],
+				megabytes / (encodeTime > 0 ? encodeTime : 1e-9), megabytes / (decodeTime > 0 ? decodeTime : 1e-9),
+				megabytes / (digestEncodeTime > 0 ? digestEncodeTime : 1e-9), megabytes / (digestDecodeTime > 0 ? digestDecodeTime : 1e-9));
+	}
+	hash::HexCodec::encoder()= originalEncoder;
+	hash::HexCodec::decoder()= originalDecoder;
+	SHA256			value("hex", 3);
+	std::string		text;
+	dt::DateTime	start;
+
+	for(int i= 0; i < digests; ++i) {
+		value.buffer()[0]= static_cast<uint8_t>(i);
+		value.hex(text);
+	}
+	const double	hexTime= dt::DateTime() - start;
+
+	start= dt::DateTime();
+	for(int i= 0; i < digests; ++i) {
+		text[0]= "0123456789abcdef"[i & 0x0F];
+		value.reset(text.c_str());
+	}
+	const double	resetTime= dt::DateTime() - start;
+
+	dotest(0 == bad);
+	printf("sha256 hex() %10.0f/sec reset(const char*) %10.0f/sec\n",
+			digests / (hexTime > 0 ? hexTime : 1e-9), digests / (resetTime > 0 ? resetTime : 1e-9));
+}
+
+/// Prints MB/s for 64 byte and 1 MB messages, for each compressor
+template<class Hasher>
+static void hashBenchmark(int smallCount, int largeCount) {
+	const size_t				kSmall= 64, kLarge= 1024 * 1024;
+	const hash::BlockCompressor	original= Hasher::compressor();
+	hash::BlockCompressor		compressors[]= {Hasher::portable, Hasher::accelerated()};
+	const char					*names[]= {"portable", "accelerated"};
+	std::string					data(kLarge, 'x');
+	uint8_t						result[Hasher::Size];
+
+	for(size_t which= 0; which < sizeof(compressors)/sizeof(compressors[0]); ++which) {
+		if(NULL == compressors[which]) {
+			continue;
+		}
+		Hasher::compressor()= compressors[which];
+		dt::DateTime	start;
+
+		for(int i= 0; i < smallCount; ++i) {
+			data[0]= static_cast<char>(i);
+			Hasher::hash(data.data(), kSmall, result);
+		}
+		const double	smallTime= dt::DateTime() - start;
+
+		start= dt::DateTime();
+		for(int i= 0; i < largeCount; ++i) {
+			data[0]= static_cast<char>(i);
+			Hasher::hash(data.data(), kLarge, result);
+		}
+		const double	largeTime= dt::DateTime() - start;
+
+		printf("%-6s %-11s 64 bytes %8.1f MB/s (%9.0f/sec) 1 MB %8.1f MB/s\n", Hasher::name(), names[which],
+				smallCount * kSmall / 1048576.0 / (smallTime > 0 ? smallTime : 1e-9), smallCount / (smallTime > 0 ? smallTime : 1e-9),
+				largeCount * kLarge / 1048576.0 / (largeTime > 0 ? largeTime : 1e-9));
+	}
+	Hasher::compressor()= original;
+}
+
+int main(int argc, const char * const argv[]) {
+	std::string	path("bin/logs/");
+	int			iterations= 100000;
+
+	if(argc >= 2) {
+		path= argv[1];
+	}
 #ifdef __Tracer_h__
 	iterations= 1;
 #endif
@@ -31,5 +569,86 @@ int main(int /*argc*/, char * /*argv*/[]) {
 			printf("FAILED: Exception: %s\n", exception.what());
 		}
 	}
+	try {
+		dotest(std::string("md5") == hash::MD5Hasher().name());
+		dotest(std::string("sha1") == hash::SHA1Hasher().name());
+		vectorTest<hash::MD5Hasher>("d41d8cd98f00b204e9800998ecf8427e", "900150983cd24fb0d6963f7d28e17f72",
+									"8215ef0796a20bcaaae116d3876c664a", "7707d6ae4e027c70eea2a935c2296f21");
+		vectorTest<hash::SHA1Hasher>("da39a3ee5e6b4b0d3255bfef95601890afd80709", "a9993e364706816aba3e25717850c26c9cd0d89d",
+									"84983e441c3bd26ebaae4aa1f95129e5e54670f1", "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+		vectorTest<hash::SHA256Hasher>("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+									"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+									"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+									"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+		incrementalTest<hash::MD5Hasher>(path + "hash.data");
+		incrementalTest<hash::SHA1Hasher>(path + "hash.data");
+		incrementalTest<hash::SHA256Hasher>(path + "hash.data");
+		incrementalTest<hash::XXH3Hasher>(path + "hash.data");
+		incrementalTest<hash::XXH128Hasher>(path + "hash.data");
+		incrementalTest<hash::CRC32CHasher>(path + "hash.data");
+		fastTest();
+	#ifdef __Tracer_h__
+		hexTest(40);
+	#else
+		hexTest(100);
+	#endif
+		batchTest<hash::MD5Hasher>(100);
+		{
+			const void							*data[]= {"", "abc"};
+			const size_t						sizes[]= {0, 3};
+			hash::SpecificHash<hash::SHA1Hasher>	results[2];
+
+			hash::SpecificHash<hash::SHA1Hasher>::hashMany(2, data, sizes, results);
+			dotest(results[0] == hash::SpecificHash<hash::SHA1Hasher>(std::string()));
+			dotest(results[1] == hash::SpecificHash<hash::SHA1Hasher>("abc", 3));
+		}
+		batchTest<hash::SHA256Hasher>(100);
+	#ifdef __Tracer_h__
+		batchBenchmark<hash::SHA256Hasher>(20);
+		hashBenchmark<hash::SHA256Hasher>(10, 1);
+		sizeBenchmark<hash::XXH3Hasher>(1);
+		keyBenchmark(10);
+		hexBenchmark(1);
+		streamBenchmark<hash::SHA256Hasher>(path + "hash.data", 1);
+	#else
+		const bool	benchmark= (argc >= 3) && (std::string("benchmark") == argv[2]);
+
+		if(benchmark) { // the sizes the commit messages' numbers come from, minutes unoptimised
+			hashBenchmark<hash::MD5Hasher>(1000000, 200);
+			hashBenchmark<hash::SHA1Hasher>(1000000, 200);
+			hashBenchmark<hash::SHA256Hasher>(1000000, 200);
+			sizeBenchmark<hash::MD5Hasher>(200);
+			sizeBenchmark<hash::SHA1Hasher>(200);
+			sizeBenchmark<hash::SHA256Hasher>(200);
+			sizeBenchmark<hash::XXH3Hasher>(2000);
+			sizeBenchmark<hash::XXH128Hasher>(2000);
+			sizeBenchmark<hash::CRC32CHasher>(2000);
+			keyBenchmark(100000000);
+			hexBenchmark(1000);
+			batchBenchmark<hash::MD5Hasher>(1000000);
+			batchBenchmark<hash::SHA256Hasher>(1000000);
+			streamBenchmark<hash::MD5Hasher>(path + "hash.data", 256);
+			streamBenchmark<hash::SHA256Hasher>(path + "hash.data", 256);
+		} else {
+			hashBenchmark<hash::MD5Hasher>(10000, 2);
+			hashBenchmark<hash::SHA1Hasher>(10000, 2);
+			hashBenchmark<hash::SHA256Hasher>(10000, 2);
+			sizeBenchmark<hash::MD5Hasher>(2);
+			sizeBenchmark<hash::SHA1Hasher>(2);
+			sizeBenchmark<hash::SHA256Hasher>(2);
+			sizeBenchmark<hash::XXH3Hasher>(20);
+			sizeBenchmark<hash::XXH128Hasher>(20);
+			sizeBenchmark<hash::CRC32CHasher>(20);
+			keyBenchmark(1000000);
+			hexBenchmark(10);
+			batchBenchmark<hash::MD5Hasher>(10000);
+			batchBenchmark<hash::SHA256Hasher>(10000);
+			streamBenchmark<hash::MD5Hasher>(path + "hash.data", 16);
+			streamBenchmark<hash::SHA256Hasher>(path + "hash.data", 16);
+		}
+	#endif
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
 	return 0;
 }
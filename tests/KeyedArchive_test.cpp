@@ -0,0 +1,275 @@
+#include "os/KeyedArchive.h"
+#include "os/DateTime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+// g++ KeyedArchive_test.cpp -I.. -o /tmp/test -O2 -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings -lpthread
+// /tmp/test bin/logs/ [benchmark]
+
+#define dotest(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
+	}
+
+static std::string key(int index) {
+	char	buffer[32];
+
+	snprintf(buffer, sizeof(buffer), "key:%d", index);
+	return buffer;
+}
+
+static std::string value(int index, int version) {
+	char	buffer[32];
+
+	snprintf(buffer, sizeof(buffer), "%d.%d:", index, version);
+	return std::string(buffer) + std::string(index % 50, static_cast<char>('a' + index % 26));
+}
+
+static void copyFile(const std::string &from, const std::string &to) {
+	std::string	contents;
+
+	unlink(to.c_str());
+	io::File(from, io::File::Binary, io::File::ReadOnly).read(contents);
+	io::File(to, io::File::Binary, io::File::ReadWrite).write(contents, 0, io::File::FromStart);
+}
+
+/// Counts the keys in expected that are not in the archive with the same value, and the keys in removed that are
+static int badKeys(io::KeyedArchive &archive, const std::map<std::string,std::string> &expected, const std::vector<std::string> &removed) {
+	std::string	found;
+	int			bad= 0;
+
+	for(std::map<std::string,std::string>::const_iterator entry= expected.begin(); entry != expected.end(); ++entry) {
+		if(!archive.get(entry->first, found) || (found != entry->second)) {
+			++bad;
+		}
+	}
+	for(std::vector<std::string>::const_iterator entry= removed.begin(); entry != removed.end(); ++entry) {
+		if(archive.find(*entry)) {
+			++bad;
+		}
+	}
+	return bad;
+}
+
+/** Puts, updates and removes keys, checking them against a std::map, through a reopen,
+		a rollback and a crash before and during a commit.
+*/
+static void keyTest(const std::string &path, int count) {
+	std::map<std::string,std::string>	expected;
+	std::vector<std::string>			removed;
+	int64_t								identifier;
+
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	{
+		io::KeyedArchive	archive(path);
+		std::string			found;
+
+		dotest(!archive.get("missing", found));
+		dotest(!archive.remove("missing"));
+		archive.startTransaction();
+		for(int i= 0; i < count; ++i) {
+			expected[key(i)]= value(i, 0);
+			archive.put(key(i), value(i, 0));
+		}
+		archive.commit();
+		dotest(archive.buckets() > 1);
+		archive.put(std::string(), "empty key");
+		archive.put(std::string("\0\xFF\0", 3), std::string("\0binary\0", 8));
+		archive.put(std::string(5000, 'k'), std::string(100000, 'v'));
+		expected[std::string()]= "empty key";
+		expected[std::string("\0\xFF\0", 3)]= std::string("\0binary\0", 8);
+		expected[std::string(5000, 'k')]= std::string(100000, 'v');
+		identifier= archive.find(key(1)).identifier();
+		for(int i= 0; i < count; i+= 3) {
+			expected[key(i)]= value(i, 1);
+			archive.put(key(i), value(i, 1));
+		}
+		dotest(archive.find(key(1)).identifier() == identifier);
+		for(int i= 1; i < count; i+= 3) {
+			expected.erase(key(i));
+			removed.push_back(key(i));
+			dotest(archive.remove(key(i)));
+		}
+		dotest(!archive.remove(key(1)));
+		dotest(badKeys(archive, expected, removed) == 0);
+	}
+	{
+		io::KeyedArchive	archive(path);
+		const int64_t		buckets= archive.buckets();
+
+		dotest(badKeys(archive, expected, removed) == 0);
+		archive.startTransaction();
+		for(int i= count; i < 2 * count; ++i) {
+			archive.put(key(i), value(i, 0));
+		}
+		archive.remove(key(0));
+		dotest(archive.find(key(count)));
+		dotest(!archive.find(key(0)));
+		archive.rollback();
+		dotest(archive.buckets() == buckets);
+		dotest(!archive.find(key(count)));
+		dotest(badKeys(archive, expected, removed) == 0);
+
+		archive.startTransaction();
+		for(int i= count; i < 2 * count; ++i) {
+			archive.put(key(i), value(i, 0));
+		}
+		copyFile(path, path + ".before"); // as if we crashed before the commit
+		archive.commit();
+		copyFile(path, path + ".after");
+		copyFile(path + "-journal", path + ".after-journal"); // as if we crashed just after the commit
+	}
+	{
+		io::KeyedArchive	archive(path + ".before");
+
+		dotest(badKeys(archive, expected, removed) == 0);
+		dotest(!archive.find(key(count)));
+	}
+	for(int i= count; i < 2 * count; ++i) {
+		expected[key(i)]= value(i, 0);
+	}
+	{
+		io::KeyedArchive	archive(path + ".after");
+
+		dotest(badKeys(archive, expected, removed) == 0);
+	}
+	{
+		io::KeyedArchive	archive(path, io::File::ReadOnly);
+
+		dotest(badKeys(archive, expected, removed) == 0);
+	}
+	try {
+		io::ArchiveFile	file(path);
+
+		fprintf(stderr, "FAIL: opened a KeyedArchive as a plain ArchiveFile\n");
+	} catch(const posix::err::EILSEQ_Errno &) {
+		// expected
+	}
+	unlink((path + ".before").c_str());
+	unlink((path + ".after").c_str());
+	unlink((path + "-journal").c_str());
+	unlink(path.c_str());
+}
+
+/** Puts count keys, batchSize to a commit, then gets them all in random order, gets keys that are not there,
+		updates them and removes them.
+*/
+static void keyBenchmark(const std::string &path, int count, int batchSize) {
+	std::vector<int>	order;
+	std::string			found;
+	double				putTime, openTime, getTime, missTime, updateTime, removeTime;
+	int					bad= 0;
+	int64_t				buckets;
+
+	for(int i= 0; i < count; ++i) {
+		order.push_back(i);
+	}
+	srandom(count);
+	for(int i= count - 1; i > 0; --i) {
+		std::swap(order[i], order[random() % (i + 1)]);
+	}
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	{
+		io::KeyedArchive	archive(path);
+		dt::DateTime		start;
+
+		archive.durability(io::File::NoSync);
+		for(int i= 0; i < count; ++i) {
+			if(i % batchSize == 0) {
+				archive.startTransaction();
+			}
+			archive.put(key(i), value(i, 0));
+			if( (i % batchSize == batchSize - 1) || (i == count - 1) ) {
+				archive.commit();
+			}
+		}
+		putTime= dt::DateTime() - start;
+		buckets= archive.buckets();
+	}
+	{
+		dt::DateTime		start;
+		io::KeyedArchive	archive(path);
+
+		openTime= dt::DateTime() - start;
+		archive.durability(io::File::NoSync);
+		start= dt::DateTime();
+		for(int i= 0; i < count; ++i) {
+			if(!archive.get(key(order[i]), found) || (found != value(order[i], 0))) {
+				++bad;
+			}
+		}
+		getTime= dt::DateTime() - start;
+		start= dt::DateTime();
+		for(int i= count; i < 2 * count; ++i) {
+			if(archive.find(key(i))) {
+				++bad;
+			}
+		}
+		missTime= dt::DateTime() - start;
+		start= dt::DateTime();
+		for(int i= 0; i < count; ++i) {
+			if(i % batchSize == 0) {
+				archive.startTransaction();
+			}
+			archive.put(key(order[i]), value(order[i], 1));
+			if( (i % batchSize == batchSize - 1) || (i == count - 1) ) {
+				archive.commit();
+			}
+		}
+		updateTime= dt::DateTime() - start;
+		start= dt::DateTime();
+		for(int i= 0; i < count; ++i) {
+			if(i % batchSize == 0) {
+				archive.startTransaction();
+			}
+			if(!archive.remove(key(order[i]))) {
+				++bad;
+			}
+			if( (i % batchSize == batchSize - 1) || (i == count - 1) ) {
+				archive.commit();
+			}
+		}
+		removeTime= dt::DateTime() - start;
+	}
+	dotest(0 == bad);
+	unlink(path.c_str());
+	unlink((path + "-journal").c_str());
+	printf("%7d keys %4d per commit (%6d buckets): put %8.0f/sec open %6.3fs get %8.0f/sec miss %8.0f/sec update %8.0f/sec remove %8.0f/sec\n",
+			count, batchSize, static_cast<int>(buckets),
+			count / (putTime > 0 ? putTime : 1e-9), openTime, count / (getTime > 0 ? getTime : 1e-9), count / (missTime > 0 ? missTime : 1e-9),
+			count / (updateTime > 0 ? updateTime : 1e-9), count / (removeTime > 0 ? removeTime : 1e-9));
+}
+
+int main(int argc, const char * const argv[]) {
+	try {
+		std::string	path("bin/logs/");
+
+		if(argc >= 2) {
+			path= argv[1];
+		}
+#ifdef __Tracer_h__
+		keyTest(path + "keyed.archive", 300);
+		keyBenchmark(path + "keyed.archive", 500, 50);
+#else
+		const bool	benchmark= (argc >= 3) && (std::string("benchmark") == argv[2]);
+
+		if(benchmark) { // the sizes the commit message numbers come from, minutes
+			keyTest(path + "keyed.archive", 30000);
+			keyBenchmark(path + "keyed.archive", 1000, 1);
+			keyBenchmark(path + "keyed.archive", 1000000, 1000);
+		} else {
+			keyTest(path + "keyed.archive", 3000);
+			keyBenchmark(path + "keyed.archive", 100, 1);
+			keyBenchmark(path + "keyed.archive", 20000, 1000);
+		}
+#endif
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
+	return 0;
+}
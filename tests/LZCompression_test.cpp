@@ -0,0 +1,114 @@
+#include "os/LZCompression.h"
+#include "os/DateTime.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define dotest(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
+	}
+
+// g++ -o /tmp/test tests/LZCompression_test.cpp -I.. -O2 -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings
+
+/// Words and numbers, something like a log file.
+static std::string text(size_t size) {
+	const char * const	words[]= {"the", "archive", "block", "of", "compressed", "file", "and", "a", "checksum", "read",
+									"written", "to", "error", "request", "from", "server", "at", "with", "size", "offset"};
+	std::string			result;
+	char				number[32];
+
+	srandom(17);
+	while(result.size() < size) {
+		snprintf(number, sizeof(number), "%ld: ", random() % 100000);
+		result.append(number);
+		for(int word= random() % 12 + 3; word > 0; --word) {
+			result.append(words[random() % (sizeof(words) / sizeof(words[0]))]);
+			result.append(1, word == 1 ? '\n' : ' ');
+		}
+	}
+	result.resize(size);
+	return result;
+}
+
+static std::string noise(size_t size) {
+	std::string	result(size, '\0');
+
+	for(size_t index= 0; index < size; ++index) {
+		result[index]= static_cast<char>(random() >> 7);
+	}
+	return result;
+}
+
+static bool roundTrip(const std::string &original) {
+	std::string	compressed, uncompressed;
+
+	lz::compress(original, compressed);
+	if(compressed.size() > lz::bound(original.size())) {
+		return false;
+	}
+	return lz::uncompress(compressed, uncompressed, original.size()) == original;
+}
+
+static bool corruptThrows(const std::string &compressed, size_t size) {
+	std::string	uncompressed;
+
+	try {
+		lz::uncompress(compressed, uncompressed, size);
+	} catch(const posix::err::EILSEQ_Errno &) {
+		return true;
+	}
+	return false;
+}
+
+int main(const int /*argc*/, const char * const /*argv*/[]) {
+	size_t	size= 64 * 1024 * 1024;
+#ifdef __Tracer_h__
+	size= 64 * 1024;
+#endif
+	try {
+		const std::string	corpus= text(size);
+		std::string			compressed, uncompressed;
+
+		dotest(roundTrip(""));
+		dotest(roundTrip("a"));
+		dotest(roundTrip("abcdefghijkl"));
+		dotest(roundTrip("abcdefghijklm"));
+		dotest(roundTrip(std::string(13, 'x')));
+		dotest(roundTrip(std::string(100000, 'x')));
+		dotest(roundTrip(std::string(1000, 'x') + std::string(1000, 'y') + std::string(1000, 'x')));
+		dotest(roundTrip(noise(100000)));
+		dotest(roundTrip(noise(70000) + noise(70000)));
+		dotest(roundTrip(text(100)));
+		dotest(roundTrip(text(300000)));
+		dotest(lz::compress(std::string(100000, 'x'), compressed).size() < 500);
+		dotest(lz::compress(noise(4096), compressed).size() <= lz::bound(4096));
+
+		lz::compress(text(10000), compressed);
+		dotest(corruptThrows(compressed, 9999));
+		dotest(corruptThrows(compressed, 10001));
+		dotest(corruptThrows(compressed.substr(0, compressed.size() / 2), 10000));
+		dotest(corruptThrows(std::string(1, '\xF0'), 100));
+		dotest(corruptThrows(std::string("\x1F""a\x00\x00", 4), 100));
+		dotest(corruptThrows(std::string("\x1F""a\x05\x00", 4), 100));
+		dotest(corruptThrows(std::string("\x00\x01", 2), 100));
+
+		{
+			dt::DateTime	start;
+			double			seconds;
+
+			lz::compress(corpus, compressed);
+			seconds= dt::DateTime() - start;
+			printf("compress:   %0.1f MiB/s %0.1f%% of %lu bytes\n", static_cast<double>(size) / (1024.0 * 1024.0) / (seconds > 0 ? seconds : 1e-9),
+					100.0 * static_cast<double>(compressed.size()) / static_cast<double>(size), static_cast<unsigned long>(size));
+			start= dt::DateTime();
+			lz::uncompress(compressed, uncompressed, corpus.size());
+			seconds= dt::DateTime() - start;
+			printf("uncompress: %0.1f MiB/s\n", static_cast<double>(size) / (1024.0 * 1024.0) / (seconds > 0 ? seconds : 1e-9));
+			dotest(uncompressed == corpus);
+			dotest(compressed.size() < corpus.size() / 2);
+		}
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
+	return 0;
+}
@@ -1,14 +1,306 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
 #include "os/ReferencedString.h"
+#include "os/DateTime.h"
 
 // $ g++ -o /tmp/test tests/ReferencedString_test.cpp -isysroot $SDK_PATH/MacOSX10.5.sdk -I. -include Tracer.h -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings
+// $ /tmp/test [benchmark]
 
 #define dotest(condition) \
 	if(!(condition)) { \
 		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
 	}
 
-int main(const int /*argc*/, const char * const /*argv*/[]) {
+/// Bytes from an alphabet of the given size, the same for the same seed
+static std::string randomString(size_t size, int alphabet, uint32_t seed) {
+	std::string	data(size, '\0');
+
+	for(size_t i= 0; i < size; ++i) {
+		seed= seed * 1103515245 + 12345;
+		data[i]= static_cast<char>('a' + (seed >> 16) % alphabet);
+	}
+	return data;
+}
+
+/// The find() before the search engine, memchr for the first byte then a byte by byte compare
+static size_t oldFind(const std::string &haystack, const std::string &needle, size_t offset) {
+	while(offset + needle.size() <= haystack.size()) {
+		const char	*found= reinterpret_cast<const char*>(memchr(haystack.data() + offset, needle[0], haystack.size() - offset));
+
+		if(NULL == found) {
+			return ReferencedString::npos;
+		}
+		offset= found - haystack.data();
+		if(offset + needle.size() > haystack.size()) {
+			return ReferencedString::npos;
+		}
+		size_t	index= 1;
+
+		while( (index < needle.size()) && (haystack[offset + index] == needle[index]) ) {
+			++index;
+		}
+		if(index == needle.size()) {
+			return offset;
+		}
+		++offset;
+	}
+	return ReferencedString::npos;
+}
+
+/** Checks find(), rfind(), find_first_of() and Searcher against std::string on small alphabets,
+		where needles repeat and overlap, for every needle length around the short needle limit.
+*/
+static void searchTest(int rounds) {
+	const size_t	needleSizes[]= {1, 2, 3, 5, 16, 31, 32, 33, 34, 40, 64, 100, 300};
+	const int		alphabets[]= {1, 2, 4, 26};
+
+	for(int round= 0; round < rounds; ++round) {
+		for(size_t a= 0; a < sizeof(alphabets) / sizeof(alphabets[0]); ++a) {
+			const std::string		text= randomString(2000, alphabets[a], round * 7 + a);
+			const ReferencedString	haystack(text);
+
+			for(size_t n= 0; n < sizeof(needleSizes) / sizeof(needleSizes[0]); ++n) {
+				const size_t		size= needleSizes[n];
+				const std::string	inside= text.substr((round * 131 + size) % (text.size() - size), size);
+				const std::string	periodic= (randomString(size / 3 + 1, alphabets[a], round) + randomString(size, 1, 0)).substr(0, size);
+				const std::string	outside= randomString(size, alphabets[a], round * 11 + 5);
+				const std::string	needles[]= {inside, periodic, outside, text.substr(text.size() - size)};
+
+				for(size_t which= 0; which < sizeof(needles) / sizeof(needles[0]); ++which) {
+					const ReferencedString				needle(needles[which]);
+					const ReferencedString::Searcher	searcher(needle);
+					const size_t						offsets[]= {0, 1, 17, text.size() / 2, text.size() - size, text.size() - 1, text.size()};
+
+					dotest(searcher.needle() == needle);
+					for(size_t o= 0; o < sizeof(offsets) / sizeof(offsets[0]); ++o) {
+						const size_t	expected= text.find(needles[which], offsets[o]) == std::string::npos ? ReferencedString::npos : text.find(needles[which], offsets[o]);
+
+						dotest(haystack.find(needle, offsets[o]) == (offsets[o] < text.size() ? expected : ReferencedString::npos));
+						dotest(searcher.find(haystack, offsets[o]) == (offsets[o] < text.size() ? expected : ReferencedString::npos));
+						dotest(haystack.rfind(needle, offsets[o]) == text.rfind(needles[which], offsets[o]));
+						dotest(haystack.find_first_of(needle, offsets[o]) == text.find_first_of(needles[which], offsets[o]));
+					}
+					dotest(haystack.rfind(needle) == text.rfind(needles[which]));
+					dotest(haystack.rfind(needle[0]) == text.rfind(needles[which][0]));
+					dotest(haystack.rfind(needle[0], 17) == text.rfind(needles[which][0], 17));
+				}
+			}
+		}
+	}
+	dotest(ReferencedString("testing").find("testing") == 0);
+	dotest(ReferencedString("testing").find("ing") == 4);
+	dotest(ReferencedString("testing").rfind('t') == 3);
+	dotest(ReferencedString("testing").rfind('x') == ReferencedString::npos);
+	dotest(ReferencedString("testing").rfind("t", 2) == 0);
+	dotest(ReferencedString("testing").rfind("testings") == ReferencedString::npos);
+	dotest(ReferencedString().rfind('t') == ReferencedString::npos);
+	dotest(ReferencedString().rfind("t") == ReferencedString::npos);
+	dotest(ReferencedString("testing").find_first_of("gn") == 5);
+	dotest(ReferencedString("testing").find_first_of("xyz") == ReferencedString::npos);
+	dotest(ReferencedString("testing").find_first_of(ReferencedString()) == ReferencedString::npos);
+	dotest(ReferencedString("testing").find_first_of("t", 7) == ReferencedString::npos);
+	dotest(ReferencedString::Searcher("testing").find(ReferencedString()) == ReferencedString::npos);
+	dotest(ReferencedString::Searcher(std::string(40, 'x')).find("short") == ReferencedString::npos);
+}
+
+/** Times the old find(), the new one, a Searcher made once and std::string::find for needles of several
+		sizes in English-like text, in random bytes, and in a run of one byte where the old find is quadratic.
+*/
+static void searchBenchmark(size_t size, int rounds) {
+	const char	*words[]= {"the ", "of ", "and ", "a ", "to ", "in ", "is ", "you ", "that ", "it ", "he ", "was ", "for ", "on ",
+							"are ", "as ", "with ", "his ", "they ", "at ", "be ", "this ", "have ", "from ", "or ", "one ",
+							"had ", "by ", "word ", "but ", "not ", "what ", "all ", "were ", "when ", "we ", "there ", "can "};
+	std::string	text, binary(size, '\0'), repeated(size, 'a');
+	const size_t	needleSizes[]= {2, 8, 24, 64, 256};
+
+	srandom(static_cast<unsigned int>(size));
+	while(text.size() < size) {
+		text+= words[random() % (sizeof(words) / sizeof(words[0]))];
+	}
+	for(size_t i= 0; i < size; ++i) {
+		binary[i]= static_cast<char>(random() % 255);
+	}
+	for(int corpus= 0; corpus < 3; ++corpus) {
+		const std::string	&data= (0 == corpus) ? text : (1 == corpus) ? binary : repeated;
+		const char			*name= (0 == corpus) ? "text" : (1 == corpus) ? "binary" : "aaaa";
+		const ReferencedString	haystack(data);
+
+		for(size_t n= 0; n < sizeof(needleSizes) / sizeof(needleSizes[0]); ++n) {
+			// a needle that is not there, so the whole haystack is searched
+			const std::string	needle= (2 == corpus) ? std::string(needleSizes[n] - 1, 'a') + "b"
+										: (0 == corpus) ? (std::string("the ") + randomString(needleSizes[n], 26, 9)).substr(0, needleSizes[n] - 1) + "."
+										: binary.substr(random() % (size - needleSizes[n]), needleSizes[n] - 1) + "\xFF";
+			const ReferencedString				key(needle);
+			const ReferencedString::Searcher	searcher(key);
+			const int							times= (2 == corpus) && (needleSizes[n] > 24) ? 1 : rounds;
+			double								seconds[4];
+			size_t								found[4]= {0, 0, 0, 0};
+
+			for(int method= 0; method < 4; ++method) {
+				dt::DateTime	start;
+
+				for(int round= 0; round < times; ++round) {
+					found[method]+= (0 == method) ? oldFind(data, needle, round % 2)
+									: (1 == method) ? haystack.find(key, round % 2)
+									: (2 == method) ? searcher.find(haystack, round % 2)
+									: data.find(needle, round % 2);
+				}
+				seconds[method]= dt::DateTime() - start;
+			}
+			dotest(found[0] == found[1]);
+			dotest(found[0] == found[2]);
+			dotest(found[0] == found[3]);
+			printf("%-6s %8d bytes needle %3d: old %8.1f MB/s find %8.1f MB/s Searcher %8.1f MB/s std::string %8.1f MB/s\n",
+					name, static_cast<int>(size), static_cast<int>(needleSizes[n]),
+					times * size / 1048576.0 / (seconds[0] > 0 ? seconds[0] : 1e-9), times * size / 1048576.0 / (seconds[1] > 0 ? seconds[1] : 1e-9),
+					times * size / 1048576.0 / (seconds[2] > 0 ? seconds[2] : 1e-9), times * size / 1048576.0 / (seconds[3] > 0 ? seconds[3] : 1e-9));
+		}
+	}
+}
+
+/// -1, 0 or 1
+static int sign(int value) {
+	return (value < 0) ? -1 : (value > 0) ? 1 : 0;
+}
+
+/// The compare() before the prefix, a byte at a time
+struct OldLess {
+	bool operator()(const ReferencedString &left, const ReferencedString &right) const {
+		const unsigned char	*s1= reinterpret_cast<const unsigned char*>(left.data());
+		const unsigned char	*s2= reinterpret_cast<const unsigned char*>(right.data());
+
+		for(size_t index= 0; index < left.size() && index < right.size(); ++index) {
+			if(s1[index] != s2[index]) {
+				return s1[index] < s2[index];
+			}
+		}
+		return left.size() < right.size();
+	}
+};
+
+/** Checks compare(), the operators, prefix() and Key against std::string for strings that share prefixes,
+		differ in the first 8 bytes or after them, hold zeros and bytes over 127, and are shorter and longer than 8.
+*/
+static void compareTest(int count) {
+	std::vector<std::string>	strings;
+	const char					alphabet[]= {'\0', 'a', 'b', '\x80', '\xFF'};
+	uint32_t					seed= 5;
+
+	for(int i= 0; i < count; ++i) {
+		seed= seed * 1103515245 + 12345;
+		std::string	value(seed >> 28, '\0');
+
+		for(size_t c= 0; c < value.size(); ++c) {
+			seed= seed * 1103515245 + 12345;
+			value[c]= alphabet[(seed >> 16) % (c < 6 ? 2 : sizeof(alphabet))];
+		}
+		strings.push_back(value);
+	}
+	for(size_t i= 0; i < strings.size(); ++i) {
+		const ReferencedString		left(strings[i].data(), strings[i].size());
+		const ReferencedString::Key	leftKey(left);
+
+		dotest(leftKey.value().sameAddress(left));
+		dotest(leftKey.prefix() == left.prefix());
+		for(size_t j= 0; j < strings.size(); ++j) {
+			const ReferencedString		right(strings[j].data(), strings[j].size());
+			const ReferencedString::Key	rightKey(right);
+			const int					expected= sign(strings[i].compare(strings[j]));
+
+			dotest(left.compare(right) == expected);
+			dotest(leftKey.compare(rightKey) == expected);
+			dotest((left == right) == (0 == expected));
+			dotest((left != right) == (0 != expected));
+			dotest((left < right) == (expected < 0));
+			dotest((leftKey == rightKey) == (0 == expected));
+			dotest((leftKey != rightKey) == (0 != expected));
+			dotest((leftKey < rightKey) == (expected < 0));
+			dotest((leftKey > rightKey) == (expected > 0));
+			dotest((leftKey <= rightKey) == (expected <= 0));
+			dotest((leftKey >= rightKey) == (expected >= 0));
+			dotest( (left.prefix() < right.prefix()) <= (expected < 0) );
+		}
+	}
+	dotest(ReferencedString("abcdefghij").prefix() == 0x6162636465666768ULL);
+	dotest(ReferencedString("ab").prefix() == 0x6162000000000000ULL);
+	dotest(ReferencedString().prefix() == 0);
+	dotest(ReferencedString::Key() == ReferencedString::Key(ReferencedString()));
+	dotest(ReferencedString::Key() < ReferencedString::Key("\x01"));
+	dotest(ReferencedString::Key("abcdefgh") < ReferencedString::Key("abcdefghi"));
+	dotest(ReferencedString::Key("abcdefghij") > ReferencedString::Key("abcdefghii"));
+}
+
+/** Sorts strings that share long prefixes (paths), strings that differ in the first 8 bytes (words)
+		and strings that differ just after them (numbered names) with the old compare, the new one, Key and std::string.
+*/
+static void sortBenchmark(int count) {
+	std::string						buffer;
+	std::vector<size_t>				offsets;
+	std::vector<ReferencedString>	strings, sorted;
+	std::vector<ReferencedString::Key>	keys;
+	std::vector<std::string>		copies;
+	char							line[128];
+	double							seconds[4];
+
+	srandom(static_cast<unsigned int>(count));
+	for(int i= 0; i < count; ++i) {
+		const int	kind= i % 3;
+		const long	number= random();
+
+		if(0 == kind) {
+			snprintf(line, sizeof(line), "/usr/local/share/doc/package%ld/file%ld", number % 1000, number / 1000 % 100000);
+		} else if(1 == kind) {
+			snprintf(line, sizeof(line), "%c%c%c%c%c%c%c%c%ld", static_cast<char>('a' + number % 26), static_cast<char>('a' + number / 26 % 26),
+						static_cast<char>('a' + number / 676 % 26), static_cast<char>('a' + number / 17576 % 26), 'e', 'r', 's', '-', number);
+		} else {
+			snprintf(line, sizeof(line), "customer:%08ld", number % 100000000);
+		}
+		offsets.push_back(buffer.size());
+		buffer.append(line);
+	}
+	offsets.push_back(buffer.size());
+	for(int i= 0; i < count; ++i) {
+		strings.push_back(ReferencedString(buffer.data() + offsets[i], offsets[i + 1] - offsets[i]));
+	}
+	for(int method= 0; method < 4; ++method) {
+		dt::DateTime	start;
+
+		if(0 == method) {
+			sorted= strings;
+			start= dt::DateTime();
+			std::sort(sorted.begin(), sorted.end(), OldLess());
+		} else if(1 == method) {
+			std::vector<ReferencedString>	again(strings);
+
+			start= dt::DateTime();
+			std::sort(again.begin(), again.end());
+			dotest(again == sorted);
+		} else if(2 == method) {
+			start= dt::DateTime();
+			keys.assign(strings.begin(), strings.end());
+			std::sort(keys.begin(), keys.end());
+			for(int i= 0; i < count; ++i) {
+				if(!keys[i].value().sameAddress(sorted[i])) {
+					dotest(keys[i].value() == sorted[i]);
+				}
+			}
+		} else {
+			for(int i= 0; i < count; ++i) {
+				copies.push_back(strings[i].string());
+			}
+			start= dt::DateTime();
+			std::sort(copies.begin(), copies.end());
+			dotest(ReferencedString(copies[count / 2]) == sorted[count / 2]);
+		}
+		seconds[method]= dt::DateTime() - start;
+	}
+	printf("sort %8d strings: old compare %7.3fs compare %7.3fs Key (with making them) %7.3fs std::string %7.3fs\n", count,
+			seconds[0], seconds[1], seconds[2], seconds[3]);
+}
+
+int main(const int argc, const char * const argv[]) {
 	int	iterations= 150000;
 #ifdef __Tracer_h__
 	iterations= 3;
@@ -193,5 +485,28 @@ int main(const int /*argc*/, const char * const /*argv*/[]) {
 		dotest(word5 >= word5);
 		dotest(word5 <= word5);
 	}
+#ifdef __Tracer_h__
+	const void	*__unused__[]= {&argc, &argv, &__unused__};
+
+	searchTest(1);
+	searchBenchmark(4096, 1);
+	compareTest(60);
+	sortBenchmark(1000);
+#else
+	const bool	benchmark= (argc >= 2) && (std::string("benchmark") == argv[1]);
+
+	searchTest(20);
+	if(benchmark) { // the sizes the commit message numbers come from, about half a minute
+		searchBenchmark(16 * 1024 * 1024, 10);
+	} else {
+		searchBenchmark(1024 * 1024, 2);
+	}
+	compareTest(600);
+	if(benchmark) { // the sizes the commit message numbers come from, about forty seconds
+		sortBenchmark(10 * 1000 * 1000);
+	} else {
+		sortBenchmark(200 * 1000);
+	}
+#endif
 	return 0;
 }
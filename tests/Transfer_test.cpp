@@ -0,0 +1,188 @@
+#include "os/Transfer.h"
+#include "os/SocketServer.h"
+#include "os/AddressIPv4.h"
+#include "os/AddressIPv6.h"
+#include "os/BufferManaged.h"
+#include "os/Thread.h"
+#include "os/DateTime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+
+#define dotest(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
+	}
+
+// g++ -o /tmp/test tests/Transfer_test.cpp -I.. -O2 -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings -lpthread
+// /tmp/test /tmp/ 8087 [benchmark]
+
+/// Accepts one connection and reads everything sent on it.
+class Sink : public exec::Thread {
+	public:
+		Sink(int port)
+				:exec::Thread(KeepAroundAfterFinish),
+				_serverAddress(port),
+				_server(_serverAddress.family()),
+				_received(0),
+				_sum(0) {
+			_server.bind(_serverAddress);
+			_server.listen(1);
+			start();
+		}
+		virtual ~Sink() {}
+		off_t received() {return _received;}
+		unsigned long sum() {return _sum;}
+	protected:
+		virtual void *run() {
+			net::AddressIPv6	connectedTo;
+			net::Socket			connection;
+			BufferManaged		buffer(256 * 1024);
+			size_t				amount;
+
+			_server.accept(connectedTo, connection);
+			while( (amount= connection.read(buffer)) > 0) {
+				const unsigned char	*bytes= reinterpret_cast<const unsigned char*>(buffer.start());
+
+				for(size_t index= 0; index < amount; ++index) {
+					_sum+= bytes[index];
+				}
+				_received+= amount;
+			}
+			connection.close();
+			_server.close();
+			return NULL;
+		}
+		virtual void *handle(const std::exception &exception, void *result) {
+			printf("FAIL: Exception: %s\n", exception.what());
+			return result;
+		}
+	private:
+		net::AddressIPv4	_serverAddress;
+		net::SocketServer	_server;
+		off_t				_received;
+		unsigned long		_sum;
+		Sink(const Sink&); ///< Prevent Usage
+		Sink &operator=(const Sink&); ///< Prevent Usage
+};
+
+/// Fills a file with a known pattern and returns the sum of the bytes written.
+unsigned long fill(io::File &file, off_t size) {
+	std::string		block(1024 * 1024, '\0');
+	unsigned long	sum= 0;
+
+	for(size_t index= 0; index < block.size(); ++index) {
+		block[index]= static_cast<char>(index * 7 + index / 251);
+	}
+	for(off_t written= 0; written < size; written+= block.size()) {
+		const size_t	amount= size - written < static_cast<off_t>(block.size()) ? size - written : block.size();
+
+		file.write(block.data(), amount, written, io::File::FromStart);
+		for(size_t index= 0; index < amount; ++index) {
+			sum+= static_cast<unsigned char>(block[index]);
+		}
+	}
+	file.flush();
+	return sum;
+}
+
+bool same(io::File &first, off_t firstOffset, io::File &second, off_t secondOffset, off_t length) {
+	std::string	a, b;
+
+	for(off_t done= 0; done < length; done+= 1024 * 1024) {
+		const size_t	amount= length - done < 1024 * 1024 ? length - done : 1024 * 1024;
+
+		first.read(a, amount, firstOffset + done, io::File::FromStart);
+		second.read(b, amount, secondOffset + done, io::File::FromStart);
+		if(a != b) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// A non-blocking destination makes sendfile fill the socket and wait for room, which the Sink makes by reading.
+void sendTest(const char *name, io::Transfer &transfer, io::File &source, unsigned long sum, int port, io::Transfer::Method method, bool nonBlocking= false) {
+	Sink				sink(port);
+	net::AddressIPv4	local(port);
+	net::Socket			connection(local.family());
+	dt::DateTime		start;
+	const clock_t		cpuStart= clock();
+	off_t				sent;
+	double				seconds, cpu;
+
+	connection.connect(local);
+	if(nonBlocking) {
+		dotest(fcntl(connection.descriptor(), F_SETFL, fcntl(connection.descriptor(), F_GETFL) | O_NONBLOCK) == 0);
+	}
+	sent= transfer.send(source, 0, source.size(), connection, method);
+	connection.close();
+	sink.join();
+	seconds= dt::DateTime() - start;
+	cpu= static_cast<double>(clock() - cpuStart) / CLOCKS_PER_SEC;
+	dotest(sent == source.size());
+	dotest(sink.received() == source.size());
+	dotest(sink.sum() == sum);
+	printf("send %s: %0.1f MiB/s %0.3fs cpu %0.3fs\n", name,
+			static_cast<double>(sent) / (1024.0 * 1024.0) / (seconds > 0 ? seconds : 1e-9), seconds, cpu);
+}
+
+void copyTest(const char *name, io::Transfer &transfer, io::File &source, io::File &destination, io::Transfer::Method method) {
+	dt::DateTime	start;
+	const clock_t	cpuStart= clock();
+	off_t			copied;
+	double			seconds, cpu;
+
+	destination.moveto(7);
+	copied= transfer.copy(source, 0, source.size(), destination, 0, method);
+	seconds= dt::DateTime() - start;
+	cpu= static_cast<double>(clock() - cpuStart) / CLOCKS_PER_SEC;
+	dotest(copied == source.size());
+	dotest(destination.location() == 7);
+	dotest(destination.size() == source.size());
+	dotest(same(source, 0, destination, 0, source.size()));
+	printf("copy %s: %0.1f MiB/s %0.3fs cpu %0.3fs\n", name,
+			static_cast<double>(copied) / (1024.0 * 1024.0) / (seconds > 0 ? seconds : 1e-9), seconds, cpu);
+}
+
+int main(int argc, char *argv[]) {
+	const std::string	path= std::string(argc < 2 ? "bin/tests/" : argv[1]) + "Transfer_test";
+	const int			port= argc < 3 ? 8087 : atoi(argv[2]);
+#ifdef __Tracer_h__
+	const off_t			size= 3 * 1024 * 1024 + 17;
+#else
+	const bool			benchmark= (argc >= 4) && (std::string("benchmark") == argv[3]);
+	const off_t			size= benchmark ? 1024 * 1024 * 1024 : 16 * 1024 * 1024 + 17; // 1 GiB for the commit message numbers
+#endif
+	try {
+		io::File		source(path + ".source", io::File::Binary, io::File::ReadWrite);
+		io::Transfer	transfer, small(4096);
+		unsigned long	sum= fill(source, size);
+
+		{
+			io::File	destination(path + ".zerocopy", io::File::Binary, io::File::ReadWrite);
+
+			copyTest("zero copy", transfer, source, destination, io::Transfer::ZeroCopy);
+			dotest(transfer.copy(source, size - 10, 100, destination, 3) == 10);
+			dotest(same(source, size - 10, destination, 3, 10));
+			dotest(transfer.copy(source, size, 100, destination, 0) == 0);
+		}
+		{
+			io::File	destination(path + ".buffered", io::File::Binary, io::File::ReadWrite);
+
+			copyTest("buffered", transfer, source, destination, io::Transfer::Buffered);
+			dotest(small.copy(source, 5, 10000, destination, 1, io::Transfer::Buffered) == 10000);
+			dotest(same(source, 5, destination, 1, 10000));
+		}
+		sendTest("zero copy", transfer, source, sum, port, io::Transfer::ZeroCopy);
+		sendTest("buffered", transfer, source, sum, port + 1, io::Transfer::Buffered);
+		sendTest("zero copy non-blocking", transfer, source, sum, port + 2, io::Transfer::ZeroCopy, true);
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
+	unlink((path + ".source").c_str());
+	unlink((path + ".zerocopy").c_str());
+	unlink((path + ".buffered").c_str());
+	return 0;
+}
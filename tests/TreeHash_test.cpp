@@ -0,0 +1,234 @@
+#include "os/TreeHash.h"
+#include "os/DateTime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define dotest(condition) \
+	if(!(condition)) { \
+		fprintf(stderr, "FAIL(%s:%d): %s\n",__FILE__, __LINE__, #condition); \
+	}
+
+// g++ -o /tmp/test tests/TreeHash_test.cpp -I.. -O2 -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings -lpthread
+// /tmp/test bin/logs/ [benchmark]
+
+/** The tree hash worked out the plain way, one SpecificHash at a time.
+*/
+template<class Hasher>
+static std::string reference(const std::string &data, size_t chunkSize) {
+	typedef hash::SpecificHash<Hasher>	Hash;
+	std::vector<std::string>			level;
+	std::string							sizes;
+
+	for(size_t start= 0; start < data.size() || level.empty(); start+= chunkSize) {
+		const Hash	leaf(std::string(1, '\0') + data.substr(start, chunkSize));
+
+		level.push_back(std::string(reinterpret_cast<const char*>(leaf.buffer()), leaf.size()));
+	}
+	while(level.size() > 1) {
+		std::vector<std::string>	above;
+
+		for(size_t node= 0; node + 1 < level.size(); node+= 2) {
+			const Hash	combined(std::string(1, '\x01') + level[node] + level[node + 1]);
+
+			above.push_back(std::string(reinterpret_cast<const char*>(combined.buffer()), combined.size()));
+		}
+		if(level.size() % 2 == 1) {
+			above.push_back(level.back());
+		}
+		level.swap(above);
+	}
+	for(int shift= 56; shift >= 0; shift-= 8) {
+		sizes.append(1, static_cast<char>(static_cast<uint64_t>(chunkSize) >> shift));
+	}
+	for(int shift= 56; shift >= 0; shift-= 8) {
+		sizes.append(1, static_cast<char>(static_cast<uint64_t>(data.size()) >> shift));
+	}
+	const Hash	root(std::string(1, '\x02') + sizes + level[0]);
+
+	return std::string(reinterpret_cast<const char*>(root.buffer()), root.size());
+}
+
+template<class Hash>
+static std::string value(const Hash &hash) {
+	return std::string(reinterpret_cast<const char*>(hash.buffer()), hash.size());
+}
+
+/** Checks memory and file ranges at every chunk count around the odd nodes against the reference,
+		on one thread and on several, and that ranges past the end of the file are refused.
+*/
+template<class Hasher>
+static void treeTest(const std::string &path, size_t chunkSize, int maximum) {
+	typedef hash::TreeHash<Hasher>	Tree;
+	typename Tree::Hash				result;
+	std::string						data;
+	const int						threads[]= {1, 3};
+
+	for(int i= 0; i < maximum; ++i) {
+		data.append(1, static_cast<char>(i * 31 + (i >> 8)));
+	}
+	unlink(path.c_str());
+	{
+		io::File	file(path, io::File::Binary, io::File::ReadWrite);
+
+		file.write(data);
+	}
+	io::File	file(path, io::File::Binary, io::File::ReadOnly);
+
+	for(size_t t= 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+		Tree	tree(threads[t], chunkSize);
+
+		dotest(tree.threads() == threads[t]);
+		dotest(tree.chunkSize() == chunkSize);
+		for(size_t chunks= 0; chunks <= 9; ++chunks) {
+			const size_t	sizes[]= {chunks * chunkSize, chunks * chunkSize + 1, chunks * chunkSize + chunkSize - 1};
+
+			for(size_t s= 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+				const size_t		size= sizes[s];
+				const std::string	expected= size + 7 <= data.size() ? reference<Hasher>(data.substr(7, size), chunkSize) : std::string();
+
+				if(expected.empty()) {
+					continue;
+				}
+				dotest(value(tree.hash(data.data() + 7, size, result)) == expected);
+				dotest(value(tree.hash(file, result, 7, size)) == expected);
+			}
+		}
+		dotest(value(tree.hash(file, result)) == reference<Hasher>(data, chunkSize));
+		dotest(value(tree.hash(file, result, data.size() / 3)) == reference<Hasher>(data.substr(data.size() / 3), chunkSize));
+		dotest(value(tree.hash(file, result, data.size())) == reference<Hasher>(std::string(), chunkSize));
+		dotest(value(tree.hash(data.data(), data.size(), result)) != value(Tree(threads[t], chunkSize + 1).hash(data.data(), data.size(), result)));
+		try {
+			tree.hash(file, result, 1, data.size());
+			fprintf(stderr, "FAIL: hashed past the end of the file\n");
+		} catch(const msg::Exception &) {
+			// expected
+		}
+	}
+	try {
+		hash::TreeHash<Hasher>	tree(1, 0);
+
+		fprintf(stderr, "FAIL: made a tree with empty chunks\n");
+	} catch(const msg::Exception &) {
+		// expected
+	}
+	unlink(path.c_str());
+}
+
+/** Hashes its own data on a shared tree over and over, counting the results that are not its data's.
+*/
+template<class Hasher>
+class Caller : public exec::Thread {
+	public:
+		Caller(hash::TreeHash<Hasher> &tree, const std::string &data, const std::string &expected, int rounds)
+			:Thread(KeepAroundAfterFinish), _tree(tree), _data(data), _expected(expected), _rounds(rounds), _wrong(0) {start();}
+		virtual ~Caller() {}
+		int wrong() const {return _wrong;}
+	protected:
+		virtual void *run() {
+			typename hash::TreeHash<Hasher>::Hash	result;
+
+			for(int i= 0; i < _rounds; ++i) {
+				if(value(_tree.hash(_data.data(), _data.size(), result)) != _expected) {
+					++_wrong;
+				}
+			}
+			return NULL;
+		}
+	private:
+		hash::TreeHash<Hasher>	&_tree;
+		const std::string		_data;
+		const std::string		_expected;
+		const int				_rounds;
+		int						_wrong;
+		Caller(const Caller&); ///< Prevent Usage
+		Caller &operator=(const Caller&); ///< Prevent Usage
+};
+
+/** Several threads hash different data on one tree at once, and each gets the hash of its own.
+*/
+template<class Hasher>
+static void sharedTest(size_t chunkSize, int rounds) {
+	hash::TreeHash<Hasher>			tree(3, chunkSize);
+	std::vector<Caller<Hasher>*>	callers;
+
+	for(int caller= 0; caller < 4; ++caller) {
+		const std::string	data(chunkSize * (5 + caller) + caller, static_cast<char>('a' + caller));
+
+		callers.push_back(new Caller<Hasher>(tree, data, reference<Hasher>(data, chunkSize), rounds));
+	}
+	for(size_t caller= 0; caller < callers.size(); ++caller) {
+		callers[caller]->join();
+		dotest(callers[caller]->wrong() == 0);
+		delete callers[caller];
+	}
+}
+
+/** Hashes a file with the plain streaming hash and as a tree on more and more threads.
+*/
+template<class Hasher>
+static void scalingBenchmark(const std::string &path, int megabytes) {
+	typedef hash::TreeHash<Hasher>	Tree;
+	std::string						block(1024 * 1024, 's');
+	typename Tree::Hash				streamed, result, first;
+	typename Tree::Hash::Stream		stream;
+
+	unlink(path.c_str());
+	{
+		io::File	file(path, io::File::Binary, io::File::ReadWrite);
+
+		for(int i= 0; i < megabytes; ++i) {
+			block[0]= static_cast<char>(i);
+			file.write(block);
+		}
+	}
+	io::File		file(path, io::File::Binary, io::File::ReadOnly);
+	dt::DateTime	start;
+
+	stream.update(file).final(streamed);
+	const double	streamTime= dt::DateTime() - start;
+
+	printf("%-6s %5d MB file streamed %8.1f MB/s\n", Hasher::name(), megabytes, megabytes / (streamTime > 0 ? streamTime : 1e-9));
+	for(int threads= 1; threads <= 2 * Tree::processors() || threads <= 4; threads*= 2) {
+		Tree	tree(threads);
+
+		start= dt::DateTime();
+		tree.hash(file, result);
+		const double	time= dt::DateTime() - start;
+
+		if(threads == 1) {
+			first= result;
+		}
+		dotest(result == first);
+		printf("%-6s %5d MB file tree on %2d threads %8.1f MB/s (%d processors)\n", Hasher::name(), megabytes, threads,
+				megabytes / (time > 0 ? time : 1e-9), Tree::processors());
+	}
+	unlink(path.c_str());
+}
+
+int main(int argc, const char * const argv[]) {
+	std::string	path("bin/logs/");
+
+	if(argc >= 2) {
+		path= argv[1];
+	}
+	try {
+		treeTest<hash::SHA256Hasher>(path + "tree.data", 1024, 16 * 1024);
+		treeTest<hash::XXH3Hasher>(path + "tree.data", 100, 4 * 1024);
+	#ifdef __Tracer_h__
+		sharedTest<hash::SHA256Hasher>(1024, 5);
+		scalingBenchmark<hash::SHA256Hasher>(path + "tree.data", 2);
+	#else
+		const bool	benchmark= (argc >= 3) && (std::string("benchmark") == argv[2]);
+		const int	megabytes= benchmark ? 512 : 32; // 512 for the commit message numbers
+
+		sharedTest<hash::SHA256Hasher>(64 * 1024, 50);
+		treeTest<hash::SHA256Hasher>(path + "tree.data", 256 * 1024, 3 * 1024 * 1024);
+		scalingBenchmark<hash::SHA256Hasher>(path + "tree.data", megabytes);
+		scalingBenchmark<hash::XXH3Hasher>(path + "tree.data", megabytes);
+	#endif
+	} catch(const std::exception &exception) {
+		printf("FAILED: Exception: %s\n", exception.what());
+	}
+	return 0;
+}
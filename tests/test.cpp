@@ -19,7 +19,7 @@ typedef std::map<std::string,CompilerTimes>		TestCompilerTimes;
 
 const double		gTestTimeAllowancePercent= 5;
 const double		gTestMinimumTimeInSeconds= 1;
-const char * const	gCompilerFlags= "-I.. -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings -lsqlite3 -framework Carbon";
+const char * const	gCompilerFlags= "-I.. -Wall -Weffc++ -Wextra -Wshadow -Wwrite-strings -lsqlite3 -lz -framework Carbon";
 
 TestCompilerTimes	gCompilerTimes;
 Dictionary			gCompilerLocations;